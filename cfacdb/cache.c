@@ -21,12 +21,190 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+/*
+ * The cache DB holds, for each collisional transition, a table of rates
+ * computed at different temperatures. It is read into memory when attached
+ * and kept sorted by (cid, T); a rate at a temperature not in the table is
+ * interpolated in log(rate) vs log(T) by the two quadratics through the
+ * bracketing entries and either next one, provided they agree to the
+ * requested accuracy. New rates are appended to both the DB and the
+ * in-memory table.
+ *
+ * The cache DB may also hold, per transition, a Chebyshev expansion of
+ * log(rate) + e0/T in the reduced log(T) (see cfacdb_fit_rates()); these
+ * are likewise read into memory, sorted by cid.
+ */
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 #include "cfacdbP.h"
 
 #include "cache_schema.i"
 
+/* relative difference for temperatures considered equal */
+#define CACHE_T_EPS 1.0e-9
+
+static int rcache_cmp(const void *a, const void *b)
+{
+    const cfacdb_rcache_entry_t *ea = a, *eb = b;
+    
+    if (ea->cid != eb->cid) {
+        return (ea->cid > eb->cid) - (ea->cid < eb->cid);
+    } else {
+        return (ea->t > eb->t) - (ea->t < eb->t);
+    }
+}
+
+void cfacdb_rcache_free(cfacdb_rcache_t *rcache)
+{
+    free(rcache->entries);
+    rcache->entries = NULL;
+    rcache->n = rcache->nalloc = rcache->nsorted = 0;
+}
+
+int cfacdb_rcache_add(cfacdb_rcache_t *rcache,
+    unsigned int cid, double T, double rate)
+{
+    cfacdb_rcache_entry_t *e;
+    
+    if (rcache->n == rcache->nalloc) {
+        unsigned long nalloc = rcache->nalloc ? 2*rcache->nalloc:1024;
+        e = realloc(rcache->entries, nalloc*sizeof(cfacdb_rcache_entry_t));
+        if (!e) {
+            return CFACDB_FAILURE;
+        }
+        rcache->entries = e;
+        rcache->nalloc  = nalloc;
+    }
+    
+    e = &rcache->entries[rcache->n++];
+    e->cid  = cid;
+    e->t    = T;
+    e->rate = rate;
+    
+    return CFACDB_SUCCESS;
+}
+
+/* sort the entries added since the last call and merge them in */
+int cfacdb_rcache_sort(cfacdb_rcache_t *rcache)
+{
+    cfacdb_rcache_entry_t *buf, *a, *b, *a_end, *b_end, *p;
+    unsigned long nnew = rcache->n - rcache->nsorted;
+    
+    if (!nnew) {
+        return CFACDB_SUCCESS;
+    }
+    
+    qsort(rcache->entries + rcache->nsorted, nnew,
+        sizeof(cfacdb_rcache_entry_t), rcache_cmp);
+    
+    if (rcache->nsorted) {
+        buf = malloc(rcache->nalloc*sizeof(cfacdb_rcache_entry_t));
+        if (!buf) {
+            return CFACDB_FAILURE;
+        }
+        
+        a = rcache->entries; a_end = a + rcache->nsorted;
+        b = a_end;           b_end = rcache->entries + rcache->n;
+        p = buf;
+        while (a < a_end && b < b_end) {
+            *p++ = (rcache_cmp(a, b) <= 0) ? *a++:*b++;
+        }
+        while (a < a_end) {
+            *p++ = *a++;
+        }
+        while (b < b_end) {
+            *p++ = *b++;
+        }
+        
+        free(rcache->entries);
+        rcache->entries = buf;
+    }
+    
+    rcache->nsorted = rcache->n;
+    
+    return CFACDB_SUCCESS;
+}
+
+/* index of the first sorted entry not less than (cid, t) */
+static unsigned long rcache_lower_bound(const cfacdb_rcache_t *rcache,
+    unsigned int cid, double t)
+{
+    unsigned long lo = 0, hi = rcache->nsorted;
+    cfacdb_rcache_entry_t key;
+    
+    key.cid = cid;
+    key.t   = t;
+    
+    while (lo < hi) {
+        unsigned long mid = lo + (hi - lo)/2;
+        if (rcache_cmp(&rcache->entries[mid], &key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    return lo;
+}
+
+/* quadratic through (x[i], y[i]), i = 0..2, evaluated at x0 */
+static double rcache_quad(const double *x, const double *y, double x0)
+{
+    return y[0]*(x0 - x[1])*(x0 - x[2])/((x[0] - x[1])*(x[0] - x[2])) +
+           y[1]*(x0 - x[0])*(x0 - x[2])/((x[1] - x[0])*(x[1] - x[2])) +
+           y[2]*(x0 - x[0])*(x0 - x[1])/((x[2] - x[0])*(x[2] - x[1]));
+}
+
+int cfacdb_rcache_lookup(const cfacdb_rcache_t *rcache,
+    unsigned int cid, double T, double *ratec)
+{
+    const cfacdb_rcache_entry_t *e = rcache->entries;
+    unsigned long lo, hi, j, k;
+    double x, xs[4], ys[4], y1, y2;
+    
+    lo = rcache_lower_bound(rcache, cid, 0.0);
+    if (lo == rcache->nsorted || e[lo].cid != cid) {
+        return CFACDB_FALSE;
+    }
+    hi = rcache_lower_bound(rcache, cid + 1, 0.0);
+    
+    /* exact match */
+    j = rcache_lower_bound(rcache, cid, (1.0 - CACHE_T_EPS)*T);
+    if (j < hi && e[j].t <= (1.0 + CACHE_T_EPS)*T) {
+        *ratec = e[j].rate;
+        return CFACDB_TRUE;
+    }
+    
+    /* interpolation between j - 1 and j: the quadratics through them and
+       either neighboring entry should agree */
+    if (rcache->tol <= 0.0 || j < lo + 2 || j + 1 >= hi) {
+        return CFACDB_FALSE;
+    }
+    
+    x = log(T);
+    for (k = j - 2; k <= j + 1; k++) {
+        if (e[k].rate <= 0.0) {
+            return CFACDB_FALSE;
+        }
+        xs[k - j + 2] = log(e[k].t);
+        ys[k - j + 2] = log(e[k].rate);
+    }
+    
+    y1 = rcache_quad(xs, ys, x);
+    y2 = rcache_quad(xs + 1, ys + 1, x);
+    if (0.5*fabs(y1 - y2) > rcache->tol) {
+        return CFACDB_FALSE;
+    }
+    
+    *ratec = exp(0.5*(y1 + y2));
+    
+    return CFACDB_TRUE;
+}
+
 int cfacdb_attach_cache(cfacdb_t *cdb, const char *fname)
 {
     sqlite3_stmt *stmt;
@@ -34,7 +212,7 @@ int cfacdb_attach_cache(cfacdb_t *cdb, const char *fname)
     int rc, i;
     char *errmsg;
     
-    if (!fname) {
+    if (!cdb || !fname || cdb->cached) {
         return CFACDB_FAILURE;
     }
     
@@ -43,6 +221,7 @@ int cfacdb_attach_cache(cfacdb_t *cdb, const char *fname)
     if (rc) {
         fprintf(stderr, "Cannot open '%s' database: %s\n",
             fname, sqlite3_errmsg(cdb->cache_db));
+        sqlite3_close(cdb->cache_db);
         return CFACDB_FAILURE;
     }
 
@@ -53,23 +232,36 @@ int cfacdb_attach_cache(cfacdb_t *cdb, const char *fname)
         if (rc != SQLITE_OK) {
             fprintf(stderr, "SQL error: %s\n", errmsg);
             sqlite3_free(errmsg);
+            sqlite3_close(cdb->cache_db);
             return CFACDB_FAILURE;
         }
         i++;
     }
     
-    /* now attach it to the primary database */
-    sql = "ATTACH DATABASE ? AS cache";
-    sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL);
-    sqlite3_bind_text(stmt, 1, fname, -1, SQLITE_STATIC);
+    /* load the rates into memory */
+    sql = "SELECT cid, t, rate FROM crates ORDER BY cid, t";
+    sqlite3_prepare_v2(cdb->cache_db, sql, -1, &stmt, NULL);
     
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(cdb->db));
-        sqlite3_finalize(stmt);
-        return CFACDB_FAILURE;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (cfacdb_rcache_add(&cdb->rcache,
+                sqlite3_column_int   (stmt, 0),
+                sqlite3_column_double(stmt, 1),
+                sqlite3_column_double(stmt, 2)) != CFACDB_SUCCESS) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
     }
     sqlite3_finalize(stmt);
+    
+    if (rc != SQLITE_DONE ||
+        cfacdb_rcache_sort(&cdb->rcache) != CFACDB_SUCCESS ||
+        cfacdb_rfits_load(cdb) != CFACDB_SUCCESS) {
+        fprintf(stderr, "Failed reading the cache DB %s\n", fname);
+        cfacdb_rcache_free(&cdb->rcache);
+        cfacdb_rfits_free(&cdb->rfits);
+        sqlite3_close(cdb->cache_db);
+        return CFACDB_FAILURE;
+    }
 
     /* we're ready for cached mode */
     cdb->cached = CFACDB_TRUE;
@@ -77,89 +269,174 @@ int cfacdb_attach_cache(cfacdb_t *cdb, const char *fname)
     return CFACDB_SUCCESS;
 }
 
-int cfacdb_crates_cached(cfacdb_t *cdb, double T,
-    cfacdb_crates_sink_t sink, void *udata)
+int cfacdb_set_cache_tolerance(cfacdb_t *cdb, double tol)
 {
-    sqlite3_stmt *stmt;
-    const char *sql;
-    int rc;
+    if (!cdb || tol < 0.0) {
+        return CFACDB_FAILURE;
+    }
     
-    sql = "INSERT INTO _cache_temp" \
-          " SELECT DISTINCT (cid) cid, rate" \
-          "  FROM crates" \
-          "  WHERE t >= ? AND t <= ? AND cid IN (" \
-          "   SELECT cid FROM _ctransitions_v" \
-          "    WHERE sid = ? AND ini_nele <= ? AND fin_nele >= ?)";
+    cdb->rcache.tol = tol;
+    
+    return CFACDB_SUCCESS;
+}
 
+void cfacdb_rfits_free(cfacdb_rfits_t *rfits)
+{
+    free(rfits->fits);
+    free(rfits->coefs);
+    memset(rfits, 0, sizeof(cfacdb_rfits_t));
+}
 
-    sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL);
-    sqlite3_bind_double(stmt, 1, 0.99*T);
-    sqlite3_bind_double(stmt, 2, 1.01*T);
+/* the coefficients are little-endian doubles, see cfacdb_bind_packed() */
+static int rfits_add(cfacdb_rfits_t *rfits, const cfacdb_rfit_t *fit,
+    const void *coefs)
+{
+    if (rfits->n == rfits->nalloc) {
+        unsigned long nalloc = rfits->nalloc ? 2*rfits->nalloc:1024;
+        cfacdb_rfit_t *p = realloc(rfits->fits, nalloc*sizeof(cfacdb_rfit_t));
+        if (!p) {
+            return CFACDB_FAILURE;
+        }
+        rfits->fits   = p;
+        rfits->nalloc = nalloc;
+    }
+    if (rfits->ncoefs + fit->ncoef > rfits->ncalloc) {
+        unsigned long ncalloc = rfits->ncalloc ? 2*rfits->ncalloc:8192;
+        double *p;
+        while (ncalloc < rfits->ncoefs + fit->ncoef) {
+            ncalloc *= 2;
+        }
+        p = realloc(rfits->coefs, ncalloc*sizeof(double));
+        if (!p) {
+            return CFACDB_FAILURE;
+        }
+        rfits->coefs   = p;
+        rfits->ncalloc = ncalloc;
+    }
+    
+    rfits->fits[rfits->n] = *fit;
+    rfits->fits[rfits->n].coffset = rfits->ncoefs;
+    cfacdb_unpack_doubles(coefs, fit->ncoef*sizeof(double),
+        rfits->coefs + rfits->ncoefs);
+    rfits->ncoefs += fit->ncoef;
+    rfits->n++;
     
-    sqlite3_bind_int(stmt, 3, cdb->sid);
-    sqlite3_bind_int(stmt, 4, cdb->nele_max);
-    sqlite3_bind_int(stmt, 5, cdb->nele_min);
+    return CFACDB_SUCCESS;
+}
 
-    rc = sqlite3_step(stmt);
+/* (re)read the rate fits from the cache DB */
+int cfacdb_rfits_load(cfacdb_t *cdb)
+{
+    sqlite3_stmt *stmt;
+    const char *sql;
+    int rc;
+    
+    cfacdb_rfits_free(&cdb->rfits);
+    
+    sql = "SELECT cid, tmin, tmax, e0, maxerr, coefs FROM rfits ORDER BY cid";
+    sqlite3_prepare_v2(cdb->cache_db, sql, -1, &stmt, NULL);
+    
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        cfacdb_rfit_t fit;
+        
+        fit.cid    = sqlite3_column_int   (stmt, 0);
+        fit.lmin   = log(sqlite3_column_double(stmt, 1));
+        fit.lmax   = log(sqlite3_column_double(stmt, 2));
+        fit.e0     = sqlite3_column_double(stmt, 3);
+        fit.maxerr = sqlite3_column_double(stmt, 4);
+        fit.ncoef  = sqlite3_column_bytes (stmt, 5)/sizeof(double);
+        
+        if (fit.ncoef == 0) {
+            continue;
+        }
+        
+        if (rfits_add(&cdb->rfits,
+                &fit, sqlite3_column_blob(stmt, 5)) != CFACDB_SUCCESS) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+    }
+    sqlite3_finalize(stmt);
+    
     if (rc != SQLITE_DONE) {
-        fprintf(stderr, "SQL error %d: %s\n", rc, sqlite3_errmsg(cdb->db));
-        sqlite3_finalize(stmt);
+        cfacdb_rfits_free(&cdb->rfits);
         return CFACDB_FAILURE;
     }
-    sqlite3_finalize(stmt);
     
-    sql = "SELECT ini_id, fin_id, type, de, rate" \
-          " FROM _crates_cached_v" \
-          " ORDER BY ini_id, fin_id, type";
-
-    sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL);
-    sqlite3_bind_int(stmt, 1, cdb->sid);
-    sqlite3_bind_int(stmt, 2, cdb->nele_max);
-    sqlite3_bind_int(stmt, 3, cdb->nele_min);
-
-    do {
-        double rate, de;
-        unsigned int ilfac, iufac, type;
+    return CFACDB_SUCCESS;
+}
 
-        cfacdb_crates_data_t cbdata;
-        
-        rc = sqlite3_step(stmt);
-        switch (rc) {
-        case SQLITE_DONE:
-        case SQLITE_OK:
-            break;
-        case SQLITE_ROW:
-            iufac = sqlite3_column_int   (stmt, 0);
-            ilfac = sqlite3_column_int   (stmt, 1);
-            
-            type  = sqlite3_column_int   (stmt, 2);
-            de    = sqlite3_column_double(stmt, 3);
-            
-            rate  = sqlite3_column_double(stmt, 4);
-            
-            cbdata.ii = cdb->lmap[iufac - cdb->id_min];
-            cbdata.fi = cdb->lmap[ilfac - cdb->id_min];
-            
-            cbdata.type = type;
-            cbdata.de   = de;
-            
-            cbdata.ratec = rate;
-            
-            if (sink(cdb, &cbdata, udata) != CFACDB_SUCCESS) {
-                sqlite3_finalize(stmt);
-                return CFACDB_FAILURE;
-            }
-            
-            break;
-        default:
-            fprintf(stderr, "SQL error %d: %s\n", rc, sqlite3_errmsg(cdb->db));
-            sqlite3_finalize(stmt);
-            return CFACDB_FAILURE;
-            break;
+static const cfacdb_rfit_t *rfits_find(const cfacdb_rfits_t *rfits,
+    unsigned int cid)
+{
+    unsigned long lo = 0, hi = rfits->n;
+    
+    while (lo < hi) {
+        unsigned long mid = (lo + hi)/2;
+        if (rfits->fits[mid].cid < cid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
-    } while (rc == SQLITE_ROW);
+    }
+    
+    if (lo < rfits->n && rfits->fits[lo].cid == cid) {
+        return &rfits->fits[lo];
+    } else {
+        return NULL;
+    }
+}
 
-    sqlite3_finalize(stmt);
+int cfacdb_rate_eval(const cfacdb_t *cdb, unsigned int cid, double T,
+    double *ratec)
+{
+    const cfacdb_rfit_t *fit;
+    const double *c;
+    double lT, x, b0, b1, b2;
+    unsigned int j;
+    
+    if (!cdb || T <= 0.0 || !(fit = rfits_find(&cdb->rfits, cid))) {
+        return CFACDB_FAILURE;
+    }
+    
+    lT = log(T);
+    if (lT < fit->lmin - CACHE_T_EPS || lT > fit->lmax + CACHE_T_EPS) {
+        return CFACDB_FAILURE;
+    }
+    
+    /* Clenshaw recurrence */
+    x = (2*lT - fit->lmin - fit->lmax)/(fit->lmax - fit->lmin);
+    c = cdb->rfits.coefs + fit->coffset;
+    b1 = b2 = 0.0;
+    for (j = fit->ncoef - 1; j > 0; j--) {
+        b0 = c[j] + 2*x*b1 - b2;
+        b2 = b1;
+        b1 = b0;
+    }
+    
+    *ratec = exp(c[0] + x*b1 - b2 - fit->e0/T);
+    
+    return CFACDB_SUCCESS;
+}
 
+int cfacdb_rate_fit_info(const cfacdb_t *cdb, unsigned int cid,
+    double *Tmin, double *Tmax, double *maxerr)
+{
+    const cfacdb_rfit_t *fit;
+    
+    if (!cdb || !(fit = rfits_find(&cdb->rfits, cid))) {
+        return CFACDB_FAILURE;
+    }
+    
+    if (Tmin) {
+        *Tmin = exp(fit->lmin);
+    }
+    if (Tmax) {
+        *Tmax = exp(fit->lmax);
+    }
+    if (maxerr) {
+        *maxerr = fit->maxerr;
+    }
+    
     return CFACDB_SUCCESS;
 }
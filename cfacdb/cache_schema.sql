@@ -4,3 +4,12 @@ CREATE TABLE IF NOT EXISTS crates (
     rate     REAL    NOT NULL,
     UNIQUE (cid, t)
 );
+
+CREATE TABLE IF NOT EXISTS rfits (
+    cid      INTEGER PRIMARY KEY,
+    tmin     REAL    NOT NULL,
+    tmax     REAL    NOT NULL,
+    e0       REAL    NOT NULL,
+    maxerr   REAL    NOT NULL,
+    coefs    BLOB    NOT NULL
+);
@@ -1,10 +1,9 @@
 CREATE TEMPORARY VIEW _cstrengths_v AS
   SELECT ct.sid, ct.cid, ct.ini_id, ct.fin_id, ct.type,
-         cs.e, cs.strength,
+         cs.e, cs.strength, cs.rowid AS rid,
          li.nele AS ini_nele, lf.nele AS fin_nele,
          lf.e - li.e AS de, ct.kl, ct.ap0, ct.ap1, ct.ap2, ct.ap3
     FROM cstrengths AS cs
       INNER JOIN ctransitions AS ct ON (cs.cid = ct.cid)
       INNER JOIN levels AS li ON (ct.sid = li.sid AND ct.ini_id = li.id)
-      INNER JOIN levels AS lf ON (ct.sid = lf.sid AND ct.fin_id = lf.id)
-    WHERE cs.strength > 0;
+      INNER JOIN levels AS lf ON (ct.sid = lf.sid AND ct.fin_id = lf.id);
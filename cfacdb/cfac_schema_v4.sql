@@ -0,0 +1,10 @@
+CREATE TEMPORARY VIEW _cstrengths_v AS
+  SELECT ct.sid, ct.cid, ct.ini_id, ct.fin_id, ct.type,
+         cg.e, cv.strength,
+         li.nele AS ini_nele, lf.nele AS fin_nele,
+         lf.e - li.e AS de, ct.kl, ct.ap0, ct.ap1, ct.ap2, ct.ap3
+    FROM cvectors AS cv
+      INNER JOIN ctransitions AS ct ON (cv.cid = ct.cid)
+      INNER JOIN cgrids AS cg ON (cv.gid = cg.gid)
+      INNER JOIN levels AS li ON (ct.sid = li.sid AND ct.ini_id = li.id)
+      INNER JOIN levels AS lf ON (ct.sid = lf.sid AND ct.fin_id = lf.id);
@@ -36,6 +36,7 @@
 #include "cfac_schema.i"
 #include "cfac_schema_v1.i"
 #include "cfac_schema_v2.i"
+#include "cfac_schema_v4.i"
 
 static int sid_cb(void *udata,
     int argc, char **argv, char **colNames)
@@ -91,11 +92,18 @@ cfacdb_t *cfacdb_open(const char *fname, cfacdb_temp_t temp_store)
     
     const char **schemas[2];
 
+    /* a session image is mapped rather than opened via SQLite */
+    if (cfacdb_is_image(fname)) {
+        return cfacdb_open_image(fname);
+    }
+
     cdb = malloc(sizeof(cfacdb_t));
     if (!cdb) {
         return NULL;
     }
     memset(cdb, 0, sizeof(cfacdb_t));   
+    cdb->nthreads = 1;
+    cdb->rcache.tol = CFACDB_CACHE_TOL_DEFAULT;
 
     rc = sqlite3_open_v2(fname, &cdb->db, SQLITE_OPEN_READONLY, NULL);
     if (rc) {
@@ -135,7 +143,7 @@ cfacdb_t *cfacdb_open(const char *fname, cfacdb_temp_t temp_store)
         cdb->db_format = 1;
     }
     
-    if (cdb->db_format < 1 || cdb->db_format > 3) {
+    if (cdb->db_format < 1 || cdb->db_format > CFACDB_FORMAT_MAX) {
         fprintf(stderr, "Unsupported database format %d\n", cdb->db_format);
         cfacdb_close(cdb);
         return NULL;
@@ -144,8 +152,11 @@ cfacdb_t *cfacdb_open(const char *fname, cfacdb_temp_t temp_store)
     schemas[0] = cfac_schema;
     if (cdb->db_format == 1) {
         schemas[1] = cfac_schema_v1;
-    } else {
+    } else
+    if (cdb->db_format < 4) {
         schemas[1] = cfac_schema_v2;
+    } else {
+        schemas[1] = cfac_schema_v4;
     }
     
     /* create temporary views etc */
@@ -189,11 +200,15 @@ void cfacdb_close(cfacdb_t *cdb)
             free(cdb->lmap);
         }
         
+        cfacdb_snapshot_free(cdb->snapshot);
+        
         sqlite3_close(cdb->db);
         
         if (cdb->cached) {
             sqlite3_close(cdb->cache_db);
         }
+        cfacdb_rcache_free(&cdb->rcache);
+        cfacdb_rfits_free(&cdb->rfits);
         
         free(cdb);
     }
@@ -221,6 +236,17 @@ void *cfacdb_get_udata(cfacdb_t *cdb)
     }
 }
 
+int cfacdb_set_nthreads(cfacdb_t *cdb, unsigned int nthreads)
+{
+    if (!cdb || !nthreads) {
+        return CFACDB_FAILURE;
+    }
+    
+    cdb->nthreads = nthreads;
+    
+    return CFACDB_SUCCESS;
+}
+
 unsigned int cfacdb_get_nsessions(const cfacdb_t *cdb)
 {
     if (!cdb) {
@@ -241,6 +267,10 @@ int cfacdb_sessions(const cfacdb_t *cdb,
         return CFACDB_FAILURE;
     }
     
+    if (!cdb->db) {
+        return cfacdb_snapshot_sessions(cdb, sink, udata);
+    }
+    
     if (cdb->db_format < 3) {
         sql = "SELECT sid, symbol, anum, mass, nele_min, nele_max" \
               " FROM _sessions_v" \
@@ -306,13 +336,26 @@ int cfacdb_init(cfacdb_t *cdb, unsigned long sid, int nele_min, int nele_max)
         return CFACDB_FAILURE;
     }
 
+    /* the open cursors would read the new window with the old indices */
+    if (cdb->ncursors) {
+        fprintf(stderr, "cfacdb_init(): %u cursor(s) still open\n",
+            cdb->ncursors);
+        return CFACDB_FAILURE;
+    }
+
     /* free from possible previous invocation of cfacdb_init() */
     if (cdb->lmap) {
         free(cdb->lmap);
+        cdb->lmap = NULL;
     }
+    cdb->initialized = CFACDB_FALSE;
 
     if (sid) {
         cdb->sid = sid;
+    } else
+    if (!cdb->db) {
+        /* a session image holds just one session */
+        cdb->sid = cdb->snapshot->sid;
     } else {
         if (cdb->nsessions > 1) {
             fprintf(stderr,
@@ -330,6 +373,21 @@ int cfacdb_init(cfacdb_t *cdb, unsigned long sid, int nele_min, int nele_max)
         }
     }
 
+    /* serve the session from memory if it has been loaded */
+    if (cdb->snapshot) {
+        if (cdb->snapshot->sid == cdb->sid) {
+            return cfacdb_snapshot_init(cdb, nele_min, nele_max);
+        }
+        
+        if (!cdb->db) {
+            fprintf(stderr, "Session id %lu is not in the image\n", cdb->sid);
+            return CFACDB_FAILURE;
+        }
+        
+        cfacdb_snapshot_free(cdb->snapshot);
+        cdb->snapshot = NULL;
+    }
+
     /* get dimension of the database subset */
     sql = "SELECT SUM(nlevels) AS ndim" \
           " FROM _cstates_v" \
@@ -562,6 +620,10 @@ int cfacdb_cstates(cfacdb_t *cdb, cfacdb_cstates_sink_t sink, void *udata)
         return CFACDB_FAILURE;
     }
     
+    if (cdb->snapshot) {
+        return cfacdb_snapshot_cstates(cdb, sink, udata);
+    }
+    
     sql = "SELECT nele, e_gs, nlevels" \
           " FROM _cstates_v" \
           " WHERE sid = ? AND nele <= ? AND nele >= ?" \
@@ -615,6 +677,10 @@ int cfacdb_levels(cfacdb_t *cdb, cfacdb_levels_sink_t sink, void *udata)
         return CFACDB_FAILURE;
     }
     
+    if (cdb->snapshot) {
+        return cfacdb_snapshot_levels(cdb, sink, udata);
+    }
+    
     sql = "SELECT id, name, nele, e, g, vn, vl, p, ncomplex, sname" \
           " FROM _levels_v" \
           " WHERE sid = ? AND nele <= ? AND nele >= ?" \
@@ -667,15 +733,10 @@ int cfacdb_levels(cfacdb_t *cdb, cfacdb_levels_sink_t sink, void *udata)
 }
 
 
-int cfacdb_rtrans(cfacdb_t *cdb, cfacdb_rtrans_sink_t sink, void *udata)
+sqlite3_stmt *cfacdb_rtrans_stmt(const cfacdb_t *cdb)
 {
     sqlite3_stmt *stmt;
     const char *sql;
-    int rc;
-    
-    if (!cdb) {
-        return CFACDB_FAILURE;
-    }
     
     if (cdb->db_format < 3) {
         sql = "SELECT ini_id, fin_id, mpole, rme, de" \
@@ -689,16 +750,76 @@ int cfacdb_rtrans(cfacdb_t *cdb, cfacdb_rtrans_sink_t sink, void *udata)
               " ORDER BY ini_id, fin_id";
     }
 
-    sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL);
+    if (sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(cdb->db));
+        return NULL;
+    }
     sqlite3_bind_int(stmt, 1, cdb->sid);
     sqlite3_bind_int(stmt, 2, cdb->nele_max);
     sqlite3_bind_int(stmt, 3, cdb->nele_min);
+    
+    return stmt;
+}
+
+void cfacdb_rtrans_row(const cfacdb_t *cdb, sqlite3_stmt *stmt,
+    cfacdb_rtrans_data_t *cbdata)
+{
+    double de, rme, uta_de, uta_sd;
+    unsigned int ilfac, iufac, m2;
+    int mpole;
+    
+    ilfac = sqlite3_column_int   (stmt, 0);
+    iufac = sqlite3_column_int   (stmt, 1);
+    mpole = sqlite3_column_int   (stmt, 2);
+    rme   = sqlite3_column_double(stmt, 3);
+    de    = sqlite3_column_double(stmt, 4);
+    if (cdb->db_format >= 3) {
+        uta_de = sqlite3_column_double(stmt, 5);
+        uta_sd = sqlite3_column_double(stmt, 6);
+    } else {
+        uta_de = 0.0;
+        uta_sd = 0.0;
+    }
+    
+    /* in the original DB format, ini/fin levels were swapped */
+    if (cdb->db_format < 2) {
+        unsigned int ibuf;
+        ibuf = ilfac; ilfac = iufac; iufac = ibuf;
+        de = -de;
+    }
+    
+    m2 = 2*abs(mpole);
+    cbdata->gf = SQR(rme)*de*pow(ALPHA*de, m2 - 2)/(m2 + 1);
+    cbdata->mpole = mpole;
+    
+    cbdata->ii = cdb->lmap[ilfac - cdb->id_min];
+    cbdata->fi = cdb->lmap[iufac - cdb->id_min];
+    
+    cbdata->de = de;
+    
+    cbdata->uta_de = uta_de;
+    cbdata->uta_sd = uta_sd;
+}
+
+int cfacdb_rtrans(cfacdb_t *cdb, cfacdb_rtrans_sink_t sink, void *udata)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+    
+    if (!cdb) {
+        return CFACDB_FAILURE;
+    }
+    
+    if (cdb->snapshot) {
+        return cfacdb_snapshot_rtrans(cdb, sink, udata);
+    }
+    
+    stmt = cfacdb_rtrans_stmt(cdb);
+    if (!stmt) {
+        return CFACDB_FAILURE;
+    }
 
     do {
-        double de, rme, uta_de, uta_sd;
-        unsigned int ilfac, iufac, m2;
-        int mpole;
-        
         cfacdb_rtrans_data_t cbdata;
         
         rc = sqlite3_step(stmt);
@@ -707,38 +828,7 @@ int cfacdb_rtrans(cfacdb_t *cdb, cfacdb_rtrans_sink_t sink, void *udata)
         case SQLITE_OK:
             break;
         case SQLITE_ROW:
-            ilfac = sqlite3_column_int   (stmt, 0);
-            iufac = sqlite3_column_int   (stmt, 1);
-            mpole = sqlite3_column_int   (stmt, 2);
-            rme   = sqlite3_column_double(stmt, 3);
-            de    = sqlite3_column_double(stmt, 4);
-            if (cdb->db_format >= 3) {
-                uta_de = sqlite3_column_double(stmt, 5);
-                uta_sd = sqlite3_column_double(stmt, 6);
-            } else {
-                uta_de = 0.0;
-                uta_sd = 0.0;
-            }
-            
-            /* in the original DB format, ini/fin levels were swapped */
-            if (cdb->db_format < 2) {
-                unsigned int ibuf;
-                ibuf = ilfac; ilfac = iufac; iufac = ibuf;
-                de = -de;
-            }
-    
-            m2 = 2*abs(mpole);
-            cbdata.gf = SQR(rme)*de*pow(ALPHA*de, m2 - 2)/(m2 + 1);
-            cbdata.mpole = mpole;
-            cbdata.de = de;
-            
-            cbdata.ii = cdb->lmap[ilfac - cdb->id_min];
-            cbdata.fi = cdb->lmap[iufac - cdb->id_min];
-            
-            cbdata.de = de;
-            
-            cbdata.uta_de = uta_de;
-            cbdata.uta_sd = uta_sd;
+            cfacdb_rtrans_row(cdb, stmt, &cbdata);
             
             if (sink(cdb, &cbdata, udata) != CFACDB_SUCCESS) {
                 sqlite3_finalize(stmt);
@@ -760,29 +850,59 @@ int cfacdb_rtrans(cfacdb_t *cdb, cfacdb_rtrans_sink_t sink, void *udata)
 }
 
 
-int cfacdb_aitrans(cfacdb_t *cdb, cfacdb_aitrans_sink_t sink, void *udata)
+sqlite3_stmt *cfacdb_aitrans_stmt(const cfacdb_t *cdb)
 {
     sqlite3_stmt *stmt;
     const char *sql;
-    int rc;
-    
-    if (!cdb) {
-        return CFACDB_FAILURE;
-    }
     
     sql = "SELECT ini_id, fin_id, rate" \
           " FROM _aitransitions_v" \
           " WHERE sid = ? AND nele <= ? AND nele > ?" \
           " ORDER BY ini_id, fin_id";
-    sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL);
+    if (sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(cdb->db));
+        return NULL;
+    }
     sqlite3_bind_int(stmt, 1, cdb->sid);
     sqlite3_bind_int(stmt, 2, cdb->nele_max);
     sqlite3_bind_int(stmt, 3, cdb->nele_min);
+    
+    return stmt;
+}
 
-    do {
-        double rate;
-        unsigned int ilfac, iufac;
+void cfacdb_aitrans_row(const cfacdb_t *cdb, sqlite3_stmt *stmt,
+    cfacdb_aitrans_data_t *cbdata)
+{
+    unsigned int ilfac, iufac;
+    
+    iufac = sqlite3_column_int(stmt, 0);
+    ilfac = sqlite3_column_int(stmt, 1);
+    
+    cbdata->ii = cdb->lmap[iufac - cdb->id_min];
+    cbdata->fi = cdb->lmap[ilfac - cdb->id_min];
+    
+    cbdata->rate = sqlite3_column_double(stmt, 2);
+}
+
+int cfacdb_aitrans(cfacdb_t *cdb, cfacdb_aitrans_sink_t sink, void *udata)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+    
+    if (!cdb) {
+        return CFACDB_FAILURE;
+    }
+    
+    if (cdb->snapshot) {
+        return cfacdb_snapshot_aitrans(cdb, sink, udata);
+    }
+    
+    stmt = cfacdb_aitrans_stmt(cdb);
+    if (!stmt) {
+        return CFACDB_FAILURE;
+    }
 
+    do {
         cfacdb_aitrans_data_t cbdata;
         
         rc = sqlite3_step(stmt);
@@ -791,14 +911,7 @@ int cfacdb_aitrans(cfacdb_t *cdb, cfacdb_aitrans_sink_t sink, void *udata)
         case SQLITE_OK:
             break;
         case SQLITE_ROW:
-            iufac = sqlite3_column_int   (stmt, 0);
-            ilfac = sqlite3_column_int   (stmt, 1);
-            rate  = sqlite3_column_double(stmt, 2);
-            
-            cbdata.ii = cdb->lmap[iufac - cdb->id_min];
-            cbdata.fi = cdb->lmap[ilfac - cdb->id_min];
-            
-            cbdata.rate = rate;
+            cfacdb_aitrans_row(cdb, stmt, &cbdata);
             
             if (sink(cdb, &cbdata, udata) != CFACDB_SUCCESS) {
                 sqlite3_finalize(stmt);
@@ -820,12 +933,194 @@ int cfacdb_aitrans(cfacdb_t *cdb, cfacdb_aitrans_sink_t sink, void *udata)
 }
 
 
+/* packed arrays are stored as little-endian IEEE 754 doubles (grids, rate
+   fits) or floats (strengths) */
+static void le_swap(void *d, unsigned int size, unsigned int n)
+{
+    const unsigned short t = 0x01;
+    unsigned int i, k;
+    
+    if (*((const unsigned char *) &t) == 1) {
+        /* little-endian host, nothing to do */
+        return;
+    }
+    
+    for (i = 0; i < n; i++) {
+        unsigned char *p = (unsigned char *) d + i*size;
+        for (k = 0; k < size/2; k++) {
+            unsigned char c = p[k];
+            p[k] = p[size - 1 - k];
+            p[size - 1 - k] = c;
+        }
+    }
+}
+
+unsigned int cfacdb_unpack_doubles(const void *blob, int nbytes, double *d)
+{
+    unsigned int n = nbytes/sizeof(double);
+    
+    if (n) {
+        memcpy(d, blob, n*sizeof(double));
+        le_swap(d, sizeof(double), n);
+    }
+    
+    return n;
+}
+
+static unsigned int unpack_floats(const void *blob, int nbytes, double *d)
+{
+    unsigned int i, n = nbytes/sizeof(float);
+    const unsigned char *p = blob;
+    
+    for (i = 0; i < n; i++) {
+        float f;
+        memcpy(&f, p + i*sizeof(float), sizeof(float));
+        le_swap(&f, sizeof(float), 1);
+        d[i] = f;
+    }
+    
+    return n;
+}
+
+int cfacdb_bind_packed(sqlite3_stmt *stmt, int id,
+    const double *d, int as_float, unsigned int n)
+{
+    unsigned int i, size = as_float ? sizeof(float):sizeof(double);
+    unsigned char *buf = malloc(n*size + 1);
+    
+    if (!buf) {
+        return SQLITE_NOMEM;
+    }
+    if (as_float) {
+        for (i = 0; i < n; i++) {
+            float f = d[i];
+            memcpy(buf + i*size, &f, size);
+        }
+    } else {
+        memcpy(buf, d, n*size);
+    }
+    le_swap(buf, size, n);
+    
+    return sqlite3_bind_blob(stmt, id, buf, n*size, free);
+}
+
+static int ctrans_packed(cfacdb_t *cdb, cfacdb_ctrans_sink_t sink, void *udata)
+{
+    sqlite3_stmt *stmt;
+    const char *sql;
+    int rc, retval = CFACDB_SUCCESS;
+    unsigned int nalloc = 0;
+    double *eg = NULL, *sg = NULL;
+    cfacdb_ctrans_data_t cbdata;
+    
+    sql = "SELECT cid, ini_id, fin_id, type, e, strength, de," \
+          "       kl, ap0, ap1, ap2, ap3" \
+          " FROM _cstrengths_v" \
+          " WHERE sid = ? AND ini_nele <= ? AND fin_nele >= ?" \
+          " ORDER BY ini_id, fin_id, type";
+    
+    sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL);
+    sqlite3_bind_int(stmt, 1, cdb->sid);
+    sqlite3_bind_int(stmt, 2, cdb->nele_max);
+    sqlite3_bind_int(stmt, 3, cdb->nele_min);
+    
+    do {
+        unsigned int ilfac, iufac, ne, ns, i, nd;
+        int eb, sb;
+        
+        rc = sqlite3_step(stmt);
+        switch (rc) {
+        case SQLITE_DONE:
+        case SQLITE_OK:
+            break;
+        case SQLITE_ROW:
+            eb = sqlite3_column_bytes(stmt, 4);
+            sb = sqlite3_column_bytes(stmt, 5);
+            
+            /* grow the buffers as needed */
+            ne = eb/sizeof(double);
+            ns = sb/sizeof(float);
+            if (ne > nalloc || ns > nalloc) {
+                double *p;
+                
+                nalloc = ne > ns ? ne:ns;
+                if ((p = realloc(eg, nalloc*sizeof(double)))) {
+                    eg = p;
+                    p = realloc(sg, nalloc*sizeof(double));
+                }
+                if (!p) {
+                    fprintf(stderr, "Failed allocating memory for nd=%u\n",
+                        nalloc);
+                    retval = CFACDB_FAILURE;
+                    break;
+                }
+                sg = p;
+            }
+            
+            cbdata.cid  = sqlite3_column_int   (stmt,  0);
+            ilfac       = sqlite3_column_int   (stmt,  1);
+            iufac       = sqlite3_column_int   (stmt,  2);
+            cbdata.type = sqlite3_column_int   (stmt,  3);
+            ne = cfacdb_unpack_doubles(sqlite3_column_blob(stmt, 4), eb, eg);
+            ns = unpack_floats(sqlite3_column_blob(stmt, 5), sb, sg);
+            cbdata.de   = sqlite3_column_double(stmt,  6);
+            cbdata.kl   = sqlite3_column_int   (stmt,  7);
+            cbdata.ap0  = sqlite3_column_double(stmt,  8);
+            cbdata.ap1  = sqlite3_column_double(stmt,  9);
+            cbdata.ap2  = sqlite3_column_double(stmt, 10);
+            cbdata.ap3  = sqlite3_column_double(stmt, 11);
+            
+            cbdata.ii   = cdb->lmap[ilfac - cdb->id_min];
+            cbdata.fi   = cdb->lmap[iufac - cdb->id_min];
+            
+            /* TODO: msub; the subsets are stored back to back, each on
+               the ne-point grid, and only the first one is used */
+            if (ns > ne) {
+                ns = ne;
+            }
+            
+            /* convert in place, skipping non-positive strengths */
+            for (i = 0, nd = 0; i < ns; i++) {
+                if (sg[i] > 0.0) {
+                    eg[nd] = 1 + eg[i]/cbdata.de;
+                    sg[nd] = sg[i];
+                    nd++;
+                }
+            }
+            
+            if (nd) {
+                cbdata.nd = nd;
+                cbdata.e  = eg;
+                cbdata.d  = sg;
+                
+                if (sink(cdb, &cbdata, udata) != CFACDB_SUCCESS) {
+                    retval = CFACDB_FAILURE;
+                }
+            }
+            
+            break;
+        default:
+            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(cdb->db));
+            retval = CFACDB_FAILURE;
+            break;
+        }
+    } while (rc == SQLITE_ROW && retval == CFACDB_SUCCESS);
+    
+    sqlite3_finalize(stmt);
+    
+    free(eg);
+    free(sg);
+    
+    return retval;
+}
+
 int cfacdb_ctrans(cfacdb_t *cdb, cfacdb_ctrans_sink_t sink, void *udata)
 {
     sqlite3_stmt *stmt;
     const char *sql;
-    int nd, rc;
+    int nd, nr, rc;
     unsigned int ilfac_prev, iufac_prev, type_prev;
+    double e_prev;
     
     double es[256], ds[256]; /* TODO: make truly allocatable ? */
     cfacdb_ctrans_data_t cbdata;
@@ -837,36 +1132,26 @@ int cfacdb_ctrans(cfacdb_t *cdb, cfacdb_ctrans_sink_t sink, void *udata)
         return CFACDB_FAILURE;
     }
 
+    if (cdb->snapshot) {
+        return cfacdb_snapshot_ctrans(cdb, sink, udata);
+    }
+
+    if (cdb->db_format >= 4) {
+        return ctrans_packed(cdb, sink, udata);
+    }
+
     if (cdb->db_format == 1) {
-        if (cdb->cached) {
-            sql = "SELECT cid, ini_id, fin_id, type, e, strength, de," \
-                  "       ap0, ap1" \
-                  " FROM _cstrengths_v" \
-                  " WHERE sid = ? AND ini_nele <= ? AND fin_nele >= ?" \
-                  " AND cid NOT IN (SELECT cid FROM _cache_temp)" \
-                  " ORDER BY ini_id, fin_id, type, e";
-        } else {
-            sql = "SELECT cid, ini_id, fin_id, type, e, strength, de," \
-                  "       ap0, ap1" \
-                  " FROM _cstrengths_v" \
-                  " WHERE sid = ? AND ini_nele <= ? AND fin_nele >= ?" \
-                  " ORDER BY ini_id, fin_id, type, e";
-        }
+        sql = "SELECT cid, ini_id, fin_id, type, e, strength, de," \
+              "       ap0, ap1" \
+              " FROM _cstrengths_v" \
+              " WHERE sid = ? AND ini_nele <= ? AND fin_nele >= ?" \
+              " ORDER BY ini_id, fin_id, type, e";
     } else {
-        if (cdb->cached) {
-            sql = "SELECT cid, ini_id, fin_id, type, e, strength, de," \
-                  "       kl, ap0, ap1, ap2, ap3" \
-                  " FROM _cstrengths_v" \
-                  " WHERE sid = ? AND ini_nele <= ? AND fin_nele >= ?" \
-                  " AND cid NOT IN (SELECT cid FROM _cache_temp)" \
-                  " ORDER BY ini_id, fin_id, type, e";
-        } else {
-            sql = "SELECT cid, ini_id, fin_id, type, e, strength, de," \
-                  "       kl, ap0, ap1, ap2, ap3" \
-                  " FROM _cstrengths_v" \
-                  " WHERE sid = ? AND ini_nele <= ? AND fin_nele >= ?" \
-                  " ORDER BY ini_id, fin_id, type, e";
-        }
+        sql = "SELECT cid, ini_id, fin_id, type, e, strength, de," \
+              "       kl, ap0, ap1, ap2, ap3" \
+              " FROM _cstrengths_v" \
+              " WHERE sid = ? AND ini_nele <= ? AND fin_nele >= ?" \
+              " ORDER BY ini_id, fin_id, type, e, rid";
     }
     
     sqlite3_prepare_v2(cdb->db, sql, -1, &stmt, NULL);
@@ -877,7 +1162,9 @@ int cfacdb_ctrans(cfacdb_t *cdb, cfacdb_ctrans_sink_t sink, void *udata)
     ilfac_prev = 0;
     iufac_prev = 0;
     type_prev = 0;
+    e_prev = 0.0;
     nd = 0;
+    nr = 0;
     do {
         unsigned int cid, ilfac, iufac, type, kl;
         double de, ap0, ap1, ap2, ap3, e, strength;
@@ -932,12 +1219,26 @@ int cfacdb_ctrans(cfacdb_t *cdb, cfacdb_ctrans_sink_t sink, void *udata)
                 }
 
                 nd = 0;
+                nr = 0;
 
                 ilfac_prev = ilfac;
                 iufac_prev = iufac;
                 type_prev  = type;
             }
             
+            /* with msub, each energy comes once per subset, in insertion
+               (= subset) order; only the first subset is used, as in the
+               packed format */
+            if (nr++ && e == e_prev) {
+                break;
+            }
+            e_prev = e;
+            
+            /* the packed format drops these, too */
+            if (strength <= 0.0) {
+                break;
+            }
+            
             cbdata.cid  = cid;
             
             cbdata.ii   = cdb->lmap[ilfac - cdb->id_min];
@@ -957,13 +1258,6 @@ int cfacdb_ctrans(cfacdb_t *cdb, cfacdb_ctrans_sink_t sink, void *udata)
             ds[nd] = strength;
             
             nd++;
-
-            if (strength <= 0.0) {
-                fprintf(stderr,
-                    "ignoring non-positive cstrength %g at e=%g\n",
-                        strength, e);
-                continue;
-            }
             
             break;
         default:
@@ -979,3 +1273,260 @@ int cfacdb_ctrans(cfacdb_t *cdb, cfacdb_ctrans_sink_t sink, void *udata)
     
     return CFACDB_SUCCESS;
 }
+
+/* cgrids.e holds the n_usr grid energies as little-endian doubles;
+   cvectors.strength holds nsub*n_usr little-endian floats, subset-major
+   (subset k at offset k*n_usr), nsub being 1 unless msub is set */
+static const char *migrate_v4_str[] = {
+    "CREATE TABLE cgrids ("                                             \
+    " gid      INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"             \
+    " sid      INTEGER NOT NULL REFERENCES sessions(sid) ON DELETE CASCADE," \
+    " e        BLOB    NOT NULL)",
+    "CREATE TABLE cvectors ("                                           \
+    " cid      INTEGER PRIMARY KEY NOT NULL"                            \
+    "          REFERENCES ctransitions(cid) ON DELETE CASCADE,"         \
+    " gid      INTEGER NOT NULL REFERENCES cgrids(gid) ON DELETE CASCADE," \
+    " strength BLOB    NOT NULL)",
+    NULL
+};
+
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *cg_stmt;
+    sqlite3_stmt *cv_stmt;
+    
+    unsigned int nalloc;
+    unsigned int n;
+    double *e;
+    double *d;
+    
+    unsigned long int sid;
+    unsigned long int cid;
+    
+    /* the last stored grid */
+    unsigned long int gid;
+    unsigned long int g_sid;
+    unsigned int g_n;
+    double *g_e;
+} migrate_t;
+
+static int migrate_flush(migrate_t *m)
+{
+    int rc;
+    unsigned int i, ng;
+    
+    if (!m->n) {
+        return CFACDB_SUCCESS;
+    }
+    
+    /* msub subsets come one after another, in insertion order, each on
+       the same grid; the grid ends where the energy stops increasing */
+    for (ng = 1; ng < m->n; ng++) {
+        if (m->e[ng] <= m->e[ng - 1]) {
+            break;
+        }
+    }
+    for (i = ng; i < m->n; i++) {
+        if (m->e[i] != m->e[i % ng]) {
+            break;
+        }
+    }
+    if (i != m->n || m->n % ng) {
+        fprintf(stderr, "Inconsistent energy grid of cid=%lu\n", m->cid);
+        return CFACDB_FAILURE;
+    }
+    
+    /* all transitions of a cFAC block share the same grid */
+    if (!m->gid || m->g_sid != m->sid || m->g_n != ng ||
+        memcmp(m->g_e, m->e, ng*sizeof(double))) {
+        sqlite3_bind_int64(m->cg_stmt, 1, m->sid);
+        cfacdb_bind_packed(m->cg_stmt, 2, m->e, 0, ng);
+        
+        rc = sqlite3_step(m->cg_stmt);
+        sqlite3_reset(m->cg_stmt);
+        if (rc != SQLITE_DONE) {
+            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(m->db));
+            return CFACDB_FAILURE;
+        }
+        
+        m->gid   = sqlite3_last_insert_rowid(m->db);
+        m->g_sid = m->sid;
+        m->g_n   = ng;
+        memcpy(m->g_e, m->e, ng*sizeof(double));
+    }
+    
+    sqlite3_bind_int64(m->cv_stmt, 1, m->cid);
+    sqlite3_bind_int64(m->cv_stmt, 2, m->gid);
+    cfacdb_bind_packed(m->cv_stmt, 3, m->d, 1, m->n);
+    
+    rc = sqlite3_step(m->cv_stmt);
+    sqlite3_reset(m->cv_stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(m->db));
+        return CFACDB_FAILURE;
+    }
+    
+    m->n = 0;
+    
+    return CFACDB_SUCCESS;
+}
+
+static int migrate_v4(sqlite3 *db)
+{
+    sqlite3_stmt *stmt;
+    const char *sql;
+    char *errmsg;
+    int rc, i, retval = CFACDB_SUCCESS;
+    migrate_t m;
+    
+    memset(&m, 0, sizeof(migrate_t));
+    m.db = db;
+    
+    i = 0;
+    while ((sql = migrate_v4_str[i])) {
+        rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "SQL error: %s\n", errmsg);
+            sqlite3_free(errmsg);
+            return CFACDB_FAILURE;
+        }
+        i++;
+    }
+    
+    sql = "INSERT INTO cgrids (sid, e) VALUES (?, ?)";
+    sqlite3_prepare_v2(db, sql, -1, &m.cg_stmt, NULL);
+    sql = "INSERT INTO cvectors (cid, gid, strength) VALUES (?, ?, ?)";
+    sqlite3_prepare_v2(db, sql, -1, &m.cv_stmt, NULL);
+    
+    sql = "SELECT cs.cid, ct.sid, cs.e, cs.strength" \
+          " FROM cstrengths AS cs" \
+          "  INNER JOIN ctransitions AS ct ON (cs.cid = ct.cid)" \
+          " ORDER BY cs.cid, cs.rowid";
+    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    
+    do {
+        unsigned long int cid;
+        
+        rc = sqlite3_step(stmt);
+        switch (rc) {
+        case SQLITE_DONE:
+            retval = migrate_flush(&m);
+            break;
+        case SQLITE_ROW:
+            cid = sqlite3_column_int64(stmt, 0);
+            if (cid != m.cid) {
+                retval = migrate_flush(&m);
+                m.cid = cid;
+                m.sid = sqlite3_column_int64(stmt, 1);
+            }
+            
+            if (m.n == m.nalloc) {
+                double *p;
+                
+                m.nalloc = m.nalloc ? 2*m.nalloc:256;
+                if ((p = realloc(m.e, m.nalloc*sizeof(double)))) {
+                    m.e = p;
+                    if ((p = realloc(m.d, m.nalloc*sizeof(double)))) {
+                        m.d = p;
+                        p = realloc(m.g_e, m.nalloc*sizeof(double));
+                    }
+                }
+                if (!p) {
+                    fprintf(stderr, "Failed allocating memory for nd=%u\n",
+                        m.nalloc);
+                    retval = CFACDB_FAILURE;
+                    break;
+                }
+                m.g_e = p;
+            }
+            
+            m.e[m.n] = sqlite3_column_double(stmt, 2);
+            m.d[m.n] = sqlite3_column_double(stmt, 3);
+            m.n++;
+            
+            break;
+        default:
+            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+            retval = CFACDB_FAILURE;
+            break;
+        }
+    } while (rc == SQLITE_ROW && retval == CFACDB_SUCCESS);
+    
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(m.cg_stmt);
+    sqlite3_finalize(m.cv_stmt);
+    
+    free(m.e);
+    free(m.d);
+    free(m.g_e);
+    
+    if (retval != CFACDB_SUCCESS) {
+        return retval;
+    }
+    
+    sql = "DROP TABLE cstrengths;" \
+          "CREATE INDEX cvectors_gid ON cvectors(gid);" \
+          "UPDATE cfacdb SET value = 4 WHERE property = 'format'";
+    rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", errmsg);
+        sqlite3_free(errmsg);
+        return CFACDB_FAILURE;
+    }
+    
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_migrate(const char *fname)
+{
+    sqlite3 *db;
+    const char *sql;
+    char *errmsg;
+    int rc, db_format = 1, retval;
+    
+    rc = sqlite3_open_v2(fname, &db, SQLITE_OPEN_READWRITE, NULL);
+    if (rc) {
+        fprintf(stderr, "Cannot open database \"%s\": %s\n",
+            fname, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return CFACDB_FAILURE;
+    }
+    
+    sql = "SELECT value FROM cfacdb WHERE property = 'format'";
+    sqlite3_exec(db, sql, format_cb, &db_format, NULL);
+    
+    if (db_format == CFACDB_FORMAT_MAX) {
+        sqlite3_close(db);
+        return CFACDB_SUCCESS;
+    }
+    
+    if (db_format != 3) {
+        fprintf(stderr, "Migration from database format %d is not supported\n",
+            db_format);
+        sqlite3_close(db);
+        return CFACDB_FAILURE;
+    }
+    
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    
+    retval = migrate_v4(db);
+    if (retval == CFACDB_SUCCESS &&
+        sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        retval = CFACDB_FAILURE;
+    }
+    if (retval == CFACDB_SUCCESS) {
+        /* reclaim the space freed by the per-point table */
+        rc = sqlite3_exec(db, "VACUUM", NULL, NULL, &errmsg);
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "SQL error: %s\n", errmsg);
+            sqlite3_free(errmsg);
+        }
+    } else {
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    
+    sqlite3_close(db);
+    
+    return retval;
+}
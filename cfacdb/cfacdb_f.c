@@ -67,6 +67,9 @@ static char *f77char2str(const char *fstr, unsigned int fstrlen)
 /* Fortran API functions below */
 static cfacdb_t *cdb = NULL;
 
+void cfacdb_rtrans_close_(void);
+void cfacdb_aitrans_close_(void);
+
 
 void cfacdb_init_(const char *fname, int *nele_min, int *nele_max,
     int *ndim, int *rtdim, int *aidim, int *cedim, int *cidim, int *pidim,
@@ -83,6 +86,10 @@ void cfacdb_init_(const char *fname, int *nele_min, int *nele_max,
         return;
     }
     
+    /* the cursors refer to the previous window */
+    cfacdb_rtrans_close_();
+    cfacdb_aitrans_close_();
+    
     cdb = cfacdb_open(s, CFACDB_TEMP_DEFAULT);
     free(s);
     
@@ -111,6 +118,9 @@ void cfacdb_init_(const char *fname, int *nele_min, int *nele_max,
 
 void cfacdb_close_(void)
 {
+    cfacdb_rtrans_close_();
+    cfacdb_aitrans_close_();
+    
     cfacdb_close(cdb);
     cdb = NULL;
 }
@@ -282,3 +292,357 @@ void cfacdb_crates_(double *T, cfacdb_crates_fsink_t sink, int *ierr)
     
     *ierr = cfacdb_crates(cdb, *T, crates_fsink, &fdata);
 }
+
+
+/* Cursor (batch) access; one cursor of each kind may be open at a time */
+static cfacdb_cursor_t *rtrans_cur = NULL;
+static cfacdb_cursor_t *aitrans_cur = NULL;
+
+static void f77index(unsigned int *ii, unsigned int *fi, unsigned int n)
+{
+    unsigned int k;
+    
+    for (k = 0; k < n; k++) {
+        ii[k]++;
+        fi[k]++;
+    }
+}
+
+void cfacdb_rtrans_open_(int *ierr)
+{
+    cfacdb_rtrans_close(rtrans_cur);
+    
+    rtrans_cur = cfacdb_rtrans_open(cdb);
+    
+    *ierr = rtrans_cur ? 0:1;
+}
+
+void cfacdb_rtrans_next_batch_(int *n, int *ii, int *fi, int *mpole,
+    double *de, double *gf, double *uta_de, double *uta_sd,
+    int *nread, int *ierr)
+{
+    cfacdb_rtrans_batch_t batch;
+    unsigned int nr;
+    
+    *nread = 0;
+    
+    if (*n < 0) {
+        *ierr = 1;
+        return;
+    }
+    
+    batch.ii     = (unsigned int *) ii;
+    batch.fi     = (unsigned int *) fi;
+    batch.mpole  = mpole;
+    batch.de     = de;
+    batch.gf     = gf;
+    batch.uta_de = uta_de;
+    batch.uta_sd = uta_sd;
+    
+    *ierr = cfacdb_rtrans_next_batch(rtrans_cur, *n, &batch, &nr);
+    
+    f77index(batch.ii, batch.fi, nr);
+    
+    *nread = nr;
+}
+
+void cfacdb_rtrans_close_(void)
+{
+    cfacdb_rtrans_close(rtrans_cur);
+    rtrans_cur = NULL;
+}
+
+
+void cfacdb_aitrans_open_(int *ierr)
+{
+    cfacdb_aitrans_close(aitrans_cur);
+    
+    aitrans_cur = cfacdb_aitrans_open(cdb);
+    
+    *ierr = aitrans_cur ? 0:1;
+}
+
+void cfacdb_aitrans_next_batch_(int *n, int *ii, int *fi, double *rate,
+    int *nread, int *ierr)
+{
+    cfacdb_aitrans_batch_t batch;
+    unsigned int nr;
+    
+    *nread = 0;
+    
+    if (*n < 0) {
+        *ierr = 1;
+        return;
+    }
+    
+    batch.ii   = (unsigned int *) ii;
+    batch.fi   = (unsigned int *) fi;
+    batch.rate = rate;
+    
+    *ierr = cfacdb_aitrans_next_batch(aitrans_cur, *n, &batch, &nr);
+    
+    f77index(batch.ii, batch.fi, nr);
+    
+    *nread = nr;
+}
+
+void cfacdb_aitrans_close_(void)
+{
+    cfacdb_aitrans_close(aitrans_cur);
+    aitrans_cur = NULL;
+}
+
+
+/*
+ * Bulk access: all records of a kind are stored in caller-provided arrays
+ * in one call. The arrays must be large enough for the dimensions returned
+ * by cfacdb_init(); otherwise ierr = 4 is returned, with only the records
+ * which fit stored.
+ */
+#define F77_ERR_SIZE    4
+
+static void str2f77char(char *fstr, unsigned int fstrlen, const char *s)
+{
+    unsigned int len = s ? strlen(s):0;
+    
+    if (len > fstrlen) {
+        len = fstrlen;
+    }
+    if (len) {
+        memcpy(fstr, s, len);
+    }
+    memset(fstr + len, ' ', fstrlen - len);
+}
+
+typedef struct {
+    unsigned int n;
+    int overflow;
+    
+    double *energy;
+    int *nele, *g, *vn, *vl, *p;
+    char *name, *ncmplx, *sname;
+    int _namelen, _ncmplxlen, _snamelen;
+} levels_bulk_t;
+
+static int levels_bulk_sink(const cfacdb_t *cdb,
+    cfacdb_levels_data_t *cbdata, void *udata)
+{
+    levels_bulk_t *b = udata;
+    unsigned int i = cbdata->i;
+    
+    if (i >= b->n) {
+        b->overflow = 1;
+        return CFACDB_FAILURE;
+    }
+    
+    b->energy[i] = cbdata->energy;
+    b->nele[i]   = cbdata->nele;
+    b->g[i]      = cbdata->g;
+    b->vn[i]     = cbdata->vn;
+    b->vl[i]     = cbdata->vl;
+    b->p[i]      = cbdata->p;
+    
+    str2f77char(b->name   + i*b->_namelen,   b->_namelen,   cbdata->name);
+    str2f77char(b->ncmplx + i*b->_ncmplxlen, b->_ncmplxlen, cbdata->ncmplx);
+    str2f77char(b->sname  + i*b->_snamelen,  b->_snamelen,  cbdata->sname);
+    
+    return CFACDB_SUCCESS;
+}
+
+void cfacdb_levels_bulk_(int *n, double *energy, int *nele, int *g,
+    int *vn, int *vl, int *p, char *name, char *ncmplx, char *sname,
+    int *ierr,
+    int _namelen, int _ncmplxlen, int _snamelen)
+{
+    levels_bulk_t b;
+    
+    if (*n < 0) {
+        *ierr = 1;
+        return;
+    }
+    
+    b.n        = *n;
+    b.overflow = 0;
+    b.energy   = energy;
+    b.nele     = nele;
+    b.g        = g;
+    b.vn       = vn;
+    b.vl       = vl;
+    b.p        = p;
+    b.name     = name;
+    b.ncmplx   = ncmplx;
+    b.sname    = sname;
+    b._namelen   = _namelen;
+    b._ncmplxlen = _ncmplxlen;
+    b._snamelen  = _snamelen;
+    
+    *ierr = cfacdb_levels(cdb, levels_bulk_sink, &b);
+    if (b.overflow) {
+        *ierr = F77_ERR_SIZE;
+    }
+}
+
+
+/* radiative transitions come grouped by the upper level, with A-values */
+void cfacdb_rtrans_bulk_(int *n, int *ii, int *fi, int *mpole,
+    double *de, double *gf, double *a, int *nread, int *ierr)
+{
+    cfacdb_rtable_t *rt;
+    unsigned int iu, nlevels;
+    unsigned long k = 0;
+    
+    *nread = 0;
+    
+    if (*n < 0) {
+        *ierr = 1;
+        return;
+    }
+    
+    rt = cfacdb_rtable_build(cdb);
+    if (!rt) {
+        *ierr = 1;
+        return;
+    }
+    
+    *ierr = 0;
+    
+    nlevels = cfacdb_rtable_nlevels(rt);
+    for (iu = 0; iu < nlevels && !*ierr; iu++) {
+        cfacdb_rtable_slice_t slice;
+        unsigned long j;
+        
+        cfacdb_rtable_from_upper(rt, iu, &slice);
+        for (j = 0; j < slice.n; j++, k++) {
+            if (k >= (unsigned long) *n) {
+                *ierr = F77_ERR_SIZE;
+                break;
+            }
+            ii[k]    = slice.lev[j] + 1;
+            fi[k]    = iu + 1;
+            mpole[k] = slice.mpole[j];
+            de[k]    = slice.de[j];
+            gf[k]    = slice.gf[j];
+            a[k]     = slice.a[j];
+        }
+    }
+    
+    *nread = k;
+    
+    cfacdb_rtable_free(rt);
+}
+
+
+typedef struct {
+    unsigned int n;
+    unsigned int nread;
+    int overflow;
+    
+    int *ii, *fi;
+    double *rate;
+} aitrans_bulk_t;
+
+static int aitrans_bulk_sink(const cfacdb_t *cdb,
+    cfacdb_aitrans_data_t *cbdata, void *udata)
+{
+    aitrans_bulk_t *b = udata;
+    unsigned int k = b->nread;
+    
+    if (k >= b->n) {
+        b->overflow = 1;
+        return CFACDB_FAILURE;
+    }
+    
+    b->ii[k]   = cbdata->ii + 1;
+    b->fi[k]   = cbdata->fi + 1;
+    b->rate[k] = cbdata->rate;
+    
+    b->nread++;
+    
+    return CFACDB_SUCCESS;
+}
+
+void cfacdb_aitrans_bulk_(int *n, int *ii, int *fi, double *rate,
+    int *nread, int *ierr)
+{
+    aitrans_bulk_t b;
+    
+    *nread = 0;
+    
+    if (*n < 0) {
+        *ierr = 1;
+        return;
+    }
+    
+    b.n        = *n;
+    b.nread    = 0;
+    b.overflow = 0;
+    b.ii       = ii;
+    b.fi       = fi;
+    b.rate     = rate;
+    
+    *ierr = cfacdb_aitrans(cdb, aitrans_bulk_sink, &b);
+    if (b.overflow) {
+        *ierr = F77_ERR_SIZE;
+    }
+    
+    *nread = b.nread;
+}
+
+
+typedef struct {
+    unsigned int n;
+    unsigned int nread;
+    int overflow;
+    
+    int *ii, *fi, *type;
+    double *ratec;
+} crates_bulk_t;
+
+static int crates_bulk_sink(const cfacdb_t *cdb,
+    cfacdb_crates_data_t *cbdata, void *udata)
+{
+    crates_bulk_t *b = udata;
+    unsigned int k = b->nread;
+    
+    if (k >= b->n) {
+        b->overflow = 1;
+        return CFACDB_FAILURE;
+    }
+    
+    b->ii[k]    = cbdata->ii + 1;
+    b->fi[k]    = cbdata->fi + 1;
+    b->type[k]  = cbdata->type;
+    b->ratec[k] = cbdata->ratec;
+    
+    b->nread++;
+    
+    return CFACDB_SUCCESS;
+}
+
+void cfacdb_crates_bulk_(double *T, int *n, int *ii, int *fi, int *type,
+    double *ratec, int *nread, int *ierr)
+{
+    crates_bulk_t b;
+    
+    *nread = 0;
+    
+    if (*n < 0) {
+        *ierr = 1;
+        return;
+    }
+    
+    b.n        = *n;
+    b.nread    = 0;
+    b.overflow = 0;
+    b.ii       = ii;
+    b.fi       = fi;
+    b.type     = type;
+    b.ratec    = ratec;
+    
+    *ierr = cfacdb_crates(cdb, *T, crates_bulk_sink, &b);
+    if (b.overflow) {
+        *ierr = F77_ERR_SIZE;
+    }
+    
+    *nread = b.nread;
+}
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
+#include <time.h>
+#include <math.h>
 
 #include "cfac.h"
 #include "cfacdb.h"
@@ -9,8 +11,11 @@
 typedef struct {
     const char *db_fname;
     const char *cache_fname;
+    const char *image_fname;
     
     int print_info;
+    int migrate;
+    int benchmark;
     
     long sid;
     
@@ -21,6 +26,16 @@ typedef struct {
     unsigned long nsid;
     
     double T;
+    
+    double tgrid_min;
+    double tgrid_max;
+    unsigned int tgrid_n;
+    
+    double fit_min;
+    double fit_max;
+    unsigned int fit_n;
+    
+    unsigned int nthreads;
 } cfacdbu_t;
 
 static void verinfo(void)
@@ -46,6 +61,19 @@ static void usage(FILE *fp, const char *progname)
     fprintf(fp, "  -c, --cache FILE       create (if needed) and attach a cache DB [none]\n");
     fprintf(fp, "  -T, --temperature T    populate the cache DB with rate coefficients,\n" \
                 "                         calculated at temperature T (a.u.)\n");
+    fprintf(fp, "      --tgrid Tmin:Tmax:N\n" \
+                "                         populate the cache DB with rate coefficients,\n" \
+                "                         calculated on a log-spaced grid of N\n" \
+                "                         temperatures between Tmin and Tmax (a.u.)\n");
+    fprintf(fp, "      --fit Tmin:Tmax[:N]\n" \
+                "                         fit rate coefficients between Tmin and Tmax\n" \
+                "                         (a.u.) with N Chebyshev terms [16] and store\n" \
+                "                         the fits in the cache DB\n");
+    fprintf(fp, "  -j, --threads N        number of threads to compute rates with [1]\n");
+    fprintf(fp, "  -m, --migrate          convert the DB in place to the latest format\n");
+    fprintf(fp, "  -b, --benchmark        time data retrieval via SQL vs in-memory snapshot\n");
+    fprintf(fp, "  -w, --write-image FILE save the session as a binary image, which can\n" \
+                "                         be opened instead of the DB [none]\n");
     
     fprintf(fp, "  -V, --version          print version info and exit\n");
     fprintf(fp, "  -h, --help             display this help and exit\n");
@@ -62,7 +90,13 @@ static int parse_args(cfacdbu_t *u, unsigned int argc, char *const *argv)
             {"temperature",      required_argument, NULL,  'T'},
             {"nele-min",         required_argument, NULL,  128},
             {"nele-max",         required_argument, NULL,  129},
+            {"tgrid",            required_argument, NULL,  130},
+            {"fit",              required_argument, NULL,  131},
+            {"threads",          required_argument, NULL,  'j'},
             {"info",             no_argument,       NULL,  'i'},
+            {"migrate",          no_argument,       NULL,  'm'},
+            {"benchmark",        no_argument,       NULL,  'b'},
+            {"write-image",      required_argument, NULL,  'w'},
             {"version",          no_argument,       NULL,  'V'},
             {"help",             no_argument,       NULL,  'h'},
             {NULL,               0,                 NULL,    0}
@@ -72,7 +106,7 @@ static int parse_args(cfacdbu_t *u, unsigned int argc, char *const *argv)
         int option_index = 0;
 
         optc = getopt_long(argc, argv,
-            "is:c:T:Vh",
+            "is:c:T:j:mbw:Vh",
             long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -84,9 +118,18 @@ static int parse_args(cfacdbu_t *u, unsigned int argc, char *const *argv)
         case 'i':
             u->print_info = CFACDB_TRUE;
             break;
+        case 'm':
+            u->migrate = CFACDB_TRUE;
+            break;
+        case 'b':
+            u->benchmark = CFACDB_TRUE;
+            break;
         case 'c':
             u->cache_fname = optarg;
             break;
+        case 'w':
+            u->image_fname = optarg;
+            break;
         case 's':
             if (!strcmp(optarg, "all")) {
                 u->sid = -1;
@@ -101,6 +144,33 @@ static int parse_args(cfacdbu_t *u, unsigned int argc, char *const *argv)
                 return CFACDB_FAILURE;
             }
             break;
+        case 130:
+            if (sscanf(optarg, "%lf:%lf:%u",
+                    &u->tgrid_min, &u->tgrid_max, &u->tgrid_n) != 3 ||
+                u->tgrid_min <= 0.0 || u->tgrid_max < u->tgrid_min ||
+                u->tgrid_n == 0 ||
+                (u->tgrid_max == u->tgrid_min && u->tgrid_n > 1)) {
+                fprintf(stderr, " Invalid temperature grid \"%s\"!\n", optarg);
+                return CFACDB_FAILURE;
+            }
+            break;
+        case 131:
+            u->fit_n = 16;
+            if (sscanf(optarg, "%lf:%lf:%u",
+                    &u->fit_min, &u->fit_max, &u->fit_n) < 2 ||
+                u->fit_min <= 0.0 || u->fit_max <= u->fit_min ||
+                u->fit_n < 2 || u->fit_n > CFACDB_RFIT_NCOEF_MAX) {
+                fprintf(stderr, " Invalid fit range \"%s\"!\n", optarg);
+                return CFACDB_FAILURE;
+            }
+            break;
+        case 'j':
+            if (atoi(optarg) <= 0) {
+                fprintf(stderr, " Number of threads must be positive!\n");
+                return CFACDB_FAILURE;
+            }
+            u->nthreads = atoi(optarg);
+            break;
         case 128:
             u->nele_min = atoi(optarg);
             if (u->nele_min < 0) {
@@ -157,6 +227,11 @@ static int parse_args(cfacdbu_t *u, unsigned int argc, char *const *argv)
         return CFACDB_FAILURE;
     }
     
+    if ((u->tgrid_n || u->fit_n) && !u->cache_fname) {
+        fprintf(stderr, "--tgrid and --fit require a cache DB (--cache)!\n");
+        return CFACDB_FAILURE;
+    }
+    
     return CFACDB_SUCCESS;
 }
 
@@ -197,6 +272,280 @@ static int crates_sink(const cfacdb_t *cdb,
     return CFACDB_SUCCESS;
 }
 
+static double wall_time(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+static int levels_count_sink(const cfacdb_t *cdb,
+    cfacdb_levels_data_t *cbdata, void *udata)
+{
+    (*(unsigned long *) udata)++;
+    return CFACDB_SUCCESS;
+}
+
+static int rtrans_count_sink(const cfacdb_t *cdb,
+    cfacdb_rtrans_data_t *cbdata, void *udata)
+{
+    (*(unsigned long *) udata)++;
+    return CFACDB_SUCCESS;
+}
+
+static int aitrans_count_sink(const cfacdb_t *cdb,
+    cfacdb_aitrans_data_t *cbdata, void *udata)
+{
+    (*(unsigned long *) udata)++;
+    return CFACDB_SUCCESS;
+}
+
+static int ctrans_count_sink(const cfacdb_t *cdb,
+    cfacdb_ctrans_data_t *cbdata, void *udata)
+{
+    (*(unsigned long *) udata)++;
+    return CFACDB_SUCCESS;
+}
+
+/* a full pass over the data of the selected charge states */
+static double benchmark_pass(cfacdb_t *cdb, const cfacdbu_t *cdu,
+    unsigned long sid, unsigned long *nrec)
+{
+    double t0 = wall_time();
+    
+    *nrec = 0;
+    
+    if (cfacdb_init(cdb, sid, cdu->nele_min, cdu->nele_max)
+            != CFACDB_SUCCESS                                  ||
+        cfacdb_levels (cdb, levels_count_sink,  nrec) != CFACDB_SUCCESS ||
+        cfacdb_rtrans (cdb, rtrans_count_sink,  nrec) != CFACDB_SUCCESS ||
+        cfacdb_aitrans(cdb, aitrans_count_sink, nrec) != CFACDB_SUCCESS ||
+        cfacdb_ctrans (cdb, ctrans_count_sink,  nrec) != CFACDB_SUCCESS) {
+        return -1.0;
+    }
+    
+    return wall_time() - t0;
+}
+
+static int benchmark(cfacdb_t *cdb, const cfacdbu_t *cdu, unsigned long sid)
+{
+    double t_sql, t_load, t_mem;
+    unsigned long n_sql, n_mem;
+    
+    t_sql = benchmark_pass(cdb, cdu, sid, &n_sql);
+    if (t_sql < 0.0) {
+        return CFACDB_FAILURE;
+    }
+    
+    t_load = wall_time();
+    if (cfacdb_load_snapshot(cdb) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+    t_load = wall_time() - t_load;
+    
+    t_mem = benchmark_pass(cdb, cdu, sid, &n_mem);
+    if (t_mem < 0.0) {
+        return CFACDB_FAILURE;
+    }
+    
+    printf("Benchmark of session ID %ld with nele = %d ... %d:\n",
+        sid, cdu->nele_min, cdu->nele_max);
+    printf("\tSQL:      %lu records in %.3f s\n", n_sql, t_sql);
+    printf("\tsnapshot: %lu records in %.3f s (+ %.3f s to load)\n",
+        n_mem, t_mem, t_load);
+    
+    return CFACDB_SUCCESS;
+}
+
+typedef struct {
+    unsigned long ntrans;
+    unsigned long ndone;
+    double t0;
+    double t_report;
+} tgrid_progress_t;
+
+static void tgrid_report(const tgrid_progress_t *p, double t)
+{
+    double rate = t > p->t0 ? p->ndone/(t - p->t0):0.0;
+    
+    if (p->ntrans) {
+        fprintf(stderr, "\r\t%lu/%lu transitions (%.0f%%), %.0f/s ",
+            p->ndone, p->ntrans, 100.0*p->ndone/p->ntrans, rate);
+    } else {
+        fprintf(stderr, "\r\t%lu transitions, %.0f/s ", p->ndone, rate);
+    }
+}
+
+static int tgrid_sink(const cfacdb_t *cdb,
+    cfacdb_crates_multi_data_t *cbdata, void *udata)
+{
+    tgrid_progress_t *p = udata;
+    
+    p->ndone++;
+    
+    /* check the clock only now and then */
+    if (p->ndone % 256 == 0) {
+        double t = wall_time();
+        if (t - p->t_report >= 1.0) {
+            tgrid_report(p, t);
+            p->t_report = t;
+        }
+    }
+    
+    return CFACDB_SUCCESS;
+}
+
+/* populate the cache with rates on a log-spaced temperature grid */
+static int tgrid_cache(cfacdb_t *cdb, const cfacdbu_t *cdu)
+{
+    cfacdb_stats_t stats;
+    tgrid_progress_t p;
+    double *T, dt;
+    unsigned int k, n = cdu->tgrid_n;
+    int rc;
+    
+    T = malloc(n*sizeof(double));
+    if (!T) {
+        return CFACDB_FAILURE;
+    }
+    dt = n > 1 ? log(cdu->tgrid_max/cdu->tgrid_min)/(n - 1):0.0;
+    for (k = 0; k < n; k++) {
+        T[k] = cdu->tgrid_min*exp(k*dt);
+    }
+    
+    memset(&p, 0, sizeof(p));
+    if (cfacdb_get_stats(cdb, &stats) == CFACDB_SUCCESS) {
+        p.ntrans = stats.cedim + stats.cidim + stats.pidim;
+    }
+    
+    printf("Caching rates at %u temperature%s, %g ... %g:\n",
+        n, n == 1 ? "":"s", T[0], T[n - 1]);
+    fflush(stdout);
+    
+    p.t0 = p.t_report = wall_time();
+    rc = cfacdb_crates_multi(cdb, n, T, tgrid_sink, &p);
+    
+    tgrid_report(&p, wall_time());
+    fprintf(stderr, "\n");
+    
+    if (rc == CFACDB_SUCCESS) {
+        double t = wall_time() - p.t0;
+        printf("\t%lu transitions x %u temperatures in %.2f s", p.ndone, n, t);
+        if (t > 0.0) {
+            printf(" (%.0f transitions/s, %.0f rates/s)",
+                p.ndone/t, (double) n*p.ndone/t);
+        }
+        printf("\n");
+    }
+    
+    free(T);
+    
+    return rc;
+}
+
+typedef struct {
+    unsigned int *cids;
+    unsigned long n, nalloc;
+} cid_list_t;
+
+static int cid_sink(const cfacdb_t *cdb,
+    cfacdb_ctrans_data_t *cbdata, void *udata)
+{
+    cid_list_t *l = udata;
+    
+    if (l->n == l->nalloc) {
+        unsigned long nalloc = l->nalloc ? 2*l->nalloc:1024;
+        unsigned int *p = realloc(l->cids, nalloc*sizeof(unsigned int));
+        if (!p) {
+            return CFACDB_FAILURE;
+        }
+        l->cids   = p;
+        l->nalloc = nalloc;
+    }
+    l->cids[l->n++] = cbdata->cid;
+    
+    return CFACDB_SUCCESS;
+}
+
+static int dbl_cmp(const void *a, const void *b)
+{
+    double da = *(const double *) a, db = *(const double *) b;
+    
+    return (da > db) - (da < db);
+}
+
+/* fit the rates and report the accuracy and evaluation speed of the fits */
+static int fit_rates(cfacdb_t *cdb, const cfacdbu_t *cdu)
+{
+    cid_list_t l;
+    double *errs, t, lT, dlT, sum = 0.0;
+    unsigned long i, nfail, nfit = 0, neval = 0;
+    unsigned int k;
+    
+    printf("Fitting rates at %g ... %g with %u terms:\n",
+        cdu->fit_min, cdu->fit_max, cdu->fit_n);
+    fflush(stdout);
+    
+    t = wall_time();
+    if (cfacdb_fit_rates(cdb, cdu->fit_min, cdu->fit_max, cdu->fit_n,
+            &nfail) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+    t = wall_time() - t;
+    
+    memset(&l, 0, sizeof(l));
+    if (cfacdb_ctrans(cdb, cid_sink, &l) != CFACDB_SUCCESS) {
+        free(l.cids);
+        return CFACDB_FAILURE;
+    }
+    
+    errs = malloc((l.n + 1)*sizeof(double));
+    if (!errs) {
+        free(l.cids);
+        return CFACDB_FAILURE;
+    }
+    for (i = 0; i < l.n; i++) {
+        if (cfacdb_rate_fit_info(cdb, l.cids[i],
+                NULL, NULL, &errs[nfit]) == CFACDB_SUCCESS) {
+            nfit++;
+        }
+    }
+    qsort(errs, nfit, sizeof(double), dbl_cmp);
+    
+    printf("\t%lu processes fitted (%lu not) in %.2f s\n", nfit, nfail, t);
+    if (nfit) {
+        printf("\tmax relative error: median %.2e, 99%% %.2e, worst %.2e\n",
+            errs[nfit/2], errs[(99*nfit)/100], errs[nfit - 1]);
+    }
+    
+    /* evaluation speed, over the whole temperature range */
+    lT  = log(cdu->fit_min);
+    dlT = (log(cdu->fit_max) - lT)/9;
+    t = wall_time();
+    for (k = 0; k < 10; k++) {
+        double T = exp(lT + k*dlT);
+        for (i = 0; i < l.n; i++) {
+            double ratec;
+            if (cfacdb_rate_eval(cdb, l.cids[i], T, &ratec)
+                == CFACDB_SUCCESS) {
+                sum += ratec;
+                neval++;
+            }
+        }
+    }
+    t = wall_time() - t;
+    if (neval && sum >= 0.0) {
+        printf("\tevaluation: %.0f ns per rate\n", 1.0e9*t/neval);
+    }
+    
+    free(errs);
+    free(l.cids);
+    
+    return CFACDB_SUCCESS;
+}
+
 int main(int argc, char *const *argv)
 {
     cfacdb_t *cdb;
@@ -212,6 +561,13 @@ int main(int argc, char *const *argv)
         exit(1);
     }
     
+    if (cdu.migrate) {
+        if (cfacdb_migrate(cdu.db_fname) != CFACDB_SUCCESS) {
+            fprintf(stderr, "Failed migrating DB \"%s\"\n", cdu.db_fname);
+            exit(1);
+        }
+    }
+    
     cdb = cfacdb_open(cdu.db_fname, CFACDB_TEMP_DEFAULT);
     if (!cdb) {
         exit(1);
@@ -225,6 +581,12 @@ int main(int argc, char *const *argv)
         }
     }
     
+    if (cdu.nthreads > 1 &&
+        cfacdb_set_nthreads(cdb, cdu.nthreads) != CFACDB_SUCCESS) {
+        fprintf(stderr, "Failed setting number of threads to %u\n",
+            cdu.nthreads);
+    }
+    
     nsessions = cfacdb_get_nsessions(cdb);
     if (cdu.print_info) {
         printf("%s: %d session%s\n",
@@ -251,6 +613,12 @@ int main(int argc, char *const *argv)
         cdu.sids[0] = cdu.sid;
     }
     
+    if (cdu.image_fname && nsessions != 1) {
+        fprintf(stderr, "An image can hold only one session\n");
+        cfacdb_close(cdb);
+        exit(1);
+    }
+    
     for (i = 0; i < nsessions; i++) {
         unsigned long sid = cdu.sids[i];
         
@@ -278,6 +646,42 @@ int main(int argc, char *const *argv)
         if (cdu.cache_fname && cdu.T > 0.0) {
             cfacdb_crates(cdb, cdu.T, crates_sink, NULL);
         }
+        
+        if (cdu.cache_fname && cdu.tgrid_n) {
+            if (tgrid_cache(cdb, &cdu) != CFACDB_SUCCESS) {
+                fprintf(stderr,
+                    "Caching rates of session ID %lu failed\n", sid);
+                cfacdb_close(cdb);
+                exit(1);
+            }
+        }
+        
+        if (cdu.cache_fname && cdu.fit_n) {
+            if (fit_rates(cdb, &cdu) != CFACDB_SUCCESS) {
+                fprintf(stderr,
+                    "Fitting rates of session ID %lu failed\n", sid);
+                cfacdb_close(cdb);
+                exit(1);
+            }
+        }
+        
+        if (cdu.image_fname) {
+            if (cfacdb_load_snapshot(cdb) != CFACDB_SUCCESS ||
+                cfacdb_save_snapshot(cdb, cdu.image_fname) != CFACDB_SUCCESS) {
+                fprintf(stderr, "Failed saving session ID %lu to \"%s\"\n",
+                    sid, cdu.image_fname);
+                cfacdb_close(cdb);
+                exit(1);
+            }
+        }
+        
+        if (cdu.benchmark) {
+            if (benchmark(cdb, &cdu, sid) != CFACDB_SUCCESS) {
+                fprintf(stderr, "Benchmark of session ID %lu failed\n", sid);
+                cfacdb_close(cdb);
+                exit(1);
+            }
+        }
     }
 
     free(cdu.sids);
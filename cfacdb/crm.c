@@ -0,0 +1,399 @@
+/*
+ * Assembly of the collisional-radiative rate matrix.
+ */
+
+/*
+ * Copyright (C) 2015 Evgeny Stambulchik
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The rate matrix M, such that dn/dt = M n, is a polynomial in the electron
+ * density: M = M0 + ne*M1 + ne^2*M2, where M0 holds the spontaneous
+ * (radiative and autoionization) rates, M1 the two-body collisional ones,
+ * radiative recombination and dielectronic capture, and M2 the three-body
+ * recombination. The three share a single sparsity
+ * pattern, found (and the rates at the given temperature computed) once;
+ * assembling M for a density is then a single pass over the values.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "cfacdbP.h"
+
+typedef struct {
+    unsigned int row, col;
+    double v[3];
+} crm_entry_t;
+
+struct _cfacdb_crm_t {
+    unsigned int n;
+    unsigned long nnz;
+
+    unsigned long *rowptr;  /* n + 1 */
+    unsigned int  *col;     /* nnz   */
+    unsigned long *diag;    /* n     */
+
+    double *v0, *v1, *v2;   /* nnz   */
+};
+
+typedef struct {
+    double T;
+    unsigned int *g;
+    double *e;
+
+    crm_entry_t *entries;
+    unsigned long n, nalloc;
+
+    int status;
+} crm_build_t;
+
+static int crm_entry_cmp(const void *a, const void *b)
+{
+    const crm_entry_t *ea = a, *eb = b;
+
+    if (ea->row != eb->row) {
+        return ea->row < eb->row ? -1:1;
+    }
+    if (ea->col != eb->col) {
+        return ea->col < eb->col ? -1:1;
+    }
+    return 0;
+}
+
+static int crm_push(crm_build_t *b, unsigned int row, unsigned int col,
+    unsigned int order, double rate)
+{
+    crm_entry_t *e;
+
+    if (b->n == b->nalloc) {
+        unsigned long nalloc = b->nalloc ? 2*b->nalloc:4096;
+        e = realloc(b->entries, nalloc*sizeof(crm_entry_t));
+        if (!e) {
+            b->status = CFACDB_FAILURE;
+            return CFACDB_FAILURE;
+        }
+        b->entries = e;
+        b->nalloc  = nalloc;
+    }
+
+    e = &b->entries[b->n++];
+    e->row = row;
+    e->col = col;
+    e->v[0] = e->v[1] = e->v[2] = 0.0;
+    e->v[order] = rate;
+
+    return CFACDB_SUCCESS;
+}
+
+/* a process from level i to level f with the rate of the given order in ne */
+static int crm_add(crm_build_t *b, unsigned int i, unsigned int f,
+    unsigned int order, double rate)
+{
+    if (!(rate > 0.0)) {
+        return CFACDB_SUCCESS;
+    }
+
+    if (crm_push(b, f, i, order, rate) != CFACDB_SUCCESS ||
+        crm_push(b, i, i, order, -rate) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+static int crm_levels_sink(const cfacdb_t *cdb,
+    cfacdb_levels_data_t *cbdata, void *udata)
+{
+    crm_build_t *b = udata;
+
+    b->g[cbdata->i] = cbdata->g;
+    b->e[cbdata->i] = cbdata->energy;
+
+    return CFACDB_SUCCESS;
+}
+
+/* g_f/g_i*exp(de/T)*ratec, avoiding overflow of the exponent */
+static double crm_inverse(double ratec, unsigned int gf, double de, double T)
+{
+    if (!(ratec > 0.0) || !gf) {
+        return 0.0;
+    }
+
+    return exp(log(ratec/gf) + de/T);
+}
+
+static int crm_aitrans_sink(const cfacdb_t *cdb,
+    cfacdb_aitrans_data_t *cbdata, void *udata)
+{
+    crm_build_t *b = udata;
+    unsigned int ii = cbdata->ii, fi = cbdata->fi;
+    double de = b->e[ii] - b->e[fi], T = b->T;
+    int rc;
+
+    /* from the autoionizing level to the ion */
+    rc = crm_add(b, ii, fi, 0, cbdata->rate);
+
+    /* dielectronic capture, A*g_i/(2*g_f)*(2*pi/T)^1.5*exp(-de/T) */
+    if (rc == CFACDB_SUCCESS) {
+        rc = crm_add(b, fi, ii, 1,
+            crm_inverse(cbdata->rate*b->g[ii], b->g[fi], -de, T)*
+            pow(2*M_PI/T, 1.5)/2);
+    }
+
+    return rc;
+}
+
+static int crm_crates_sink(const cfacdb_t *cdb,
+    cfacdb_crates_data_t *cbdata, void *udata)
+{
+    crm_build_t *b = udata;
+    unsigned int ii = cbdata->ii, fi = cbdata->fi;
+    unsigned int gi = b->g[ii], gf = b->g[fi];
+    double T = b->T, ratec = cbdata->ratec;
+    int rc = CFACDB_SUCCESS;
+
+    /* NB: the rates include the degeneracy of the initial level */
+    switch (cbdata->type) {
+    case CFACDB_CS_CE:
+        if (gi) {
+            rc = crm_add(b, ii, fi, 1, ratec/gi);
+        }
+        if (rc == CFACDB_SUCCESS) {
+            rc = crm_add(b, fi, ii, 1, crm_inverse(ratec, gf, cbdata->de, T));
+        }
+        break;
+    case CFACDB_CS_CI:
+        if (gi) {
+            rc = crm_add(b, ii, fi, 1, ratec/gi);
+        }
+        /* three-body recombination; the free electron has g = 2 */
+        if (rc == CFACDB_SUCCESS) {
+            rc = crm_add(b, fi, ii, 2, crm_inverse(ratec, gf, cbdata->de, T)*
+                pow(2*M_PI/T, 1.5)/2);
+        }
+        break;
+    case CFACDB_CS_PI:
+        /* radiative recombination, from the ion */
+        if (gf) {
+            rc = crm_add(b, fi, ii, 1, ratec/gf);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return rc;
+}
+
+void cfacdb_crm_free(cfacdb_crm_t *crm)
+{
+    if (crm) {
+        free(crm->rowptr);
+        free(crm->col);
+        free(crm->diag);
+        free(crm->v0);
+        free(crm->v1);
+        free(crm->v2);
+        free(crm);
+    }
+}
+
+/* merge the sorted entries into the CSR arrays */
+static int crm_compress(cfacdb_crm_t *crm, crm_build_t *b)
+{
+    unsigned long k, nnz = 0;
+    unsigned int i;
+
+    qsort(b->entries, b->n, sizeof(crm_entry_t), crm_entry_cmp);
+
+    /* merge duplicates in place */
+    for (k = 0; k < b->n; k++) {
+        crm_entry_t *e = &b->entries[k];
+        if (nnz && b->entries[nnz - 1].row == e->row &&
+                   b->entries[nnz - 1].col == e->col) {
+            crm_entry_t *p = &b->entries[nnz - 1];
+            p->v[0] += e->v[0];
+            p->v[1] += e->v[1];
+            p->v[2] += e->v[2];
+        } else {
+            b->entries[nnz++] = *e;
+        }
+    }
+
+    crm->nnz    = nnz;
+    crm->rowptr = calloc(crm->n + 1, sizeof(unsigned long));
+    crm->diag   = malloc((crm->n + 1)*sizeof(unsigned long));
+    crm->col    = malloc((nnz + 1)*sizeof(unsigned int));
+    crm->v0     = malloc((nnz + 1)*sizeof(double));
+    crm->v1     = malloc((nnz + 1)*sizeof(double));
+    crm->v2     = malloc((nnz + 1)*sizeof(double));
+    if (!crm->rowptr || !crm->diag || !crm->col ||
+        !crm->v0 || !crm->v1 || !crm->v2) {
+        return CFACDB_FAILURE;
+    }
+
+    for (i = 0; i < crm->n; i++) {
+        crm->diag[i] = nnz;
+    }
+
+    for (k = 0; k < nnz; k++) {
+        const crm_entry_t *e = &b->entries[k];
+
+        crm->rowptr[e->row + 1]++;
+        crm->col[k] = e->col;
+        crm->v0[k]  = e->v[0];
+        crm->v1[k]  = e->v[1];
+        crm->v2[k]  = e->v[2];
+
+        if (e->row == e->col) {
+            crm->diag[e->row] = k;
+        }
+    }
+    for (i = 0; i < crm->n; i++) {
+        crm->rowptr[i + 1] += crm->rowptr[i];
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+cfacdb_crm_t *cfacdb_crm_build(cfacdb_t *cdb, double T)
+{
+    cfacdb_crm_t *crm;
+    cfacdb_rtable_t *rt = NULL;
+    cfacdb_stats_t stats;
+    crm_build_t b;
+    unsigned int iu;
+
+    if (!cdb || T <= 0.0 ||
+        cfacdb_get_stats(cdb, &stats) != CFACDB_SUCCESS) {
+        return NULL;
+    }
+
+    crm = calloc(1, sizeof(cfacdb_crm_t));
+    if (!crm) {
+        return NULL;
+    }
+    crm->n = stats.ndim;
+
+    memset(&b, 0, sizeof(b));
+    b.T      = T;
+    b.status = CFACDB_SUCCESS;
+    b.g      = calloc(crm->n + 1, sizeof(unsigned int));
+    b.e      = calloc(crm->n + 1, sizeof(double));
+    if (!b.g || !b.e) {
+        free(b.g);
+        free(b.e);
+        free(crm);
+        return NULL;
+    }
+
+    if (cfacdb_levels(cdb, crm_levels_sink, &b) != CFACDB_SUCCESS) {
+        b.status = CFACDB_FAILURE;
+    }
+
+    /* radiative decays */
+    if (b.status == CFACDB_SUCCESS) {
+        rt = cfacdb_rtable_build(cdb);
+        if (!rt) {
+            b.status = CFACDB_FAILURE;
+        }
+    }
+    for (iu = 0; b.status == CFACDB_SUCCESS && iu < crm->n; iu++) {
+        cfacdb_rtable_slice_t slice;
+        unsigned long j;
+
+        cfacdb_rtable_from_upper(rt, iu, &slice);
+        for (j = 0; j < slice.n; j++) {
+            if (crm_add(&b, iu, slice.lev[j], 0, slice.a[j])
+                != CFACDB_SUCCESS) {
+                break;
+            }
+        }
+    }
+    cfacdb_rtable_free(rt);
+
+    if (b.status == CFACDB_SUCCESS &&
+        cfacdb_aitrans(cdb, crm_aitrans_sink, &b) != CFACDB_SUCCESS) {
+        b.status = CFACDB_FAILURE;
+    }
+
+    if (b.status == CFACDB_SUCCESS &&
+        cfacdb_crates(cdb, T, crm_crates_sink, &b) != CFACDB_SUCCESS) {
+        b.status = CFACDB_FAILURE;
+    }
+
+    /* make sure each row has its diagonal element */
+    for (iu = 0; b.status == CFACDB_SUCCESS && iu < crm->n; iu++) {
+        crm_push(&b, iu, iu, 0, 0.0);
+    }
+
+    if (b.status == CFACDB_SUCCESS) {
+        b.status = crm_compress(crm, &b);
+    }
+
+    free(b.entries);
+    free(b.g);
+    free(b.e);
+
+    if (b.status != CFACDB_SUCCESS) {
+        fprintf(stderr, "Failed building the rate matrix\n");
+        cfacdb_crm_free(crm);
+        return NULL;
+    }
+
+    return crm;
+}
+
+int cfacdb_crm_get_pattern(const cfacdb_crm_t *crm,
+    cfacdb_crm_pattern_t *pattern)
+{
+    if (!crm || !pattern) {
+        return CFACDB_FAILURE;
+    }
+
+    pattern->n      = crm->n;
+    pattern->nnz    = crm->nnz;
+    pattern->rowptr = crm->rowptr;
+    pattern->col    = crm->col;
+    pattern->diag   = crm->diag;
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_crm_assemble(const cfacdb_crm_t *crm, double ne, double *val)
+{
+    const double *v0, *v1, *v2;
+    unsigned long k, nnz;
+
+    if (!crm || !val || ne < 0.0) {
+        return CFACDB_FAILURE;
+    }
+
+    v0 = crm->v0;
+    v1 = crm->v1;
+    v2 = crm->v2;
+    nnz = crm->nnz;
+
+    for (k = 0; k < nnz; k++) {
+        val[k] = v0[k] + ne*(v1[k] + ne*v2[k]);
+    }
+
+    return CFACDB_SUCCESS;
+}
@@ -0,0 +1,583 @@
+/*
+ * Round-trip check of the collision strength storage: a format-3 database
+ * (one cstrengths row per energy point) is read through the SQL path, then
+ * migrated to format 4 (packed cgrids/cvectors) and read again. Both reads
+ * must give the same data, i.e., the first magnetic subset with the
+ * non-positive strengths dropped.
+ *
+ * Also checks the rate matrix: with autoionization and dielectronic
+ * capture only, the steady state must obey the Saha relation for each
+ * autoionizing level and the ion level it decays to.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <sqlite3.h>
+
+#include "cfacdb.h"
+
+#define CHECK_DB "ctcheck.db"
+#define CRM_DB   "crmcheck.db"
+
+static const char *schema_v3_str[] = {
+    "CREATE TABLE cfacdb (property TEXT UNIQUE NOT NULL," \
+    " value INTEGER NOT NULL)",
+    "CREATE TABLE sessions (sid INTEGER PRIMARY KEY NOT NULL," \
+    " version INTEGER NOT NULL, uta BOOLEAN NOT NULL, cmdline TEXT NOT NULL)",
+    "CREATE TABLE species (sid INTEGER NOT NULL, symbol TEXT NOT NULL," \
+    " anum INTEGER NOT NULL, mass REAL NOT NULL)",
+    "CREATE TABLE levels (sid INTEGER NOT NULL, id INTEGER NOT NULL," \
+    " nele INTEGER NOT NULL, name TEXT NOT NULL, e REAL NOT NULL," \
+    " g INTEGER NOT NULL, vn INTEGER NOT NULL, vl INTEGER NOT NULL," \
+    " p INTEGER NOT NULL, ibase INTEGER, ncomplex TEXT NOT NULL," \
+    " sname TEXT NOT NULL, PRIMARY KEY(sid, id))",
+    "CREATE TABLE rtransitions (sid INTEGER NOT NULL," \
+    " ini_id INTEGER NOT NULL, fin_id INTEGER NOT NULL," \
+    " mpole INTEGER NOT NULL, rme REAL NOT NULL, mode INTEGER NOT NULL," \
+    " uta_de REAL, uta_sd REAL)",
+    "CREATE TABLE aitransitions (sid INTEGER NOT NULL," \
+    " ini_id INTEGER NOT NULL, fin_id INTEGER NOT NULL, rate REAL NOT NULL)",
+    "CREATE TABLE ctransitions (" \
+    " cid INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL," \
+    " sid INTEGER NOT NULL, ini_id INTEGER NOT NULL," \
+    " fin_id INTEGER NOT NULL, type INTEGER NOT NULL," \
+    " qk_mode INTEGER NOT NULL, kl INTEGER NOT NULL," \
+    " ap0 REAL NOT NULL, ap1 REAL NOT NULL," \
+    " ap2 REAL NOT NULL, ap3 REAL NOT NULL)",
+    "CREATE TABLE cstrengths (cid INTEGER NOT NULL," \
+    " e REAL NOT NULL, strength REAL NOT NULL)",
+    "INSERT INTO cfacdb (property, value) VALUES ('format', 3)",
+    "INSERT INTO sessions VALUES (1, 10000, 0, 'ctcheck')",
+    "INSERT INTO species VALUES (1, 'Fe', 26, 55.845)",
+    NULL
+};
+
+#define NLEVELS 4
+#define NGRID   4
+
+static const double egrid[NGRID] = {1.0, 2.0, 4.0, 8.0};
+
+typedef struct {
+    unsigned int ini_id;
+    unsigned int fin_id;
+    unsigned int nsub;
+    double strength[3*NGRID];   /* subset-major */
+} check_trans_t;
+
+static const check_trans_t ctrans[] = {
+    /* no msub, with a zero point */
+    {0, 1, 1, {0.5, 0.0, 0.7, 0.9}},
+    /* msub, two subsets */
+    {0, 2, 2, {0.1, 0.2, 0.3, 0.4,
+               1.1, 1.2, 1.3, 1.4}},
+    /* msub, three subsets, the first one with a zero point */
+    {1, 3, 3, {0.25, 0.5,  0.0,  1.0,
+               2.25, 2.5,  2.75, 3.0,
+               3.25, 3.5,  3.75, 4.0}},
+};
+
+#define NCTRANS (sizeof(ctrans)/sizeof(check_trans_t))
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t size;
+} dump_t;
+
+static int dump_printf(dump_t *dump, double x)
+{
+    char s[32];
+    size_t n;
+
+    n = snprintf(s, sizeof(s), " %.6g", x);
+    if (dump->len + n + 1 > dump->size) {
+        char *p;
+
+        dump->size = 2*(dump->len + n + 1);
+        if (!(p = realloc(dump->buf, dump->size))) {
+            return CFACDB_FAILURE;
+        }
+        dump->buf = p;
+    }
+    memcpy(dump->buf + dump->len, s, n + 1);
+    dump->len += n;
+
+    return CFACDB_SUCCESS;
+}
+
+static int dump_sink(const cfacdb_t *cdb,
+    cfacdb_ctrans_data_t *cbdata, void *udata)
+{
+    dump_t *dump = udata;
+    unsigned int i;
+    int retval;
+
+    retval  = dump_printf(dump, cbdata->ii);
+    retval |= dump_printf(dump, cbdata->fi);
+    retval |= dump_printf(dump, cbdata->nd);
+    for (i = 0; i < cbdata->nd; i++) {
+        retval |= dump_printf(dump, cbdata->e[i]);
+        retval |= dump_printf(dump, cbdata->d[i]);
+    }
+
+    return retval;
+}
+
+static int dump_expected(dump_t *dump)
+{
+    unsigned int i, j, nd;
+    int retval = CFACDB_SUCCESS;
+
+    for (i = 0; i < NCTRANS; i++) {
+        const check_trans_t *t = &ctrans[i];
+        double de = t->fin_id - t->ini_id;
+
+        for (j = 0, nd = 0; j < NGRID; j++) {
+            if (t->strength[j] > 0.0) {
+                nd++;
+            }
+        }
+
+        retval |= dump_printf(dump, t->ini_id);
+        retval |= dump_printf(dump, t->fin_id);
+        retval |= dump_printf(dump, nd);
+        for (j = 0; j < NGRID; j++) {
+            if (t->strength[j] > 0.0) {
+                retval |= dump_printf(dump, 1 + egrid[j]/de);
+                retval |= dump_printf(dump, (float) t->strength[j]);
+            }
+        }
+    }
+
+    return retval;
+}
+
+static int create_db(const char *fname)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    const char *sql;
+    int rc, retval = CFACDB_SUCCESS;
+    unsigned int i, j, k;
+
+    remove(fname);
+
+    rc = sqlite3_open(fname, &db);
+    if (rc) {
+        fprintf(stderr, "Cannot open database \"%s\": %s\n",
+            fname, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return CFACDB_FAILURE;
+    }
+
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+
+    i = 0;
+    while ((sql = schema_v3_str[i]) && retval == CFACDB_SUCCESS) {
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+            retval = CFACDB_FAILURE;
+        }
+        i++;
+    }
+
+    /* the level energies are chosen so that de = fin_id - ini_id */
+    sql = "INSERT INTO levels" \
+          " (sid, id, nele, name, e, g, vn, vl, p, ncomplex, sname)" \
+          " VALUES (1, ?, 3, 'x', ?, 2, 2, 0, 0, '1*2 2*1', '2s1')";
+    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    for (i = 0; i < NLEVELS && retval == CFACDB_SUCCESS; i++) {
+        sqlite3_bind_int   (stmt, 1, i);
+        sqlite3_bind_double(stmt, 2, i);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            retval = CFACDB_FAILURE;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    /* the transitions are stored as StoreCETable() of format 3 did it */
+    for (i = 0; i < NCTRANS && retval == CFACDB_SUCCESS; i++) {
+        const check_trans_t *t = &ctrans[i];
+        sqlite3_int64 cid;
+
+        sql = "INSERT INTO ctransitions" \
+              " (sid, ini_id, fin_id, type, qk_mode, kl," \
+              "  ap0, ap1, ap2, ap3)" \
+              " VALUES (1, ?, ?, ?, 0, 0, 1.0, 0.0, 0.0, 0.0)";
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        sqlite3_bind_int(stmt, 1, t->ini_id);
+        sqlite3_bind_int(stmt, 2, t->fin_id);
+        sqlite3_bind_int(stmt, 3, CFACDB_CS_CE);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            retval = CFACDB_FAILURE;
+        }
+        sqlite3_finalize(stmt);
+
+        cid = sqlite3_last_insert_rowid(db);
+
+        sql = "INSERT INTO cstrengths (cid, e, strength) VALUES (?, ?, ?)";
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        for (k = 0; k < t->nsub; k++) {
+            for (j = 0; j < NGRID; j++) {
+                sqlite3_bind_int64 (stmt, 1, cid);
+                sqlite3_bind_double(stmt, 2, egrid[j]);
+                sqlite3_bind_double(stmt, 3,
+                    (float) t->strength[k*NGRID + j]);
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    retval = CFACDB_FAILURE;
+                }
+                sqlite3_reset(stmt);
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (retval == CFACDB_SUCCESS) {
+        sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    } else {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+
+    sqlite3_close(db);
+
+    return retval;
+}
+
+static int dump_db(const char *fname, dump_t *dump)
+{
+    cfacdb_t *cdb;
+    int retval;
+
+    cdb = cfacdb_open(fname, CFACDB_TEMP_MEMORY);
+    if (!cdb) {
+        return CFACDB_FAILURE;
+    }
+
+    retval = cfacdb_init(cdb, 0, 0, 100);
+    if (retval == CFACDB_SUCCESS) {
+        retval = cfacdb_ctrans(cdb, dump_sink, dump);
+    }
+
+    cfacdb_close(cdb);
+
+    return retval;
+}
+
+/* the ion (nele = 2) and the autoionizing levels (nele = 3) */
+typedef struct {
+    unsigned int nele;
+    double e;
+    unsigned int g;
+} check_level_t;
+
+static const check_level_t crm_levels[] = {
+    {2, 0.0, 1},
+    {2, 0.3, 3},
+    {3, 0.5, 2},
+    {3, 0.8, 4},
+    {3, 1.2, 6},
+};
+
+#define NCRMLEVELS (sizeof(crm_levels)/sizeof(check_level_t))
+
+static const struct {
+    unsigned int ini_id, fin_id;
+    double rate;
+} crm_aitrans[] = {
+    {2, 0, 1.0e-3},
+    {3, 0, 2.0e-4},
+    {3, 1, 5.0e-3},
+    {4, 1, 7.0e-2},
+};
+
+#define NCRMAI (sizeof(crm_aitrans)/sizeof(crm_aitrans[0]))
+
+#define CRM_T   0.2
+
+static int create_crm_db(const char *fname)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    const char *sql;
+    int rc, retval = CFACDB_SUCCESS;
+    unsigned int i;
+
+    remove(fname);
+
+    rc = sqlite3_open(fname, &db);
+    if (rc) {
+        fprintf(stderr, "Cannot open database \"%s\": %s\n",
+            fname, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return CFACDB_FAILURE;
+    }
+
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+
+    i = 0;
+    while ((sql = schema_v3_str[i]) && retval == CFACDB_SUCCESS) {
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+            retval = CFACDB_FAILURE;
+        }
+        i++;
+    }
+
+    sql = "INSERT INTO levels" \
+          " (sid, id, nele, name, e, g, vn, vl, p, ncomplex, sname)" \
+          " VALUES (1, ?, ?, 'x', ?, ?, 2, 0, 0, '1*2 2*1', '2s1')";
+    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    for (i = 0; i < NCRMLEVELS && retval == CFACDB_SUCCESS; i++) {
+        sqlite3_bind_int   (stmt, 1, i);
+        sqlite3_bind_int   (stmt, 2, crm_levels[i].nele);
+        sqlite3_bind_double(stmt, 3, crm_levels[i].e);
+        sqlite3_bind_int   (stmt, 4, crm_levels[i].g);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            retval = CFACDB_FAILURE;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    sql = "INSERT INTO aitransitions (sid, ini_id, fin_id, rate)" \
+          " VALUES (1, ?, ?, ?)";
+    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    for (i = 0; i < NCRMAI && retval == CFACDB_SUCCESS; i++) {
+        sqlite3_bind_int   (stmt, 1, crm_aitrans[i].ini_id);
+        sqlite3_bind_int   (stmt, 2, crm_aitrans[i].fin_id);
+        sqlite3_bind_double(stmt, 3, crm_aitrans[i].rate);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            retval = CFACDB_FAILURE;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    if (retval == CFACDB_SUCCESS) {
+        sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    } else {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+
+    sqlite3_close(db);
+
+    return retval;
+}
+
+typedef struct {
+    unsigned int n;
+    double e[NCRMLEVELS];
+    unsigned int g[NCRMLEVELS];
+    unsigned int ii[NCRMAI], fi[NCRMAI];
+    unsigned int nai;
+} crm_check_t;
+
+static int crm_levels_sink(const cfacdb_t *cdb,
+    cfacdb_levels_data_t *cbdata, void *udata)
+{
+    crm_check_t *c = udata;
+
+    if (cbdata->i >= NCRMLEVELS) {
+        return CFACDB_FAILURE;
+    }
+    c->e[cbdata->i] = cbdata->energy;
+    c->g[cbdata->i] = cbdata->g;
+    c->n++;
+
+    return CFACDB_SUCCESS;
+}
+
+static int crm_aitrans_sink(const cfacdb_t *cdb,
+    cfacdb_aitrans_data_t *cbdata, void *udata)
+{
+    crm_check_t *c = udata;
+
+    if (c->nai >= NCRMAI) {
+        return CFACDB_FAILURE;
+    }
+    c->ii[c->nai] = cbdata->ii;
+    c->fi[c->nai] = cbdata->fi;
+    c->nai++;
+
+    return CFACDB_SUCCESS;
+}
+
+/*
+ * the steady state of the dense n x n rate matrix m, with the last
+ * equation replaced by the normalization
+ */
+static int steady_state(unsigned int n, double *m, double *x)
+{
+    unsigned int i, j, k, p;
+
+    for (j = 0; j < n; j++) {
+        m[(n - 1)*n + j] = 1.0;
+        x[j] = 0.0;
+    }
+    x[n - 1] = 1.0;
+
+    for (k = 0; k < n; k++) {
+        for (p = k, i = k + 1; i < n; i++) {
+            if (fabs(m[i*n + k]) > fabs(m[p*n + k])) {
+                p = i;
+            }
+        }
+        if (m[p*n + k] == 0.0) {
+            return CFACDB_FAILURE;
+        }
+        if (p != k) {
+            double t;
+            for (j = 0; j < n; j++) {
+                t = m[k*n + j]; m[k*n + j] = m[p*n + j]; m[p*n + j] = t;
+            }
+            t = x[k]; x[k] = x[p]; x[p] = t;
+        }
+        for (i = k + 1; i < n; i++) {
+            double f = m[i*n + k]/m[k*n + k];
+            for (j = k; j < n; j++) {
+                m[i*n + j] -= f*m[k*n + j];
+            }
+            x[i] -= f*x[k];
+        }
+    }
+    for (k = n; k-- > 0;) {
+        for (j = k + 1; j < n; j++) {
+            x[k] -= m[k*n + j]*x[j];
+        }
+        x[k] /= m[k*n + k];
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+static int check_crm(const char *fname)
+{
+    const double nes[] = {1.0e-4, 1.0e-2, 1.0};
+    cfacdb_t *cdb;
+    cfacdb_crm_t *crm = NULL;
+    cfacdb_crm_pattern_t pat;
+    crm_check_t c;
+    double *val = NULL, m[NCRMLEVELS*NCRMLEVELS], x[NCRMLEVELS];
+    unsigned int i, j, l;
+    int retval;
+
+    memset(&c, 0, sizeof(c));
+
+    cdb = cfacdb_open(fname, CFACDB_TEMP_MEMORY);
+    if (!cdb) {
+        return CFACDB_FAILURE;
+    }
+
+    retval = cfacdb_init(cdb, 0, 0, 100);
+    if (retval == CFACDB_SUCCESS) {
+        retval = cfacdb_levels(cdb, crm_levels_sink, &c);
+    }
+    if (retval == CFACDB_SUCCESS) {
+        retval = cfacdb_aitrans(cdb, crm_aitrans_sink, &c);
+    }
+    if (retval == CFACDB_SUCCESS &&
+        (c.n != NCRMLEVELS || c.nai != NCRMAI)) {
+        retval = CFACDB_FAILURE;
+    }
+    if (retval == CFACDB_SUCCESS) {
+        crm = cfacdb_crm_build(cdb, CRM_T);
+        if (!crm || cfacdb_crm_get_pattern(crm, &pat) != CFACDB_SUCCESS ||
+            pat.n != NCRMLEVELS) {
+            retval = CFACDB_FAILURE;
+        }
+    }
+    if (retval == CFACDB_SUCCESS) {
+        val = malloc(pat.nnz*sizeof(double));
+        if (!val) {
+            retval = CFACDB_FAILURE;
+        }
+    }
+
+    for (l = 0; retval == CFACDB_SUCCESS && l < sizeof(nes)/sizeof(double);
+         l++) {
+        double ne = nes[l];
+
+        retval = cfacdb_crm_assemble(crm, ne, val);
+        if (retval != CFACDB_SUCCESS) {
+            break;
+        }
+
+        memset(m, 0, sizeof(m));
+        for (i = 0; i < pat.n; i++) {
+            unsigned long k;
+            for (k = pat.rowptr[i]; k < pat.rowptr[i + 1]; k++) {
+                m[i*pat.n + pat.col[k]] = val[k];
+            }
+        }
+        retval = steady_state(pat.n, m, x);
+
+        for (j = 0; retval == CFACDB_SUCCESS && j < c.nai; j++) {
+            unsigned int ii = c.ii[j], fi = c.fi[j];
+            double saha = ne*c.g[ii]/(2.0*c.g[fi])*pow(2*M_PI/CRM_T, 1.5)*
+                exp(-(c.e[ii] - c.e[fi])/CRM_T);
+            double ratio = x[ii]/x[fi];
+
+            if (fabs(ratio/saha - 1) > 1.0e-10) {
+                fprintf(stderr,
+                    "ctcheck: ne = %g, n(%u)/n(%u) = %g, Saha %g\n",
+                    ne, ii, fi, ratio, saha);
+                retval = CFACDB_FAILURE;
+            }
+        }
+    }
+
+    free(val);
+    cfacdb_crm_free(crm);
+    cfacdb_close(cdb);
+
+    return retval;
+}
+
+int main(void)
+{
+    dump_t d_ref, d_sql, d_packed;
+    int retval = CFACDB_SUCCESS;
+
+    memset(&d_ref,    0, sizeof(dump_t));
+    memset(&d_sql,    0, sizeof(dump_t));
+    memset(&d_packed, 0, sizeof(dump_t));
+
+    if (dump_expected(&d_ref)                 != CFACDB_SUCCESS ||
+        create_db(CHECK_DB)                   != CFACDB_SUCCESS ||
+        dump_db(CHECK_DB, &d_sql)             != CFACDB_SUCCESS ||
+        cfacdb_migrate(CHECK_DB)              != CFACDB_SUCCESS ||
+        dump_db(CHECK_DB, &d_packed)          != CFACDB_SUCCESS) {
+        fprintf(stderr, "ctcheck: failed\n");
+        retval = CFACDB_FAILURE;
+    } else
+    if (strcmp(d_sql.buf, d_ref.buf)) {
+        fprintf(stderr, "ctcheck: SQL path mismatch\n%s\n%s\n",
+            d_sql.buf, d_ref.buf);
+        retval = CFACDB_FAILURE;
+    } else
+    if (strcmp(d_packed.buf, d_ref.buf)) {
+        fprintf(stderr, "ctcheck: packed path mismatch\n%s\n%s\n",
+            d_packed.buf, d_ref.buf);
+        retval = CFACDB_FAILURE;
+    }
+
+    if (retval == CFACDB_SUCCESS &&
+        (create_crm_db(CRM_DB) != CFACDB_SUCCESS ||
+         check_crm(CRM_DB)     != CFACDB_SUCCESS)) {
+        fprintf(stderr, "ctcheck: rate matrix check failed\n");
+        retval = CFACDB_FAILURE;
+    }
+
+    free(d_ref.buf);
+    free(d_sql.buf);
+    free(d_packed.buf);
+
+    remove(CHECK_DB);
+    remove(CRM_DB);
+
+    return retval == CFACDB_SUCCESS ? EXIT_SUCCESS:EXIT_FAILURE;
+}
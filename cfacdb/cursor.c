@@ -0,0 +1,220 @@
+/*
+ * Pull-style (cursor) access to transition data.
+ */
+
+/*
+ * Copyright (C) 2015 Evgeny Stambulchik
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * A cursor either steps through an SQL statement or, when the session is
+ * held in a snapshot, through the in-memory arrays. The rows are decoded by
+ * the same routines as used by the sink-based accessors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cfacdbP.h"
+
+typedef enum {
+    CURSOR_RTRANS,
+    CURSOR_AITRANS
+} cursor_type_t;
+
+struct _cfacdb_cursor_t {
+    cfacdb_t *cdb;
+    cursor_type_t type;
+
+    sqlite3_stmt *stmt;     /* SQL mode      */
+    unsigned long k;        /* snapshot mode */
+
+    int done;
+};
+
+static cfacdb_cursor_t *cursor_open(cfacdb_t *cdb, cursor_type_t type)
+{
+    cfacdb_cursor_t *cur;
+
+    if (!cdb || !cdb->initialized) {
+        return NULL;
+    }
+
+    cur = malloc(sizeof(cfacdb_cursor_t));
+    if (!cur) {
+        return NULL;
+    }
+
+    cur->cdb  = cdb;
+    cur->type = type;
+    cur->stmt = NULL;
+    cur->k    = 0;
+    cur->done = CFACDB_FALSE;
+
+    if (!cdb->snapshot) {
+        if (type == CURSOR_RTRANS) {
+            cur->stmt = cfacdb_rtrans_stmt(cdb);
+        } else {
+            cur->stmt = cfacdb_aitrans_stmt(cdb);
+        }
+        if (!cur->stmt) {
+            free(cur);
+            return NULL;
+        }
+    }
+
+    cdb->ncursors++;
+
+    return cur;
+}
+
+static void cursor_close(cfacdb_cursor_t *cur)
+{
+    if (cur) {
+        cur->cdb->ncursors--;
+        sqlite3_finalize(cur->stmt);
+        free(cur);
+    }
+}
+
+/* advance the SQL statement; returns TRUE if a row is available */
+static int cursor_step(cfacdb_cursor_t *cur, int *ierr)
+{
+    int rc = sqlite3_step(cur->stmt);
+
+    switch (rc) {
+    case SQLITE_ROW:
+        return CFACDB_TRUE;
+    case SQLITE_DONE:
+    case SQLITE_OK:
+        break;
+    default:
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(cur->cdb->db));
+        *ierr = CFACDB_FAILURE;
+        break;
+    }
+
+    cur->done = CFACDB_TRUE;
+
+    return CFACDB_FALSE;
+}
+
+
+cfacdb_cursor_t *cfacdb_rtrans_open(cfacdb_t *cdb)
+{
+    return cursor_open(cdb, CURSOR_RTRANS);
+}
+
+static void rtrans_store(cfacdb_rtrans_batch_t *batch, unsigned int i,
+    const cfacdb_rtrans_data_t *cbdata)
+{
+    if (batch->ii)     batch->ii[i]     = cbdata->ii;
+    if (batch->fi)     batch->fi[i]     = cbdata->fi;
+    if (batch->mpole)  batch->mpole[i]  = cbdata->mpole;
+    if (batch->de)     batch->de[i]     = cbdata->de;
+    if (batch->gf)     batch->gf[i]     = cbdata->gf;
+    if (batch->uta_de) batch->uta_de[i] = cbdata->uta_de;
+    if (batch->uta_sd) batch->uta_sd[i] = cbdata->uta_sd;
+}
+
+int cfacdb_rtrans_next_batch(cfacdb_cursor_t *cur, unsigned int n,
+    cfacdb_rtrans_batch_t *batch, unsigned int *nread)
+{
+    const cfacdb_t *cdb;
+    int ierr = CFACDB_SUCCESS;
+
+    *nread = 0;
+
+    if (!cur || cur->type != CURSOR_RTRANS || !batch) {
+        return CFACDB_FAILURE;
+    }
+    cdb = cur->cdb;
+
+    if (cdb->snapshot) {
+        unsigned long ntot = cdb->snapshot->nrtrans;
+        while (*nread < n && cur->k < ntot) {
+            cfacdb_rtrans_data_t cbdata;
+            if (cfacdb_snapshot_rtrans_get(cdb, cur->k++, &cbdata)) {
+                rtrans_store(batch, (*nread)++, &cbdata);
+            }
+        }
+    } else {
+        while (*nread < n && !cur->done && cursor_step(cur, &ierr)) {
+            cfacdb_rtrans_data_t cbdata;
+            cfacdb_rtrans_row(cdb, cur->stmt, &cbdata);
+            rtrans_store(batch, (*nread)++, &cbdata);
+        }
+    }
+
+    return ierr;
+}
+
+void cfacdb_rtrans_close(cfacdb_cursor_t *cur)
+{
+    cursor_close(cur);
+}
+
+
+cfacdb_cursor_t *cfacdb_aitrans_open(cfacdb_t *cdb)
+{
+    return cursor_open(cdb, CURSOR_AITRANS);
+}
+
+static void aitrans_store(cfacdb_aitrans_batch_t *batch, unsigned int i,
+    const cfacdb_aitrans_data_t *cbdata)
+{
+    if (batch->ii)   batch->ii[i]   = cbdata->ii;
+    if (batch->fi)   batch->fi[i]   = cbdata->fi;
+    if (batch->rate) batch->rate[i] = cbdata->rate;
+}
+
+int cfacdb_aitrans_next_batch(cfacdb_cursor_t *cur, unsigned int n,
+    cfacdb_aitrans_batch_t *batch, unsigned int *nread)
+{
+    const cfacdb_t *cdb;
+    int ierr = CFACDB_SUCCESS;
+
+    *nread = 0;
+
+    if (!cur || cur->type != CURSOR_AITRANS || !batch) {
+        return CFACDB_FAILURE;
+    }
+    cdb = cur->cdb;
+
+    if (cdb->snapshot) {
+        unsigned long ntot = cdb->snapshot->naitrans;
+        while (*nread < n && cur->k < ntot) {
+            cfacdb_aitrans_data_t cbdata;
+            if (cfacdb_snapshot_aitrans_get(cdb, cur->k++, &cbdata)) {
+                aitrans_store(batch, (*nread)++, &cbdata);
+            }
+        }
+    } else {
+        while (*nread < n && !cur->done && cursor_step(cur, &ierr)) {
+            cfacdb_aitrans_data_t cbdata;
+            cfacdb_aitrans_row(cdb, cur->stmt, &cbdata);
+            aitrans_store(batch, (*nread)++, &cbdata);
+        }
+    }
+
+    return ierr;
+}
+
+void cfacdb_aitrans_close(cfacdb_cursor_t *cur)
+{
+    cursor_close(cur);
+}
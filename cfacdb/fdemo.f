@@ -32,6 +32,21 @@ c     species
 
       integer ierr
 
+c     Buffers for batch access
+      integer nbatch
+      parameter (nbatch = 64)
+      integer bi(nbatch), bj(nbatch), bmpole(nbatch), nread, ntot
+      double precision bde(nbatch), bgf(nbatch)
+      double precision butade(nbatch), butasd(nbatch)
+
+c     Arrays for bulk access, sized after cfacdb_init()
+      double precision, allocatable :: le(:), rde(:), rgf(:), ra(:)
+      double precision, allocatable :: crate(:)
+      integer, allocatable :: lnele(:), lg(:), lvn(:), lvl(:), lp(:)
+      integer, allocatable :: ri(:), rj(:), rmpole(:)
+      integer, allocatable :: ci(:), cj(:), ctype(:)
+      character (len=32), allocatable :: lname(:), lncmplx(:), lsname(:)
+
 c     Sink subroutines for handling (storing) data      
       external l_sink, rt_sink, ai_sink, ct_sink, cr_sink
 
@@ -80,6 +95,47 @@ c     Get radiative transitions
           stop
       endif
       
+c     Same, in batches of up to nbatch transitions
+      call cfacdb_rtrans_open(ierr)
+      if (ierr .ne. 0) then
+          print *, 'cfacdb_rtrans_open() failed with ierr = ', ierr
+          stop
+      endif
+      ntot = 0
+ 10   call cfacdb_rtrans_next_batch(nbatch, bi, bj, bmpole, bde,
+     &                              bgf, butade, butasd, nread, ierr)
+      if (ierr .ne. 0) then
+          print *, 'cfacdb_rtrans_next_batch() failed, ierr = ', ierr
+          stop
+      endif
+      if (nread .gt. 0) then
+          ntot = ntot + nread
+          goto 10
+      endif
+      call cfacdb_rtrans_close()
+      write(*, 903) ntot
+      
+c     The same data in bulk, i.e., without per-record callbacks
+      allocate(le(ndim), lnele(ndim), lg(ndim), lvn(ndim), lvl(ndim),
+     &         lp(ndim), lname(ndim), lncmplx(ndim), lsname(ndim))
+      call cfacdb_levels_bulk(ndim, le, lnele, lg, lvn, lvl, lp,
+     &                        lname, lncmplx, lsname, ierr)
+      if (ierr .ne. 0) then
+          print *, 'cfacdb_levels_bulk() failed with ierr = ', ierr
+          stop
+      endif
+
+c     (grouped by the upper level, with A-values)
+      allocate(ri(rtdim), rj(rtdim), rmpole(rtdim),
+     &         rde(rtdim), rgf(rtdim), ra(rtdim))
+      call cfacdb_rtrans_bulk(rtdim, ri, rj, rmpole, rde, rgf, ra,
+     &                        nread, ierr)
+      if (ierr .ne. 0) then
+          print *, 'cfacdb_rtrans_bulk() failed with ierr = ', ierr
+          stop
+      endif
+      write(*, 904) nread
+
 c     Get AI transitions
       call cfacdb_aitrans(ai_sink, ierr)
       if (ierr .ne. 0) then
@@ -98,6 +154,17 @@ c    (NB: the statweight of the ini state is included!!!)
           print *, 'cfacdb_crates() failed with ierr = ', ierr
           stop
       endif
+
+c     Same, in bulk
+      ntot = cedim + cidim + pidim
+      allocate(ci(ntot), cj(ntot), ctype(ntot), crate(ntot))
+      call cfacdb_crates_bulk(T, ntot, ci, cj, ctype, crate,
+     &                        nread, ierr)
+      if (ierr .ne. 0) then
+          print *, 'cfacdb_crates_bulk() failed with ierr = ', ierr
+          stop
+      endif
+      write(*, 905) nread
       
 c     Close the DB and free associated structures
       call cfacdb_close()
@@ -109,6 +176,9 @@ c---------
  901  format(' Species: anum =', i3, '; mass =', f7.2)
  902  format(' ndim =', i5, '; rtdim =', i5, '; aidim =', i5,
      &       '; cedim =', i5, '; cidim =', i5,'; pidim =', i5)
+ 903  format(' Radiative transitions read in batches:', i7)
+ 904  format(' Radiative transitions read in bulk:', i7)
+ 905  format(' Collisional rates read in bulk:', i7)
 
       end
 
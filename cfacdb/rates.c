@@ -18,6 +18,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <stdlib.h>
+#include <string.h>
+
+#include "sysdef.h"
+
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
+
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_integration.h>
 
@@ -37,53 +46,74 @@ typedef struct {
     int type;
     int db_format;
     cfacdb_intext_t intext;
+    
+    /* node values (times x^3 in the cubic mode) and segment slopes of
+       the interpolant; kept from one transition to the next */
+    unsigned int nalloc;
+    double *y;
+    double *tang;
 } rate_int_params_t;
 
-double cfacdb_intext(const cfacdb_intext_t *intext, double x)
+/* index of the interpolation segment [e[i], e[i + 1]] containing x */
+static unsigned int intext_segment(const double *dx, unsigned int n, double x)
 {
-    double Omega = 0.0;
-    unsigned int i, n;
-    double *dx = intext->e, *dd = intext->d;
+    unsigned int lo = 0, hi = n - 1;
     
-    if (x < 1.0) {
-        return 0.0;
+    /* the first i with x <= e[i + 1] */
+    while (hi - lo > 1) {
+        unsigned int mid = (lo + hi)/2;
+        if (x <= dx[mid]) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    
+    return lo;
+}
+
+static double intext_interpolate(int cube, double x,
+    double x1, double x2, double y1, double y2, double tang)
+{
+    double Omega;
+    
+    if (x < (x1 + x2)/2) {
+        Omega = y1 + tang*(x - x1);
+    } else {
+        Omega = y2 - tang*(x2 - x);
     }
+    
+    if (cube) {
+        Omega /= x*x*x;
+    }
+    
+    return Omega;
+}
 
-    n = intext->ndata;
+static double intext_segment_eval(const cfacdb_intext_t *intext,
+    unsigned int i, double x)
+{
+    double x1 = intext->e[i], x2 = intext->e[i + 1];
+    double y1 = intext->d[i], y2 = intext->d[i + 1];
+    
+    if (intext->cube) {
+        y1 *= x1*x1*x1;
+        y2 *= x2*x2*x2;
+    }
+    
+    return intext_interpolate(intext->cube, x,
+        x1, x2, y1, y2, (y2 - y1)/(x2 - x1));
+}
 
+static double intext_extrapolate(const cfacdb_intext_t *intext, double x)
+{
+    unsigned int n = intext->ndata;
+    double *dx = intext->e, *dd = intext->d;
+    double Omega;
+    
     if (x < dx[0]) {
         /* low-e extrapolation */
         Omega = intext->d0 + intext->let*(x - 1.0);
-    } else
-    if (x <= dx[n - 1]) {
-        /* interpolation */
-        for (i = 0; i < n - 1; i++) {
-            double x1 = dx[i], x2 = dx[i + 1];
-            if (x <= x2) {
-                double xavg = (x1 + x2)/2;
-                double y1 = dd[i], y2 = dd[i + 1];
-                double tang;
-                
-                if (intext->cube) {
-                    y1 *= pow(x1, 3);
-                    y2 *= pow(x2, 3);
-                }
-                
-                tang = (y2 - y1)/(x2 - x1);
-                
-                if (x < xavg) {
-                    Omega = y1 + tang*(x - x1);
-                } else {
-                    Omega = y2 - tang*(x2 - x);
-                }
-                
-                if (intext->cube) {
-                    Omega /= pow(x, 3);
-                }
-                
-                break;
-            }
-        }
     } else {
         /* high-e extrapolation */
         double c = dx[n - 1]/x;
@@ -100,6 +130,82 @@ double cfacdb_intext(const cfacdb_intext_t *intext, double x)
     return Omega;
 }
 
+double cfacdb_intext(const cfacdb_intext_t *intext, double x)
+{
+    unsigned int n = intext->ndata;
+    
+    if (x < 1.0) {
+        return 0.0;
+    }
+
+    if (x < intext->e[0] || x > intext->e[n - 1]) {
+        return intext_extrapolate(intext, x);
+    }
+    
+    /* a single point gives no interpolation segment */
+    if (n < 2) {
+        return 0.0;
+    }
+    
+    return intext_segment_eval(intext,
+        intext_segment(intext->e, n, x), x);
+}
+
+void cfacdb_intext_many(const cfacdb_intext_t *intext,
+    const double *x, unsigned int nx, double *out)
+{
+    unsigned int j, i = 0, n = intext->ndata;
+    const double *dx = intext->e;
+    
+    for (j = 0; j < nx; j++) {
+        double xj = x[j];
+        
+        if (xj < 1.0) {
+            out[j] = 0.0;
+        } else
+        if (xj < dx[0] || xj > dx[n - 1]) {
+            out[j] = intext_extrapolate(intext, xj);
+        } else
+        if (n < 2) {
+            out[j] = 0.0;
+        } else {
+            /* try the previous segment and its neighbor first */
+            if (!(xj > dx[i] && xj <= dx[i + 1])) {
+                if (i + 2 < n && xj > dx[i + 1] && xj <= dx[i + 2]) {
+                    i++;
+                } else {
+                    i = intext_segment(dx, n, xj);
+                }
+            }
+            out[j] = intext_segment_eval(intext, i, xj);
+        }
+    }
+}
+
+/* same as cfacdb_intext(), with the slopes precomputed by rate_prepare() */
+static double rate_intext(const rate_int_params_t *p, double x)
+{
+    const cfacdb_intext_t *intext = &p->intext;
+    unsigned int i, n = intext->ndata;
+    
+    if (x < 1.0) {
+        return 0.0;
+    }
+
+    if (x < intext->e[0] || x > intext->e[n - 1]) {
+        return intext_extrapolate(intext, x);
+    }
+    
+    if (n < 2) {
+        return 0.0;
+    }
+    
+    i = intext_segment(intext->e, n, x);
+    
+    return intext_interpolate(intext->cube, x,
+        intext->e[i], intext->e[i + 1], p->y[i], p->y[i + 1], p->tang[i]);
+}
+
 static double get_e_MB_vf(double T, double E)
 {
     return 2*sqrt(2/M_PI)*E/pow(T, 1.5)*exp(-E/T);
@@ -196,12 +302,59 @@ int cfacdb_prepare_intext(const cfacdb_t *cdb,
     
     return CFACDB_SUCCESS;
 }
+
+static void rate_params_free(rate_int_params_t *p)
+{
+    free(p->y);
+    p->y      = NULL;
+    p->tang   = NULL;
+    p->nalloc = 0;
+}
+
+/* set up the interpolant of a transition, reusing the slope arrays */
+static int rate_prepare(const cfacdb_t *cdb,
+    const cfacdb_ctrans_data_t *cbdata, rate_int_params_t *p)
+{
+    cfacdb_intext_t *intext = &p->intext;
+    unsigned int i;
     
-/* NB: rates include the degeneracy of the initial level!!! */
-static double rate_int_f(double e, void *params) {
-    const rate_int_params_t *p = params;
+    p->de   = cbdata->de;
+    p->type = cbdata->type;
     
-    double xs, Omega;
+    p->db_format = cdb->db_format;
+    
+    if (cfacdb_prepare_intext(cdb, cbdata, intext) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+    
+    if (intext->ndata > p->nalloc) {
+        double *y = realloc(p->y, 2*intext->ndata*sizeof(double));
+        if (!y) {
+            return CFACDB_FAILURE;
+        }
+        p->y      = y;
+        p->nalloc = intext->ndata;
+    }
+    p->tang = p->y + p->nalloc;
+    
+    for (i = 0; i < intext->ndata; i++) {
+        double x = intext->e[i];
+        p->y[i] = intext->d[i];
+        if (intext->cube) {
+            p->y[i] *= x*x*x;
+        }
+    }
+    for (i = 0; i + 1 < intext->ndata; i++) {
+        p->tang[i] = (p->y[i + 1] - p->y[i])/(intext->e[i + 1] - intext->e[i]);
+    }
+    
+    return CFACDB_SUCCESS;
+}
+    
+/* NB: rates include the degeneracy of the initial level!!! */
+static double rate_xs(double e, const rate_int_params_t *p)
+{
+    double Omega;
     
     double x = e/p->de, x1, conv;
     
@@ -226,74 +379,85 @@ static double rate_int_f(double e, void *params) {
         break;
     }
     
-    Omega = cfacdb_intext(&p->intext, x1);
-    xs = Omega*conv;
+    Omega = rate_intext(p, x1);
+    
+    return Omega*conv;
+}
 
-    return xs*get_e_MB_vf(p->T, e);
+static double rate_int_f(double e, void *params) {
+    const rate_int_params_t *p = params;
+    
+    return rate_xs(e, p)*get_e_MB_vf(p->T, e);
 }
 
-static int crates_sink(const cfacdb_t *cdb,
-    cfacdb_ctrans_data_t *cbdata, void *udata)
+typedef struct {
+    double T;
+    cfacdb_crates_sink_t sink;
+    void *udata;
+    gsl_integration_workspace *w;
+    rate_int_params_t params;   /* used by the serial evaluation only */
+    sqlite3_stmt *stmt;
+    cfacdb_rcache_t *rcache;
+} crates_data_t;
+
+static int crates_integrate(const cfacdb_t *cdb,
+    const cfacdb_ctrans_data_t *cbdata, double T,
+    gsl_integration_workspace *w, rate_int_params_t *params, double *ratec)
 {
-    cfacdb_crates_data_t rcbdata;
-    cfacdb_intext_t *intext;
-    
     int gsl_status;
     double low_limit, split_limit, result, error;
-    
-    rate_int_params_t params;
 
     gsl_function F;
 
-    double ratec = 0.0;
-    
-    struct {
-        double T;
-        cfacdb_crates_sink_t sink;
-        void *udata;
-        gsl_integration_workspace *w;
-        sqlite3_stmt *stmt;
-    } *rdata = udata;
-    
-    params.T    = rdata->T;
-    params.de   = cbdata->de;
-    params.type = cbdata->type;
+    *ratec = 0.0;
     
-    params.db_format = cdb->db_format;
+    params->T = T;
     
-    intext = &params.intext;
-    
-    cfacdb_prepare_intext(cdb, cbdata, intext);
+    if (rate_prepare(cdb, cbdata, params) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
     
     F.function = &rate_int_f;
-    F.params   = &params;
+    F.params   = params;
 
     if (cbdata->type == CFACDB_CS_PI) {
         low_limit   = 0.0;
     } else {
-        low_limit   = params.de;
+        low_limit   = params->de;
     }
 
-    split_limit = 3*params.de;
+    split_limit = 3*params->de;
     
     gsl_status = gsl_integration_qags(&F, low_limit, split_limit,
-        0, CFACDB_QAGI_EPS, 1000, rdata->w, &result, &error);
+        0, CFACDB_QAGI_EPS, 1000, w, &result, &error);
     if (gsl_status) {
         fprintf(stderr, "gsl_integration_qags() failed with %s\n",
             gsl_strerror(gsl_status));
         return CFACDB_FAILURE;
     }
-    ratec = result;
+    *ratec = result;
     
     gsl_status = gsl_integration_qagiu(&F, split_limit,
-        0, CFACDB_QAGI_EPS, 1000, rdata->w, &result, &error);
+        0, CFACDB_QAGI_EPS, 1000, w, &result, &error);
     if (gsl_status) {
         fprintf(stderr, "gsl_integration_qagiu() failed with %s\n",
             gsl_strerror(gsl_status));
         return CFACDB_FAILURE;
     }
-    ratec += result;
+    *ratec += result;
+
+    return CFACDB_SUCCESS;
+}
+
+/* pass the rate to the user sink and, if needed, to the cache DB */
+static int crates_emit(const cfacdb_t *cdb,
+    const cfacdb_ctrans_data_t *cbdata, double ratec,
+    const crates_data_t *rdata, int store)
+{
+    cfacdb_crates_data_t rcbdata;
+    int rc;
 
+    rcbdata.cid   = cbdata->cid;
     rcbdata.type  = cbdata->type;
     rcbdata.de    = cbdata->de;
     rcbdata.ii    = cbdata->ii;
@@ -306,69 +470,895 @@ static int crates_sink(const cfacdb_t *cdb,
     }
 
     /* if the cache DB exists, store data there */
-    if (cdb->cached) {
+    if (cdb->cached && store) {
         sqlite3_bind_int   (rdata->stmt, 1, cbdata->cid);
         sqlite3_bind_double(rdata->stmt, 3, ratec);
 
-        sqlite3_step(rdata->stmt);
+        rc = sqlite3_step(rdata->stmt);
 
         sqlite3_reset(rdata->stmt);
+        
+        if (rc != SQLITE_DONE) {
+            fprintf(stderr, "SQL error: %s\n",
+                sqlite3_errmsg(cdb->cache_db));
+            return CFACDB_FAILURE;
+        }
+        
+        cfacdb_rcache_add(rdata->rcache, cbdata->cid, rdata->T, ratec);
     }
     
     return CFACDB_SUCCESS;
 }
 
-int cfacdb_crates(cfacdb_t *cdb, double T,
-    cfacdb_crates_sink_t sink, void *udata)
+static int crates_sink(const cfacdb_t *cdb,
+    cfacdb_ctrans_data_t *cbdata, void *udata)
 {
-    int rc;
+    crates_data_t *rdata = udata;
+    double ratec;
+    
+    if (cdb->cached &&
+        cfacdb_rcache_lookup(rdata->rcache, cbdata->cid, rdata->T, &ratec)) {
+        return crates_emit(cdb, cbdata, ratec, rdata, CFACDB_FALSE);
+    }
+    
+    if (crates_integrate(cdb, cbdata, rdata->T, rdata->w, &rdata->params,
+        &ratec) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+    
+    return crates_emit(cdb, cbdata, ratec, rdata, CFACDB_TRUE);
+}
+
+/*
+ * Multi-temperature rates: a fixed composite Gauss-Legendre rule in the
+ * energy above the threshold, with geometrically growing panels, is
+ * shared by all temperatures, so that each cross section is evaluated
+ * once per node rather than once per node and temperature.
+ */
+
+/* nodes and weights of the 8-point Gauss-Legendre rule on [-1, 1] */
+static const double gl8_x[4] = {
+    0.1834346424956498, 0.5255324099163290,
+    0.7966664774136267, 0.9602898564975363
+};
+static const double gl8_w[4] = {
+    0.3626837833783620, 0.3137066458778873,
+    0.2223810344533745, 0.1012285362903763
+};
+
+/* panel growth factor */
+#define CRATES_MULTI_RATIO   1.25
+/* first panel width, in units of the lowest temperature */
+#define CRATES_MULTI_DE0     1.0e-3
+/* integration cut-off, in units of the highest temperature */
+#define CRATES_MULTI_EMAX    60.0
+
+typedef struct {
+    unsigned int nT;
+    const double *T;
+    
+    unsigned int n;     /* number of nodes                         */
+    double *de;         /* node energies above the threshold       */
+    double *wexp;       /* w_i*exp(-de_i/T_k), nT x n              */
+    double *norm;       /* Maxwellian normalization, nT            */
+    
+    double *g;          /* (e0 + de_i)*xs(e0 + de_i), n            */
+    double *ratec;      /* results, nT                             */
+    
+    rate_int_params_t params;   /* interpolant (serial evaluation) */
+} crates_multi_t;
+
+typedef struct {
+    crates_multi_t *m;
+    cfacdb_crates_multi_sink_t sink;
+    void *udata;
+    sqlite3_stmt *stmt;
+    cfacdb_rcache_t *rcache;
+} crates_multi_data_t;
+
+static void crates_multi_free(crates_multi_t *m)
+{
+    free(m->de);
+    free(m->wexp);
+    free(m->norm);
+    free(m->g);
+    free(m->ratec);
+    rate_params_free(&m->params);
+}
+
+static int crates_multi_init(crates_multi_t *m,
+    unsigned int nT, const double *T)
+{
+    double Tmin, Tmax, a, b;
+    unsigned int i, k, np;
+    
+    memset(m, 0, sizeof(crates_multi_t));
+    m->nT = nT;
+    m->T  = T;
+    
+    Tmin = Tmax = T[0];
+    for (k = 1; k < nT; k++) {
+        if (T[k] < Tmin) {
+            Tmin = T[k];
+        }
+        if (T[k] > Tmax) {
+            Tmax = T[k];
+        }
+    }
+    
+    /* [0, de0] plus geometric panels up to the cut-off */
+    b = CRATES_MULTI_DE0*Tmin;
+    np = 1;
+    while (b < CRATES_MULTI_EMAX*Tmax) {
+        b *= CRATES_MULTI_RATIO;
+        np++;
+    }
+    m->n = 8*np;
+    
+    m->de    = malloc(m->n*sizeof(double));
+    m->wexp  = malloc(nT*m->n*sizeof(double));
+    m->norm  = malloc(nT*sizeof(double));
+    m->g     = malloc(m->n*sizeof(double));
+    m->ratec = malloc(nT*sizeof(double));
+    if (!m->de || !m->wexp || !m->norm || !m->g || !m->ratec) {
+        crates_multi_free(m);
+        return CFACDB_FAILURE;
+    }
     
-    struct {
-        double T;
-        cfacdb_crates_sink_t sink;
-        void *udata;
-        gsl_integration_workspace *w;
-        sqlite3_stmt *stmt;
-    } rdata;
+    a = 0.0;
+    b = CRATES_MULTI_DE0*Tmin;
+    for (i = 0; i < m->n; i += 8) {
+        double c = (a + b)/2, h = (b - a)/2;
+        unsigned int j;
+        
+        for (j = 0; j < 4; j++) {
+            m->de[i + 2*j]     = c - h*gl8_x[j];
+            m->de[i + 2*j + 1] = c + h*gl8_x[j];
+            
+            for (k = 0; k < nT; k++) {
+                m->wexp[k*m->n + i + 2*j] =
+                    h*gl8_w[j]*exp(-m->de[i + 2*j]/T[k]);
+                m->wexp[k*m->n + i + 2*j + 1] =
+                    h*gl8_w[j]*exp(-m->de[i + 2*j + 1]/T[k]);
+            }
+        }
+        
+        a = b;
+        b *= CRATES_MULTI_RATIO;
+    }
+    
+    for (k = 0; k < nT; k++) {
+        m->norm[k] = 2*sqrt(2/M_PI)/pow(T[k], 1.5);
+    }
+    
+    return CFACDB_SUCCESS;
+}
+
+/* rates of one transition at all temperatures; g is a scratch of m->n */
+static int crates_multi_eval(const cfacdb_t *cdb, const crates_multi_t *m,
+    const cfacdb_ctrans_data_t *cbdata, rate_int_params_t *params,
+    double *g, double *ratec)
+{
+    double e0;
+    unsigned int i, k;
+    
+    params->T = 0.0;
+    
+    if (rate_prepare(cdb, cbdata, params) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+    
+    if (cbdata->type == CFACDB_CS_PI) {
+        e0 = 0.0;
+    } else {
+        e0 = params->de;
+    }
+    
+    /* cross sections, evaluated once for all temperatures */
+    for (i = 0; i < m->n; i++) {
+        double e = e0 + m->de[i];
+        g[i] = e*rate_xs(e, params);
+    }
+    
+    for (k = 0; k < m->nT; k++) {
+        const double *wexp = m->wexp + k*m->n;
+        double sum = 0.0;
+        
+        for (i = 0; i < m->n; i++) {
+            sum += wexp[i]*g[i];
+        }
+        
+        ratec[k] = m->norm[k]*exp(-e0/m->T[k])*sum;
+    }
+    
+    return CFACDB_SUCCESS;
+}
+
+/*
+ * pass the rates to the user sink and, if needed, to the cache DB; only
+ * the temperatures not yet covered by the cache are stored
+ */
+static int crates_multi_emit(const cfacdb_t *cdb,
+    const cfacdb_ctrans_data_t *cbdata, const double *ratec,
+    const crates_multi_data_t *rdata)
+{
+    const crates_multi_t *m = rdata->m;
+    cfacdb_crates_multi_data_t rcbdata;
+    
+    rcbdata.cid   = cbdata->cid;
+    rcbdata.type  = cbdata->type;
+    rcbdata.de    = cbdata->de;
+    rcbdata.ii    = cbdata->ii;
+    rcbdata.fi    = cbdata->fi;
+    
+    rcbdata.nT    = m->nT;
+    rcbdata.T     = m->T;
+    rcbdata.ratec = ratec;
+    
+    if (rdata->sink &&
+        rdata->sink(cdb, &rcbdata, rdata->udata) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
     
     if (cdb->cached) {
-        const char *sql;
+        unsigned int k;
+        int rc;
+        
+        for (k = 0; k < m->nT; k++) {
+            double r;
+            
+            if (cfacdb_rcache_lookup(rdata->rcache,
+                    cbdata->cid, m->T[k], &r)) {
+                continue;
+            }
+            
+            sqlite3_bind_int   (rdata->stmt, 1, cbdata->cid);
+            sqlite3_bind_double(rdata->stmt, 2, m->T[k]);
+            sqlite3_bind_double(rdata->stmt, 3, ratec[k]);
+
+            rc = sqlite3_step(rdata->stmt);
+
+            sqlite3_reset(rdata->stmt);
+            
+            if (rc != SQLITE_DONE) {
+                fprintf(stderr, "SQL error: %s\n",
+                    sqlite3_errmsg(cdb->cache_db));
+                return CFACDB_FAILURE;
+            }
+            
+            cfacdb_rcache_add(rdata->rcache, cbdata->cid, m->T[k], ratec[k]);
+        }
+    }
+    
+    return CFACDB_SUCCESS;
+}
+
+static int crates_multi_sink(const cfacdb_t *cdb,
+    cfacdb_ctrans_data_t *cbdata, void *udata)
+{
+    crates_multi_data_t *rdata = udata;
+    crates_multi_t *m = rdata->m;
+    
+    if (crates_multi_eval(cdb, m, cbdata, &m->params, m->g, m->ratec)
+        != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+    
+    return crates_multi_emit(cdb, cbdata, m->ratec, rdata);
+}
+
+#ifdef HAVE_LIBPTHREAD
+
+/*
+ * Parallel evaluation: the SQL cursor fills a batch of transitions while
+ * the worker pool integrates the previous one; the results are passed to
+ * the user sink (and the cache) by the calling thread, in the cursor order.
+ * The same pool serves both the single- and the multi-temperature rates.
+ */
+
+/* number of transitions per batch */
+#define CRATES_BATCH_SIZE   256
+
+typedef struct {
+    cfacdb_ctrans_data_t cbdata;
+    unsigned int nalloc;
+    double ratec;
+    double *ratec_v;            /* multi-temperature results        */
+    int cached;                 /* ratec taken from the cache       */
+    int status;
+} crates_job_t;
+
+typedef struct {
+    crates_job_t jobs[CRATES_BATCH_SIZE];
+    unsigned int njobs;
+} crates_batch_t;
+
+typedef struct {
+    const cfacdb_t *cdb;
+    crates_data_t *rdata;       /* single temperature               */
+    crates_multi_data_t *mdata; /* multiple temperatures            */
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t  work_cond;
+    pthread_cond_t  done_cond;
+    
+    crates_batch_t  batches[2];
+    crates_batch_t *filling;    /* batch being filled by the cursor */
+    crates_batch_t *running;    /* batch being processed, if any    */
+    unsigned int next;          /* next job to pick up              */
+    unsigned int ndone;         /* jobs completed                   */
+    
+    int quit;
+    
+    unsigned int nthreads;
+    pthread_t *threads;
+    
+    double *ratec_v;            /* storage of the jobs' ratec_v     */
+} crates_pool_t;
+
+static void *crates_worker(void *arg)
+{
+    crates_pool_t *pool = arg;
+    gsl_integration_workspace *w = NULL;
+    double *g = NULL;
+    rate_int_params_t params;
+    
+    memset(&params, 0, sizeof(rate_int_params_t));
+    
+    if (pool->mdata) {
+        g = malloc(pool->mdata->m->n*sizeof(double));
+    } else {
+        w = gsl_integration_workspace_alloc(1000);
+    }
+    
+    pthread_mutex_lock(&pool->mutex);
+    while (CFACDB_TRUE) {
+        crates_batch_t *b;
+        crates_job_t *job;
+        
+        while (!pool->quit &&
+            (!pool->running || pool->next >= pool->running->njobs)) {
+            pthread_cond_wait(&pool->work_cond, &pool->mutex);
+        }
+        if (pool->quit) {
+            break;
+        }
+        
+        b = pool->running;
+        job = &b->jobs[pool->next];
+        pool->next++;
+        pthread_mutex_unlock(&pool->mutex);
+        
+        if (job->cached) {
+            job->status = CFACDB_SUCCESS;
+        } else
+        if (g) {
+            job->status = crates_multi_eval(pool->cdb, pool->mdata->m,
+                &job->cbdata, &params, g, job->ratec_v);
+        } else
+        if (w) {
+            job->status = crates_integrate(pool->cdb, &job->cbdata,
+                pool->rdata->T, w, &params, &job->ratec);
+        } else {
+            job->status = CFACDB_FAILURE;
+        }
+        
+        pthread_mutex_lock(&pool->mutex);
+        pool->ndone++;
+        if (pool->ndone == b->njobs) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    
+    if (w) {
+        gsl_integration_workspace_free(w);
+    }
+    free(g);
+    rate_params_free(&params);
+    
+    return NULL;
+}
+
+/* wait for the running batch to complete and (optionally) emit results */
+static int crates_pool_drain(crates_pool_t *pool, int emit)
+{
+    crates_batch_t *b;
+    unsigned int i;
+    int retval = CFACDB_SUCCESS;
+    
+    pthread_mutex_lock(&pool->mutex);
+    b = pool->running;
+    while (b && pool->ndone < b->njobs) {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pool->running = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+    
+    if (!b) {
+        return CFACDB_SUCCESS;
+    }
+    
+    for (i = 0; emit && i < b->njobs && retval == CFACDB_SUCCESS; i++) {
+        crates_job_t *job = &b->jobs[i];
+        if (job->status != CFACDB_SUCCESS) {
+            retval = CFACDB_FAILURE;
+        } else
+        if (pool->mdata) {
+            retval = crates_multi_emit(pool->cdb, &job->cbdata,
+                job->ratec_v, pool->mdata);
+        } else {
+            retval = crates_emit(pool->cdb, &job->cbdata, job->ratec,
+                pool->rdata, !job->cached);
+        }
+    }
+    b->njobs = 0;
+    
+    return retval;
+}
+
+/* hand the filled batch over to the workers */
+static int crates_pool_submit(crates_pool_t *pool)
+{
+    crates_batch_t *b = pool->filling;
+    
+    if (crates_pool_drain(pool, CFACDB_TRUE) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+    
+    if (!b->njobs) {
+        return CFACDB_SUCCESS;
+    }
+    
+    pthread_mutex_lock(&pool->mutex);
+    pool->running = b;
+    pool->next    = 0;
+    pool->ndone   = 0;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    
+    pool->filling = (b == &pool->batches[0]) ?
+        &pool->batches[1]:&pool->batches[0];
+    
+    return CFACDB_SUCCESS;
+}
+
+static int crates_pool_sink(const cfacdb_t *cdb,
+    cfacdb_ctrans_data_t *cbdata, void *udata)
+{
+    crates_pool_t *pool = udata;
+    crates_batch_t *b = pool->filling;
+    crates_job_t *job = &b->jobs[b->njobs];
+    double *e, *d;
+    unsigned int nd;
+    
+    job->cached = pool->rdata && cdb->cached &&
+        cfacdb_rcache_lookup(pool->rdata->rcache,
+            cbdata->cid, pool->rdata->T, &job->ratec);
+    
+    /* the cursor reuses its buffers, so make a deep copy (unless cached) */
+    nd = job->cached ? 0:cbdata->nd;
+    if (nd > job->nalloc) {
+        e = realloc(job->cbdata.e, nd*sizeof(double));
+        if (e) {
+            job->cbdata.e = e;
+        }
+        d = realloc(job->cbdata.d, nd*sizeof(double));
+        if (d) {
+            job->cbdata.d = d;
+        }
+        if (!e || !d) {
+            fprintf(stderr, "Failed allocating memory for nd=%u\n", nd);
+            return CFACDB_FAILURE;
+        }
+        job->nalloc = nd;
+    }
+    e = job->cbdata.e;
+    d = job->cbdata.d;
+    job->cbdata = *cbdata;
+    job->cbdata.e  = e;
+    job->cbdata.d  = d;
+    job->cbdata.nd = nd;
+    memcpy(job->cbdata.e, cbdata->e, nd*sizeof(double));
+    memcpy(job->cbdata.d, cbdata->d, nd*sizeof(double));
+    
+    b->njobs++;
+    
+    if (b->njobs == CRATES_BATCH_SIZE) {
+        return crates_pool_submit(pool);
+    }
+    
+    return CFACDB_SUCCESS;
+}
+
+/* either rdata or mdata is given, selecting the single- or multi-T mode */
+static int crates_parallel(cfacdb_t *cdb,
+    crates_data_t *rdata, crates_multi_data_t *mdata)
+{
+    crates_pool_t *pool;
+    unsigned int i, j;
+    int rc;
+    
+    pool = malloc(sizeof(crates_pool_t));
+    if (!pool) {
+        return CFACDB_FAILURE;
+    }
+    memset(pool, 0, sizeof(crates_pool_t));
+    
+    pool->cdb      = cdb;
+    pool->rdata    = rdata;
+    pool->mdata    = mdata;
+    pool->filling  = &pool->batches[0];
+    pool->nthreads = cdb->nthreads;
+    
+    if (mdata) {
+        unsigned int nT = mdata->m->nT;
         
-        /* first, try to get previously calculated rates */
-        cfacdb_crates_cached(cdb, T, sink, udata);
+        pool->ratec_v = malloc(2*CRATES_BATCH_SIZE*nT*sizeof(double));
+        if (!pool->ratec_v) {
+            free(pool);
+            return CFACDB_FAILURE;
+        }
+        for (i = 0; i < 2; i++) {
+            for (j = 0; j < CRATES_BATCH_SIZE; j++) {
+                pool->batches[i].jobs[j].ratec_v =
+                    pool->ratec_v + (i*CRATES_BATCH_SIZE + j)*nT;
+            }
+        }
+    }
+    
+    pool->threads = malloc(pool->nthreads*sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool->ratec_v);
+        free(pool);
+        return CFACDB_FAILURE;
+    }
+    
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    
+    for (i = 0; i < pool->nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, crates_worker, pool)) {
+            break;
+        }
+    }
+    pool->nthreads = i;
+    
+    if (pool->nthreads) {
+        rc = cfacdb_ctrans(cdb, crates_pool_sink, pool);
         
-        /* prepare for transaction */
-        sqlite3_exec(cdb->cache_db, "BEGIN", NULL, NULL, NULL);
+        /* flush the last, possibly incomplete, batch */
+        if (rc == CFACDB_SUCCESS) {
+            rc = crates_pool_submit(pool);
+        }
+        if (crates_pool_drain(pool, rc == CFACDB_SUCCESS)
+            != CFACDB_SUCCESS) {
+            rc = CFACDB_FAILURE;
+        }
+    } else {
+        rc = CFACDB_FAILURE;
+    }
+    
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = CFACDB_TRUE;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    
+    for (i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < CRATES_BATCH_SIZE; j++) {
+            free(pool->batches[i].jobs[j].cbdata.e);
+            free(pool->batches[i].jobs[j].cbdata.d);
+        }
+    }
+    free(pool->ratec_v);
+    free(pool->threads);
+    free(pool);
+    
+    return rc;
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
+/* open a cache DB transaction; returns the prepared insert statement */
+static sqlite3_stmt *crates_cache_begin(const cfacdb_t *cdb)
+{
+    sqlite3_stmt *stmt = NULL;
+    const char *sql;
+    
+    /* prepare for transaction */
+    sqlite3_exec(cdb->cache_db, "BEGIN", NULL, NULL, NULL);
+
+    sql = "INSERT INTO crates" \
+          " (cid, t, rate)" \
+          " VALUES (?, ?, ?)";
+    sqlite3_prepare_v2(cdb->cache_db, sql, -1, &stmt, NULL);
+    
+    return stmt;
+}
+
+static int crates_cache_end(cfacdb_t *cdb, sqlite3_stmt *stmt)
+{
+    sqlite3_finalize(stmt);
+
+    /* finalize transaction */
+    sqlite3_exec(cdb->cache_db, "END", NULL, NULL, NULL);
+
+    /* make the new rates available for lookups */
+    return cfacdb_rcache_sort(&cdb->rcache);
+}
 
-        sql = "INSERT INTO crates" \
-              " (cid, t, rate)" \
-              " VALUES (?, ?, ?)";
-        sqlite3_prepare_v2(cdb->cache_db, sql, -1, &rdata.stmt, NULL);
+int cfacdb_crates(cfacdb_t *cdb, double T,
+    cfacdb_crates_sink_t sink, void *udata)
+{
+    int rc;
+    
+    crates_data_t rdata;
+    
+    if (cdb->cached) {
+        rdata.stmt = crates_cache_begin(cdb);
         sqlite3_bind_double(rdata.stmt, 2, T);
     }
 
     rdata.sink  = sink;
     rdata.udata = udata;
     rdata.T = T;
+    rdata.rcache = &cdb->rcache;
+    memset(&rdata.params, 0, sizeof(rate_int_params_t));
+    
+#ifdef HAVE_LIBPTHREAD
+    if (cdb->nthreads > 1) {
+        rdata.w = NULL;
+        rc = crates_parallel(cdb, &rdata, NULL);
+    } else
+#endif
+    {
+        rdata.w = gsl_integration_workspace_alloc(1000);
+        if (!rdata.w) {
+            return CFACDB_FAILURE;
+        }
+    
+        rc = cfacdb_ctrans(cdb, crates_sink, &rdata);
+    
+        gsl_integration_workspace_free(rdata.w);
+        rate_params_free(&rdata.params);
+    }
     
-    rdata.w = gsl_integration_workspace_alloc(1000);
-    if (!rdata.w) {
+    if (cdb->cached) {
+        if (crates_cache_end(cdb, rdata.stmt) != CFACDB_SUCCESS) {
+            rc = CFACDB_FAILURE;
+        }
+    }
+
+    return rc;
+}
+
+int cfacdb_crates_multi(cfacdb_t *cdb, unsigned int nT, const double *T,
+    cfacdb_crates_multi_sink_t sink, void *udata)
+{
+    crates_multi_t m;
+    crates_multi_data_t rdata;
+    unsigned int k, l;
+    int rc;
+    
+    if (!cdb || !nT || !T) {
+        return CFACDB_FAILURE;
+    }
+    
+    for (k = 0; k < nT; k++) {
+        if (T[k] <= 0.0) {
+            fprintf(stderr, "Temperature must be positive\n");
+            return CFACDB_FAILURE;
+        }
+        /* the cache holds one rate per (cid, T) */
+        for (l = 0; l < k; l++) {
+            if (T[l] == T[k]) {
+                fprintf(stderr, "Duplicate temperature %g\n", T[k]);
+                return CFACDB_FAILURE;
+            }
+        }
+    }
+    
+    if (crates_multi_init(&m, nT, T) != CFACDB_SUCCESS) {
+        fprintf(stderr, "Failed allocating memory for nT=%u\n", nT);
         return CFACDB_FAILURE;
     }
     
-    rc = cfacdb_ctrans(cdb, crates_sink, &rdata);
+    rdata.m      = &m;
+    rdata.sink   = sink;
+    rdata.udata  = udata;
+    rdata.stmt   = NULL;
+    rdata.rcache = &cdb->rcache;
+    
+    if (cdb->cached) {
+        rdata.stmt = crates_cache_begin(cdb);
+    }
     
-    gsl_integration_workspace_free(rdata.w);
+#ifdef HAVE_LIBPTHREAD
+    if (cdb->nthreads > 1) {
+        rc = crates_parallel(cdb, NULL, &rdata);
+    } else
+#endif
+    {
+        rc = cfacdb_ctrans(cdb, crates_multi_sink, &rdata);
+    }
     
     if (cdb->cached) {
-        sqlite3_finalize(rdata.stmt);
+        if (crates_cache_end(cdb, rdata.stmt) != CFACDB_SUCCESS) {
+            rc = CFACDB_FAILURE;
+        }
+    }
+    
+    crates_multi_free(&m);
+    
+    return rc;
+}
+
+/*
+ * Rate fits: y = log(ratec) + e0/T, where e0 is the threshold energy (zero
+ * for RR), is expanded in Chebyshev polynomials of x, the log(T) reduced
+ * to [-1, 1]. The coefficients are found by interpolation at the n
+ * Chebyshev nodes; the error is checked at the n + 1 extrema of T_n
+ * (including the end points of the range), where the interpolation error
+ * of a smooth function peaks.
+ */
+
+/* number of temperatures for a fit with n coefficients */
+#define RFIT_NT(n)  (2*(n) + 1)
+
+/* reduced log(T) of the k-th temperature */
+static double rfit_x(unsigned int n, unsigned int k)
+{
+    if (k < n) {
+        return cos(M_PI*(k + 0.5)/n);
+    } else {
+        return cos(M_PI*(k - n)/n);
+    }
+}
+
+typedef struct {
+    unsigned int ncoef;
+    double *c;
+    sqlite3_stmt *stmt;
+    double Tmin, Tmax;
+    unsigned long nfail;
+} rfit_data_t;
 
-        /* finalize transaction */
-        sqlite3_exec(cdb->cache_db, "END", NULL, NULL, NULL);
+static double rfit_eval(const double *c, unsigned int n, double x)
+{
+    double b0, b1 = 0.0, b2 = 0.0;
+    unsigned int j;
+    
+    for (j = n - 1; j > 0; j--) {
+        b0 = c[j] + 2*x*b1 - b2;
+        b2 = b1;
+        b1 = b0;
+    }
+    
+    return c[0] + x*b1 - b2;
+}
 
-        /* clean the temporary table in the main DB */
-        sqlite3_exec(cdb->db, "DELETE FROM _cache_temp", NULL, NULL, NULL);
+static int rfit_sink(const cfacdb_t *cdb,
+    cfacdb_crates_multi_data_t *cbdata, void *udata)
+{
+    rfit_data_t *fdata = udata;
+    unsigned int j, k, n = fdata->ncoef;
+    const double *T = cbdata->T, *ratec = cbdata->ratec;
+    double e0, maxerr = 0.0;
+    
+    e0 = (cbdata->type == CFACDB_CS_PI) ? 0.0:cbdata->de;
+    
+    for (k = 0; k < cbdata->nT; k++) {
+        if (!(ratec[k] > 0.0)) {
+            /* can't be fitted in the log scale */
+            fdata->nfail++;
+            return CFACDB_SUCCESS;
+        }
+    }
+    
+    /* the first n temperatures are the nodes */
+    for (j = 0; j < n; j++) {
+        double sum = 0.0;
+        for (k = 0; k < n; k++) {
+            double y = log(ratec[k]) + e0/T[k];
+            sum += y*cos(M_PI*j*(k + 0.5)/n);
+        }
+        fdata->c[j] = (j ? 2.0:1.0)*sum/n;
+    }
+    
+    /* the rest are for checking */
+    for (k = n; k < cbdata->nT; k++) {
+        double err;
+        err = fabs(exp(rfit_eval(fdata->c, n, rfit_x(n, k)) - e0/T[k])/ratec[k]
+            - 1.0);
+        if (err > maxerr) {
+            maxerr = err;
+        }
+    }
+    
+    sqlite3_bind_int   (fdata->stmt, 1, cbdata->cid);
+    sqlite3_bind_double(fdata->stmt, 2, fdata->Tmin);
+    sqlite3_bind_double(fdata->stmt, 3, fdata->Tmax);
+    sqlite3_bind_double(fdata->stmt, 4, e0);
+    sqlite3_bind_double(fdata->stmt, 5, maxerr);
+    
+    if (cfacdb_bind_packed(fdata->stmt, 6, fdata->c, 0, n) != SQLITE_OK ||
+        sqlite3_step(fdata->stmt) != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(cdb->cache_db));
+        sqlite3_reset(fdata->stmt);
+        return CFACDB_FAILURE;
     }
+    sqlite3_reset(fdata->stmt);
+    
+    return CFACDB_SUCCESS;
+}
 
+int cfacdb_fit_rates(cfacdb_t *cdb, double Tmin, double Tmax,
+    unsigned int ncoef, unsigned long *nfail)
+{
+    rfit_data_t fdata;
+    double *T, lmid, lhalf;
+    const char *sql;
+    unsigned int k;
+    int rc;
+    
+    if (!cdb || Tmin <= 0.0 || Tmax <= Tmin ||
+        ncoef < 2 || ncoef > CFACDB_RFIT_NCOEF_MAX) {
+        return CFACDB_FAILURE;
+    }
+    
+    if (!cdb->cached) {
+        fprintf(stderr, "Rate fits require a cache DB\n");
+        return CFACDB_FAILURE;
+    }
+    
+    T = malloc(RFIT_NT(ncoef)*sizeof(double));
+    fdata.c = malloc(ncoef*sizeof(double));
+    if (!T || !fdata.c) {
+        free(T);
+        free(fdata.c);
+        return CFACDB_FAILURE;
+    }
+    
+    lmid  = (log(Tmax) + log(Tmin))/2;
+    lhalf = (log(Tmax) - log(Tmin))/2;
+    for (k = 0; k < RFIT_NT(ncoef); k++) {
+        T[k] = exp(lmid + lhalf*rfit_x(ncoef, k));
+    }
+    
+    fdata.ncoef = ncoef;
+    fdata.Tmin  = Tmin;
+    fdata.Tmax  = Tmax;
+    fdata.nfail = 0;
+    
+    sql = "INSERT OR REPLACE INTO rfits" \
+          " (cid, tmin, tmax, e0, maxerr, coefs)" \
+          " VALUES (?, ?, ?, ?, ?, ?)";
+    sqlite3_prepare_v2(cdb->cache_db, sql, -1, &fdata.stmt, NULL);
+    
+    /* the rates are stored in the same transaction */
+    rc = cfacdb_crates_multi(cdb, RFIT_NT(ncoef), T, rfit_sink, &fdata);
+    
+    sqlite3_finalize(fdata.stmt);
+    
+    if (cfacdb_rfits_load(cdb) != CFACDB_SUCCESS) {
+        rc = CFACDB_FAILURE;
+    }
+    
+    if (nfail) {
+        *nfail = fdata.nfail;
+    }
+    
+    free(fdata.c);
+    free(T);
+    
     return rc;
 }
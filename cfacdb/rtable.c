@@ -0,0 +1,334 @@
+/*
+ * Indexed in-memory table of radiative transitions.
+ */
+
+/*
+ * Copyright (C) 2015 Evgeny Stambulchik
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The transitions of the current window are read once and stored in the
+ * compressed sparse row (CSR) form twice: grouped by the upper level and
+ * grouped by the lower one. The transition IDs are the positions in the
+ * upper-level order; the lower-level copy carries them along, so that
+ * per-transition data (e.g., escape factors) can be shared by both views.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gsl/gsl_const_num.h>
+#define ALPHA GSL_CONST_NUM_FINE_STRUCTURE
+
+#include "cfacdbP.h"
+
+/* one of the two views */
+typedef struct {
+    unsigned long *start;   /* nlevels + 1 offsets              */
+    unsigned int  *lev;     /* the other level of a transition  */
+    unsigned long *tid;     /* transition IDs                   */
+    double *a;              /* Einstein coefficients            */
+    double *de;             /* transition energies              */
+    double *gf;             /* oscillator strengths             */
+    int *mpole;             /* multipole types                  */
+} rtable_csr_t;
+
+struct _cfacdb_rtable_t {
+    unsigned int nlevels;
+    unsigned long ntrans;
+
+    rtable_csr_t upper;
+    rtable_csr_t lower;
+};
+
+typedef struct {
+    unsigned int *g;        /* level degeneracies */
+
+    unsigned long n, nalloc;
+    cfacdb_rtrans_data_t *trans;
+} rtable_read_t;
+
+static int rtable_levels_sink(const cfacdb_t *cdb,
+    cfacdb_levels_data_t *cbdata, void *udata)
+{
+    rtable_read_t *r = udata;
+
+    r->g[cbdata->i] = cbdata->g;
+
+    return CFACDB_SUCCESS;
+}
+
+static int rtable_rtrans_sink(const cfacdb_t *cdb,
+    cfacdb_rtrans_data_t *cbdata, void *udata)
+{
+    rtable_read_t *r = udata;
+
+    if (r->n == r->nalloc) {
+        unsigned long nalloc = r->nalloc ? 2*r->nalloc:1024;
+        cfacdb_rtrans_data_t *p;
+        p = realloc(r->trans, nalloc*sizeof(cfacdb_rtrans_data_t));
+        if (!p) {
+            return CFACDB_FAILURE;
+        }
+        r->trans  = p;
+        r->nalloc = nalloc;
+    }
+
+    r->trans[r->n++] = *cbdata;
+
+    return CFACDB_SUCCESS;
+}
+
+static void rtable_csr_free(rtable_csr_t *csr)
+{
+    free(csr->start);
+    free(csr->lev);
+    free(csr->tid);
+    free(csr->a);
+    free(csr->de);
+    free(csr->gf);
+    free(csr->mpole);
+}
+
+static int rtable_csr_alloc(rtable_csr_t *csr,
+    unsigned int nlevels, unsigned long ntrans)
+{
+    /* avoid zero-size allocations */
+    unsigned long n = ntrans ? ntrans:1;
+
+    csr->start = calloc(nlevels + 1, sizeof(unsigned long));
+    csr->lev   = malloc(n*sizeof(unsigned int));
+    csr->tid   = malloc(n*sizeof(unsigned long));
+    csr->a     = malloc(n*sizeof(double));
+    csr->de    = malloc(n*sizeof(double));
+    csr->gf    = malloc(n*sizeof(double));
+    csr->mpole = malloc(n*sizeof(int));
+
+    if (!csr->start || !csr->lev || !csr->tid ||
+        !csr->a || !csr->de || !csr->gf || !csr->mpole) {
+        return CFACDB_FAILURE;
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+/* turn the per-level counts in start[1..nlevels] into offsets */
+static void rtable_csr_offsets(rtable_csr_t *csr, unsigned int nlevels)
+{
+    unsigned int i;
+
+    for (i = 0; i < nlevels; i++) {
+        csr->start[i + 1] += csr->start[i];
+    }
+}
+
+static void rtable_csr_set(rtable_csr_t *csr, unsigned long k,
+    unsigned int lev, unsigned long tid, double a,
+    const cfacdb_rtrans_data_t *t)
+{
+    csr->lev[k]   = lev;
+    csr->tid[k]   = tid;
+    csr->a[k]     = a;
+    csr->de[k]    = t->de;
+    csr->gf[k]    = t->gf;
+    csr->mpole[k] = t->mpole;
+}
+
+cfacdb_rtable_t *cfacdb_rtable_build(cfacdb_t *cdb)
+{
+    cfacdb_rtable_t *rt;
+    cfacdb_stats_t stats;
+    rtable_read_t r;
+    unsigned long k, *pos = NULL;
+    unsigned int i;
+    int rc;
+
+    if (cfacdb_get_stats(cdb, &stats) != CFACDB_SUCCESS) {
+        return NULL;
+    }
+
+    rt = calloc(1, sizeof(cfacdb_rtable_t));
+    if (!rt) {
+        return NULL;
+    }
+    rt->nlevels = stats.ndim;
+
+    memset(&r, 0, sizeof(r));
+    r.g = calloc(rt->nlevels + 1, sizeof(unsigned int));
+    if (!r.g) {
+        free(rt);
+        return NULL;
+    }
+
+    rc = cfacdb_levels(cdb, rtable_levels_sink, &r);
+    if (rc == CFACDB_SUCCESS) {
+        rc = cfacdb_rtrans(cdb, rtable_rtrans_sink, &r);
+    }
+    rt->ntrans = r.n;
+
+    if (rc == CFACDB_SUCCESS) {
+        rc = rtable_csr_alloc(&rt->upper, rt->nlevels, rt->ntrans);
+    }
+    if (rc == CFACDB_SUCCESS) {
+        rc = rtable_csr_alloc(&rt->lower, rt->nlevels, rt->ntrans);
+    }
+    if (rc == CFACDB_SUCCESS) {
+        pos = malloc((rt->nlevels + 1)*sizeof(unsigned long));
+        if (!pos) {
+            rc = CFACDB_FAILURE;
+        }
+    }
+    if (rc != CFACDB_SUCCESS) {
+        fprintf(stderr, "Failed building the radiative table\n");
+        free(r.g);
+        free(r.trans);
+        cfacdb_rtable_free(rt);
+        return NULL;
+    }
+
+    /* the upper level is the final one of a transition */
+    for (k = 0; k < rt->ntrans; k++) {
+        rt->upper.start[r.trans[k].fi + 1]++;
+        rt->lower.start[r.trans[k].ii + 1]++;
+    }
+    rtable_csr_offsets(&rt->upper, rt->nlevels);
+    rtable_csr_offsets(&rt->lower, rt->nlevels);
+
+    memcpy(pos, rt->upper.start, rt->nlevels*sizeof(unsigned long));
+    for (k = 0; k < rt->ntrans; k++) {
+        const cfacdb_rtrans_data_t *t = &r.trans[k];
+        unsigned int gu = r.g[t->fi];
+        double a = gu ? 2*ALPHA*ALPHA*ALPHA*t->de*t->de*t->gf/gu:0.0;
+        unsigned long j = pos[t->fi]++;
+
+        rtable_csr_set(&rt->upper, j, t->ii, j, a, t);
+    }
+
+    /* the lower-level view, in the order of the transition IDs */
+    memcpy(pos, rt->lower.start, rt->nlevels*sizeof(unsigned long));
+    for (i = 0; i < rt->nlevels; i++) {
+        unsigned long j;
+        for (j = rt->upper.start[i]; j < rt->upper.start[i + 1]; j++) {
+            unsigned int l = rt->upper.lev[j];
+            cfacdb_rtrans_data_t t;
+
+            t.de    = rt->upper.de[j];
+            t.gf    = rt->upper.gf[j];
+            t.mpole = rt->upper.mpole[j];
+
+            rtable_csr_set(&rt->lower, pos[l]++, i, j, rt->upper.a[j], &t);
+        }
+    }
+
+    free(pos);
+    free(r.g);
+    free(r.trans);
+
+    return rt;
+}
+
+void cfacdb_rtable_free(cfacdb_rtable_t *rt)
+{
+    if (rt) {
+        rtable_csr_free(&rt->upper);
+        rtable_csr_free(&rt->lower);
+        free(rt);
+    }
+}
+
+unsigned int cfacdb_rtable_nlevels(const cfacdb_rtable_t *rt)
+{
+    return rt ? rt->nlevels:0;
+}
+
+unsigned long cfacdb_rtable_ntrans(const cfacdb_rtable_t *rt)
+{
+    return rt ? rt->ntrans:0;
+}
+
+static int rtable_slice(const rtable_csr_t *csr, unsigned int nlevels,
+    unsigned int i, cfacdb_rtable_slice_t *slice)
+{
+    unsigned long k0;
+
+    if (i >= nlevels || !slice) {
+        return CFACDB_FAILURE;
+    }
+
+    k0 = csr->start[i];
+
+    slice->n     = csr->start[i + 1] - k0;
+    slice->lev   = csr->lev   + k0;
+    slice->tid   = csr->tid   + k0;
+    slice->a     = csr->a     + k0;
+    slice->de    = csr->de    + k0;
+    slice->gf    = csr->gf    + k0;
+    slice->mpole = csr->mpole + k0;
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_rtable_from_upper(const cfacdb_rtable_t *rt, unsigned int iu,
+    cfacdb_rtable_slice_t *slice)
+{
+    if (!rt) {
+        return CFACDB_FAILURE;
+    }
+
+    return rtable_slice(&rt->upper, rt->nlevels, iu, slice);
+}
+
+int cfacdb_rtable_to_lower(const cfacdb_rtable_t *rt, unsigned int il,
+    cfacdb_rtable_slice_t *slice)
+{
+    if (!rt) {
+        return CFACDB_FAILURE;
+    }
+
+    return rtable_slice(&rt->lower, rt->nlevels, il, slice);
+}
+
+int cfacdb_rtable_asums(const cfacdb_rtable_t *rt, const double *esc,
+    double *asum)
+{
+    unsigned int i;
+
+    if (!rt || !asum) {
+        return CFACDB_FAILURE;
+    }
+
+    /* in the upper-level view, the transition ID is the position */
+    for (i = 0; i < rt->nlevels; i++) {
+        unsigned long k;
+        double sum = 0.0;
+
+        if (esc) {
+            for (k = rt->upper.start[i]; k < rt->upper.start[i + 1]; k++) {
+                sum += rt->upper.a[k]*esc[k];
+            }
+        } else {
+            for (k = rt->upper.start[i]; k < rt->upper.start[i + 1]; k++) {
+                sum += rt->upper.a[k];
+            }
+        }
+
+        asum[i] = sum;
+    }
+
+    return CFACDB_SUCCESS;
+}
@@ -0,0 +1,1001 @@
+/*
+ * In-memory snapshot of a cFACdb session.
+ */
+
+/*
+ * Copyright (C) 2015 Evgeny Stambulchik
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The whole session (all charge states) is read once through the regular
+ * SQL accessors. Levels are kept in the order used for the level mapping
+ * (nele descending, energy ascending), so that any nele window is a
+ * contiguous range of them; transitions are kept in the SQL order, tagged
+ * with the number of electrons needed for the window selection. Energy
+ * grids shared by consecutive collisional transitions are stored once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "sysdef.h"
+
+#ifdef HAVE_MMAP
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#include "cfacdbP.h"
+
+static size_t snap_strdup(cfacdb_snapshot_t *snap, const char *s)
+{
+    size_t len, offset;
+
+    if (!s) {
+        s = "";
+    }
+    len = strlen(s) + 1;
+
+    if (snap->strpool_len + len > snap->strpool_size) {
+        size_t size = 2*(snap->strpool_size + len);
+        char *p = realloc(snap->strpool, size);
+        if (!p) {
+            return (size_t) -1;
+        }
+        snap->strpool = p;
+        snap->strpool_size = size;
+    }
+
+    offset = snap->strpool_len;
+    memcpy(snap->strpool + offset, s, len);
+    snap->strpool_len += len;
+
+    return offset;
+}
+
+static size_t snap_pool_append(double **pool, size_t *len, size_t *size,
+    const double *x, unsigned int n)
+{
+    size_t offset;
+
+    if (*len + n > *size) {
+        size_t nsize = 2*(*size + n);
+        double *p = realloc(*pool, nsize*sizeof(double));
+        if (!p) {
+            return (size_t) -1;
+        }
+        *pool = p;
+        *size = nsize;
+    }
+
+    offset = *len;
+    memcpy(*pool + offset, x, n*sizeof(double));
+    *len += n;
+
+    return offset;
+}
+
+static int levels_load_sink(const cfacdb_t *cdb,
+    cfacdb_levels_data_t *cbdata, void *udata)
+{
+    cfacdb_snapshot_t *snap = udata;
+    cfacdb_snap_level_t *l;
+    unsigned int i = cdb->lmap[cbdata->ifac - cdb->id_min];
+
+    if (i >= snap->nlevels) {
+        return CFACDB_FAILURE;
+    }
+    l = &snap->levels[i];
+
+    l->ifac   = cbdata->ifac;
+    l->nele   = cbdata->nele;
+    l->energy = cbdata->energy;
+    l->g      = cbdata->g;
+    l->vn     = cbdata->vn;
+    l->vl     = cbdata->vl;
+    l->p      = cbdata->p;
+    l->name   = snap_strdup(snap, cbdata->name);
+    l->ncmplx = snap_strdup(snap, cbdata->ncmplx);
+    l->sname  = snap_strdup(snap, cbdata->sname);
+    if (l->name == (size_t) -1 || l->ncmplx == (size_t) -1 ||
+        l->sname == (size_t) -1) {
+        return CFACDB_FAILURE;
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+static int rtrans_load_sink(const cfacdb_t *cdb,
+    cfacdb_rtrans_data_t *cbdata, void *udata)
+{
+    cfacdb_snapshot_t *snap = udata;
+    cfacdb_snap_rtrans_t *r;
+
+    if (snap->nrtrans >= cdb->stats.rtdim) {
+        return CFACDB_FAILURE;
+    }
+    r = &snap->rtrans[snap->nrtrans++];
+
+    r->ilfac  = snap->levels[cbdata->ii].ifac;
+    r->iufac  = snap->levels[cbdata->fi].ifac;
+    r->nele   = snap->levels[cbdata->ii].nele;
+    r->mpole  = cbdata->mpole;
+    r->de     = cbdata->de;
+    r->gf     = cbdata->gf;
+    r->uta_de = cbdata->uta_de;
+    r->uta_sd = cbdata->uta_sd;
+
+    return CFACDB_SUCCESS;
+}
+
+static int aitrans_load_sink(const cfacdb_t *cdb,
+    cfacdb_aitrans_data_t *cbdata, void *udata)
+{
+    cfacdb_snapshot_t *snap = udata;
+    cfacdb_snap_aitrans_t *r;
+
+    if (snap->naitrans >= cdb->stats.aidim) {
+        return CFACDB_FAILURE;
+    }
+    r = &snap->aitrans[snap->naitrans++];
+
+    r->iufac = snap->levels[cbdata->ii].ifac;
+    r->ilfac = snap->levels[cbdata->fi].ifac;
+    r->nele  = snap->levels[cbdata->ii].nele;
+    r->rate  = cbdata->rate;
+
+    return CFACDB_SUCCESS;
+}
+
+static int ctrans_load_sink(const cfacdb_t *cdb,
+    cfacdb_ctrans_data_t *cbdata, void *udata)
+{
+    cfacdb_snapshot_t *snap = udata;
+    cfacdb_snap_ctrans_t *r;
+    unsigned long nmax = cdb->stats.cedim + cdb->stats.cidim +
+        cdb->stats.pidim;
+    size_t eoffset = (size_t) -1, doffset;
+
+    if (snap->nctrans >= nmax) {
+        return CFACDB_FAILURE;
+    }
+
+    if (snap->nctrans) {
+        const cfacdb_snap_ctrans_t *p = &snap->ctrans[snap->nctrans - 1];
+        if (p->nd == cbdata->nd && !memcmp(snap->ce + p->eoffset,
+                cbdata->e, cbdata->nd*sizeof(double))) {
+            eoffset = p->eoffset;
+        }
+    }
+    if (eoffset == (size_t) -1) {
+        eoffset = snap_pool_append(&snap->ce, &snap->ce_len, &snap->ce_size,
+            cbdata->e, cbdata->nd);
+    }
+    doffset = snap_pool_append(&snap->cd, &snap->cd_len, &snap->cd_size,
+        cbdata->d, cbdata->nd);
+    if (eoffset == (size_t) -1 || doffset == (size_t) -1) {
+        return CFACDB_FAILURE;
+    }
+
+    r = &snap->ctrans[snap->nctrans++];
+
+    r->cid      = cbdata->cid;
+    r->ilfac    = snap->levels[cbdata->ii].ifac;
+    r->iufac    = snap->levels[cbdata->fi].ifac;
+    r->ini_nele = snap->levels[cbdata->ii].nele;
+    r->fin_nele = snap->levels[cbdata->fi].nele;
+    r->type     = cbdata->type;
+    r->kl       = cbdata->kl;
+    r->de       = cbdata->de;
+    r->ap0      = cbdata->ap0;
+    r->ap1      = cbdata->ap1;
+    r->ap2      = cbdata->ap2;
+    r->ap3      = cbdata->ap3;
+    r->nd       = cbdata->nd;
+    r->eoffset  = eoffset;
+    r->doffset  = doffset;
+
+    return CFACDB_SUCCESS;
+}
+
+void cfacdb_snapshot_free(cfacdb_snapshot_t *snap)
+{
+    if (snap && snap->image) {
+#ifdef HAVE_MMAP
+        munmap(snap->image, snap->image_size);
+#else
+        free(snap->image);
+#endif
+        free(snap);
+    } else
+    if (snap) {
+        free(snap->levels);
+        free(snap->strpool);
+        free(snap->rtrans);
+        free(snap->aitrans);
+        free(snap->ctrans);
+        free(snap->ce);
+        free(snap->cd);
+        free(snap);
+    }
+}
+
+static int sessions_load_sink(const cfacdb_t *cdb,
+    cfacdb_sessions_data_t *cbdata, void *udata)
+{
+    cfacdb_snapshot_t *snap = udata;
+
+    if (cbdata->sid == snap->sid) {
+        strncpy(snap->sym, cbdata->sym ? cbdata->sym:"", sizeof(snap->sym));
+        snap->sym[sizeof(snap->sym) - 1] = '\0';
+        snap->uta = cbdata->uta;
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_load_snapshot(cfacdb_t *cdb)
+{
+    cfacdb_snapshot_t *snap;
+    int nele_min, nele_max;
+    unsigned long nc;
+
+    if (!cdb || !cdb->initialized) {
+        return CFACDB_FAILURE;
+    }
+
+    /* the open cursors would switch from SQL to memory under the hood */
+    if (cdb->ncursors) {
+        fprintf(stderr, "cfacdb_load_snapshot(): %u cursor(s) still open\n",
+            cdb->ncursors);
+        return CFACDB_FAILURE;
+    }
+
+    /* opened from a session image, i.e., already in memory */
+    if (!cdb->db) {
+        return CFACDB_SUCCESS;
+    }
+
+    cfacdb_snapshot_free(cdb->snapshot);
+    cdb->snapshot = NULL;
+
+    nele_min = cdb->nele_min;
+    nele_max = cdb->nele_max;
+
+    /* select all charge states of the session */
+    if (cfacdb_init(cdb, cdb->sid, 0, INT_MAX) != CFACDB_SUCCESS) {
+        return CFACDB_FAILURE;
+    }
+
+    snap = calloc(1, sizeof(cfacdb_snapshot_t));
+    if (!snap) {
+        return CFACDB_FAILURE;
+    }
+    snap->sid       = cdb->sid;
+    snap->db_format = cdb->db_format;
+    snap->anum      = cdb->anum;
+    snap->mass      = cdb->mass;
+    snap->id_min    = cdb->id_min;
+    snap->id_max    = cdb->id_max;
+
+    nc = cdb->stats.cedim + cdb->stats.cidim + cdb->stats.pidim;
+
+    snap->nlevels = cdb->stats.ndim;
+    snap->levels  = calloc(snap->nlevels, sizeof(cfacdb_snap_level_t));
+    snap->rtrans  = malloc((cdb->stats.rtdim + 1)*
+        sizeof(cfacdb_snap_rtrans_t));
+    snap->aitrans = malloc((cdb->stats.aidim + 1)*
+        sizeof(cfacdb_snap_aitrans_t));
+    snap->ctrans  = malloc((nc + 1)*sizeof(cfacdb_snap_ctrans_t));
+    if (!snap->levels || !snap->rtrans || !snap->aitrans || !snap->ctrans) {
+        fprintf(stderr, "Failed allocating memory for ndim=%lu\n",
+            cdb->stats.ndim);
+        cfacdb_snapshot_free(snap);
+        return CFACDB_FAILURE;
+    }
+
+    if (cfacdb_sessions(cdb, sessions_load_sink, snap) != CFACDB_SUCCESS ||
+        cfacdb_levels (cdb, levels_load_sink,  snap) != CFACDB_SUCCESS ||
+        cfacdb_rtrans (cdb, rtrans_load_sink,  snap) != CFACDB_SUCCESS ||
+        cfacdb_aitrans(cdb, aitrans_load_sink, snap) != CFACDB_SUCCESS ||
+        cfacdb_ctrans (cdb, ctrans_load_sink,  snap) != CFACDB_SUCCESS) {
+        fprintf(stderr, "Failed loading snapshot of session ID %lu\n",
+            cdb->sid);
+        cfacdb_snapshot_free(snap);
+        return CFACDB_FAILURE;
+    }
+
+    cdb->snapshot = snap;
+
+    /* restore the original selection, now served from memory */
+    return cfacdb_init(cdb, cdb->sid, nele_min, nele_max);
+}
+
+int cfacdb_snapshot_init(cfacdb_t *cdb, int nele_min, int nele_max)
+{
+    const cfacdb_snapshot_t *snap = cdb->snapshot;
+    unsigned long i, ntot;
+    unsigned int n;
+
+    cdb->nele_min = nele_min;
+    cdb->nele_max = nele_max;
+
+    memset(&cdb->stats, 0, sizeof(cfacdb_stats_t));
+
+    ntot = cdb->id_max - cdb->id_min + 1;
+    cdb->lmap = calloc(ntot, sizeof(unsigned int));
+    if (!cdb->lmap) {
+        fprintf(stderr, "Failed allocating memory for ntot=%lu\n", ntot);
+        return CFACDB_FAILURE;
+    }
+
+    for (i = 0, n = 0; i < snap->nlevels; i++) {
+        const cfacdb_snap_level_t *l = &snap->levels[i];
+        if (l->nele <= nele_max && l->nele >= nele_min) {
+            cdb->lmap[l->ifac - cdb->id_min] = n; n++;
+        }
+    }
+    cdb->stats.ndim = n;
+    if (cdb->stats.ndim == 0) {
+        fprintf(stderr, "Empty or non-existing session id %lu\n", cdb->sid);
+        return CFACDB_FAILURE;
+    }
+
+    for (i = 0; i < snap->nrtrans; i++) {
+        const cfacdb_snap_rtrans_t *r = &snap->rtrans[i];
+        if (r->nele <= nele_max && r->nele >= nele_min) {
+            cdb->stats.rtdim++;
+        }
+    }
+
+    for (i = 0; i < snap->naitrans; i++) {
+        const cfacdb_snap_aitrans_t *r = &snap->aitrans[i];
+        if (r->nele <= nele_max && r->nele > nele_min) {
+            cdb->stats.aidim++;
+        }
+    }
+
+    for (i = 0; i < snap->nctrans; i++) {
+        const cfacdb_snap_ctrans_t *r = &snap->ctrans[i];
+        if (r->ini_nele <= nele_max && r->fin_nele >= nele_min) {
+            switch (r->type) {
+            case CFACDB_CS_CE:
+                cdb->stats.cedim++;
+                break;
+            case CFACDB_CS_CI:
+                cdb->stats.cidim++;
+                break;
+            case CFACDB_CS_PI:
+                cdb->stats.pidim++;
+                break;
+            }
+        }
+    }
+
+    cdb->initialized = CFACDB_TRUE;
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_snapshot_sessions(const cfacdb_t *cdb,
+    cfacdb_sessions_sink_t sink, void *udata)
+{
+    const cfacdb_snapshot_t *snap = cdb->snapshot;
+    cfacdb_sessions_data_t cbdata;
+
+    cbdata.sid      = snap->sid;
+    cbdata.sym      = snap->sym;
+    cbdata.anum     = snap->anum;
+    cbdata.mass     = snap->mass;
+    cbdata.nele_max = snap->nlevels ? snap->levels[0].nele:0;
+    cbdata.nele_min = snap->nlevels ? snap->levels[snap->nlevels - 1].nele:0;
+    cbdata.uta      = snap->uta;
+
+    return sink(cdb, &cbdata, udata);
+}
+
+int cfacdb_snapshot_cstates(cfacdb_t *cdb,
+    cfacdb_cstates_sink_t sink, void *udata)
+{
+    const cfacdb_snapshot_t *snap = cdb->snapshot;
+    unsigned long i = 0;
+
+    while (i < snap->nlevels) {
+        cfacdb_cstates_data_t cbdata;
+        int nele = snap->levels[i].nele;
+
+        /* levels of a charge state go by increasing energy */
+        cbdata.nele    = nele;
+        cbdata.e_gs    = snap->levels[i].energy;
+        cbdata.nlevels = 0;
+        while (i < snap->nlevels && snap->levels[i].nele == nele) {
+            cbdata.nlevels++;
+            i++;
+        }
+
+        if (nele <= cdb->nele_max && nele >= cdb->nele_min) {
+            if (sink(cdb, &cbdata, udata) != CFACDB_SUCCESS) {
+                return CFACDB_FAILURE;
+            }
+        }
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_snapshot_levels(cfacdb_t *cdb,
+    cfacdb_levels_sink_t sink, void *udata)
+{
+    const cfacdb_snapshot_t *snap = cdb->snapshot;
+    unsigned long k;
+    unsigned int i = 0;
+
+    for (k = 0; k < snap->nlevels; k++) {
+        const cfacdb_snap_level_t *l = &snap->levels[k];
+        cfacdb_levels_data_t cbdata;
+
+        if (l->nele > cdb->nele_max || l->nele < cdb->nele_min) {
+            continue;
+        }
+
+        cbdata.i      = i;
+        cbdata.ifac   = l->ifac;
+        cbdata.name   = snap->strpool + l->name;
+        cbdata.nele   = l->nele;
+        cbdata.energy = l->energy;
+        cbdata.g      = l->g;
+        cbdata.vn     = l->vn;
+        cbdata.vl     = l->vl;
+        cbdata.p      = l->p;
+        cbdata.ncmplx = snap->strpool + l->ncmplx;
+        cbdata.sname  = snap->strpool + l->sname;
+
+        if (sink(cdb, &cbdata, udata) != CFACDB_SUCCESS) {
+            return CFACDB_FAILURE;
+        }
+        i++;
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_snapshot_rtrans_get(const cfacdb_t *cdb, unsigned long k,
+    cfacdb_rtrans_data_t *cbdata)
+{
+    const cfacdb_snap_rtrans_t *r = &cdb->snapshot->rtrans[k];
+
+    if (r->nele > cdb->nele_max || r->nele < cdb->nele_min) {
+        return CFACDB_FALSE;
+    }
+
+    cbdata->ii     = cdb->lmap[r->ilfac - cdb->id_min];
+    cbdata->fi     = cdb->lmap[r->iufac - cdb->id_min];
+    cbdata->mpole  = r->mpole;
+    cbdata->de     = r->de;
+    cbdata->gf     = r->gf;
+    cbdata->uta_de = r->uta_de;
+    cbdata->uta_sd = r->uta_sd;
+
+    return CFACDB_TRUE;
+}
+
+int cfacdb_snapshot_rtrans(cfacdb_t *cdb,
+    cfacdb_rtrans_sink_t sink, void *udata)
+{
+    unsigned long k;
+
+    for (k = 0; k < cdb->snapshot->nrtrans; k++) {
+        cfacdb_rtrans_data_t cbdata;
+
+        if (!cfacdb_snapshot_rtrans_get(cdb, k, &cbdata)) {
+            continue;
+        }
+
+        if (sink(cdb, &cbdata, udata) != CFACDB_SUCCESS) {
+            return CFACDB_FAILURE;
+        }
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_snapshot_aitrans_get(const cfacdb_t *cdb, unsigned long k,
+    cfacdb_aitrans_data_t *cbdata)
+{
+    const cfacdb_snap_aitrans_t *r = &cdb->snapshot->aitrans[k];
+
+    if (r->nele > cdb->nele_max || r->nele <= cdb->nele_min) {
+        return CFACDB_FALSE;
+    }
+
+    cbdata->ii   = cdb->lmap[r->iufac - cdb->id_min];
+    cbdata->fi   = cdb->lmap[r->ilfac - cdb->id_min];
+    cbdata->rate = r->rate;
+
+    return CFACDB_TRUE;
+}
+
+int cfacdb_snapshot_aitrans(cfacdb_t *cdb,
+    cfacdb_aitrans_sink_t sink, void *udata)
+{
+    unsigned long k;
+
+    for (k = 0; k < cdb->snapshot->naitrans; k++) {
+        cfacdb_aitrans_data_t cbdata;
+
+        if (!cfacdb_snapshot_aitrans_get(cdb, k, &cbdata)) {
+            continue;
+        }
+
+        if (sink(cdb, &cbdata, udata) != CFACDB_SUCCESS) {
+            return CFACDB_FAILURE;
+        }
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_snapshot_ctrans(cfacdb_t *cdb,
+    cfacdb_ctrans_sink_t sink, void *udata)
+{
+    const cfacdb_snapshot_t *snap = cdb->snapshot;
+    unsigned long k;
+    int retval = CFACDB_SUCCESS;
+
+    for (k = 0; k < snap->nctrans && retval == CFACDB_SUCCESS; k++) {
+        const cfacdb_snap_ctrans_t *r = &snap->ctrans[k];
+        cfacdb_ctrans_data_t cbdata;
+
+        if (r->ini_nele > cdb->nele_max || r->fin_nele < cdb->nele_min) {
+            continue;
+        }
+
+        cbdata.cid  = r->cid;
+        cbdata.ii   = cdb->lmap[r->ilfac - cdb->id_min];
+        cbdata.fi   = cdb->lmap[r->iufac - cdb->id_min];
+        cbdata.type = r->type;
+        cbdata.de   = r->de;
+        cbdata.kl   = r->kl;
+        cbdata.ap0  = r->ap0;
+        cbdata.ap1  = r->ap1;
+        cbdata.ap2  = r->ap2;
+        cbdata.ap3  = r->ap3;
+        cbdata.nd   = r->nd;
+        cbdata.e    = snap->ce + r->eoffset;
+        cbdata.d    = snap->cd + r->doffset;
+
+        retval = sink(cdb, &cbdata, udata);
+    }
+
+    return retval;
+}
+
+
+/*
+ * Session images: the snapshot arrays written as is, after a header, to a
+ * file that can be mapped by any number of processes. The layout follows
+ * the in-memory structures, so an image is only usable on the platform
+ * (endianness, word size, compiler) it was created on; this is verified
+ * when opening it.
+ */
+
+#define IMAGE_MAGIC     "cFACdbI"
+#define IMAGE_VERSION   1
+#define IMAGE_ALIGN     16
+
+#define IMAGE_ALIGNED(n) (((n) + IMAGE_ALIGN - 1)/IMAGE_ALIGN*IMAGE_ALIGN)
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order;        /* IMAGE_BYTE_ORDER as written */
+    unsigned int rec_sizes[5];
+
+    unsigned long int sid;
+    char sym[8];
+    int uta;
+    int db_format;
+    unsigned int anum;
+    double mass;
+    unsigned int id_min, id_max;
+
+    unsigned long nlevels, nrtrans, naitrans, nctrans;
+    size_t strpool_len, ce_len, cd_len;
+
+    size_t levels, strpool, rtrans, aitrans, ctrans, ce, cd;  /* offsets */
+    size_t size;
+} image_header_t;
+
+#define IMAGE_BYTE_ORDER 0x01020304U
+
+static void image_rec_sizes(unsigned int *rec_sizes)
+{
+    rec_sizes[0] = sizeof(image_header_t);
+    rec_sizes[1] = sizeof(cfacdb_snap_level_t);
+    rec_sizes[2] = sizeof(cfacdb_snap_rtrans_t);
+    rec_sizes[3] = sizeof(cfacdb_snap_aitrans_t);
+    rec_sizes[4] = sizeof(cfacdb_snap_ctrans_t);
+}
+
+static int image_write(FILE *fp, size_t offset, const void *data, size_t len)
+{
+    if (!len) {
+        return CFACDB_SUCCESS;
+    }
+    if (fseek(fp, offset, SEEK_SET) || fwrite(data, 1, len, fp) != len) {
+        return CFACDB_FAILURE;
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+int cfacdb_save_snapshot(const cfacdb_t *cdb, const char *fname)
+{
+    const cfacdb_snapshot_t *snap;
+    image_header_t h;
+    char *tmpname;
+    FILE *fp;
+    size_t offset;
+    int rc;
+
+    if (!cdb || !cdb->snapshot || !fname) {
+        return CFACDB_FAILURE;
+    }
+    snap = cdb->snapshot;
+
+    memset(&h, 0, sizeof(h));
+    strcpy(h.magic, IMAGE_MAGIC);
+    h.version    = IMAGE_VERSION;
+    h.byte_order = IMAGE_BYTE_ORDER;
+    image_rec_sizes(h.rec_sizes);
+
+    h.sid       = snap->sid;
+    memcpy(h.sym, snap->sym, sizeof(h.sym));
+    h.uta       = snap->uta;
+    h.db_format = snap->db_format;
+    h.anum      = snap->anum;
+    h.mass      = snap->mass;
+    h.id_min    = snap->id_min;
+    h.id_max    = snap->id_max;
+
+    h.nlevels     = snap->nlevels;
+    h.nrtrans     = snap->nrtrans;
+    h.naitrans    = snap->naitrans;
+    h.nctrans     = snap->nctrans;
+    h.strpool_len = snap->strpool_len;
+    h.ce_len      = snap->ce_len;
+    h.cd_len      = snap->cd_len;
+
+    offset = IMAGE_ALIGNED(sizeof(h));
+    h.levels  = offset;
+    offset = IMAGE_ALIGNED(offset + h.nlevels*sizeof(cfacdb_snap_level_t));
+    h.rtrans  = offset;
+    offset = IMAGE_ALIGNED(offset + h.nrtrans*sizeof(cfacdb_snap_rtrans_t));
+    h.aitrans = offset;
+    offset = IMAGE_ALIGNED(offset + h.naitrans*sizeof(cfacdb_snap_aitrans_t));
+    h.ctrans  = offset;
+    offset = IMAGE_ALIGNED(offset + h.nctrans*sizeof(cfacdb_snap_ctrans_t));
+    h.ce      = offset;
+    offset = IMAGE_ALIGNED(offset + h.ce_len*sizeof(double));
+    h.cd      = offset;
+    offset = IMAGE_ALIGNED(offset + h.cd_len*sizeof(double));
+    h.strpool = offset;
+    h.size    = offset + h.strpool_len;
+
+    /* write to a temporary file first, so that the image appears
+       atomically to processes waiting for it */
+    tmpname = malloc(strlen(fname) + 5);
+    if (!tmpname) {
+        return CFACDB_FAILURE;
+    }
+    sprintf(tmpname, "%s.tmp", fname);
+
+    fp = fopen(tmpname, "wb");
+    if (!fp) {
+        fprintf(stderr, "Cannot open \"%s\" for writing\n", tmpname);
+        free(tmpname);
+        return CFACDB_FAILURE;
+    }
+
+    rc = image_write(fp, 0, &h, sizeof(h));
+    if (rc == CFACDB_SUCCESS) {
+        rc = image_write(fp, h.levels, snap->levels,
+            h.nlevels*sizeof(cfacdb_snap_level_t));
+    }
+    if (rc == CFACDB_SUCCESS) {
+        rc = image_write(fp, h.rtrans, snap->rtrans,
+            h.nrtrans*sizeof(cfacdb_snap_rtrans_t));
+    }
+    if (rc == CFACDB_SUCCESS) {
+        rc = image_write(fp, h.aitrans, snap->aitrans,
+            h.naitrans*sizeof(cfacdb_snap_aitrans_t));
+    }
+    if (rc == CFACDB_SUCCESS) {
+        rc = image_write(fp, h.ctrans, snap->ctrans,
+            h.nctrans*sizeof(cfacdb_snap_ctrans_t));
+    }
+    if (rc == CFACDB_SUCCESS) {
+        rc = image_write(fp, h.ce, snap->ce, h.ce_len*sizeof(double));
+    }
+    if (rc == CFACDB_SUCCESS) {
+        rc = image_write(fp, h.cd, snap->cd, h.cd_len*sizeof(double));
+    }
+    if (rc == CFACDB_SUCCESS) {
+        rc = image_write(fp, h.strpool, snap->strpool, h.strpool_len);
+    }
+
+    if (fclose(fp) != 0) {
+        rc = CFACDB_FAILURE;
+    }
+    if (rc == CFACDB_SUCCESS && rename(tmpname, fname) != 0) {
+        rc = CFACDB_FAILURE;
+    }
+    if (rc != CFACDB_SUCCESS) {
+        fprintf(stderr, "Failed writing session image \"%s\"\n", fname);
+        remove(tmpname);
+    }
+    free(tmpname);
+
+    return rc;
+}
+
+int cfacdb_is_image(const char *fname)
+{
+    char magic[8];
+    FILE *fp = fopen(fname, "rb");
+    int retval = CFACDB_FALSE;
+
+    if (fp) {
+        if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+            !memcmp(magic, IMAGE_MAGIC, sizeof(magic))) {
+            retval = CFACDB_TRUE;
+        }
+        fclose(fp);
+    }
+
+    return retval;
+}
+
+/* map (or, lacking mmap, read) the whole file */
+static void *image_map(const char *fname, size_t *size)
+{
+    void *image;
+#ifdef HAVE_MMAP
+    struct stat st;
+    int fd = open(fname, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    *size = st.st_size;
+
+    image = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+#else
+    FILE *fp = fopen(fname, "rb");
+    long len;
+
+    if (!fp) {
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) <= 0) {
+        fclose(fp);
+        return NULL;
+    }
+    *size = len;
+    rewind(fp);
+
+    image = malloc(*size);
+    if (image && fread(image, 1, *size, fp) != *size) {
+        free(image);
+        image = NULL;
+    }
+    fclose(fp);
+#endif
+
+    return image;
+}
+
+/* does the section of n records of rec_size at offset fit in the image? */
+static int image_section_ok(size_t offset, unsigned long n, size_t rec_size,
+    size_t size)
+{
+    if (offset % IMAGE_ALIGN || offset > size) {
+        return CFACDB_FALSE;
+    }
+    /* n*rec_size <= size - offset, without overflow */
+    if (n > (size - offset)/rec_size) {
+        return CFACDB_FALSE;
+    }
+
+    return CFACDB_TRUE;
+}
+
+static int image_level_ok(const image_header_t *h, unsigned int ifac)
+{
+    return ifac >= h->id_min && ifac <= h->id_max;
+}
+
+/*
+ * check that all the sections lie within the image and all the references
+ * in the records (level IDs, string and e/d pool offsets) are in range
+ */
+static int image_validate(const char *image, size_t size)
+{
+    const image_header_t *h = (const image_header_t *) image;
+    const cfacdb_snap_level_t *levels;
+    const cfacdb_snap_rtrans_t *rtrans;
+    const cfacdb_snap_aitrans_t *aitrans;
+    const cfacdb_snap_ctrans_t *ctrans;
+    unsigned long i;
+
+    if (h->size != size || h->strpool + h->strpool_len != size ||
+        h->id_min > h->id_max ||
+        !image_section_ok(h->levels,  h->nlevels,
+            sizeof(cfacdb_snap_level_t), size) ||
+        !image_section_ok(h->rtrans,  h->nrtrans,
+            sizeof(cfacdb_snap_rtrans_t), size) ||
+        !image_section_ok(h->aitrans, h->naitrans,
+            sizeof(cfacdb_snap_aitrans_t), size) ||
+        !image_section_ok(h->ctrans,  h->nctrans,
+            sizeof(cfacdb_snap_ctrans_t), size) ||
+        !image_section_ok(h->ce, h->ce_len, sizeof(double), size) ||
+        !image_section_ok(h->cd, h->cd_len, sizeof(double), size) ||
+        !image_section_ok(h->strpool, h->strpool_len, 1, size)) {
+        return CFACDB_FAILURE;
+    }
+
+    /* the last string must be terminated, then all of them are */
+    if (h->strpool_len && image[h->strpool + h->strpool_len - 1] != '\0') {
+        return CFACDB_FAILURE;
+    }
+
+    levels = (const cfacdb_snap_level_t *) (image + h->levels);
+    for (i = 0; i < h->nlevels; i++) {
+        const cfacdb_snap_level_t *l = &levels[i];
+        if (!image_level_ok(h, l->ifac) ||
+            l->name   >= h->strpool_len ||
+            l->ncmplx >= h->strpool_len ||
+            l->sname  >= h->strpool_len) {
+            return CFACDB_FAILURE;
+        }
+    }
+
+    rtrans = (const cfacdb_snap_rtrans_t *) (image + h->rtrans);
+    for (i = 0; i < h->nrtrans; i++) {
+        if (!image_level_ok(h, rtrans[i].ilfac) ||
+            !image_level_ok(h, rtrans[i].iufac)) {
+            return CFACDB_FAILURE;
+        }
+    }
+
+    aitrans = (const cfacdb_snap_aitrans_t *) (image + h->aitrans);
+    for (i = 0; i < h->naitrans; i++) {
+        if (!image_level_ok(h, aitrans[i].ilfac) ||
+            !image_level_ok(h, aitrans[i].iufac)) {
+            return CFACDB_FAILURE;
+        }
+    }
+
+    ctrans = (const cfacdb_snap_ctrans_t *) (image + h->ctrans);
+    for (i = 0; i < h->nctrans; i++) {
+        const cfacdb_snap_ctrans_t *r = &ctrans[i];
+        if (!image_level_ok(h, r->ilfac) || !image_level_ok(h, r->iufac) ||
+            r->eoffset > h->ce_len || r->nd > h->ce_len - r->eoffset ||
+            r->doffset > h->cd_len || r->nd > h->cd_len - r->doffset) {
+            return CFACDB_FAILURE;
+        }
+    }
+
+    return CFACDB_SUCCESS;
+}
+
+cfacdb_t *cfacdb_open_image(const char *fname)
+{
+    cfacdb_t *cdb;
+    cfacdb_snapshot_t *snap;
+    const image_header_t *h;
+    unsigned int rec_sizes[5];
+    char *image;
+    size_t size;
+
+    image = image_map(fname, &size);
+    if (!image) {
+        fprintf(stderr, "Cannot map session image \"%s\"\n", fname);
+        return NULL;
+    }
+    h = (const image_header_t *) image;
+
+    image_rec_sizes(rec_sizes);
+    if (size < sizeof(image_header_t) ||
+        memcmp(h->magic, IMAGE_MAGIC, sizeof(h->magic)) ||
+        h->version != IMAGE_VERSION || h->byte_order != IMAGE_BYTE_ORDER ||
+        memcmp(h->rec_sizes, rec_sizes, sizeof(rec_sizes)) ||
+        image_validate(image, size) != CFACDB_SUCCESS) {
+        fprintf(stderr,
+            "\"%s\" is not a valid session image for this platform\n", fname);
+#ifdef HAVE_MMAP
+        munmap(image, size);
+#else
+        free(image);
+#endif
+        return NULL;
+    }
+
+    cdb  = calloc(1, sizeof(cfacdb_t));
+    snap = calloc(1, sizeof(cfacdb_snapshot_t));
+    if (!cdb || !snap) {
+        free(cdb);
+        free(snap);
+#ifdef HAVE_MMAP
+        munmap(image, size);
+#else
+        free(image);
+#endif
+        return NULL;
+    }
+
+    snap->image      = image;
+    snap->image_size = size;
+
+    snap->sid       = h->sid;
+    memcpy(snap->sym, h->sym, sizeof(snap->sym));
+    snap->uta       = h->uta;
+    snap->db_format = h->db_format;
+    snap->anum      = h->anum;
+    snap->mass      = h->mass;
+    snap->id_min    = h->id_min;
+    snap->id_max    = h->id_max;
+
+    snap->nlevels     = h->nlevels;
+    snap->levels      = (cfacdb_snap_level_t *) (image + h->levels);
+    snap->nrtrans     = h->nrtrans;
+    snap->rtrans      = (cfacdb_snap_rtrans_t *) (image + h->rtrans);
+    snap->naitrans    = h->naitrans;
+    snap->aitrans     = (cfacdb_snap_aitrans_t *) (image + h->aitrans);
+    snap->nctrans     = h->nctrans;
+    snap->ctrans      = (cfacdb_snap_ctrans_t *) (image + h->ctrans);
+    snap->ce          = (double *) (image + h->ce);
+    snap->cd          = (double *) (image + h->cd);
+    snap->ce_len      = h->ce_len;
+    snap->cd_len      = h->cd_len;
+    snap->strpool     = image + h->strpool;
+    snap->strpool_len = h->strpool_len;
+
+    cdb->snapshot  = snap;
+    cdb->nsessions = 1;
+    cdb->db_format = snap->db_format;
+    cdb->anum      = snap->anum;
+    cdb->mass      = snap->mass;
+    cdb->id_min    = snap->id_min;
+    cdb->id_max    = snap->id_max;
+    cdb->nthreads  = 1;
+    cdb->rcache.tol = CFACDB_CACHE_TOL_DEFAULT;
+
+    return cdb;
+}
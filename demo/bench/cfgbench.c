@@ -0,0 +1,105 @@
+/*
+** time of coupling a large configuration expansion on 1 and n threads.
+**
+** usage: cfgbench [nthreads [cfg ...]]
+**
+** the configurations (by default the two given below, 3549
+** configurations in all) are added to one group with cfac_add_config(),
+** once serially and once on nthreads (default 4) threads. the states of
+** all symmetries are hashed in order; the two runs must agree.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cfacP.h"
+
+static const char *default_cfgs[] = {
+  "1s2 2*8 3*5 4*2",
+  "1s2 2*8 3*6 4*1",
+};
+
+static double WallTime(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1E-9*t.tv_nsec;
+}
+
+static int Run(unsigned int nthreads, int ncfgs, const char **cfgs,
+	       unsigned long *hash) {
+  cfac_t *cfac;
+  SYMMETRY *sym;
+  STATE *s;
+  double t0, t1;
+  long nstates;
+  int i, k, gid;
+
+  cfac = cfac_new();
+  if (!cfac || cfac_set_nthreads(cfac, nthreads) != CFAC_SUCCESS) {
+    printf("cannot set up the cfac context\n");
+    return -1;
+  }
+
+  gid = -1;
+  t0 = WallTime();
+  for (i = 0; i < ncfgs; i++) {
+    gid = cfac_add_config(cfac, "bench", cfgs[i], 0);
+    if (gid < 0) {
+      printf("cannot add the configuration %s\n", cfgs[i]);
+      cfac_free(cfac);
+      return -1;
+    }
+  }
+  t1 = WallTime();
+
+  *hash = 0;
+  nstates = 0;
+  for (k = 0; k < MAX_SYMMETRIES; k++) {
+    sym = &(cfac->symmetry_list[k]);
+    for (i = 0; i < sym->n_states; i++) {
+      s = ArrayGet(&(sym->states), i);
+      *hash = *hash*1000003 + (s->kgroup*131 + s->kcfg)*131 + s->kstate + k;
+      nstates++;
+    }
+  }
+
+  printf("%2u threads: %6d configurations, %8ld states, %8.3f s, "
+	 "hash %016lx\n", nthreads, cfac->cfg_groups[gid].n_cfgs, nstates,
+	 t1-t0, *hash);
+
+  cfac_free(cfac);
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long h1, hn;
+  const char **cfgs;
+  int ncfgs, nthreads;
+
+  nthreads = argc > 1 ? atoi(argv[1]) : 4;
+  if (nthreads < 1) {
+    printf("usage: %s [nthreads [cfg ...]]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 2) {
+    cfgs = (const char **) argv + 2;
+    ncfgs = argc - 2;
+  } else {
+    cfgs = default_cfgs;
+    ncfgs = sizeof(default_cfgs)/sizeof(char *);
+  }
+
+  if (Run(1, ncfgs, cfgs, &h1) < 0 ||
+      Run(nthreads, ncfgs, cfgs, &hn) < 0) {
+    return 1;
+  }
+  if (h1 != hn) {
+    printf("the states differ between 1 and %d threads\n", nthreads);
+    return 1;
+  }
+
+  return 0;
+}
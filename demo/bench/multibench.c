@@ -0,0 +1,94 @@
+/*
+** startup cost of the cfac context and throughput of a MULTI cache.
+**
+** usage: multibench [n]
+**
+** times cfac_new(), which sets up the radial and angular MULTI caches,
+** then does n (default 200000) insertions and lookups on a 5-index
+** MULTI of doubles, as the Slater integral cache does. the peak RSS is
+** reported after each phase.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "cfacP.h"
+
+static double WallTime(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1E-9*t.tv_nsec;
+}
+
+static long MaxRSS(void) {
+  struct rusage r;
+
+  getrusage(RUSAGE_SELF, &r);
+  return r.ru_maxrss;
+}
+
+static void SlaterIndex(int i, int *k) {
+  int j;
+
+  k[0] = i;
+  for (j = 1; j < 5; j++) {
+    k[j] = (i*7 + j*13)%97 + (j*i)%31;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  cfac_t *cfac;
+  MULTI ma;
+  int blocks[5] = {MULTI_BLOCK6, MULTI_BLOCK6, MULTI_BLOCK6,
+		   MULTI_BLOCK6, MULTI_BLOCK6};
+  int i, n, k[5];
+  double t0, t1, *p;
+
+  n = argc > 1 ? atoi(argv[1]) : 200000;
+  if (n <= 0) {
+    printf("usage: %s [n]\n", argv[0]);
+    return 1;
+  }
+
+  t0 = WallTime();
+  cfac = cfac_new();
+  t1 = WallTime();
+  if (!cfac) {
+    printf("cfac_new failed\n");
+    return 1;
+  }
+  printf("cfac_new: %10.3f ms, max RSS %8ld kB\n", 1E3*(t1-t0), MaxRSS());
+  cfac_free(cfac);
+
+  t0 = WallTime();
+  MultiInit(&ma, sizeof(double), 5, blocks, NULL, InitDoubleData);
+  for (i = 0; i < n; i++) {
+    SlaterIndex(i, k);
+    p = MultiSet(&ma, k, NULL);
+    if (!p) {
+      printf("MultiSet failed at %d\n", i);
+      return 1;
+    }
+    *p = i;
+  }
+  t1 = WallTime();
+  printf("%d sets: %10.3f ms, max RSS %8ld kB\n", n, 1E3*(t1-t0), MaxRSS());
+
+  t0 = WallTime();
+  for (i = 0; i < n; i++) {
+    SlaterIndex(i, k);
+    p = MultiGet(&ma, k);
+    if (!p || *p != i) {
+      printf("MultiGet mismatch at %d\n", i);
+      return 1;
+    }
+  }
+  t1 = WallTime();
+  printf("%d gets: %10.3f ms\n", n, 1E3*(t1-t0));
+  MultiFree(&ma);
+
+  return 0;
+}
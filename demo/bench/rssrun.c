@@ -0,0 +1,57 @@
+/*
+** peak memory of a command, e.g. sfac on one of the demos.
+**
+** usage: rssrun command [arg ...]
+**
+** runs the command, waits for it and reports its wall time and its
+** maximum resident set size. the exit status of the command is returned.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+static double WallTime(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1E-9*t.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  struct rusage r;
+  double t0, t1;
+  pid_t pid;
+  int status;
+
+  if (argc < 2) {
+    printf("usage: %s command [arg ...]\n", argv[0]);
+    return 1;
+  }
+
+  t0 = WallTime();
+  pid = fork();
+  if (pid < 0) {
+    printf("cannot fork\n");
+    return 1;
+  }
+  if (pid == 0) {
+    execvp(argv[1], argv + 1);
+    printf("cannot run %s\n", argv[1]);
+    fflush(stdout);
+    _exit(127);
+  }
+  if (wait4(pid, &status, 0, &r) < 0) {
+    printf("cannot wait for %s\n", argv[1]);
+    return 1;
+  }
+  t1 = WallTime();
+
+  printf("%s: %8.3f s, max RSS %8ld kB\n", argv[1], t1-t0, r.ru_maxrss);
+
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,196 @@
+/*
+** throughput of the 3j, 6j and 9j symbols of angular.c against the GSL
+** coupling routines they replace.
+**
+** usage: wbench [2jmax]
+**
+** all allowed symbols with 2j <= 2jmax (default 14; 6 for the 9j) are
+** evaluated once through W3j(), W6j() and W9j(), which fills their
+** caches, then three more times from the cache, and once through GSL.
+** the time per call and the largest difference to GSL, relative for
+** symbols above 1E-10 in magnitude, are reported.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <gsl/gsl_sf_coupling.h>
+
+#include "angular.h"
+
+#define NREPEAT 3
+#define MAXTRIAD 1024
+
+/* the arguments of n symbols of type 3, 6 or 9, na of them each */
+typedef struct _SYMBOL_LIST_ {
+  int type, na;
+  int n, nalloc;
+  int *a;
+} SYMBOL_LIST;
+
+static double WallTime(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1E-9*t.tv_nsec;
+}
+
+/* the triangle rule, with a + b + c even */
+static int Allowed(int a, int b, int c) {
+  return !((a+b+c)&1) && c >= abs(a-b) && c <= a+b;
+}
+
+static void AddSymbol(SYMBOL_LIST *s, const int *a) {
+  int i;
+
+  if (s->n == s->nalloc) {
+    s->nalloc = s->nalloc ? 2*s->nalloc : 1024;
+    s->a = realloc(s->a, sizeof(int)*s->na*s->nalloc);
+    if (!s->a) {
+      printf("cannot enlarge the symbol list\n");
+      exit(1);
+    }
+  }
+  for (i = 0; i < s->na; i++) {
+    s->a[s->n*s->na + i] = a[i];
+  }
+  s->n++;
+}
+
+static double EvalSymbol(const SYMBOL_LIST *s, int i, int gsl) {
+  const int *a = s->a + i*s->na;
+
+  switch (s->type) {
+  case 3:
+    return gsl ? gsl_sf_coupling_3j(a[0], a[1], a[2], a[3], a[4], a[5])
+      : W3j(a[0], a[1], a[2], a[3], a[4], a[5]);
+  case 6:
+    return gsl ? gsl_sf_coupling_6j(a[0], a[1], a[2], a[3], a[4], a[5])
+      : W6j(a[0], a[1], a[2], a[3], a[4], a[5]);
+  default:
+    return gsl ? gsl_sf_coupling_9j(a[0], a[1], a[2], a[3], a[4], a[5],
+				    a[6], a[7], a[8])
+      : W9j(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+  }
+}
+
+static void Run(const char *name, const SYMBOL_LIST *s) {
+  double t0, t1, t2, t3, x, y, d, dmax, sum;
+  int i, r;
+
+  sum = 0.0;
+  t0 = WallTime();
+  for (i = 0; i < s->n; i++) sum += EvalSymbol(s, i, 0);
+  t1 = WallTime();
+  for (r = 0; r < NREPEAT; r++) {
+    for (i = 0; i < s->n; i++) sum += EvalSymbol(s, i, 0);
+  }
+  t2 = WallTime();
+  for (i = 0; i < s->n; i++) sum += EvalSymbol(s, i, 1);
+  t3 = WallTime();
+
+  dmax = 0.0;
+  for (i = 0; i < s->n; i++) {
+    x = EvalSymbol(s, i, 0);
+    y = EvalSymbol(s, i, 1);
+    /* relative, except for the symbols that vanish by cancellation */
+    d = fabs(x - y);
+    if (fabs(y) > 1E-10) d /= fabs(y);
+    if (d > dmax) dmax = d;
+  }
+
+  printf("%s: %8d symbols, first %7.1f ns, cached %7.1f ns, "
+	 "GSL %7.1f ns per call, max rel. diff %.1E (%g)\n",
+	 name, s->n, 1E9*(t1-t0)/s->n, 1E9*(t2-t1)/(NREPEAT*s->n),
+	 1E9*(t3-t2)/s->n, dmax, sum);
+}
+
+int main(int argc, char *argv[]) {
+  SYMBOL_LIST s3 = {3, 6, 0, 0, NULL};
+  SYMBOL_LIST s6 = {6, 6, 0, 0, NULL};
+  SYMBOL_LIST s9 = {9, 9, 0, 0, NULL};
+  int triad[MAXTRIAD][3], ntriad;
+  int jmax, j9max, a[9], i, j, k, l;
+
+  jmax = argc > 1 ? atoi(argv[1]) : 14;
+  if (jmax < 0) {
+    printf("usage: %s [2jmax]\n", argv[0]);
+    return 1;
+  }
+  j9max = jmax < 6 ? jmax : 6;
+
+  /* the 3j symbols with m3 = -m1-m2 */
+  for (a[0] = 0; a[0] <= jmax; a[0]++) {
+    for (a[1] = 0; a[1] <= jmax; a[1]++) {
+      for (a[2] = abs(a[0]-a[1]); a[2] <= a[0]+a[1] && a[2] <= jmax;
+	   a[2] += 2) {
+	for (a[3] = -a[0]; a[3] <= a[0]; a[3] += 2) {
+	  for (a[4] = -a[1]; a[4] <= a[1]; a[4] += 2) {
+	    a[5] = -a[3]-a[4];
+	    if (abs(a[5]) > a[2]) continue;
+	    AddSymbol(&s3, a);
+	  }
+	}
+      }
+    }
+  }
+
+  for (a[0] = 0; a[0] <= jmax; a[0]++) {
+    for (a[1] = 0; a[1] <= jmax; a[1]++) {
+      for (a[2] = 0; a[2] <= jmax; a[2]++) {
+	if (!Allowed(a[0], a[1], a[2])) continue;
+	for (a[3] = 0; a[3] <= jmax; a[3]++) {
+	  for (a[4] = 0; a[4] <= jmax; a[4]++) {
+	    if (!Allowed(a[3], a[4], a[2])) continue;
+	    for (a[5] = 0; a[5] <= jmax; a[5]++) {
+	      if (!Allowed(a[0], a[4], a[5]) ||
+		  !Allowed(a[3], a[1], a[5])) continue;
+	      AddSymbol(&s6, a);
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  /* the 9j symbols, row by row: all triads, then the column triangles */
+  ntriad = 0;
+  for (i = 0; i <= j9max; i++) {
+    for (j = 0; j <= j9max; j++) {
+      for (k = 0; k <= j9max; k++) {
+	if (!Allowed(i, j, k) || ntriad == MAXTRIAD) continue;
+	triad[ntriad][0] = i;
+	triad[ntriad][1] = j;
+	triad[ntriad][2] = k;
+	ntriad++;
+      }
+    }
+  }
+  for (i = 0; i < ntriad; i++) {
+    for (j = 0; j < ntriad; j++) {
+      for (k = 0; k < ntriad; k++) {
+	for (l = 0; l < 3; l++) {
+	  a[l] = triad[i][l];
+	  a[3+l] = triad[j][l];
+	  a[6+l] = triad[k][l];
+	}
+	if (!Allowed(a[0], a[3], a[6]) ||
+	    !Allowed(a[1], a[4], a[7]) ||
+	    !Allowed(a[2], a[5], a[8])) continue;
+	AddSymbol(&s9, a);
+      }
+    }
+  }
+
+  Run("3j", &s3);
+  Run("6j", &s6);
+  Run("9j", &s9);
+
+  free(s3.a);
+  free(s6.a);
+  free(s9.a);
+
+  return 0;
+}
@@ -0,0 +1,579 @@
+/*
+ *   FAC - Flexible Atomic Code
+ *   Copyright (C) 2001-2015 Ming Feng Gu
+ *   Portions Copyright (C) 2010-2015 Evgeny Stambulchik
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sysdef.h"
+
+#ifdef HAVE_MMAP
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#include "cfacP.h"
+#include "radial.h"
+#include "structure.h"
+
+/*
+** the persistent store of the angular coefficients between the basis
+** states of two symmetry Hamiltonians (the ANGZ_DATUM blocks). these
+** depend only on the configuration lists and the coupling, not on the
+** radial potential, so a store written by one run can be reused by any
+** later run with the same Config() list, e.g., in a scan over the
+** potential or the radial grid.
+**
+** the file is a header followed by appended records. each record is
+** keyed by a 128-bit hash of everything the block depends upon: its
+** type, the maximum rank, and, for both Hamiltonians, the shells and
+** the coupled shell states of each basis state together with the
+** closed shell flags. the orbitals are saved as (n, kappa) and mapped
+** to the orbital indices of the current run on loading.
+**
+** the file is mapped into memory (or read, lacking mmap) and indexed
+** on opening; the blocks missing from it are appended as they are
+** calculated.
+*/
+
+#define ANGZ_STORE_MAGIC    "CFACANGZ"
+#define ANGZ_STORE_VERSION  1
+#define ANGZ_RECORD_MAGIC   "AZRC"
+
+typedef struct _ANGZ_STORE_HEADER_ {
+  char magic[8];
+  int32_t version;
+  int32_t byte_order;
+  int32_t rec_size;
+  int32_t ent_size;
+} ANGZ_STORE_HEADER;
+
+typedef struct _ANGZ_RECORD_ {
+  uint64_t key[2];
+  int32_t type;
+  int32_t ns;      /* number of state pairs, followed by nz[ns] */
+  int32_t nent;    /* total number of entries, following nz[]   */
+  char magic[4];
+} ANGZ_RECORD;
+
+/*
+** an orbital is saved as (n, kappa); a plain value (the 2j of the free
+** electron in the ZxZ blocks) has kappa = 0.
+*/
+typedef struct _ANGZ_ENTRY_ {
+  double coeff;
+  int16_t k;
+  int16_t n[4];
+  int16_t kappa[4];
+} ANGZ_ENTRY;
+
+struct _ANGZ_STORE_ {
+  char *fn;
+  FILE *fp;        /* for appending                                 */
+  long size;       /* end of the valid records                      */
+  char *image;     /* the file contents                             */
+  long isize;      /* the size of the image                         */
+  MULTI index;     /* offsets of the records, by key                */
+  int nloaded, nsaved;
+};
+
+/* which of the four slots of an entry hold orbital indices */
+static const int slot_orbital[3][4] = {
+  {1, 1, 0, 0},    /* ANGZ_STORE_ZMIX: k0, k1          */
+  {1, 0, 0, 0},    /* ANGZ_STORE_ZFB:  kb              */
+  {0, 1, 1, 1}     /* ANGZ_STORE_ZXZ:  j, k1, k2, k3   */
+};
+
+static void UnmapAngZStore(ANGZ_STORE *st) {
+  if (st->image) {
+#ifdef HAVE_MMAP
+    munmap(st->image, st->isize);
+#else
+    free(st->image);
+#endif
+  }
+  st->image = NULL;
+  st->isize = 0;
+}
+
+/* (re)map the valid part of the file */
+static int MapAngZStore(ANGZ_STORE *st) {
+#ifdef HAVE_MMAP
+  int fd;
+#endif
+
+  UnmapAngZStore(st);
+  if (st->size <= 0) return 0;
+
+#ifdef HAVE_MMAP
+  fd = open(st->fn, O_RDONLY);
+  if (fd < 0) return -1;
+  st->image = mmap(NULL, st->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (st->image == MAP_FAILED) {
+    st->image = NULL;
+    return -1;
+  }
+#else
+  {
+    FILE *f = fopen(st->fn, "rb");
+    if (!f) return -1;
+    st->image = malloc(st->size);
+    if (!st->image || fread(st->image, 1, st->size, f) != st->size) {
+      free(st->image);
+      st->image = NULL;
+      fclose(f);
+      return -1;
+    }
+    fclose(f);
+  }
+#endif
+  st->isize = st->size;
+
+  return 0;
+}
+
+static void KeyToIndex(const uint64_t *key, int *k) {
+  k[0] = (int) (key[0] & 0x7FFFFFFF);
+  k[1] = (int) ((key[0] >> 32) & 0x7FFFFFFF);
+  k[2] = (int) (key[1] & 0x7FFFFFFF);
+  k[3] = (int) ((key[1] >> 32) & 0x7FFFFFFF);
+}
+
+static int AddToIndex(ANGZ_STORE *st, const uint64_t *key, long offset) {
+  int k[4];
+
+  KeyToIndex(key, k);
+  if (MultiSet(&st->index, k, &offset) == NULL) return -1;
+
+  return 0;
+}
+
+/* index the records of the image, returning the end of the valid ones */
+static long ScanAngZStore(ANGZ_STORE *st, long size) {
+  long p, next;
+  ANGZ_RECORD r;
+
+  p = sizeof(ANGZ_STORE_HEADER);
+  while (p + (long) sizeof(ANGZ_RECORD) <= size) {
+    memcpy(&r, st->image + p, sizeof(ANGZ_RECORD));
+    if (memcmp(r.magic, ANGZ_RECORD_MAGIC, 4) ||
+	r.type < 0 || r.type > ANGZ_STORE_ZXZ || r.ns < 0 || r.nent < 0) {
+      break;
+    }
+    next = p + sizeof(ANGZ_RECORD) + r.ns*sizeof(int32_t) +
+      r.nent*sizeof(ANGZ_ENTRY);
+    if (next > size) break;
+    if (AddToIndex(st, r.key, p) < 0) break;
+    p = next;
+  }
+
+  return p;
+}
+
+static void HeaderAngZStore(ANGZ_STORE_HEADER *h) {
+  memset(h, 0, sizeof(ANGZ_STORE_HEADER));
+  memcpy(h->magic, ANGZ_STORE_MAGIC, 8);
+  h->version = ANGZ_STORE_VERSION;
+  h->byte_order = 0x01020304;
+  h->rec_size = sizeof(ANGZ_RECORD);
+  h->ent_size = sizeof(ANGZ_ENTRY);
+}
+
+static ANGZ_STORE *OpenAngZStore(const char *fn) {
+  ANGZ_STORE *st;
+  ANGZ_STORE_HEADER h, h0;
+  int blocks[4] = {MULTI_BLOCK4, MULTI_BLOCK4, MULTI_BLOCK4, MULTI_BLOCK4};
+  long size;
+
+  st = calloc(1, sizeof(ANGZ_STORE));
+  if (!st) return NULL;
+  st->fn = malloc(strlen(fn) + 1);
+  if (!st->fn) {
+    free(st);
+    return NULL;
+  }
+  strcpy(st->fn, fn);
+  MultiInit(&st->index, sizeof(long), 4, blocks, NULL, NULL);
+
+  HeaderAngZStore(&h0);
+  st->fp = fopen(fn, "r+b");
+  if (st->fp == NULL) {
+    st->fp = fopen(fn, "rb");
+    if (st->fp != NULL) {
+      printf("the angular store %s is not writable\n", fn);
+      goto ERROR;
+    }
+    st->fp = fopen(fn, "w+b");
+    if (st->fp == NULL ||
+	fwrite(&h0, sizeof(h0), 1, st->fp) != 1 || fflush(st->fp)) {
+      printf("cannot create the angular store %s\n", fn);
+      goto ERROR;
+    }
+    st->size = sizeof(h0);
+    return st;
+  }
+
+  if (fseek(st->fp, 0, SEEK_END) || (size = ftell(st->fp)) < 0) {
+    goto ERROR;
+  }
+  rewind(st->fp);
+  if (size < (long) sizeof(h) || fread(&h, sizeof(h), 1, st->fp) != 1 ||
+      memcmp(&h, &h0, sizeof(h))) {
+    printf("%s is not an angular store for this build\n", fn);
+    goto ERROR;
+  }
+
+  st->size = size;
+  if (MapAngZStore(st) < 0) {
+    printf("cannot map the angular store %s\n", fn);
+    goto ERROR;
+  }
+  st->size = ScanAngZStore(st, size);
+  if (st->size < size) {
+    printf("ignoring %ld trailing bytes of the angular store %s\n",
+	   size - st->size, fn);
+  }
+
+  return st;
+
+ ERROR:
+  FreeAngZStore(st);
+  return NULL;
+}
+
+void FreeAngZStore(ANGZ_STORE *st) {
+  if (st == NULL) return;
+  UnmapAngZStore(st);
+  if (st->fp) fclose(st->fp);
+  MultiFree(&st->index);
+  free(st->fn);
+  free(st);
+}
+
+/*
+** attach the angular store in the file fn (created if it does not exist)
+** to the cfac context. an empty or NULL fn detaches the current store.
+*/
+int SetAngZStore(cfac_t *cfac, const char *fn) {
+  if (cfac->angz_store) {
+    ANGZ_STORE *st = cfac->angz_store;
+    if (st->nloaded || st->nsaved) {
+      printf("angular store %s: %d blocks loaded, %d saved\n",
+	     st->fn, st->nloaded, st->nsaved);
+    }
+    FreeAngZStore(st);
+    cfac->angz_store = NULL;
+  }
+  if (fn == NULL || fn[0] == '\0') return 0;
+
+  cfac->angz_store = OpenAngZStore(fn);
+  if (cfac->angz_store == NULL) return -1;
+
+  return 0;
+}
+
+/*
+** the key hashes are two independent 64-bit FNV-1a chains over the
+** integers the block depends upon.
+*/
+#define FNV_PRIME   1099511628211ULL
+
+static void HashInt(uint64_t *key, int v) {
+  key[0] = (key[0] ^ (uint32_t) v)*FNV_PRIME;
+  key[1] = (key[1] ^ ((uint32_t) v*0x9E3779B9U))*FNV_PRIME;
+}
+
+static void HashHamilton(cfac_t *cfac, uint64_t *key, int ih) {
+  SHAMILTON *h = &cfac->hams[ih];
+  STATE *s;
+  CONFIG *c;
+  SHELL_STATE *csf;
+  int i, m;
+
+  HashInt(key, h->nbasis);
+  for (i = 0; i < MBCLOSE; i++) {
+    HashInt(key, h->closed[i]);
+  }
+  for (i = 0; i < h->nbasis; i++) {
+    s = h->basis[i];
+    c = GetConfigFromGroup(cfac, s->kgroup, s->kcfg);
+    csf = c->csfs + s->kstate;
+    HashInt(key, c->n_shells);
+    for (m = 0; m < c->n_shells; m++) {
+      HashInt(key, c->shells[m].n);
+      HashInt(key, c->shells[m].kappa);
+      HashInt(key, c->shells[m].nq);
+      HashInt(key, csf[m].shellJ);
+      HashInt(key, csf[m].totalJ);
+      HashInt(key, csf[m].nu);
+      HashInt(key, csf[m].Nr);
+    }
+  }
+}
+
+static void AngZStoreKey(cfac_t *cfac, int type, int ih1, int ih2,
+			 uint64_t *key) {
+  key[0] = 14695981039346656037ULL;
+  key[1] = 7809847782465536322ULL;
+  HashInt(key, ANGZ_STORE_VERSION);
+  HashInt(key, type);
+  HashInt(key, GetMaxRank(cfac));
+  HashInt(key, ih1 == ih2);
+  HashHamilton(cfac, key, ih1);
+  HashHamilton(cfac, key, ih2);
+}
+
+static void GetEntrySlots(int type, const void *ang, int i,
+			  double *coeff, int *k, int *v) {
+  const ANGULAR_ZMIX *zm;
+  const ANGULAR_ZFB *zfb;
+  const ANGULAR_ZxZMIX *zxz;
+
+  v[0] = v[1] = v[2] = v[3] = 0;
+  switch (type) {
+  case ANGZ_STORE_ZMIX:
+    zm = (const ANGULAR_ZMIX *) ang + i;
+    *coeff = zm->coeff;
+    *k = zm->k;
+    v[0] = zm->k0;
+    v[1] = zm->k1;
+    break;
+  case ANGZ_STORE_ZFB:
+    zfb = (const ANGULAR_ZFB *) ang + i;
+    *coeff = zfb->coeff;
+    *k = 0;
+    v[0] = zfb->kb;
+    break;
+  default:
+    zxz = (const ANGULAR_ZxZMIX *) ang + i;
+    *coeff = zxz->coeff;
+    *k = zxz->k;
+    v[0] = zxz->k0;
+    v[1] = zxz->k1;
+    v[2] = zxz->k2;
+    v[3] = zxz->k3;
+    break;
+  }
+}
+
+static void SetEntrySlots(int type, void *ang, int i,
+			  double coeff, int k, const int *v) {
+  ANGULAR_ZMIX *zm;
+  ANGULAR_ZFB *zfb;
+  ANGULAR_ZxZMIX *zxz;
+
+  switch (type) {
+  case ANGZ_STORE_ZMIX:
+    zm = (ANGULAR_ZMIX *) ang + i;
+    zm->coeff = coeff;
+    zm->k = k;
+    zm->k0 = v[0];
+    zm->k1 = v[1];
+    break;
+  case ANGZ_STORE_ZFB:
+    zfb = (ANGULAR_ZFB *) ang + i;
+    zfb->coeff = coeff;
+    zfb->kb = v[0];
+    break;
+  default:
+    zxz = (ANGULAR_ZxZMIX *) ang + i;
+    zxz->coeff = coeff;
+    zxz->k = k;
+    zxz->k0 = v[0];
+    zxz->k1 = v[1];
+    zxz->k2 = v[2];
+    zxz->k3 = v[3];
+    break;
+  }
+}
+
+static size_t EntrySize(int type) {
+  switch (type) {
+  case ANGZ_STORE_ZMIX:
+    return sizeof(ANGULAR_ZMIX);
+  case ANGZ_STORE_ZFB:
+    return sizeof(ANGULAR_ZFB);
+  default:
+    return sizeof(ANGULAR_ZxZMIX);
+  }
+}
+
+/*
+** fill the empty datum ad of the Hamiltonians ih1 and ih2 from the
+** store. returns the number of state pairs, or 0 if the block is not
+** in the store or refers to an orbital that this run does not have yet;
+** ad is then left empty and the block is to be recomputed.
+*/
+int LoadAngZStore(cfac_t *cfac, int type, ANGZ_DATUM *ad, int ih1, int ih2) {
+  ANGZ_STORE *st = cfac->angz_store;
+  ANGZ_RECORD r;
+  ANGZ_ENTRY e;
+  uint64_t key[2];
+  int k[4], v[4], i, j, m, nz;
+  long *offset;
+  const char *p;
+  void *ang;
+
+  if (st == NULL) return 0;
+
+  AngZStoreKey(cfac, type, ih1, ih2, key);
+  KeyToIndex(key, k);
+  offset = (long *) MultiGet(&st->index, k);
+  if (offset == NULL) return 0;
+  if (*offset >= st->isize && MapAngZStore(st) < 0) return 0;
+
+  p = st->image + *offset;
+  memcpy(&r, p, sizeof(ANGZ_RECORD));
+  if (r.key[0] != key[0] || r.key[1] != key[1] || r.type != type ||
+      r.ns != cfac->hams[ih1].nbasis*cfac->hams[ih2].nbasis) {
+    return 0;
+  }
+  p += sizeof(ANGZ_RECORD);
+
+  ad->ns = r.ns;
+  ad->nz = malloc(sizeof(int)*r.ns);
+  ad->angz = malloc(sizeof(void *)*r.ns);
+  if (!ad->nz || !ad->angz) {
+    printf("failed allocating memory for the stored angular block\n");
+    exit(1);
+  }
+  for (i = 0; i < r.ns; i++) {
+    int32_t n32;
+    memcpy(&n32, p, sizeof(int32_t));
+    ad->nz[i] = n32;
+    p += sizeof(int32_t);
+  }
+
+  if (r.nent > 0) {
+    ad->pool = malloc(EntrySize(type)*r.nent);
+    if (!ad->pool) {
+      printf("failed allocating memory for the stored angular block\n");
+      exit(1);
+    }
+  }
+  ang = ad->pool;
+  for (i = 0; i < r.ns; i++) {
+    nz = ad->nz[i];
+    if (nz == 0) {
+      ad->angz[i] = NULL;
+      continue;
+    }
+    for (j = 0; j < nz; j++) {
+      memcpy(&e, p, sizeof(ANGZ_ENTRY));
+      p += sizeof(ANGZ_ENTRY);
+      for (m = 0; m < 4; m++) {
+	if (e.kappa[m] != 0) {
+	  /*
+	  ** OrbitalIndex() would create and solve a missing orbital,
+	  ** so look it up first; without it, recompute the block.
+	  */
+	  if (OrbitalExists(cfac, e.n[m], e.kappa[m], 0.0) < 0) {
+	    printf("orbital (%d, %d) of the angular store not found\n",
+		   e.n[m], e.kappa[m]);
+	    free(ad->pool);
+	    free(ad->angz);
+	    free(ad->nz);
+	    ad->pool = NULL;
+	    ad->angz = NULL;
+	    ad->nz = NULL;
+	    ad->ns = 0;
+	    return 0;
+	  }
+	  v[m] = OrbitalIndex(cfac, e.n[m], e.kappa[m], 0.0);
+	} else {
+	  v[m] = e.n[m];
+	}
+      }
+      SetEntrySlots(type, ang, j, e.coeff, e.k, v);
+    }
+    ad->angz[i] = ang;
+    ang = (char *) ang + EntrySize(type)*nz;
+  }
+  st->nloaded++;
+
+  return ad->ns;
+}
+
+/* append the freshly calculated datum ad to the store */
+int SaveAngZStore(cfac_t *cfac, int type, const ANGZ_DATUM *ad,
+		  int ih1, int ih2) {
+  ANGZ_STORE *st = cfac->angz_store;
+  ANGZ_RECORD r;
+  ANGZ_ENTRY e;
+  ORBITAL *orb;
+  double coeff;
+  int i, j, m, kk, v[4];
+  int32_t n32;
+
+  if (st == NULL || ad->ns <= 0) return 0;
+
+  memset(&r, 0, sizeof(r));
+  AngZStoreKey(cfac, type, ih1, ih2, r.key);
+  r.type = type;
+  r.ns = ad->ns;
+  r.nent = 0;
+  for (i = 0; i < ad->ns; i++) {
+    r.nent += ad->nz[i];
+  }
+  memcpy(r.magic, ANGZ_RECORD_MAGIC, 4);
+
+  if (fseek(st->fp, st->size, SEEK_SET) ||
+      fwrite(&r, sizeof(r), 1, st->fp) != 1) {
+    goto ERROR;
+  }
+  for (i = 0; i < ad->ns; i++) {
+    n32 = ad->nz[i];
+    if (fwrite(&n32, sizeof(n32), 1, st->fp) != 1) goto ERROR;
+  }
+  for (i = 0; i < ad->ns; i++) {
+    for (j = 0; j < ad->nz[i]; j++) {
+      GetEntrySlots(type, ad->angz[i], j, &coeff, &kk, v);
+      memset(&e, 0, sizeof(e));
+      e.coeff = coeff;
+      e.k = kk;
+      for (m = 0; m < 4; m++) {
+	if (slot_orbital[type][m]) {
+	  orb = GetOrbital(cfac, v[m]);
+	  e.n[m] = orb->n;
+	  e.kappa[m] = orb->kappa;
+	} else {
+	  e.n[m] = v[m];
+	}
+      }
+      if (fwrite(&e, sizeof(e), 1, st->fp) != 1) goto ERROR;
+    }
+  }
+  if (fflush(st->fp)) goto ERROR;
+
+  if (AddToIndex(st, r.key, st->size) < 0) goto ERROR;
+  st->size = ftell(st->fp);
+  st->nsaved++;
+
+  return 0;
+
+ ERROR:
+  printf("error writing the angular store %s, detached\n", st->fn);
+  FreeAngZStore(st);
+  cfac->angz_store = NULL;
+  return -1;
+}
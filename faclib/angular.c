@@ -27,18 +27,50 @@
 *************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <gsl/gsl_sf_gamma.h>
 #include <gsl/gsl_sf_coupling.h>
 
+#include "sysdef.h"
+
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
+
 #include "cfacP.h"
 #include "consts.h"
 #include "angular.h"
 
+/* ln(n!) for n < LNFACT_MAX, filled once */
+#define LNFACT_MAX 1024
+static double ln_fact[LNFACT_MAX];
+
+static void InitLnFactTable(void)
+{
+    unsigned int n;
+
+    ln_fact[0] = 0.0;
+    for (n = 1; n < LNFACT_MAX; n++) {
+        ln_fact[n] = gsl_sf_lnfact(n);
+    }
+}
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_once_t ln_fact_once = PTHREAD_ONCE_INIT;
+# define LnFactTable() pthread_once(&ln_fact_once, InitLnFactTable)
+#else
+static int ln_fact_done = 0;
+# define LnFactTable() \
+    if (!ln_fact_done) { InitLnFactTable(); ln_fact_done = 1; }
+#endif
+
 double LnFactorial(unsigned int n)
 {
-    if (n == 0) {
-        return 0.0;
+    if (n < LNFACT_MAX) {
+        LnFactTable();
+        return ln_fact[n];
     } else {
         return gsl_sf_lnfact(n);
     }
@@ -82,19 +114,269 @@ int Triangle(int j1, int j2, int j3) {
     return 0;
 }
 
+/*
+** the 3j, 6j and 9j symbols are memoized in direct-mapped tables, keyed
+** by the arguments reduced by the symmetries of the symbols. an entry
+** stores (key^value, value), so that an entry torn by concurrent writers
+** fails the key check instead of returning a wrong value; no locking is
+** needed.
+*/
+#define WCACHE_BITS  16
+#define WCACHE_SIZE  (1<<WCACHE_BITS)
+#define WCACHE_TAG   ((uint64_t)1<<63)
+
+typedef struct {
+  uint64_t c;  /* key^v */
+  uint64_t v;  /* the bits of the value */
+} WCACHE_ENTRY;
+
+static WCACHE_ENTRY w3j_cache[WCACHE_SIZE];
+static WCACHE_ENTRY w6j_cache[WCACHE_SIZE];
+static WCACHE_ENTRY w9j_cache[WCACHE_SIZE];
+
+#if defined(__GNUC__)
+# define WCACHE_LOAD(p)     __atomic_load_n(p, __ATOMIC_RELAXED)
+# define WCACHE_STORE(p, x) __atomic_store_n(p, x, __ATOMIC_RELAXED)
+#else
+# define WCACHE_LOAD(p)     (*(p))
+# define WCACHE_STORE(p, x) (*(p) = (x))
+#endif
+
+static WCACHE_ENTRY *WCacheSlot(WCACHE_ENTRY *cache, uint64_t key) {
+  key *= 0x9E3779B97F4A7C15ULL;
+  return &cache[key >> (64 - WCACHE_BITS)];
+}
+
+static int WCacheGet(WCACHE_ENTRY *cache, uint64_t key, double *r) {
+  WCACHE_ENTRY *e = WCacheSlot(cache, key);
+  uint64_t c, v;
+
+  c = WCACHE_LOAD(&e->c);
+  v = WCACHE_LOAD(&e->v);
+  if ((c^v) != key) return 0;
+  memcpy(r, &v, sizeof(double));
+  return 1;
+}
+
+static void WCacheSet(WCACHE_ENTRY *cache, uint64_t key, double r) {
+  WCACHE_ENTRY *e = WCacheSlot(cache, key);
+  uint64_t v;
+
+  memcpy(&v, &r, sizeof(double));
+  WCACHE_STORE(&e->c, key^v);
+  WCACHE_STORE(&e->v, v);
+}
+
+/* a column of a 3j or 6j symbol, as a 20-bit code */
+static uint64_t WColumn(int u, int l) {
+  return ((uint64_t)u<<10) | (uint64_t)l;
+}
+
+static int WSwap(uint64_t *a, uint64_t *b) {
+  uint64_t x = *a, y = *b;
+  int s = (x < y);
+
+  *a = s ? y:x;
+  *b = s ? x:y;
+  return s;
+}
+
+/* sort the columns in descending order; returns the parity of the swaps */
+static int WSort3(uint64_t *c) {
+  int p;
+
+  p  = WSwap(&c[0], &c[1]);
+  p ^= WSwap(&c[1], &c[2]);
+  p ^= WSwap(&c[0], &c[1]);
+  return p;
+}
+
+static uint64_t WKey(const uint64_t *c) {
+  return WCACHE_TAG | (c[0]<<40) | (c[1]<<20) | c[2];
+}
+
+/* ln of the triangle coefficient; j's are doubled */
+static double LnDelta(int j1, int j2, int j3) {
+  return 0.5*(ln_fact[(j1+j2-j3)/2] + ln_fact[(j1-j2+j3)/2] +
+	      ln_fact[(j2+j3-j1)/2] - ln_fact[(j1+j2+j3)/2+1]);
+}
+
+/* 
+** the Racah formula for the 3j symbol. the selection rules are checked by
+** the caller, and all the factorials fall within the table. the terms of
+** the alternating sum are generated by their (exact) ratios, so that only
+** the common prefactor carries the error of the log-factorials.
+*/
+static double Racah3j(int j1, int j2, int j3, int m1, int m2, int m3) {
+  int k, kmin, kmax, a, b, c, d, e;
+  double x, r, t;
+
+  a = (j3-j2+m1)/2;
+  b = (j3-j1-m2)/2;
+  c = (j1+j2-j3)/2;
+  d = (j1-m1)/2;
+  e = (j2+m2)/2;
+  kmin = Max(0, Max(-a, -b));
+  kmax = Min(c, Min(d, e));
+
+  x = LnDelta(j1, j2, j3) + 
+    0.5*(ln_fact[(j1+m1)/2] + ln_fact[(j1-m1)/2] +
+	 ln_fact[(j2+m2)/2] + ln_fact[(j2-m2)/2] +
+	 ln_fact[(j3+m3)/2] + ln_fact[(j3-m3)/2]) -
+    ln_fact[kmin] - ln_fact[a+kmin] - ln_fact[b+kmin] -
+    ln_fact[c-kmin] - ln_fact[d-kmin] - ln_fact[e-kmin];
+
+  r = 0.0;
+  t = 1.0;
+  for (k = kmin; k <= kmax; k++) {
+    r += t;
+    t *= -((double)(c-k)*(d-k)*(e-k))/((double)(k+1)*(a+k+1)*(b+k+1));
+  }
+  r *= exp(x);
+  if (IsOdd(kmin + (j1-j2-m3)/2)) r = -r;
+
+  return r;
+}
+
+/* 
+** the Racah formula for the 6j symbol {a b c; d e f}, with the triangles
+** checked by the caller; summed as in Racah3j().
+*/
+static double Racah6j(int a, int b, int c, int d, int e, int f) {
+  int t, tmin, tmax, a1, a2, a3, a4, b1, b2, b3;
+  double x, y, r;
+
+  a1 = (a+b+c)/2;
+  a2 = (a+e+f)/2;
+  a3 = (d+b+f)/2;
+  a4 = (d+e+c)/2;
+  b1 = (a+b+d+e)/2;
+  b2 = (b+c+e+f)/2;
+  b3 = (c+a+f+d)/2;
+  tmin = Max(Max(a1, a2), Max(a3, a4));
+  tmax = Min(b1, Min(b2, b3));
+
+  x = LnDelta(a, b, c) + LnDelta(a, e, f) + 
+    LnDelta(d, b, f) + LnDelta(d, e, c) + ln_fact[tmin+1] -
+    ln_fact[tmin-a1] - ln_fact[tmin-a2] -
+    ln_fact[tmin-a3] - ln_fact[tmin-a4] -
+    ln_fact[b1-tmin] - ln_fact[b2-tmin] - ln_fact[b3-tmin];
+
+  r = 0.0;
+  y = 1.0;
+  for (t = tmin; t <= tmax; t++) {
+    r += y;
+    y *= -((double)(t+2)*(b1-t)*(b2-t)*(b3-t))/
+      ((double)(t+1-a1)*(t+1-a2)*(t+1-a3)*(t+1-a4));
+  }
+  r *= exp(x);
+  if (IsOdd(tmin)) r = -r;
+
+  return r;
+}
+
 /* 
 ** calculate the Wigner 3j symbols.
 */
 double W3j(int j1, int j2, int j3, int m1, int m2, int m3) {
-  return gsl_sf_coupling_3j(j1, j2, j3, m1, m2, m3);
+  uint64_t c[3], key, kmax;
+  int p, sign;
+  double r;
+
+  if (m1 + m2 + m3 != 0) return 0.0;
+  if (abs(m1) > j1 || abs(m2) > j2 || abs(m3) > j3) return 0.0;
+  if (IsOdd(j1+m1) || IsOdd(j2+m2) || IsOdd(j3+m3)) return 0.0;
+  if (!Triangle(j1, j2, j3) || IsOdd(j1+j2+j3)) return 0.0;
+
+  if (j1 > 511 || j2 > 511 || j3 > 511 || (j1+j2+j3)/2+1 >= LNFACT_MAX) {
+    return gsl_sf_coupling_3j(j1, j2, j3, m1, m2, m3);
+  }
+
+  /* 
+  ** odd permutations of the columns and the reversal of the m's both
+  ** give the phase (-1)^(j1+j2+j3); the key is the larger of the two
+  ** sorted forms.
+  */
+  c[0] = WColumn(j1, 512+m1);
+  c[1] = WColumn(j2, 512+m2);
+  c[2] = WColumn(j3, 512+m3);
+  sign = WSort3(c);
+  kmax = WKey(c);
+  c[0] = WColumn(j1, 512-m1);
+  c[1] = WColumn(j2, 512-m2);
+  c[2] = WColumn(j3, 512-m3);
+  p = !WSort3(c);
+  key = WKey(c);
+  if (key > kmax) {
+    kmax = key;
+    sign = p;
+  }
+  if (!IsOdd((j1+j2+j3)/2)) sign = 0;
+
+  LnFactTable();
+  if (!WCacheGet(w3j_cache, kmax, &r)) {
+    r = Racah3j(j1, j2, j3, m1, m2, m3);
+    if (sign) r = -r;
+    WCacheSet(w3j_cache, kmax, r);
+  }
+
+  return sign ? -r:r;
 }
 
 /* 
 ** FUNCTION:    W6j.
 ** PURPOSE:     calculate the 6j symbol.
+** NOTE:        the symbol is invariant under the permutations of the
+**              columns and the exchange of the upper and lower arguments
+**              in two of them; the cache key is the smallest of the
+**              four forms with sorted columns.
 */
 double W6j(int j1, int j2, int j3, int i1, int i2, int i3) {
-  return gsl_sf_coupling_6j(j1, j2, j3, i1, i2, i3);
+  uint64_t p[3], f[3], c[3], key, kmin;
+  double r;
+
+  if (j1 < 0 || j2 < 0 || j3 < 0 || i1 < 0 || i2 < 0 || i3 < 0) return 0.0;
+  if (!W6jTriangle(j1, j2, j3, i1, i2, i3)) return 0.0;
+  if (IsOdd(j1+j2+j3) || IsOdd(j1+i2+i3) ||
+      IsOdd(i1+j2+i3) || IsOdd(i1+i2+j3)) return 0.0;
+
+  if (j1 > 1023 || j2 > 1023 || j3 > 1023 ||
+      i1 > 1023 || i2 > 1023 || i3 > 1023 ||
+      (j1+j2+i1+i2)/2+1 >= LNFACT_MAX || (j2+j3+i2+i3)/2+1 >= LNFACT_MAX ||
+      (j3+j1+i3+i1)/2+1 >= LNFACT_MAX) {
+    return gsl_sf_coupling_6j(j1, j2, j3, i1, i2, i3);
+  }
+
+  p[0] = WColumn(j1, i1);
+  p[1] = WColumn(j2, i2);
+  p[2] = WColumn(j3, i3);
+  f[0] = WColumn(i1, j1);
+  f[1] = WColumn(i2, j2);
+  f[2] = WColumn(i3, j3);
+
+  c[0] = p[0]; c[1] = p[1]; c[2] = p[2];
+  WSort3(c);
+  kmin = WKey(c);
+  c[0] = f[0]; c[1] = f[1]; c[2] = p[2];
+  WSort3(c);
+  key = WKey(c);
+  if (key < kmin) kmin = key;
+  c[0] = f[0]; c[1] = p[1]; c[2] = f[2];
+  WSort3(c);
+  key = WKey(c);
+  if (key < kmin) kmin = key;
+  c[0] = p[0]; c[1] = f[1]; c[2] = f[2];
+  WSort3(c);
+  key = WKey(c);
+  if (key < kmin) kmin = key;
+
+  LnFactTable();
+  if (!WCacheGet(w6j_cache, kmin, &r)) {
+    r = Racah6j(j1, j2, j3, i1, i2, i3);
+    WCacheSet(w6j_cache, kmin, r);
+  }
+
+  return r;
 }
 
 /* 
@@ -133,7 +415,41 @@ int W6jTriangle(int j1, int j2, int j3, int i1, int i2, int i3) {
 double W9j(int j1, int j2, int j3,
 	   int i1, int i2, int i3,
 	   int k1, int k2, int k3) {
-  return gsl_sf_coupling_9j(j1, j2, j3, i1, i2, i3, k1, k2, k3);
+  int x, xmin, xmax;
+  uint64_t key;
+  double r;
+
+  if (!W9jTriangle(j1, j2, j3, i1, i2, i3, k1, k2, k3)) return 0.0;
+
+  if (j1 > 127 || j2 > 127 || j3 > 127 ||
+      i1 > 127 || i2 > 127 || i3 > 127 ||
+      k1 > 127 || k2 > 127 || k3 > 127) {
+    return gsl_sf_coupling_9j(j1, j2, j3, i1, i2, i3, k1, k2, k3);
+  }
+
+  /* the 72 symmetries of the 9j symbol are not reduced */
+  key = WCACHE_TAG | 
+    ((uint64_t)j1<<56) | ((uint64_t)j2<<49) | ((uint64_t)j3<<42) |
+    ((uint64_t)i1<<35) | ((uint64_t)i2<<28) | ((uint64_t)i3<<21) |
+    ((uint64_t)k1<<14) | ((uint64_t)k2<<7) | (uint64_t)k3;
+  if (WCacheGet(w9j_cache, key, &r)) {
+    return r;
+  }
+
+  /* the sum over products of three 6j symbols */
+  xmin = Max(abs(j1-k3), Max(abs(i1-k2), abs(j2-i3)));
+  xmax = Min(j1+k3, Min(i1+k2, j2+i3));
+  r = 0.0;
+  for (x = xmin; x <= xmax; x += 2) {
+    double a = W6j(j1, j2, j3, i3, k3, x)*
+      W6j(i1, i2, i3, j2, x, k2)*
+      W6j(k1, k2, k3, x, j1, i1);
+    if (IsOdd(x)) a = -a;
+    r += (x+1.0)*a;
+  }
+  WCacheSet(w9j_cache, key, r);
+
+  return r;
 }
 
 /* 
@@ -314,8 +314,12 @@ void InitMDataData(void *p, int n) {
   }
 }
 
-#define HashSize(n) ((ub4)1<<(((n)/2)+16))
-#define HashMask(n) (HashSize(n)-1)
+/* the maximum number of hash bits for an n-dimensional array */
+#define HashBits(n) (((n)/2)+16)
+/* the initial number of hash bits */
+#define HashBits0   8
+#define HashSize(b) ((ub4)1<<(b))
+#define HashMask(b) (HashSize(b)-1)
 #define Mix(a, b, c) \
 { \
   a -= b; a -= c; a ^= (c>>13); \
@@ -329,7 +333,7 @@ void InitMDataData(void *p, int n) {
   c -= a; c -= b; c ^= (b>>15); \
 }
 
-static int Hash2(int *id, ub4 length, ub4 initval, int n) {
+static int Hash2(int *id, ub4 length, ub4 initval, int nbits) {
   register ub4 a, b, c, len, *k;
   ub4 kd[32], i;
 
@@ -358,12 +362,92 @@ static int Hash2(int *id, ub4 length, ub4 initval, int n) {
   }
   Mix(a,b,c);
   /*-------------------------------------------- report the result */
-  return (int) (c & HashMask(n));
+  return (int) (c & HashMask(nbits));
+}
+
+static ARRAY *NMultiBuckets(MULTI *ma, int hbits) {
+  ARRAY *a;
+  int i, n;
+
+  n = HashSize(hbits);
+  a = (ARRAY *) malloc(sizeof(ARRAY)*n);
+  if (!a) return NULL;
+  for (i = 0; i < n; i++) {
+    ArrayInit(&(a[i]), sizeof(MDATA), 10, ma->FreeElem, ma->InitData);
+  }
+
+  return a;
+}
+
+/* a free slot at the end of the bucket a */
+static MDATA *NMultiNewSlot(ARRAY *a) {
+  DATA *p;
+  int m;
+
+  m = a->dim % a->block;
+  if (a->dim == 0) {
+    a->data = (DATA *) malloc(sizeof(DATA));
+    p = a->data;
+  } else {
+    p = a->data;
+    while (p->next) p = p->next;
+    if (m == 0) {
+      p->next = (DATA *) malloc(sizeof(DATA));
+      p = p->next;
+    }
+  }
+  if (m == 0) {
+    p->dptr = malloc(a->bsize);
+    InitMDataData(p->dptr, a->block);
+    p->next = NULL;
+  }
+  (a->dim)++;
+
+  return ((MDATA *) p->dptr) + m;
+}
+
+/* 
+** move the elements into 2^hbits buckets. only the (index, data)
+** pointers are moved, so the element addresses stay valid.
+*/
+static int NMultiRehash(MULTI *ma, int hbits) {
+  ARRAY *a, *b;
+  DATA *p, *p0;
+  MDATA *pt, *q;
+  int i, j, m, n, h;
+
+  n = HashSize(ma->hbits);
+  a = ma->array;
+  b = NMultiBuckets(ma, hbits);
+  if (!b) return -1;
+
+  for (i = 0; i < n; i++) {
+    p = a[i].data;
+    j = 0;
+    while (p) {
+      pt = (MDATA *) p->dptr;
+      for (m = 0; m < a[i].block && j < a[i].dim; j++, m++) {
+	h = Hash2(pt->index, ma->ndim, 0, hbits);
+	q = NMultiNewSlot(&(b[h]));
+	*q = *pt;
+	pt++;
+      }
+      p0 = p;
+      p = p->next;
+      free(p0->dptr);
+      free(p0);
+    }
+  }
+  free(a);
+
+  ma->array = b;
+  ma->hbits = hbits;
+
+  return 0;
 }
 
 int NMultiInit(MULTI *ma, int esize, int ndim, int *block,
     ARRAY_ELEM_FREE FreeElem, ARRAY_DATA_INIT InitData) {
-  int i, n;
 
   ma->maxelem = -1;
   ma->numelem = 0;
@@ -371,12 +455,12 @@ int NMultiInit(MULTI *ma, int esize, int ndim, int *block,
   ma->isize = sizeof(int)*ndim;
   ma->esize = esize;
   ma->block = (unsigned short *) malloc(sizeof(unsigned short)*ndim);
-  n = HashSize(ma->ndim);
 
-  ma->array = (ARRAY *) malloc(sizeof(ARRAY)*n);
-  for (i = 0; i < n; i++) {
-    ArrayInit(&(ma->array[i]), sizeof(MDATA), 10, FreeElem, InitData);
-  }
+  ma->FreeElem = FreeElem;
+  ma->InitData = InitData;
+  /* the buckets are allocated by the first NMultiSet() */
+  ma->hbits = 0;
+  ma->array = NULL;
 
   return 0;
 }
@@ -387,7 +471,8 @@ void *NMultiGet(MULTI *ma, int *k) {
   DATA *p;
   int i, j, m, h;
 
-  h = Hash2(k, ma->ndim, 0, ma->ndim);
+  if (!ma->array) return NULL;
+  h = Hash2(k, ma->ndim, 0, ma->hbits);
   a = &(ma->array[h]);
   p = a->data;
   i = a->dim;
@@ -407,50 +492,51 @@ void *NMultiGet(MULTI *ma, int *k) {
 }
 
 void *NMultiSet(MULTI *ma, int *k, void *d) {
-  int i, j, m = 0, h;
+  int i, j, m, h, hbits;
   MDATA *pt = NULL;
   ARRAY *a;
-  DATA *p, *p0 = NULL;
+  DATA *p;
 
   if (ma->maxelem > 0 && ma->numelem >= ma->maxelem) {
     NMultiFreeData(ma);
     ma->numelem = 0;
   }
-  h = Hash2(k, ma->ndim, 0, ma->ndim);
+  if (!ma->array) {
+    ma->array = NMultiBuckets(ma, HashBits0);
+    if (!ma->array) return NULL;
+    ma->hbits = HashBits0;
+  }
+  h = Hash2(k, ma->ndim, 0, ma->hbits);
   a = &(ma->array[h]);
-  if (a->dim == 0) {
-    a->data = (DATA *) malloc(sizeof(DATA));
-    a->data->dptr = malloc(a->bsize);
-    InitMDataData(a->data->dptr, a->block);
-    a->data->next = NULL;
-    pt = (MDATA *) a->data->dptr;
-  } else {
-    p = a->data;
-    i = a->dim;
-    j = 0;
-    while (p) {
-      pt = (MDATA *) p->dptr;
-      for (m = 0; m < a->block && j < i; j++, m++) {
-	if (memcmp(pt->index, k, ma->isize) == 0) {
-	  if (d) {
-	    memcpy(pt->data, d, ma->esize);
-	  }
-	  return pt->data;
+  p = a->data;
+  i = a->dim;
+  j = 0;
+  while (p) {
+    pt = (MDATA *) p->dptr;
+    for (m = 0; m < a->block && j < i; j++, m++) {
+      if (memcmp(pt->index, k, ma->isize) == 0) {
+	if (d) {
+	  memcpy(pt->data, d, ma->esize);
 	}
-	pt++;
+	return pt->data;
       }
-      p0 = p;
-      p = p->next;
-    }  
-    if (m == a->block) {
-      p0->next = (DATA *) malloc(sizeof(DATA));
-      p = p0->next;
-      p->dptr = malloc(a->bsize);
-      InitMDataData(p->dptr, a->block);
-      p->next = NULL;
-      pt = (MDATA *) p->dptr;
+      pt++;
+    }
+    p = p->next;
+  }
+
+  /* a new element; keep the average bucket load below 1 */
+  if (ma->numelem >= (int)HashSize(ma->hbits) &&
+      ma->hbits < HashBits(ma->ndim)) {
+    /* four times larger, but not beyond the maximum */
+    hbits = ma->hbits+2;
+    if (hbits > HashBits(ma->ndim)) hbits = HashBits(ma->ndim);
+    if (NMultiRehash(ma, hbits) == 0) {
+      h = Hash2(k, ma->ndim, 0, ma->hbits);
+      a = &(ma->array[h]);
     }
   }
+  pt = NMultiNewSlot(a);
 
   ma->numelem++;
   pt->index = malloc(ma->isize);
@@ -458,7 +544,6 @@ void *NMultiSet(MULTI *ma, int *k, void *d) {
   pt->data = malloc(ma->esize);
   if (a && a->InitData) a->InitData(pt->data, 1);
   if (d) memcpy(pt->data, d, ma->esize);
-  (a->dim)++;
 
   return pt->data;
 }
@@ -502,13 +587,14 @@ int NMultiFreeData(MULTI *ma) {
   ARRAY *a;
   int i, n;
 
-  if (!ma) return 0;
+  if (!ma || !ma->array) return 0;
   
-  n = HashSize(ma->ndim);
+  n = HashSize(ma->hbits);
   for (i = 0; i < n; i++) {
     a = &(ma->array[i]);
     NMultiFreeDataOnly(a);
   }
+  ma->numelem = 0;
   return 0;
 }
 
@@ -523,3 +609,145 @@ int NMultiFree(MULTI *ma) {
   ma->ndim = 0;
   return 0;
 }
+
+/*
+** the blocks of an arena; the storage follows the header, which is
+** padded to keep it aligned for any type.
+*/
+#define ARENA_ALIGN 16
+#define ArenaRound(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+struct _ARENA_BLOCK_ {
+  ARENA_BLOCK *next;
+  size_t size, used;
+};
+
+#define ArenaData(b) ((char *) (b) + ArenaRound(sizeof(ARENA_BLOCK)))
+
+/* 
+** FUNCTION:    ArenaInit
+** PURPOSE:     initialize an arena.
+** INPUT:       {ARENA *a},
+**              pointer to the arena.
+**              {size_t bsize},
+**              the minimum size of the blocks in bytes.
+** RETURN:      {int},
+**              always 0.
+** SIDE EFFECT: 
+** NOTE:        no storage is allocated until the first request.
+*/
+int ArenaInit(ARENA *a, size_t bsize) {
+  a->head = NULL;
+  a->spare = NULL;
+  a->bsize = bsize;
+  a->nalloc = 0;
+  a->nsys = 0;
+  return 0;
+}
+
+/* 
+** FUNCTION:    ArenaAlloc
+** PURPOSE:     allocate n bytes in the arena.
+** INPUT:       {ARENA *a},
+**              pointer to the arena.
+**              {size_t n},
+**              the size in bytes.
+** RETURN:      {void *},
+**              the storage, or NULL if a new block cannot be allocated.
+** SIDE EFFECT: 
+** NOTE:        a released block large enough is reused before a new
+**              one is obtained from malloc.
+*/
+void *ArenaAlloc(ARENA *a, size_t n) {
+  ARENA_BLOCK *b, **pb;
+  void *p;
+
+  n = ArenaRound(n);
+  b = a->head;
+  if (!b || b->used + n > b->size) {
+    for (pb = &(a->spare); *pb; pb = &((*pb)->next)) {
+      if ((*pb)->size >= n) break;
+    }
+    if (*pb) {
+      b = *pb;
+      *pb = b->next;
+    } else {
+      size_t size = n > a->bsize ? n : a->bsize;
+      b = malloc(ArenaRound(sizeof(ARENA_BLOCK)) + size);
+      if (!b) return NULL;
+      b->size = size;
+      a->nsys++;
+    }
+    b->used = 0;
+    b->next = a->head;
+    a->head = b;
+  }
+
+  p = ArenaData(b) + b->used;
+  b->used += n;
+  a->nalloc++;
+
+  return p;
+}
+
+void *ArenaCalloc(ARENA *a, size_t n, size_t size) {
+  void *p;
+
+  p = ArenaAlloc(a, n*size);
+  if (p) memset(p, 0, n*size);
+  return p;
+}
+
+/* 
+** FUNCTION:    ArenaMark, ArenaRelease
+** PURPOSE:     record the state of the arena, and return all storage
+**              allocated since then.
+** INPUT:       {ARENA *a},
+**              pointer to the arena.
+**              {ARENA_MARK *m},
+**              the mark.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        marks must be released in the reverse order they were
+**              taken; releasing a mark invalidates all later ones.
+*/
+void ArenaMark(const ARENA *a, ARENA_MARK *m) {
+  m->block = a->head;
+  m->used = a->head ? a->head->used : 0;
+}
+
+void ArenaRelease(ARENA *a, const ARENA_MARK *m) {
+  ARENA_BLOCK *b;
+
+  while (a->head && a->head != m->block) {
+    b = a->head;
+    a->head = b->next;
+    b->next = a->spare;
+    a->spare = b;
+  }
+  if (a->head) a->head->used = m->used;
+}
+
+/* 
+** FUNCTION:    ArenaFree
+** PURPOSE:     free all storage of the arena.
+** INPUT:       {ARENA *a},
+**              pointer to the arena.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        the statistics are kept.
+*/
+void ArenaFree(ARENA *a) {
+  ARENA_BLOCK *b;
+
+  while (a->head) {
+    b = a->head;
+    a->head = b->next;
+    free(b);
+  }
+  while (a->spare) {
+    b = a->spare;
+    a->spare = b->next;
+    free(b);
+  }
+}
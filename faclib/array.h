@@ -20,6 +20,8 @@
 #ifndef _ARRAY_H_
 #define _ARRAY_H_ 1
 
+#include <stddef.h>
+
 /*************************************************************
   Header of module "array"
   
@@ -130,17 +132,54 @@ struct _ARRAY_ {
 **              {ARRAY *array},
 **              the multi-dimensional array is implemented as array 
 **              of arrays. 
-** NOTE:        
+**              {unsigned short hbits},
+**              log2 of the number of hash buckets in array.
+**              {FreeElem, InitData},
+**              element destructor and initializer of the buckets.
+** NOTE:        the buckets are allocated on the first insertion, and
+**              their number grows with the number of elements.
 */
 typedef struct _MULTI_ {
   int numelem, maxelem;
   unsigned short ndim;
+  unsigned short hbits;
   unsigned short isize;
   unsigned short esize;
   unsigned short *block;
   ARRAY *array;
+  ARRAY_ELEM_FREE FreeElem;
+  ARRAY_DATA_INIT InitData;
 } MULTI;
 
+/*
+** STRUCT:      ARENA
+** PURPOSE:     a region allocator for short-lived scratch storage.
+** FIELDS:      {ARENA_BLOCK *head},
+**              the chain of blocks in use, the newest first.
+**              {ARENA_BLOCK *spare},
+**              released blocks, kept for reuse.
+**              {size_t bsize},
+**              the minimum size of a block in bytes.
+**              {long nalloc, nsys},
+**              the numbers of allocations served and of blocks
+**              obtained from malloc, see cfac_get_arena_stats().
+** NOTE:        there is no per-allocation free; the storage is returned
+**              by rewinding to a mark taken with ArenaMark().
+*/
+typedef struct _ARENA_BLOCK_ ARENA_BLOCK;
+
+typedef struct _ARENA_ {
+  ARENA_BLOCK *head;
+  ARENA_BLOCK *spare;
+  size_t bsize;
+  long nalloc, nsys;
+} ARENA;
+
+typedef struct _ARENA_MARK_ {
+  ARENA_BLOCK *block;
+  size_t used;
+} ARENA_MARK;
+
 int   ArrayInit(ARRAY *a, int esize, int block,
     ARRAY_ELEM_FREE FreeElem, ARRAY_DATA_INIT InitData);
 void *ArrayGet(ARRAY *a, int i);
@@ -162,6 +201,13 @@ int   NMultiFree(MULTI *ma);
 int   NMultiFreeDataOnly(ARRAY *a);
 int   NMultiFreeData(MULTI *ma);
 
+int   ArenaInit(ARENA *a, size_t bsize);
+void *ArenaAlloc(ARENA *a, size_t n);
+void *ArenaCalloc(ARENA *a, size_t n, size_t size);
+void  ArenaMark(const ARENA *a, ARENA_MARK *m);
+void  ArenaRelease(ARENA *a, const ARENA_MARK *m);
+void  ArenaFree(ARENA *a);
+
 void  InitIntData(void *p, int n);
 void  InitDoubleData(void *p, int n);
 void  InitPointerData(void *p, int n);
@@ -165,6 +165,7 @@ cfac_t *cfac_new(void)
 {
     cfac_t *cfac;
     unsigned int i;
+    int blocks[2];
     
     cfac = malloc(sizeof(cfac_t));
     if (!cfac) {
@@ -173,6 +174,7 @@ cfac_t *cfac_new(void)
     memset(cfac, 0, sizeof(cfac_t));
 
     cfac->confint = 0;
+    cfac->nthreads = 1;
     
     cfac->angz_maxn = 0;
     cfac->angz_cut = ANGZCUT;
@@ -233,14 +235,17 @@ cfac_t *cfac_new(void)
         return NULL;
     }
     
+    /* the Hamiltonians are allocated by ConstructHamilton() as needed */
     cfac->nhams = 0;
-    cfac->hams = malloc(MAX_HAMS*sizeof(SHAMILTON));
-    if (!cfac->hams) {
+    cfac->hams_alloc = 0;
+    cfac->hams = NULL;
+
+    cfac->arena = malloc(sizeof(ARENA));
+    if (!cfac->arena) {
         cfac_free(cfac);
         return NULL;
     }
-    memset(cfac->hams, 0, MAX_HAMS*sizeof(SHAMILTON));
-
+    ArenaInit(cfac->arena, ARENA_BSIZE);
 
     cfac->levels = malloc(sizeof(ARRAY));
     if (!cfac->levels) {
@@ -265,21 +270,22 @@ cfac_t *cfac_new(void)
     }
     ArrayInit(cfac->ecorrections, sizeof(ECORRECTION), 512, NULL, NULL);
 
-
-    cfac->angz_array = malloc(sizeof(ANGZ_DATUM)*MAX_HAMS2);
-    if (!cfac->angz_array) {
-        cfac_free(cfac);
-        return NULL;
-    }
-    memset(cfac->angz_array, 0, sizeof(ANGZ_DATUM)*MAX_HAMS2);
-    
-    cfac->angzxz_array = malloc(sizeof(ANGZ_DATUM)*MAX_HAMS2);
-    if (!cfac->angzxz_array) {
+    /* angular coefficients, hashed by pairs of Hamiltonians */
+    blocks[0] = blocks[1] = MULTI_BLOCK2;
+    cfac->angz_array   = calloc(1, sizeof(MULTI));
+    cfac->angzxz_array = calloc(1, sizeof(MULTI));
+    cfac->angmz_array  = calloc(1, sizeof(MULTI));
+    if (!cfac->angz_array || !cfac->angzxz_array || !cfac->angmz_array) {
         cfac_free(cfac);
         return NULL;
     }
-    memset(cfac->angzxz_array, 0, sizeof(ANGZ_DATUM)*MAX_HAMS2);
-    
+    MultiInit(cfac->angz_array,
+        sizeof(ANGZ_DATUM), 2, blocks, FreeAngZData, InitAngZData);
+    MultiInit(cfac->angzxz_array,
+        sizeof(ANGZ_DATUM), 2, blocks, FreeAngZData, InitAngZData);
+    MultiInit(cfac->angmz_array,
+        sizeof(ANGZ_DATUM), 2, blocks, FreeAngZData, InitAngZData);
+
     cfac->tr_opts.gauge = DGAUGE;
     cfac->tr_opts.mode  = DMODE;
     cfac->tr_opts.max_e = ERANK;
@@ -352,27 +358,25 @@ void cfac_free(cfac_t *cfac)
         
         FreeHamsArray(cfac);
         free(cfac->hams);
+
+        if (cfac->arena) {
+            ArenaFree(cfac->arena);
+            free(cfac->arena);
+        }
         
         if (cfac->angz_array) {
-            for (i = 0; i < MAX_HAMS2; i++) {
-                FreeAngZDatum(&(cfac->angz_array[i]));
-            }
+            MultiFree(cfac->angz_array);
             free(cfac->angz_array);
         }
-        
         if (cfac->angzxz_array) {
-            for (i = 0; i < MAX_HAMS2; i++) {
-                FreeAngZDatum(&(cfac->angzxz_array[i]));
-            }
+            MultiFree(cfac->angzxz_array);
             free(cfac->angzxz_array);
         }
-        
         if (cfac->angmz_array) {
-            for (i = 0; i < MAX_HAMS2; i++) {
-                FreeAngZDatum(&(cfac->angmz_array[i]));
-            }
+            MultiFree(cfac->angmz_array);
             free(cfac->angmz_array);
         }
+        FreeAngZStore(cfac->angz_store);
         
         if (cfac->sym_jj) {
             free(cfac->sym_jj);
@@ -381,3 +385,19 @@ void cfac_free(cfac_t *cfac)
         free(cfac);
     }
 }
+
+int cfac_get_arena_stats(const cfac_t *cfac, long *nalloc, long *nsys)
+{
+    if (!cfac || !cfac->arena) {
+        return CFAC_FAILURE;
+    }
+
+    if (nalloc) {
+        *nalloc = cfac->arena->nalloc;
+    }
+    if (nsys) {
+        *nsys = cfac->arena->nsys;
+    }
+
+    return CFAC_SUCCESS;
+}
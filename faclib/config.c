@@ -32,6 +32,11 @@
 #include <ctype.h>
 #include <math.h>
 
+#include "sysdef.h"
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
+
 #include "cfacP.h"
 #include "parser.h"
 
@@ -1169,6 +1174,109 @@ int Couple(CONFIG *cfg) {
   return errcode;
 }
 
+/* number of configurations a worker takes at a time */
+#define COUPLE_CHUNK 16
+
+typedef struct {
+  CONFIG *cfg;
+  int ncfg;
+  int next;
+  int status;
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_t mutex;
+#endif
+} COUPLE_JOBS;
+
+static void *CoupleWorker(void *arg) {
+  COUPLE_JOBS *jobs = arg;
+  int i, i0, i1;
+
+  while (1) {
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_lock(&jobs->mutex);
+#endif
+    i0 = jobs->next;
+    i1 = i0 + COUPLE_CHUNK;
+    if (i1 > jobs->ncfg) i1 = jobs->ncfg;
+    jobs->next = i1;
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_unlock(&jobs->mutex);
+#endif
+    if (i0 >= i1) break;
+    for (i = i0; i < i1; i++) {
+      if (Couple(jobs->cfg+i) < 0) {
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&jobs->mutex);
+#endif
+	jobs->status = -1;
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_unlock(&jobs->mutex);
+#endif
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* 
+** FUNCTION:    CoupleConfigs
+** PURPOSE:     construct the states of a list of configurations.
+** INPUT:       {int ncfg},
+**              number of configurations.
+**              {CONFIG *cfg},
+**              the configurations to be coupled.
+** RETURN:      {int},
+**               0: success.
+**              <0: error.
+** SIDE EFFECT: 
+** NOTE:        the configurations are independent of each other and
+**              are distributed over cfac->nthreads worker threads, if
+**              so requested. Each of them is coupled exactly as by 
+**              Couple(), so the result does not depend on the number
+**              of threads.
+*/
+int CoupleConfigs(const cfac_t *cfac, int ncfg, CONFIG *cfg) {
+  COUPLE_JOBS jobs;
+#ifdef HAVE_LIBPTHREAD
+  pthread_t *threads = NULL;
+  int nthreads, i;
+#endif
+
+  jobs.cfg = cfg;
+  jobs.ncfg = ncfg;
+  jobs.next = 0;
+  jobs.status = 0;
+
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_init(&jobs.mutex, NULL);
+  nthreads = (ncfg + COUPLE_CHUNK - 1)/COUPLE_CHUNK;
+  if (nthreads > (int) cfac->nthreads) nthreads = cfac->nthreads;
+  /* the calling thread is one of the workers */
+  nthreads--;
+  if (nthreads > 0) {
+    threads = malloc(sizeof(pthread_t)*nthreads);
+    if (threads == NULL) nthreads = 0;
+  }
+  for (i = 0; i < nthreads; i++) {
+    if (pthread_create(threads+i, NULL, CoupleWorker, &jobs)) break;
+  }
+  nthreads = i;
+#endif
+
+  CoupleWorker(&jobs);
+
+#ifdef HAVE_LIBPTHREAD
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&jobs.mutex);
+#endif
+
+  return jobs.status;
+}
+
 /* 
 ** FUNCTION:    CoupleOutmost
 ** PURPOSE:     constructs all possible states by coupling 
@@ -1564,6 +1672,18 @@ void PackShellState(SHELL_STATE *s, int J, int j, int nu, int Nr){
   s->Nr = Nr;
 }
 
+/* hash of the (at most GROUP_NAME_LEN long) group name, FNV-1a */
+static int GroupNameHash(const char *name) {
+  unsigned int h = 2166136261U;
+  int i;
+
+  for (i = 0; i < GROUP_NAME_LEN && name[i]; i++) {
+    h = (h ^ (unsigned char) name[i])*16777619U;
+  }
+
+  return h & (GROUP_HASH_SIZE - 1);
+}
+
 /* 
 ** FUNCTION:    GroupIndex
 ** PURPOSE:     find the index of the group by its name.
@@ -1595,13 +1715,43 @@ int GroupIndex(cfac_t *cfac, const char *name) {
 ** NOTE:        
 */
 int GroupExists(const cfac_t *cfac, const char *name) {
-  int i;
+  int h, k;
 
-  for (i = cfac->n_groups - 1; i >= 0; i--) {
-    if (strncmp(name, cfac->cfg_groups[i].name, GROUP_NAME_LEN) == 0) 
+  h = GroupNameHash(name);
+  while ((k = cfac->group_hash[h]) > 0) {
+    if (strncmp(name, cfac->cfg_groups[k-1].name, GROUP_NAME_LEN) == 0) {
+      return k-1;
+    }
+    h = (h + 1) & (GROUP_HASH_SIZE - 1);
+  }
+
+  return -1;
+}
+
+/* 
+** FUNCTION:    HashGroup
+** PURPOSE:     enter a group into the hash table of group names.
+** INPUT:       {int k},
+**              the group index.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        an existing group with the same name is shadowed,
+**              as GroupExists() used to return the last one. 
+**              The table never fills up, since it is larger 
+**              than MAX_GROUPS.
+*/
+static void HashGroup(cfac_t *cfac, int k) {
+  const char *name = cfac->cfg_groups[k].name;
+  int h, m;
+
+  h = GroupNameHash(name);
+  while ((m = cfac->group_hash[h]) > 0) {
+    if (strncmp(name, cfac->cfg_groups[m-1].name, GROUP_NAME_LEN) == 0) {
       break;
+    }
+    h = (h + 1) & (GROUP_HASH_SIZE - 1);
   }
-  return i;
+  cfac->group_hash[h] = k+1;
 }
 
 /* 
@@ -1621,6 +1771,7 @@ int AddGroup(cfac_t *cfac, const char *name) {
     exit(1);
   }
   strncpy(cfac->cfg_groups[cfac->n_groups].name, name, GROUP_NAME_LEN);
+  HashGroup(cfac, cfac->n_groups);
   cfac->n_groups++;
   return cfac->n_groups-1;
 }
@@ -1654,6 +1805,7 @@ CONFIG_GROUP *GetNewGroup(cfac_t *cfac) {
     printf("Max # groups reached\n");
     exit(1);
   }
+  HashGroup(cfac, cfac->n_groups);
   cfac->n_groups++;
   return cfac->cfg_groups+cfac->n_groups-1;
 }
@@ -1762,6 +1914,7 @@ int AddConfigToList(cfac_t *cfac, int k, CONFIG *cfg) {
   if (m < cfg->n_shells) {
     cfg->nrs = realloc(cfg->nrs, sizeof(int)*m);
   }
+  ConfigOccSignature(cfg);
   if (ArrayAppend(clist, cfg) == NULL) return -1;
   if (cfg->n_csfs > 0) {    
     AddConfigToSymmetry(cfac, k, cfgr->n_cfgs, cfg); 
@@ -1771,6 +1924,36 @@ int AddConfigToList(cfac_t *cfac, int k, CONFIG *cfg) {
   return 0;
 }
 
+/* 
+** FUNCTION:    AddConfigsToList
+** PURPOSE:     couple a list of configurations and add them to the 
+**              specified group.
+** INPUT:       {int k},
+**              the group index where the configs are added to.
+**              {int ncfg},
+**              number of configurations.
+**              {CONFIG *cfg},
+**              the configurations, as returned by GetConfigFromString.
+** RETURN:      {int},
+**               0: success.
+**              -1: error.
+** SIDE EFFECT: 
+** NOTE:        the coupling is done in parallel by CoupleConfigs(); the
+**              configurations are then added one by one in their
+**              original order, so that the group and symmetry lists are
+**              the same as in a serial run.
+*/
+int AddConfigsToList(cfac_t *cfac, int k, int ncfg, CONFIG *cfg) {
+  int i;
+
+  if (CoupleConfigs(cfac, ncfg, cfg) < 0) return -1;
+  for (i = 0; i < ncfg; i++) {
+    if (AddConfigToList(cfac, k, cfg+i) < 0) return -1;
+  }
+
+  return 0;
+}
+
 /* 
 ** FUNCTION:    AddStateToSymmetry
 ** PURPOSE:     add a state to the symmetry list.
@@ -1919,6 +2102,52 @@ int ShellToInt(int n, int kappa) {
   return k;
 }
 
+/* 
+** FUNCTION:    ConfigOccSignature, ConfigOccDiff
+** PURPOSE:     set the occupation signature of a configuration, and
+**              compare the signatures of two.
+** INPUT:       {CONFIG *cfg, *c1, *c2},
+**              the configurations.
+** RETURN:      {int},
+**              ConfigOccDiff: the number of bits set in only one of
+**              the signatures.
+** SIDE EFFECT: 
+** NOTE:        each occupied subshell sets the bit ShellToInt() modulo
+**              64*CFG_SIG_WORDS, so the result never exceeds the number
+**              of subshells occupied in one configuration only. an
+**              operator moving m electrons connects configurations
+**              with at most 2*m of them.
+*/
+void ConfigOccSignature(CONFIG *cfg) {
+  int i, k;
+
+  for (i = 0; i < CFG_SIG_WORDS; i++) {
+    cfg->occ_sig[i] = 0;
+  }
+  for (i = 0; i < cfg->n_shells; i++) {
+    if (cfg->shells[i].nq <= 0) continue;
+    k = ShellToInt(cfg->shells[i].n, cfg->shells[i].kappa);
+    k %= 64*CFG_SIG_WORDS;
+    cfg->occ_sig[k/64] |= ((uint64_t) 1) << (k%64);
+  }
+}
+
+int ConfigOccDiff(const CONFIG *c1, const CONFIG *c2) {
+  uint64_t x;
+  int i, m;
+
+  m = 0;
+  for (i = 0; i < CFG_SIG_WORDS; i++) {
+    x = c1->occ_sig[i] ^ c2->occ_sig[i];
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    m += (int) ((x * 0x0101010101010101ULL) >> 56);
+  }
+
+  return m;
+}
+
 void IntToShell(int i, int *n, int *kappa) {  
   int k;
 
@@ -2186,6 +2415,47 @@ int InGroups(int kg, int ng, const int *kgroup) {
   return 0;
 }
 
+/* 
+** FUNCTION:    GroupSetInit
+** PURPOSE:     build the set of groups from a list of them.
+** INPUT:       {GROUP_SET *gs},
+**              the set to be built.
+**              {int ng, *kgroup}
+**              the number and index of the groups in the list.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        
+*/
+void GroupSetInit(GROUP_SET *gs, int ng, const int *kgroup) {
+  int i, kg;
+
+  memset(gs, 0, sizeof(GROUP_SET));
+  for (i = 0; i < ng; i++) {
+    kg = kgroup[i];
+    if (kg >= 0 && kg < MAX_GROUPS) {
+      gs->w[kg>>6] |= ((uint64_t) 1) << (kg&63);
+    }
+  }
+}
+
+/* 
+** FUNCTION:    InGroupSet
+** PURPOSE:     determine if a group is within a set of groups.
+** INPUT:       {GROUP_SET *gs},
+**              the set of groups.
+**              {int kg},
+**              the index of the group to be tested.
+** RETURN:      {int},
+**              0: group kg is not in the set.
+**              1: group kg is in the set.
+** SIDE EFFECT: 
+** NOTE:        same as InGroups(), in constant time.
+*/
+int InGroupSet(const GROUP_SET *gs, int kg) {
+  if (kg < 0 || kg >= MAX_GROUPS) return 0;
+  return (gs->w[kg>>6] >> (kg&63)) & 1;
+}
+
 /* 
 ** FUNCTION:    CompareShell
 ** PURPOSE:     determine which of the two shells is the inner one.
@@ -2252,15 +2522,7 @@ void FreeConfigData(void *p) {
 }
 
 int cfac_get_config_gid(const cfac_t *cfac, const char *cname) {
-    int i;
-
-    for (i = cfac->n_groups - 1; i >= 0; i--) {
-        if (!strncmp(cname, cfac->cfg_groups[i].name, GROUP_NAME_LEN)) {
-            return i;
-        }
-    }
-    
-    return -1;
+    return GroupExists(cfac, cname);
 }
 
 int cfac_add_config(cfac_t *cfac,
@@ -2281,15 +2543,10 @@ int cfac_add_config(cfac_t *cfac,
     ncfgs = GetConfigFromString(&cfgs, tmpstr);
     free(tmpstr);
     for (j = 0; j < ncfgs; j++) {
-        CONFIG *cfg = &cfgs[j];
-        cfg->uta = uta;
-        
-        if (Couple(cfg) < 0) {
-            return -1;
-        }
-        if (AddConfigToList(cfac, gidx, cfg) < 0) {
-            return -1;
-        }
+        cfgs[j].uta = uta;
+    }
+    if (AddConfigsToList(cfac, gidx, ncfgs, cfgs) < 0) {
+        return -1;
     }
     
     if (ncfgs > 0) {
@@ -2299,6 +2556,17 @@ int cfac_add_config(cfac_t *cfac,
     return gidx;
 }
 
+int cfac_set_nthreads(cfac_t *cfac, unsigned int nthreads)
+{
+    if (!cfac || !nthreads) {
+        return CFAC_FAILURE;
+    }
+
+    cfac->nthreads = nthreads;
+
+    return CFAC_SUCCESS;
+}
+
 int cfac_set_uta(cfac_t *cfac, int uta)
 {
     if (cfac) {
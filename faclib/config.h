@@ -28,6 +28,8 @@
   Author: M. F. Gu, mfgu@stanford.edu
 **************************************************************/
 
+#include <stdint.h>
+
 #include "cfacP.h"
 #include "consts.h"
 #include "array.h"
@@ -100,7 +102,12 @@ typedef struct _SHELL_RESTRICTION_ {
 /*
 ** NOTE:        shells and csfs have the shells in reverse order,
 **              i.e., the outermost shell is in the beginning of the list.
+**              occ_sig is the set of occupied subshells, with the
+**              ShellToInt indexes folded into CFG_SIG_WORDS words;
+**              it is set by AddConfigToList.
 */
+#define CFG_SIG_WORDS 2
+
 typedef struct _CONFIG_ {
   int uta;
   
@@ -114,6 +121,7 @@ typedef struct _CONFIG_ {
                         configuration indices                      */
   SHELL *shells;     /* array of shells                            */
   SHELL_STATE *csfs; /* a list specifying all states               */
+  uint64_t occ_sig[CFG_SIG_WORDS]; /* occupation signature         */
 } CONFIG;
 
 
@@ -159,6 +167,19 @@ typedef struct _CONFIG_GROUP_ {
   char name[GROUP_NAME_LEN]; 
 } CONFIG_GROUP;
 
+/*
+** STRUCT:      GROUP_SET
+** PURPOSE:     a set of configuration groups.
+** FIELDS:      {uint64_t w[]},
+**              bitmap over the group indices.
+** NOTE:        built once from a list of groups, it replaces 
+**              InGroups() in the loops over the symmetry states.
+*/
+#define GROUP_SET_WORDS ((MAX_GROUPS + 63)/64)
+typedef struct _GROUP_SET_ {
+  uint64_t w[GROUP_SET_WORDS];
+} GROUP_SET;
+
 /*
 ** STRUCT:      STATE
 ** PURPOSE:     a basis state.
@@ -209,6 +230,7 @@ int          GetAverageConfigFromString(int **n, int **kappa,
 					double **nq, char *scfg);
 int          Couple(CONFIG *cfg);
 int          CoupleOutmost(CONFIG *cfg, CONFIG *outmost, CONFIG *inner);
+int          CoupleConfigs(const cfac_t *cfac, int ncfg, CONFIG *cfg);
 int          GetSingleShell(CONFIG *cfg);
 void         UnpackShell(SHELL *s, int *n, int *kl, int *j, int *nq);
 void         PackShell(SHELL *s, int n, int kl, int j, int nq); 
@@ -227,6 +249,8 @@ int          GetKappaFromJL(int j, int kl);
 int          CompareShell(const void *s1, const void *s2);
 int          ShellClosed(SHELL *s);
 int          ShellToInt(int n, int k);
+void         ConfigOccSignature(CONFIG *cfg);
+int          ConfigOccDiff(const CONFIG *c1, const CONFIG *c2);
 int          ShellIndex(int n, int kappa, int ns, SHELL *s);
 void         IntToShell(int i, int *n, int *k);
 void         PackShellState(SHELL_STATE *s, int J, int j, int nu, int Nr);
@@ -234,6 +258,7 @@ int          MakeAverageConfig(cfac_t *cfac, int ng, int *kg, double *weight);
 int          GroupIndex(cfac_t *cfac, const char *name);
 int          GroupExists(const cfac_t *cfac, const char *name);
 int          AddConfigToList(cfac_t *cfac, int k, CONFIG *cfg);
+int          AddConfigsToList(cfac_t *cfac, int k, int ncfg, CONFIG *cfg);
 int          AddGroup(cfac_t *cfac, const char *name);
 CONFIG_GROUP *GetGroup(const cfac_t *cfac, int k);
 CONFIG_GROUP *GetNewGroup(cfac_t *cfac);
@@ -253,5 +278,7 @@ int          ConstructConfigName(char *s, int n, CONFIG *c);
 void         ListConfig(const cfac_t *cfac, const char *fn, int n, int *kg);
 int          IBisect(int k, int n, int *a);
 int          InGroups(int kg, int ng, const int *kgroup);
+void         GroupSetInit(GROUP_SET *gs, int ng, const int *kgroup);
+int          InGroupSet(const GROUP_SET *gs, int kg);
 
 #endif
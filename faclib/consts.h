@@ -160,6 +160,7 @@
 #define LEVEL_NAME_LEN     128
 #define GROUP_NAME_LEN     64
 #define MAX_GROUPS         600
+#define GROUP_HASH_SIZE    1024 /* a power of 2, larger than MAX_GROUPS */
 #define MAX_SYMMETRIES     400
 #define CONFIGS_BLOCK      1024
 #define STATES_BLOCK       2048
@@ -178,8 +179,8 @@
 #define RCOREMIN           50
 
 /* structure */
-#define MAX_HAMS           2000
-#define MAX_HAMS2          (MAX_HAMS*MAX_HAMS)
+#define HAMS_BLOCK         64
+#define ARENA_BSIZE        65536
 #define LEVELS_BLOCK       1024
 #define ANGZ_BLOCK         1024
 #define ANGZxZ_BLOCK       8192
@@ -50,6 +50,12 @@ static int mem_enf_table_size = 0;
 static int iground;
 static int iuta = 0;
 
+static int block_index = 0;
+static char *idx_fname[NDB];
+static IDX_RECORD idx_current[NDB];
+static IDX_RECORD *idx_blocks[NDB];
+static int idx_nblocks[NDB];
+
 #define _WSF0(sv, f) {					\
     n = fwrite(&(sv), sizeof(sv), 1, f);		\
     if (n != 1) return 0;				\
@@ -680,6 +686,34 @@ int WriteCIMHeader(FILE *f, CIM_HEADER *h) {
   return m;
 }
 
+static void IndexEnergy(int t, double e) {
+  IDX_RECORD *r;
+
+  if (!block_index) return;
+
+  r = &idx_current[t-1];
+  if (r->nrecords == 0 || e < r->emin) r->emin = e;
+  if (r->nrecords == 0 || e > r->emax) r->emax = e;
+}
+
+static void IndexRecord(int t, int lower, int upper) {
+  IDX_RECORD *r;
+
+  if (!block_index) return;
+
+  r = &idx_current[t-1];
+  if (r->nrecords == 0) {
+    r->lower[0] = r->lower[1] = lower;
+    r->upper[0] = r->upper[1] = upper;
+  } else {
+    if (lower < r->lower[0]) r->lower[0] = lower;
+    if (lower > r->lower[1]) r->lower[1] = lower;
+    if (upper < r->upper[0]) r->upper[0] = upper;
+    if (upper > r->upper[1]) r->upper[1] = upper;
+  }
+  r->nrecords++;
+}
+
 int WriteENRecord(FILE *f, EN_RECORD *r) {
   int n, m = 0, len;
 
@@ -706,6 +740,9 @@ int WriteENRecord(FILE *f, EN_RECORD *r) {
   WSF1(r->sname, sizeof(char), LSNAME);
   WSF1(r->name, sizeof(char), LNAME);
 
+  IndexEnergy(DB_EN, r->energy);
+  IndexRecord(DB_EN, r->ilev, r->ilev);
+
   en_header.nlevels += 1;
   en_header.length += m;
 
@@ -724,6 +761,9 @@ int WriteENFRecord(FILE *f, ENF_RECORD *r) {
   WSF0(r->energy);
   WSF0(r->pbasis);
   
+  IndexEnergy(DB_ENF, r->energy);
+  IndexRecord(DB_ENF, r->ilev, r->ilev);
+
   enf_header.nlevels += 1;
   enf_header.length += m;
 
@@ -745,6 +785,8 @@ int WriteTRRecord(FILE *f, TR_RECORD *r, TR_EXTRA *rx) {
   WSF0(rx->de);
   WSF0(rx->sdev);
 
+  IndexRecord(DB_TR, r->lower, r->upper);
+
   tr_header.ntransitions += 1;
   tr_header.length += m;
 
@@ -763,6 +805,8 @@ int WriteTRFRecord(FILE *f, TRF_RECORD *r) {
   WSF0(r->upper);
   WSF1(r->strength, sizeof(float), 2*abs(trf_header.multipole)+1);
 
+  IndexRecord(DB_TRF, r->lower, r->upper);
+
   trf_header.ntransitions += 1;
   trf_header.length += m;
 
@@ -793,6 +837,8 @@ int WriteCERecord(FILE *f, CE_RECORD *r) {
   m0 = ce_header.n_usr * r->nsub;
   WSF1(r->strength, sizeof(float), m0);
 
+  IndexRecord(DB_CE, r->lower, r->upper);
+
   ce_header.ntransitions += 1;
   ce_header.length += m;
 
@@ -816,6 +862,8 @@ int WriteCEFRecord(FILE *f, CEF_RECORD *r) {
   m0 = cef_header.n_egrid;
   WSF1(r->strength, sizeof(float), m0);
   
+  IndexRecord(DB_CEF, r->lower, r->upper);
+
   cef_header.ntransitions += 1;
   cef_header.length += m;
 
@@ -841,6 +889,8 @@ int WriteCEMFRecord(FILE *f, CEMF_RECORD *r) {
   m0 = cemf_header.n_egrid * m0;
   WSF1(r->strength, sizeof(float), m0);
   
+  IndexRecord(DB_CEMF, r->lower, r->upper);
+
   cemf_header.ntransitions += 1;
   cemf_header.length += m;
 
@@ -867,6 +917,8 @@ int WriteRRRecord(FILE *f, RR_RECORD *r) {
   m0 = rr_header.n_usr;
   WSF1(r->strength, sizeof(float), m0);
 
+  IndexRecord(DB_RR, r->b, r->f);
+
   rr_header.ntransitions += 1;
   rr_header.length += m;
 
@@ -885,6 +937,8 @@ int WriteAIRecord(FILE *f, AI_RECORD *r) {
   WSF0(r->f);
   WSF0(r->rate);
 
+  IndexRecord(DB_AI, r->b, r->f);
+
   ai_header.ntransitions += 1;
   ai_header.length += m;
 
@@ -904,6 +958,8 @@ int WriteAIMRecord(FILE *f, AIM_RECORD *r) {
   WSF0(r->nsub);
   WSF1(r->rate, sizeof(float), r->nsub);
   
+  IndexRecord(DB_AIM, r->b, r->f);
+
   aim_header.ntransitions += 1;
   aim_header.length += m;
 
@@ -927,6 +983,8 @@ int WriteCIRecord(FILE *f, CI_RECORD *r) {
   m0 = ci_header.n_usr;
   WSF1(r->strength, sizeof(float), m0);
 
+  IndexRecord(DB_CI, r->b, r->f);
+
   ci_header.ntransitions += 1;
   ci_header.length += m;
 
@@ -948,6 +1006,8 @@ int WriteCIMRecord(FILE *f, CIM_RECORD *r) {
   m0 = r->nsub*cim_header.n_usr;
   WSF1(r->strength, sizeof(float), m0);
   
+  IndexRecord(DB_CIM, r->b, r->f);
+
   cim_header.ntransitions += 1;
   cim_header.length += m;
 
@@ -1582,6 +1642,269 @@ int ReadCIMRecord(FILE *f, CIM_RECORD *r, int swp, CIM_HEADER *h) {
   return m;
 } 
   
+static int WriteIDXRecord(FILE *f, IDX_RECORD *r) {
+  int n, m = 0;
+
+  WSF0(r->position);
+  WSF0(r->length);
+  WSF0(r->nele);
+  WSF0(r->nrecords);
+  WSF1(r->lower, sizeof(int), 2);
+  WSF1(r->upper, sizeof(int), 2);
+  WSF0(r->emin);
+  WSF0(r->emax);
+
+  return m;
+}
+
+static int ReadIDXRecord(FILE *f, IDX_RECORD *r, int swp) {
+  int n, i, m = 0;
+
+  RSF0(r->position);
+  RSF0(r->length);
+  RSF0(r->nele);
+  RSF0(r->nrecords);
+  RSF1(r->lower, sizeof(int), 2);
+  RSF1(r->upper, sizeof(int), 2);
+  RSF0(r->emin);
+  RSF0(r->emax);
+
+  if (swp) {
+    SwapEndian((char *) &(r->position), sizeof(int64_t));
+    SwapEndian((char *) &(r->length), sizeof(int64_t));
+    SwapEndian((char *) &(r->nele), sizeof(int));
+    SwapEndian((char *) &(r->nrecords), sizeof(int));
+    for (i = 0; i < 2; i++) {
+      SwapEndian((char *) &(r->lower[i]), sizeof(int));
+      SwapEndian((char *) &(r->upper[i]), sizeof(int));
+    }
+    SwapEndian((char *) &(r->emin), sizeof(double));
+    SwapEndian((char *) &(r->emax), sizeof(double));
+  }
+
+  return m;
+}
+
+int SetBlockIndex(int m) {
+  block_index = m ? 1 : 0;
+
+  return 0;
+}
+
+static char *BlockIndexFileName(const char *fn) {
+  char *ifn;
+
+  ifn = malloc(strlen(fn) + strlen(DB_IDX_SUFFIX) + 1);
+  if (ifn) {
+    strcpy(ifn, fn);
+    strcat(ifn, DB_IDX_SUFFIX);
+  }
+
+  return ifn;
+}
+
+static void OpenBlockIndex(int ihdr, const char *fn) {
+  DB_INDEX idx;
+
+  if (idx_fname[ihdr]) free(idx_fname[ihdr]);
+  idx_fname[ihdr] = BlockIndexFileName(fn);
+
+  if (fheader[ihdr].nblocks == 0) {
+    if (idx_blocks[ihdr]) free(idx_blocks[ihdr]);
+    idx_blocks[ihdr] = NULL;
+    idx_nblocks[ihdr] = 0;
+  } else if (idx_nblocks[ihdr] == 0 && ReadBlockIndex(fn, &idx) == 0) {
+    /* appending to a file produced earlier, pick up its index */
+    idx_blocks[ihdr] = idx.blocks;
+    idx_nblocks[ihdr] = idx.nblocks;
+  }
+}
+
+static void InitBlockIndex(int t, long int p) {
+  IDX_RECORD *r;
+  double *e;
+  int i, ne;
+
+  r = &idx_current[t-1];
+  memset(r, 0, sizeof(IDX_RECORD));
+  r->position = p;
+
+  switch (t) {
+  case DB_CE:
+    e = ce_header.usr_egrid;
+    ne = ce_header.n_usr;
+    break;
+  case DB_RR:
+    e = rr_header.usr_egrid;
+    ne = rr_header.n_usr;
+    break;
+  case DB_AI:
+    e = ai_header.egrid;
+    ne = ai_header.n_egrid;
+    break;
+  case DB_AIM:
+    e = aim_header.egrid;
+    ne = aim_header.n_egrid;
+    break;
+  case DB_CI:
+    e = ci_header.usr_egrid;
+    ne = ci_header.n_usr;
+    break;
+  case DB_CIM:
+    e = cim_header.usr_egrid;
+    ne = cim_header.n_usr;
+    break;
+  case DB_CEF:
+    e = cef_header.egrid;
+    ne = cef_header.n_egrid;
+    break;
+  case DB_CEMF:
+    e = cemf_header.egrid;
+    ne = cemf_header.n_egrid;
+    break;
+  default:
+    e = NULL;
+    ne = 0;
+    break;
+  }
+
+  for (i = 0; i < ne; i++) {
+    if (i == 0 || e[i] < r->emin) r->emin = e[i];
+    if (i == 0 || e[i] > r->emax) r->emax = e[i];
+  }
+}
+
+static int AddBlockIndex(int t, int nele, long int length) {
+  IDX_RECORD *r;
+  int ihdr;
+
+  if (!block_index) return 0;
+
+  ihdr = t - 1;
+  r = realloc(idx_blocks[ihdr], sizeof(IDX_RECORD)*(idx_nblocks[ihdr] + 1));
+  if (!r) {
+    return -1;
+  }
+  idx_blocks[ihdr] = r;
+
+  r += idx_nblocks[ihdr];
+  memcpy(r, &idx_current[t-1], sizeof(IDX_RECORD));
+  r->nele = nele;
+  r->length = length;
+  idx_nblocks[ihdr]++;
+
+  return 0;
+}
+
+static int WriteBlockIndex(int ihdr) {
+  F_HEADER fh;
+  FILE *f;
+  int i;
+
+  if (!idx_fname[ihdr] || idx_nblocks[ihdr] == 0) return 0;
+
+  if (idx_nblocks[ihdr] != fheader[ihdr].nblocks) {
+    printf("Incomplete block index, %s not written.\n", idx_fname[ihdr]);
+    return -1;
+  }
+
+  f = fopen(idx_fname[ihdr], "wb");
+  if (f == NULL) {
+    printf("cannot open file %s\n", idx_fname[ihdr]);
+    return -1;
+  }
+
+  memcpy(&fh, &(fheader[ihdr]), sizeof(F_HEADER));
+  fh.nblocks = idx_nblocks[ihdr];
+  i = -1;
+  if (WriteFHeader(f, &fh)) {
+    for (i = 0; i < idx_nblocks[ihdr]; i++) {
+      if (!WriteIDXRecord(f, &(idx_blocks[ihdr][i]))) break;
+    }
+  }
+
+  /* a partial index would be taken for a valid one, do not leave it */
+  if (fclose(f) != 0 || i < idx_nblocks[ihdr]) {
+    printf("write error\n");
+    remove(idx_fname[ihdr]);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* read the block index of the binary file fn */
+int ReadBlockIndex(const char *fn, DB_INDEX *idx) {
+  FILE *f;
+  char *ifn;
+  int i, n, swp;
+
+  idx->nblocks = 0;
+  idx->blocks = NULL;
+
+  ifn = BlockIndexFileName(fn);
+  if (!ifn) return -1;
+  f = fopen(ifn, "rb");
+  free(ifn);
+  if (f == NULL) return -1;
+
+  n = ReadFHeader(f, &(idx->fh), &swp);
+  if (n == 0 || idx->fh.nblocks <= 0) {
+    fclose(f);
+    return -1;
+  }
+
+  idx->blocks = malloc(sizeof(IDX_RECORD)*idx->fh.nblocks);
+  if (!idx->blocks) {
+    fclose(f);
+    return -1;
+  }
+  for (i = 0; i < idx->fh.nblocks; i++) {
+    n = ReadIDXRecord(f, &(idx->blocks[i]), swp);
+    if (n == 0) break;
+  }
+  idx->nblocks = i;
+
+  fclose(f);
+
+  if (idx->nblocks != idx->fh.nblocks) {
+    printf("Error parsing block index of %s!\n", fn);
+    FreeBlockIndex(idx);
+    return -1;
+  }
+
+  return 0;
+}
+
+void FreeBlockIndex(DB_INDEX *idx) {
+  if (idx->blocks) free(idx->blocks);
+  idx->blocks = NULL;
+  idx->nblocks = 0;
+}
+
+/* find the first block, starting with the start-th one, that may contain
+ * the lower -> upper transition. a negative lower or upper matches any
+ * level. returns the block index or -1 if none is found. the block can
+ * then be read by seeking to idx->blocks[i].position and calling the
+ * corresponding Read*Header().
+ */
+int FindTransitionBlock(const DB_INDEX *idx, int lower, int upper, int start) {
+  const IDX_RECORD *r;
+  int i;
+
+  if (idx->fh.type == DB_EN || idx->fh.type == DB_ENF) return -1;
+
+  for (i = start < 0 ? 0 : start; i < idx->nblocks; i++) {
+    r = &(idx->blocks[i]);
+    if (r->nrecords == 0) continue;
+    if (lower >= 0 && (lower < r->lower[0] || lower > r->lower[1])) continue;
+    if (upper >= 0 && (upper < r->upper[0] || upper > r->upper[1])) continue;
+    return i;
+  }
+
+  return -1;
+}
+
 FILE *OpenFile(const char *fn, F_HEADER *fhdr) {
   int ihdr;
   FILE *f;
@@ -1616,6 +1939,10 @@ FILE *OpenFile(const char *fn, F_HEADER *fhdr) {
   fheader[ihdr].atom = fhdr->atom;
   WriteFHeader(f, &(fheader[ihdr]));
 
+  if (block_index) {
+    OpenBlockIndex(ihdr, fn);
+  }
+
   return f;
 }
 
@@ -1628,6 +1955,14 @@ int CloseFile(FILE *f, F_HEADER *fhdr) {
   WriteFHeader(f, &(fheader[ihdr]));
   
   fclose(f);
+
+  if (block_index) {
+    WriteBlockIndex(ihdr);
+  }
+  if (idx_blocks[ihdr]) free(idx_blocks[ihdr]);
+  idx_blocks[ihdr] = NULL;
+  idx_nblocks[ihdr] = 0;
+
   return 0;
 }
 
@@ -1741,6 +2076,10 @@ int InitFile(FILE *f, F_HEADER *fhdr, void *rhdr) {
     break;
   }
 
+  if (block_index) {
+    InitBlockIndex(fhdr->type, p);
+  }
+
   return 0;
 }
 
@@ -1757,6 +2096,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_EN, en_header.nele, en_header.length);
     }
     break;
   case DB_TR:
@@ -1766,6 +2106,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_TR, tr_header.nele, tr_header.length);
     }
     break;
   case DB_CE:
@@ -1775,6 +2116,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_CE, ce_header.nele, ce_header.length);
     }
     break;
   case DB_RR:
@@ -1784,6 +2126,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_RR, rr_header.nele, rr_header.length);
     }
     break;
   case DB_AI:
@@ -1793,6 +2136,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_AI, ai_header.nele, ai_header.length);
     }
     break;
   case DB_CI:
@@ -1802,6 +2146,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_CI, ci_header.nele, ci_header.length);
     }
     break;
   case DB_AIM:
@@ -1811,6 +2156,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_AIM, aim_header.nele, aim_header.length);
     }
     break;
   case DB_CIM:
@@ -1820,6 +2166,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_CIM, cim_header.nele, cim_header.length);
     }
     break;
   case DB_ENF:
@@ -1829,6 +2176,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_ENF, enf_header.nele, enf_header.length);
     }
     break;
   case DB_TRF:
@@ -1838,6 +2186,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_TRF, trf_header.nele, trf_header.length);
     }
     break;
   case DB_CEF:
@@ -1847,6 +2196,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_CEF, cef_header.nele, cef_header.length);
     }
     break;
   case DB_CEMF:
@@ -1856,6 +2206,7 @@ int DeinitFile(FILE *f, F_HEADER *fhdr) {
       if (!n) {
         return 1;
       }
+      AddBlockIndex(DB_CEMF, cemf_header.nele, cemf_header.length);
     }
     break;
   default:
@@ -3235,12 +3586,17 @@ int StoreTable(const cfac_t *cfac,
     FILE *fp;
     int n, swp;
     int retval = 0;
+    int nrows0;
+    struct timespec t0, t1;
 
     fp = fopen(ifn, "rb");
     if (fp == NULL) {
         return -1;
     }
 
+    nrows0 = sqlite3_total_changes(db);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
     n = ReadFHeader(fp, &fh, &swp);
     if (n == 0) {
         fclose(fp);
@@ -3271,6 +3627,16 @@ int StoreTable(const cfac_t *cfac,
     }
 
     fclose(fp);
+
+    if (StoreIsBulk()) {
+        double dt;
+        int nrows = sqlite3_total_changes(db) - nrows0;
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        dt = (t1.tv_sec - t0.tv_sec) + 1.0e-9*(t1.tv_nsec - t0.tv_nsec);
+        printf("%s: %d rows stored in %.2f s (%.0f rows/s)\n",
+            ifn, nrows, dt, dt > 0 ? nrows/dt : 0.0);
+    }
     
     return retval;
 }
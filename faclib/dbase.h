@@ -21,6 +21,7 @@
 #define _DBASE_H_ 1
 
 #include <stdio.h>
+#include <stdint.h>
 #include <sqlite3.h>
 
 #define DB_EN 1
@@ -321,6 +322,38 @@ typedef struct _CIM_RECORD_ {
   float *strength;
 } CIM_RECORD;
 
+/* optional random-access index of the blocks of a binary file. it is
+ * written into a sidecar file (the data file name + DB_IDX_SUFFIX) when
+ * enabled with SetBlockIndex(), and consists of a copy of the F_HEADER
+ * of the data file (with nblocks being the number of index entries)
+ * followed by one IDX_RECORD per block. for transition blocks, lower[]
+ * and upper[] are the ranges of the first (lower or bound) and second
+ * (upper or free) level indices of the records; for DB_EN(F) blocks both
+ * give the range of the level indices. emin and emax are the range of the
+ * level energies for DB_EN(F) blocks and of the user energy grid
+ * (egrid for DB_AI(M)) for the other blocks, if any. position and
+ * length are 64-bit on all platforms, so the index does not depend on
+ * the word size of the host that wrote it.
+ */
+#define DB_IDX_SUFFIX ".idx"
+
+typedef struct _IDX_RECORD_ {
+  int64_t position;
+  int64_t length;
+  int nele;
+  int nrecords;
+  int lower[2];
+  int upper[2];
+  double emin;
+  double emax;
+} IDX_RECORD;
+
+typedef struct _DB_INDEX_ {
+  F_HEADER fh;
+  int nblocks;
+  IDX_RECORD *blocks;
+} DB_INDEX;
+
 /* these read functions interface with the binary data files.
  * they can be used in custom c/c++ codes to read the binary 
  * files directly. to do so, copy consts.h, dbase.h, and dbase.c
@@ -450,6 +483,11 @@ int JoinTable(char *fn1, char *fn2, char *fn);
 int FindLevelByName(char *fn, int nele, char *nc, char *cnr, char *cr);
 int ISearch(int i, int n, int *ia);
 
+int SetBlockIndex(int m);
+int ReadBlockIndex(const char *fn, DB_INDEX *idx);
+void FreeBlockIndex(DB_INDEX *idx);
+int FindTransitionBlock(const DB_INDEX *idx, int lower, int upper, int start);
+
 int StoreInit(const cfac_t *cfac,
     const char *fn, int reset, sqlite3 **db, unsigned long *sid);
 int StoreTable(const cfac_t *cfac,
@@ -462,5 +500,7 @@ int StoreRRTable(const cfac_t *cfac,
 int StoreAITable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp);
 int StoreCITable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp);
 int StoreClose(sqlite3 *db,unsigned long int sid, const char *cmdline);
+int StoreSetBulk(sqlite3 *db, int bulk);
+int StoreIsBulk(void);
 
 #endif
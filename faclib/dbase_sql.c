@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <errno.h>
 #include <math.h>
@@ -30,11 +31,254 @@
 
 #include "schema.i"
 
-#define CFACDB_FORMAT_VERSION   3
+#define CFACDB_FORMAT_VERSION   4
 
 #define SQLITE3_BIND_STR(stmt, id, txt) \
         sqlite3_bind_text(stmt, id, txt, -1, SQLITE_STATIC)
 
+/*
+** indices are created after the data are in: when leaving the bulk mode,
+** and at the latest when the database is closed
+*/
+static const char *index_str[] = {
+    "CREATE INDEX IF NOT EXISTS rtransitions_sid ON rtransitions(sid)",
+    "CREATE INDEX IF NOT EXISTS aitransitions_sid ON aitransitions(sid)",
+    "CREATE INDEX IF NOT EXISTS ctransitions_sid ON ctransitions(sid)",
+    "CREATE INDEX IF NOT EXISTS cvectors_gid ON cvectors(gid)",
+    NULL
+};
+
+/* bulk import mode: no FK checks, no journal syncs, large page cache */
+static int store_bulk = 0;
+
+/* number of cvectors rows inserted by a single statement */
+#define CV_BATCH_SIZE   64
+
+/* prepared statements used for storing collisional data */
+typedef struct {
+    sqlite3_stmt *ct_stmt;      /* ctransitions                 */
+    sqlite3_stmt *cg_stmt;      /* cgrids                       */
+    sqlite3_stmt *cv_stmt;      /* cvectors, CV_BATCH_SIZE rows */
+    sqlite3_stmt *cv_stmt1;     /* cvectors, single row         */
+
+    unsigned int ncv;           /* number of cvectors rows pending */
+    sqlite3_int64 cid[CV_BATCH_SIZE];
+    sqlite3_int64 gid[CV_BATCH_SIZE];
+    void *blob[CV_BATCH_SIZE];  /* packed strengths             */
+    unsigned int blen[CV_BATCH_SIZE];
+} cs_stmts_t;
+
+static int InitCSStmts(sqlite3 *db, cs_stmts_t *cs)
+{
+    char sql_cv[64 + 16*CV_BATCH_SIZE];
+    const char *sql;
+    unsigned int i;
+    int rc;
+
+    memset(cs, 0, sizeof(cs_stmts_t));
+
+    sql = "INSERT INTO ctransitions" \
+          " (sid, type, qk_mode, ini_id, fin_id, kl, ap0, ap1, ap2, ap3)" \
+          " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    rc = sqlite3_prepare_v2(db, sql, -1, &cs->ct_stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sql = "INSERT INTO cgrids (sid, e) VALUES (?, ?)";
+        rc = sqlite3_prepare_v2(db, sql, -1, &cs->cg_stmt, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        strcpy(sql_cv,
+            "INSERT INTO cvectors (cid, gid, strength) VALUES (?, ?, ?)");
+        rc = sqlite3_prepare_v2(db, sql_cv, -1, &cs->cv_stmt1, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        for (i = 1; i < CV_BATCH_SIZE; i++) {
+            strcat(sql_cv, ", (?, ?, ?)");
+        }
+        rc = sqlite3_prepare_v2(db, sql_cv, -1, &cs->cv_stmt, NULL);
+    }
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(cs->ct_stmt);
+        sqlite3_finalize(cs->cg_stmt);
+        sqlite3_finalize(cs->cv_stmt1);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void FreeCSStmts(cs_stmts_t *cs)
+{
+    unsigned int i;
+
+    /* rows left over after an error */
+    for (i = 0; i < cs->ncv; i++) {
+        free(cs->blob[i]);
+    }
+
+    sqlite3_finalize(cs->ct_stmt);
+    sqlite3_finalize(cs->cg_stmt);
+    sqlite3_finalize(cs->cv_stmt);
+    sqlite3_finalize(cs->cv_stmt1);
+}
+
+/* packed arrays are stored as little-endian IEEE 754 doubles (grids) or
+   floats (strengths), i.e., with no loss of precision */
+static void *PackArray(const void *d, unsigned int size, unsigned int n)
+{
+    char *buf;
+    unsigned int i;
+
+    buf = malloc(n*size + 1);
+    if (!buf) {
+        return NULL;
+    }
+    memcpy(buf, d, n*size);
+    if (CheckEndian(NULL)) {
+        for (i = 0; i < n; i++) {
+            SwapEndian(buf + i*size, size);
+        }
+    }
+
+    return buf;
+}
+
+static int BindPackedArray(sqlite3_stmt *stmt, int id,
+    const void *d, unsigned int size, unsigned int n)
+{
+    void *buf;
+
+    if (!CheckEndian(NULL)) {
+        return sqlite3_bind_blob(stmt, id, d, n*size, SQLITE_STATIC);
+    }
+
+    buf = PackArray(d, size, n);
+    if (!buf) {
+        return SQLITE_NOMEM;
+    }
+
+    return sqlite3_bind_blob(stmt, id, buf, n*size, free);
+}
+
+/* the energy grid is shared by all transitions of a block */
+static int StoreCGrid(sqlite3 *db, const cs_stmts_t *cs,
+    unsigned long int sid, const double *e, unsigned int n,
+    unsigned long int *gid)
+{
+    int rc;
+
+    *gid = 0;
+
+    sqlite3_bind_int(cs->cg_stmt, 1, sid);
+    BindPackedArray (cs->cg_stmt, 2, e, sizeof(double), n);
+
+    rc = sqlite3_step(cs->cg_stmt);
+    sqlite3_reset(cs->cg_stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    *gid = sqlite3_last_insert_rowid(db);
+
+    return 0;
+}
+
+/* insert n pending cvectors rows, starting with the i0-th one */
+static int StepCVectors(sqlite3 *db, cs_stmts_t *cs, sqlite3_stmt *stmt,
+    unsigned int i0, unsigned int n)
+{
+    unsigned int i;
+    int rc;
+
+    for (i = 0; i < n; i++) {
+        sqlite3_bind_int64(stmt, 3*i + 1, cs->cid[i0 + i]);
+        sqlite3_bind_int64(stmt, 3*i + 2, cs->gid[i0 + i]);
+        /* SQLite takes over the buffer */
+        sqlite3_bind_blob (stmt, 3*i + 3,
+            cs->blob[i0 + i], cs->blen[i0 + i], free);
+        cs->blob[i0 + i] = NULL;
+    }
+
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int StoreCVector(sqlite3 *db, cs_stmts_t *cs,
+    unsigned long int cid, unsigned long int gid,
+    const float *strength, unsigned int n)
+{
+    void *blob;
+
+    blob = PackArray(strength, sizeof(float), n);
+    if (!blob) {
+        return -1;
+    }
+
+    cs->cid[cs->ncv]  = cid;
+    cs->gid[cs->ncv]  = gid;
+    cs->blob[cs->ncv] = blob;
+    cs->blen[cs->ncv] = n*sizeof(float);
+    cs->ncv++;
+
+    if (cs->ncv == CV_BATCH_SIZE) {
+        cs->ncv = 0;
+        return StepCVectors(db, cs, cs->cv_stmt, 0, CV_BATCH_SIZE);
+    }
+
+    return 0;
+}
+
+/* insert the rows left in an incomplete batch */
+static int FlushCVectors(sqlite3 *db, cs_stmts_t *cs)
+{
+    unsigned int i, n = cs->ncv;
+
+    cs->ncv = 0;
+    for (i = 0; i < n; i++) {
+        if (StepCVectors(db, cs, cs->cv_stmt1, i, 1) != 0) {
+            /* free the rest */
+            for (i++; i < n; i++) {
+                free(cs->blob[i]);
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int exec_sql(sqlite3 *db, const char *sql)
+{
+    char *errmsg;
+    int rc;
+
+    rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", errmsg);
+        sqlite3_free(errmsg);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int fk_check_cb(void *udata,
+    int argc, char **argv, char **colNames)
+{
+    unsigned long int *nviol = udata;
+
+    (*nviol)++;
+
+    return 0;
+}
+
 static int format_cb(void *udata,
     int argc, char **argv, char **colNames)
 {
@@ -397,40 +641,17 @@ int StoreAITable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
     return retval;
 }
 
-static int StoreCTransitionCB(void *udata,
-    int argc, char **argv, char **colNames)
-{
-    unsigned long int *cid = (unsigned long int *) udata;
-
-    if (argc != 1) {
-        return -1;
-    }
-    
-    *cid = atol(argv[0]);
-
-    return 0;
-}
-
-static int StoreCTransition(sqlite3 *db, unsigned long int sid,
+static int StoreCTransition(sqlite3 *db, const cs_stmts_t *cs,
+    unsigned long int sid,
     int type, int qk_mode, int ini_id, int fin_id, int kl,
     double ap0, double ap1, double ap2, double ap3,
     unsigned long int *cid)
 {
-    int retval = 0;
+    sqlite3_stmt *stmt = cs->ct_stmt;
     int rc;
-    sqlite3_stmt *stmt;
-    
-    char *errmsg;
-    const char *sql;
     
     *cid = 0;
 
-    sql = "INSERT INTO ctransitions" \
-          " (sid, type, qk_mode, ini_id, fin_id, kl, ap0, ap1, ap2, ap3)" \
-          " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
-    
-    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-
     sqlite3_bind_int(stmt, 1, sid);
     sqlite3_bind_int(stmt, 2, type);
     sqlite3_bind_int(stmt, 3, qk_mode);
@@ -445,43 +666,32 @@ static int StoreCTransition(sqlite3 *db, unsigned long int sid,
     sqlite3_bind_double(stmt, 10, ap3);
     
     rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
     if (rc != SQLITE_DONE) {
         fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
         return -1;
     }
-    sqlite3_finalize(stmt);
 
-    sql = "SELECT MAX(cid) FROM ctransitions";
+    /* cid is an alias for ROWID */
+    *cid = sqlite3_last_insert_rowid(db);
 
-    rc = sqlite3_exec(db, sql, StoreCTransitionCB, cid, &errmsg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", errmsg);
-        sqlite3_free(errmsg);
-        retval = -1;
-    }
-
-    return retval;
+    return 0;
 }
 
 int StoreCETable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
 {
     int retval = 0;
-    int rc;
-    sqlite3_stmt *stmt;
+    cs_stmts_t cs;
     
-    char *sql;
-
-    sql = "INSERT INTO cstrengths" \
-          " (cid, e, strength)" \
-          " VALUES (?, ?, ?)";
-    
-    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (InitCSStmts(db, &cs) != 0) {
+        return -1;
+    }
 
     sqlite3_exec(db, "BEGIN", 0, 0, 0);
 
     while (retval == 0) {
         CE_HEADER h;
+        unsigned long int gid;
         int n, i;
 
         n = ReadCEHeader(fp, &h, swp);
@@ -489,43 +699,26 @@ int StoreCETable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
             break;
         }
 
-        for (i = 0; i < h.ntransitions; i++) {
+        retval = StoreCGrid(db, &cs, sid, h.usr_egrid, h.n_usr, &gid);
+
+        for (i = 0; i < h.ntransitions && retval == 0; i++) {
             CE_RECORD r;
             unsigned long int cid;
-            int k, p2;
             
             n = ReadCERecord(fp, &r, swp, &h);
             if (n == 0) {
                 break;
             }
 
-            retval = StoreCTransition(db, sid,
+            retval = StoreCTransition(db, &cs, sid,
                 CFACDB_CS_CE, QK_EXACT, r.lower, r.upper,
                 0, r.bethe, r.born[0], r.born[1], 0.0,
                 &cid);
-            if (retval != 0) {
-                break;
-            }
             
-            sqlite3_bind_int(stmt, 1, cid);
-
-            p2 = 0;
-            for (k = 0; k < r.nsub && retval == 0; k++) {
-                int t;
-                /* TODO: msub */
-
-	        for (t = 0; t < h.n_usr; t++, p2++) {
-                    sqlite3_bind_double(stmt, 2, h.usr_egrid[t]);
-                    sqlite3_bind_double(stmt, 3, r.strength[p2]);
-                    
-                    rc = sqlite3_step(stmt);
-                    if (rc != SQLITE_DONE) {
-                        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-                        retval = -1;
-                        break;
-                    }
-                    sqlite3_reset(stmt);
-	        }
+            /* the r.nsub subsets go back to back, subset-major (see schema.sql) */
+            if (retval == 0) {
+                retval = StoreCVector(db, &cs, cid, gid,
+                    r.strength, r.nsub*h.n_usr);
             }
                   
             if (h.msub) {
@@ -539,9 +732,13 @@ int StoreCETable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
         free(h.usr_egrid);
     }
 
+    if (retval == 0) {
+        retval = FlushCVectors(db, &cs);
+    }
+
     sqlite3_exec(db, "COMMIT", 0, 0, 0);
 
-    sqlite3_finalize(stmt);
+    FreeCSStmts(&cs);
 
     return retval;
 }
@@ -549,21 +746,17 @@ int StoreCETable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
 int StoreCITable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
 {
     int retval = 0;
-    int rc;
-    sqlite3_stmt *stmt;
+    cs_stmts_t cs;
     
-    char *sql;
-
-    sql = "INSERT INTO cstrengths" \
-          " (cid, e, strength)" \
-          " VALUES (?, ?, ?)";
-    
-    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (InitCSStmts(db, &cs) != 0) {
+        return -1;
+    }
 
     sqlite3_exec(db, "BEGIN", 0, 0, 0);
 
     while (retval == 0) {
         CI_HEADER h;
+        unsigned long int gid;
         int n, i;
 
         n = ReadCIHeader(fp, &h, swp);
@@ -571,37 +764,25 @@ int StoreCITable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
             break;
         }
 
+        retval = StoreCGrid(db, &cs, sid, h.usr_egrid, h.n_usr, &gid);
+
         for (i = 0; i < h.ntransitions && retval == 0; i++) {
             CI_RECORD r;
             unsigned long int cid;
-            int t;
             
             n = ReadCIRecord(fp, &r, swp, &h);
             if (n == 0) {
                 break;
             }
 
-            retval = StoreCTransition(db, sid,
+            retval = StoreCTransition(db, &cs, sid,
                 CFACDB_CS_CI, h.qk_mode, r.b, r.f,
                 r.kl, r.params[0], r.params[1], r.params[2], r.params[3],
                 &cid);
-            if (retval != 0) {
-                break;
-            }
-
-            sqlite3_bind_int(stmt, 1, cid);
-
-            for (t = 0; t < h.n_usr; t++) {
-                sqlite3_bind_double(stmt, 2, h.usr_egrid[t]);
-                sqlite3_bind_double(stmt, 3, r.strength[t]);
 
-                rc = sqlite3_step(stmt);
-                if (rc != SQLITE_DONE) {
-                    fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-                    retval = -1;
-                    break;
-                }
-                sqlite3_reset(stmt);
+            if (retval == 0) {
+                retval = StoreCVector(db, &cs, cid, gid,
+                    r.strength, h.n_usr);
             }
 
             free(r.params); 
@@ -613,9 +794,13 @@ int StoreCITable(sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
         free(h.usr_egrid);
     }
 
+    if (retval == 0) {
+        retval = FlushCVectors(db, &cs);
+    }
+
     sqlite3_exec(db, "COMMIT", 0, 0, 0);
 
-    sqlite3_finalize(stmt);
+    FreeCSStmts(&cs);
 
     return retval;
 }
@@ -624,24 +809,17 @@ int StoreRRTable(const cfac_t *cfac,
     sqlite3 *db, unsigned long int sid, FILE *fp, int swp)
 {
     int retval = 0;
-    int rc;
-    sqlite3_stmt *stmt;
-    
-    char *sql;
-
-    sql = "INSERT INTO cstrengths" \
-          " (cid, e, strength)" \
-          " VALUES (?, ?, ?)";
+    cs_stmts_t cs;
     
-    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (InitCSStmts(db, &cs) != 0) {
+        return -1;
+    }
 
-    sqlite3_bind_int(stmt, 1, sid);
-    sqlite3_bind_int(stmt, 2, CFACDB_CS_PI);
-    
     sqlite3_exec(db, "BEGIN", 0, 0, 0);
 
     while (retval == 0) {
         RR_HEADER h;
+        unsigned long int gid;
         int n, i;
 
         n = ReadRRHeader(fp, &h, swp);
@@ -649,12 +827,11 @@ int StoreRRTable(const cfac_t *cfac,
             break;
         }
 
-        sqlite3_bind_int(stmt, 3, h.qk_mode);
+        retval = StoreCGrid(db, &cs, sid, h.usr_egrid, h.n_usr, &gid);
 
         for (i = 0; i < h.ntransitions && retval == 0; i++) {
             RR_RECORD r;
             unsigned long int cid;
-            int t;
             double ap0, ap1, ap2, ap3;
             
             n = ReadRRRecord(fp, &r, swp, &h);
@@ -673,27 +850,14 @@ int StoreRRTable(const cfac_t *cfac,
                 ap1 = ap2 = ap3 = 0.0;
             }
 
-            retval = StoreCTransition(db, sid,
+            retval = StoreCTransition(db, &cs, sid,
                 CFACDB_CS_PI, h.qk_mode, r.b, r.f,
                 r.kl, ap0, ap1, ap2, ap3,
                 &cid);
-            if (retval != 0) {
-                break;
-            }
 
-            sqlite3_bind_int(stmt, 1, cid);
-
-            for (t = 0; t < h.n_usr; t++) {
-                sqlite3_bind_double(stmt, 2, h.usr_egrid[t]);
-                sqlite3_bind_double(stmt, 3, r.strength[t]);
-
-                rc = sqlite3_step(stmt);
-                if (rc != SQLITE_DONE) {
-                    fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-                    retval = -1;
-                    break;
-                }
-                sqlite3_reset(stmt);
+            if (retval == 0) {
+                retval = StoreCVector(db, &cs, cid, gid,
+                    r.strength, h.n_usr);
             }
 
             free(r.params); 
@@ -705,20 +869,93 @@ int StoreRRTable(const cfac_t *cfac,
         free(h.usr_egrid);
     }
 
+    if (retval == 0) {
+        retval = FlushCVectors(db, &cs);
+    }
+
     sqlite3_exec(db, "COMMIT", 0, 0, 0);
 
-    sqlite3_finalize(stmt);
+    FreeCSStmts(&cs);
 
     return retval;
 }
 
+static int create_indices(sqlite3 *db)
+{
+    int i;
+
+    for (i = 0; index_str[i]; i++) {
+        if (exec_sql(db, index_str[i]) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* toggle the bulk import mode */
+int StoreSetBulk(sqlite3 *db, int bulk)
+{
+    unsigned long int nviol = 0;
+    char *errmsg;
+    int rc;
+
+    bulk = bulk ? 1:0;
+    if (bulk == store_bulk) {
+        return 0;
+    }
+
+    if (bulk) {
+        if (exec_sql(db, "PRAGMA foreign_keys = OFF")        ||
+            exec_sql(db, "PRAGMA journal_mode = WAL")        ||
+            exec_sql(db, "PRAGMA synchronous = OFF")         ||
+            exec_sql(db, "PRAGMA cache_size = -262144")) {
+            return -1;
+        }
+    } else {
+        /* the FK checks deferred during the import */
+        rc = sqlite3_exec(db, "PRAGMA foreign_key_check",
+            fk_check_cb, &nviol, &errmsg);
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "SQL error: %s\n", errmsg);
+            sqlite3_free(errmsg);
+            return -1;
+        }
+        if (nviol) {
+            fprintf(stderr, "%lu foreign key constraint violations found\n",
+                nviol);
+        }
+
+        /* revert to the rollback journal so that read-only access works */
+        if (exec_sql(db, "PRAGMA journal_mode = DELETE")     ||
+            exec_sql(db, "PRAGMA synchronous = FULL")        ||
+            exec_sql(db, "PRAGMA foreign_keys = ON")) {
+            return -1;
+        }
+
+        /* built once, over all the data imported */
+        if (create_indices(db) != 0) {
+            return -1;
+        }
+
+        if (nviol) {
+            store_bulk = bulk;
+            return -1;
+        }
+    }
+
+    store_bulk = bulk;
+
+    return 0;
+}
+
 int StoreClose(sqlite3 *db, unsigned long int sid, const char *cmdline)
 {
     int retval = 0;
     int rc;
     sqlite3_stmt *stmt;
     
-    char *sql;
+    const char *sql;
 
     sql = "UPDATE sessions" \
           " SET cmdline = ?" \
@@ -734,8 +971,23 @@ int StoreClose(sqlite3 *db, unsigned long int sid, const char *cmdline)
         fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
         retval = -1;
     }
+    sqlite3_finalize(stmt);
+
+    if (StoreSetBulk(db, 0) != 0) {
+        retval = -1;
+    }
+
+    /* a database filled without the bulk mode has none yet */
+    if (create_indices(db) != 0) {
+        retval = -1;
+    }
     
     sqlite3_close(db);
     
     return retval;
 }
+
+int StoreIsBulk(void)
+{
+    return store_bulk;
+}
@@ -2073,6 +2073,7 @@ int SaveExcitation(cfac_t *cfac, int nlow, int *low, int nup, int *up, int msub,
   for (isub = 0; isub < subte.dim - 1; isub++) {
     CE_HEADER ce_hdr;
     CE_RECORD r;
+    ARENA_MARK mark;
     double e0, e1, te0, ei, g_emin, g_emax;
     double c, rmin, rmax;
     int ie;
@@ -2238,12 +2239,14 @@ int SaveExcitation(cfac_t *cfac, int nlow, int *low, int nup, int *up, int msub,
     ce_hdr.usr_egrid = usr_egrid;
 
     InitFile(f, &fhdr, &ce_hdr);  
+    /* the record buffers live until the end of the sub-block */
+    ArenaMark(cfac->arena, &mark);
     nsub = 1;
     if (msub) {
-      r.params = malloc(sizeof(float)*nsub);
+      r.params = ArenaAlloc(cfac->arena, sizeof(float)*nsub);
     }
     m = ce_hdr.n_usr * nsub;
-    r.strength = malloc(sizeof(float)*m);
+    r.strength = ArenaAlloc(cfac->arena, sizeof(float)*m);
     
     /* real CE calculations begin here */
     for (i = 0; i < nlow; i++) {
@@ -2256,6 +2259,7 @@ int SaveExcitation(cfac_t *cfac, int nlow, int *low, int nup, int *up, int msub,
         int swapped;
 
         if (GetTransition(cfac, low[i], up[j], &tr, &swapped) != 0) {
+          ArenaRelease(cfac->arena, &mark);
           return -1;
         }
         
@@ -2278,9 +2282,12 @@ int SaveExcitation(cfac_t *cfac, int nlow, int *low, int nup, int *up, int msub,
 	r.upper = tr.nup;
 	r.nsub = k;
 	if (r.nsub > nsub) {
-	  r.params = realloc(r.params, sizeof(float)*r.nsub);
+	  /* the contents need not be kept */
+	  if (msub) {
+	    r.params = ArenaAlloc(cfac->arena, sizeof(float)*r.nsub);
+	  }
 	  m = ce_hdr.n_usr * r.nsub;
-	  r.strength = realloc(r.strength, sizeof(float)*m);
+	  r.strength = ArenaAlloc(cfac->arena, sizeof(float)*m);
 	  nsub = r.nsub;
 	}
 
@@ -2308,8 +2315,7 @@ int SaveExcitation(cfac_t *cfac, int nlow, int *low, int nup, int *up, int msub,
     }
     
     cfac_cbcache_free(&cbcache);
-    if (msub) free(r.params);
-    free(r.strength);
+    ArenaRelease(cfac->arena, &mark);
     DeinitFile(f, &fhdr);
     FreeExcitationQk();
     
@@ -2344,6 +2350,7 @@ int SaveExcitationEB(cfac_t *cfac, int nlow0, int *low0, int nup0, int *up0, cha
   int nc, ilow, iup;
   FILE *f;
   double qkc[MAXNE+1];
+  ARENA_MARK mark;
 
   cfac_cbcache_t cbcache;
   
@@ -2516,8 +2523,9 @@ int SaveExcitationEB(cfac_t *cfac, int nlow0, int *low0, int nup0, int *up0, cha
     ce_hdr.egrid = egrid;
     GetFields(cfac, &ce_hdr.bfield, &ce_hdr.efield, &ce_hdr.fangle);
     InitFile(f, &fhdr, &ce_hdr);  
+    ArenaMark(cfac->arena, &mark);
     m = ce_hdr.n_egrid;
-    r.strength = malloc(sizeof(float)*m);
+    r.strength = ArenaAlloc(cfac->arena, sizeof(float)*m);
     
     for (i = 0; i < nlow; i++) {
       lev1 = GetEBLevel(cfac, low[i]);
@@ -2554,7 +2562,7 @@ int SaveExcitationEB(cfac_t *cfac, int nlow0, int *low0, int nup0, int *up0, cha
       }
     }
     cfac_cbcache_free(&cbcache);
-    free(r.strength);
+    ArenaRelease(cfac->arena, &mark);
     DeinitFile(f, &fhdr);
     e0 = e1;
     FreeExcitationQk();
@@ -2592,6 +2600,7 @@ int SaveExcitationEBD(cfac_t *cfac, int nlow0, int *low0, int nup0, int *up0, ch
   FILE *f;
   double *qkc;
   double *bethe, *born;
+  ARENA_MARK mark;
 
   cfac_cbcache_t cbcache;
   
@@ -2773,10 +2782,11 @@ int SaveExcitationEBD(cfac_t *cfac, int nlow0, int *low0, int nup0, int *up0, ch
     ce_hdr.phigrid = phigrid;
     GetFields(cfac, &ce_hdr.bfield, &ce_hdr.efield, &ce_hdr.fangle);
     InitFile(f, &fhdr, &ce_hdr);  
+    ArenaMark(cfac->arena, &mark);
     m = n_thetagrid*n_phigrid;
-    r.strength = malloc(sizeof(float)*m*n_egrid);
-    r.born = malloc(sizeof(float)*m);
-    r.bethe = malloc(sizeof(float)*(m+1));
+    r.strength = ArenaAlloc(cfac->arena, sizeof(float)*m*n_egrid);
+    r.born = ArenaAlloc(cfac->arena, sizeof(float)*(m+1));
+    r.bethe = ArenaAlloc(cfac->arena, sizeof(float)*m);
     
     for (i = 0; i < nlow; i++) {
       lev1 = GetEBLevel(cfac, low[i]);
@@ -2817,9 +2827,7 @@ int SaveExcitationEBD(cfac_t *cfac, int nlow0, int *low0, int nup0, int *up0, ch
       }
     }
     cfac_cbcache_free(&cbcache);
-    free(r.strength);
-    free(r.bethe);
-    free(r.born);
+    ArenaRelease(cfac->arena, &mark);
     DeinitFile(f, &fhdr);
     e0 = e1;
     FreeExcitationQk();
@@ -954,6 +954,7 @@ int SaveIonization(cfac_t *cfac, int nb, int *b, int nf, int *f, char *fn) {
   int isub, n_tegrid0, n_egrid0, n_usr0;
   int te_set, e_set, usr_set;
   double c, e0, e1;
+  ARENA_MARK mark;
 
   emin = 1E10;
   emax = 1E-10;
@@ -1133,7 +1134,9 @@ int SaveIonization(cfac_t *cfac, int nb, int *b, int nf, int *f, char *fn) {
       SetCIPWGrid(0, NULL, NULL);
     }
 
-    r.strength = malloc(sizeof(float)*n_usr);
+    /* the record buffer lives until the end of the sub-block */
+    ArenaMark(cfac->arena, &mark);
+    r.strength = ArenaAlloc(cfac->arena, sizeof(float)*n_usr);
 
     ci_hdr.n_tegrid = n_tegrid;
     ci_hdr.n_egrid = n_egrid;
@@ -1171,7 +1174,7 @@ int SaveIonization(cfac_t *cfac, int nb, int *b, int nf, int *f, char *fn) {
 
     DeinitFile(file, &fhdr);
 
-    free(r.strength);
+    ArenaRelease(cfac->arena, &mark);
     ReinitRadial(cfac, 1);
     FreeRecQk();
     FreeRecPk();
@@ -1484,6 +1487,7 @@ int SaveIonizationMSub(cfac_t *cfac, int nb, int *b, int nf, int *f, char *fn) {
   double qku[MAXNUSR*MAXMSUB];
   double delta, emin, emax, e, emax0;
   int nq, i, j, k, ie;
+  ARENA_MARK mark;
 
   if (qk_mode != QK_DW) {
     printf("Only DW mode is supported in SaveIonizationMSub()\n");
@@ -1568,6 +1572,7 @@ int SaveIonizationMSub(cfac_t *cfac, int nb, int *b, int nf, int *f, char *fn) {
   ci_hdr.usr_egrid = usr_egrid;
   InitFile(file, &fhdr, &ci_hdr);
   
+  ArenaMark(cfac->arena, &mark);
   for (i = 0; i < nb; i++) {
     for (j = 0; j < nf; j++) {
       nq = IonizeStrengthMSub(cfac, qku, b[i], f[j]);
@@ -1575,12 +1580,12 @@ int SaveIonizationMSub(cfac_t *cfac, int nb, int *b, int nf, int *f, char *fn) {
       r.b = b[i];
       r.f = f[j];
       r.nsub = nq;
-      r.strength = malloc(sizeof(float)*nq*n_usr);
+      r.strength = ArenaAlloc(cfac->arena, sizeof(float)*nq*n_usr);
       for (ie = 0; ie < nq*n_usr; ie++) {
 	r.strength[ie] = qku[ie];
       }
       WriteCIMRecord(file, &r);
-      free(r.strength);
+      ArenaRelease(cfac->arena, &mark);
     }
   }
     
@@ -32,6 +32,12 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "sysdef.h"
+
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
+
 #include "consts.h"
 #include "angular.h"
 #include "rcfp.h"
@@ -760,7 +766,7 @@ static int rcfp_max_even[63] = {
 
 
 /* 
-** FUNCTION:    ReducedCFP
+** FUNCTION:    ReducedCFPTerms
 ** PURPOSE:     calculates the reduced coefficients 
 **              of fractional parentage by looking up the table.
 **              it's basically the reduced matrix elements of 
@@ -775,8 +781,9 @@ static int rcfp_max_even[63] = {
 ** SIDE EFFECT: 
 ** NOTE:        when the indexes are out of range, 
 **              0.0 is returned, and warning is issued.
+**              only used to fill rcfp_cfp, see ReducedCFP.
 */
-double ReducedCFP(int no_bra, int no_ket) {
+static double ReducedCFPTerms(int no_bra, int no_ket) {
   double coeff;
   int no_a, no_b, phase = 0, nom = 0, denom = 0;
 
@@ -871,7 +878,7 @@ double ReducedCFP(int no_bra, int no_ket) {
 }
        
 /* 
-** FUNCTION:    CompleteReducedW
+** FUNCTION:    CompleteReducedWTerms
 ** PURPOSE:     reduced matrix elements of W=AxA in both the
 **              angular and quasi-spin space.
 ** INPUT:       {int no_bra},
@@ -889,8 +896,11 @@ double ReducedCFP(int no_bra, int no_ket) {
 **              is <= 9/2, in which case the coeff. are looked up 
 **              in the table. otherwise, it is calculated using
 **              decoupling formula of Racah.
+**              for j <= 9/2, only used to fill rcfp_w, see
+**              CompleteReducedW.
 */
-double CompleteReducedW(int no_bra, int no_ket, int k_q, int k_j) {
+static double CompleteReducedWTerms(int no_bra, int no_ket,
+				    int k_q, int k_j) {
   double coeff;
   int jbra, Jbra, Jket, Qbra, Qket, Jrun, Qrun;
   double w6j1, w6j2;
@@ -927,8 +937,8 @@ double CompleteReducedW(int no_bra, int no_ket, int k_q, int k_j) {
       Qrun = terms_jj[no_run].Q;
       if ((w6j1 = W6j(jbra, jbra, kj2, Jket, Jbra, Jrun)) &&
 	  (w6j2 = W6j(1, 1, kq2, Qket, Qbra, Qrun))) {
-	coeff += w6j1 * w6j2 * (ReducedCFP(no_bra, no_run) *
-				ReducedCFP(no_run, no_ket));
+	coeff += w6j1 * w6j2 * (ReducedCFPTerms(no_bra, no_run) *
+				ReducedCFPTerms(no_run, no_ket));
       }
     }
 
@@ -943,6 +953,110 @@ double CompleteReducedW(int no_bra, int no_ket, int k_q, int k_j) {
 }
 
 
+/*
+** the reduced coeff. for j <= 9/2 are expanded once into tables indexed
+** directly by the RCFP_TERM indexes. rcfp_cfp holds ReducedCFP for all
+** pairs of terms; rcfp_w holds CompleteReducedW for the pairs of terms
+** of the same subshell, in blocks of [k_q][k_j] starting at
+** rcfp_w_base; rcfp_index maps (j, nu, Nr, J) to the term.
+*/
+#define RCFP_NTERMS 63
+#define RCFP_NKQ    2
+#define RCFP_NKJ    10
+#define RCFP_NW     ((2*2 + 3*3 + 6*6 + 14*14 + 38*38)*RCFP_NKQ*RCFP_NKJ)
+#define RCFP_MAXNU  5
+#define RCFP_MAXNR  1
+#define RCFP_MAXJ   25
+
+static const int rcfp_no_min[5] = {0, 2, 5, 11, 25};
+static const int rcfp_no_num[5] = {2, 3, 6, 14, 38};
+static int rcfp_w_base[5];
+
+static double rcfp_cfp[RCFP_NTERMS][RCFP_NTERMS];
+static double rcfp_w[RCFP_NW];
+static short rcfp_index[5][RCFP_MAXNU+1][RCFP_MAXNR+1][RCFP_MAXJ+1];
+
+static void InitRCFPTables(void) {
+  int i, j, m, no_bra, no_ket, k_q, k_j, n;
+  short *p;
+
+  p = &(rcfp_index[0][0][0][0]);
+  n = sizeof(rcfp_index)/sizeof(short);
+  for (i = 0; i < n; i++) p[i] = -1;
+  for (i = 0; i < RCFP_NTERMS; i++) {
+    rcfp_index[terms_jj[i].j/2][terms_jj[i].nu]
+      [terms_jj[i].Nr][terms_jj[i].subshellJ] = i;
+  }
+
+  for (no_bra = 0; no_bra < RCFP_NTERMS; no_bra++) {
+    for (no_ket = 0; no_ket < RCFP_NTERMS; no_ket++) {
+      rcfp_cfp[no_bra][no_ket] = ReducedCFPTerms(no_bra, no_ket);
+    }
+  }
+
+  m = 0;
+  for (j = 0; j < 5; j++) {
+    rcfp_w_base[j] = m;
+    for (i = 0; i < rcfp_no_num[j]*rcfp_no_num[j]; i++) {
+      no_bra = rcfp_no_min[j] + i/rcfp_no_num[j];
+      no_ket = rcfp_no_min[j] + i%rcfp_no_num[j];
+      for (k_q = 0; k_q < RCFP_NKQ; k_q++) {
+	for (k_j = 0; k_j < RCFP_NKJ; k_j++) {
+	  rcfp_w[m++] = CompleteReducedWTerms(no_bra, no_ket, k_q, k_j);
+	}
+      }
+    }
+  }
+}
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_once_t rcfp_tables_once = PTHREAD_ONCE_INIT;
+# define RCFPTables() pthread_once(&rcfp_tables_once, InitRCFPTables)
+#else
+static int rcfp_tables_done = 0;
+# define RCFPTables() \
+  if (!rcfp_tables_done) { InitRCFPTables(); rcfp_tables_done = 1; }
+#endif
+
+/* 
+** FUNCTION:    ReducedCFP, CompleteReducedW
+** PURPOSE:     look up the tabulated reduced coeff. of fractional
+**              parentage and the complete reduced matrix elements
+**              of W, see ReducedCFPTerms and CompleteReducedWTerms.
+** INPUT:       
+** RETURN:      
+** SIDE EFFECT: the tables are filled on the first call.
+** NOTE:        the states beyond the tables, i.e., those of j > 9/2
+**              for CompleteReducedW, are evaluated directly.
+*/
+double ReducedCFP(int no_bra, int no_ket) {
+  if (no_bra < 0 || no_bra >= RCFP_NTERMS ||
+      no_ket < 0 || no_ket >= RCFP_NTERMS) 
+    return 0.0;
+
+  RCFPTables();
+  return rcfp_cfp[no_bra][no_ket];
+}
+
+double CompleteReducedW(int no_bra, int no_ket, int k_q, int k_j) {
+  int j, n;
+
+  if (no_bra < 0 || no_bra >= RCFP_NTERMS ||
+      no_ket < 0 || no_ket >= RCFP_NTERMS ||
+      k_q < 0 || k_q >= RCFP_NKQ || k_j < 0 || k_j >= RCFP_NKJ) 
+    return CompleteReducedWTerms(no_bra, no_ket, k_q, k_j);
+
+  j = terms_jj[no_bra].j/2;
+  if (terms_jj[no_ket].j/2 != j) return 0.0;
+
+  RCFPTables();
+  n = rcfp_no_num[j];
+  no_bra -= rcfp_no_min[j];
+  no_ket -= rcfp_no_min[j];
+  return rcfp_w[rcfp_w_base[j] + ((no_bra*n + no_ket)*RCFP_NKQ + k_q)*RCFP_NKJ
+		+ k_j];
+}
+
 /* 
 ** FUNCTION:    CompleteReducedWFromTable
 ** PURPOSE:     reduced matrix elements of W=AxA in both the
@@ -2010,25 +2124,20 @@ double ReducedOperator(RCFP_STATE *bra, RCFP_STATE *ket,
 ** RETURN:      {int},
 **              index.
 ** SIDE EFFECT: 
-** NOTE:        j <= 9/2
+** NOTE:        for j <= 9/2 the index is read from rcfp_index,
+**              otherwise the state is packed.
 */
 int RCFPTermIndex(int j, int nu, int Nr, int subshellJ) {
-  int no_min[9] = {0, 0, 2, 0, 5, 0, 11, 0, 25};
-  int no_max[9] = {1, 0, 4, 0, 10, 0, 24, 0, 62};
-  int i;
-
   if (j <= 9) {
-    for (i = no_min[j-1]; i<= no_max[j-1]; i++) {
-      if (terms_jj[i].nu == nu &&
-	  terms_jj[i].subshellJ == subshellJ &&
-	  terms_jj[i].Nr == Nr)
-	return i;
-    }
+    if (j < 1 || IsEven(j) ||
+	nu < 0 || nu > RCFP_MAXNU || Nr < 0 || Nr > RCFP_MAXNR ||
+	subshellJ < 0 || subshellJ > RCFP_MAXJ) 
+      return -1;
+    RCFPTables();
+    return rcfp_index[j/2][nu][Nr][subshellJ];
   } else {
-    i = PackRCFPState(j, nu, subshellJ);
-    return i;
+    return PackRCFPState(j, nu, subshellJ);
   }
-  return -1;
 }
 
 
@@ -1046,6 +1046,10 @@ int AutoionizeRate(cfac_t *cfac, double *rate, double *e, int rec, int f, int ms
   for (ip = 0; ip < nkappaf; ip++) p[ip] = 0.0;
 
   nz = AngularZxZFreeBound(cfac, &ang, f, rec);
+  if (nz < 0) {
+    free(p);
+    return -1;
+  }
   nt = 1;
   if (nz > 0) {
     for (i = 0; i < nz; i++) {
@@ -38,6 +38,10 @@
 #include "rcfp.h"
 #include "recouple.h"
 
+/* the coefficient arrays come from the arena when one is given */
+#define RecoupleAlloc(a, n) ((a) ? ArenaAlloc((a), (n)) : malloc(n))
+#define RecoupleFree(a, p)  do { if (!(a)) free(p); } while (0)
+
 static void InitInteractDatum(void *p, int n) {
   INTERACT_DATUM *d;
   int i;
@@ -229,7 +233,10 @@ static double DecoupleShell(int n_shells, SHELL_STATE *bra, SHELL_STATE *ket,
 /* 
 ** FUNCTION:    AngularZ
 ** PURPOSE:     calculate the reduced matrix element of Z operator.
-** INPUT:       {double **coeff},
+** INPUT:       {ARENA *arena},
+**              where the coeff. and kk are allocated; malloc is
+**              used if it is NULL.
+**              {double **coeff},
 **              a pointer to a double array, which holds the 
 **              results on exit.
 **              {int **k},
@@ -262,7 +269,7 @@ static double DecoupleShell(int n_shells, SHELL_STATE *bra, SHELL_STATE *ket,
 **              of operators are included. This is also the same for 
 **              the next routine, AngularZxZ0
 */   
-int AngularZ(double **coeff, int **kk, int nk,
+int AngularZ(ARENA *arena, double **coeff, int **kk, int nk,
 	     int n_shells, SHELL_STATE *bra, SHELL_STATE *ket, 
 	     INTERACT_SHELL *s1, INTERACT_SHELL *s2, int max_rank){
   SHELL_STATE st1, st2;
@@ -283,7 +290,7 @@ int AngularZ(double **coeff, int **kk, int nk,
     if (kmax < kmin) return -1;
     nk = (kmax - kmin)/2 + 1;
 
-    (*kk) = malloc(sizeof(int) * nk);
+    (*kk) = RecoupleAlloc(arena, sizeof(int) * nk);
 
     if (!(*kk)) {
       return -1;
@@ -294,7 +301,7 @@ int AngularZ(double **coeff, int **kk, int nk,
       (*kk)[m++] = k;
     }
 
-    (*coeff) = malloc(sizeof(double) * nk);
+    (*coeff) = RecoupleAlloc(arena, sizeof(double) * nk);
     if (!(*coeff)) return -1;  
   }
 
@@ -459,7 +466,10 @@ static int SortShell(int ns, INTERACT_SHELL *s, int *order) {
 ** FUNCTION:    AngularZxZ0
 ** PURPOSE:     calculate the reduced matrix element of 
 **              (Z \dot Z) operator.
-** INPUT:       {double **coeff},
+** INPUT:       {ARENA *arena},
+**              where the coeff., kk and the intermediate arrays are
+**              allocated; malloc is used if it is NULL.
+**              {double **coeff},
 **              a pointer to a double array, which holds the 
 **              results on exit.
 **              {int **k},
@@ -481,7 +491,7 @@ static int SortShell(int ns, INTERACT_SHELL *s, int *order) {
 **              e.g. if the order in the slater integral is R(ab, cd), 
 **              then the order passing into this routine is a, c, b, d 
 */
-int AngularZxZ0(double **coeff, int **kk, int nk,
+int AngularZxZ0(ARENA *arena, double **coeff, int **kk, int nk,
 		int n_shells, SHELL_STATE *bra, SHELL_STATE *ket, 
 		INTERACT_SHELL *s, int max_rank) {
   
@@ -509,7 +519,7 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
     if (IsOdd(kmin)) kmin++; 
     if (kmax < kmin) return -1;
     nk = (kmax - kmin)/2 + 1;
-    (*kk) = malloc(sizeof(int)*nk);
+    (*kk) = RecoupleAlloc(arena, sizeof(int)*nk);
     if (!(*kk)) {
       return -1;
     }
@@ -518,7 +528,7 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
       (*kk)[m++] = k;
     }
 
-    (*coeff) = malloc(sizeof(double)*nk);
+    (*coeff) = RecoupleAlloc(arena, sizeof(double)*nk);
     if (!(*coeff)) return -1;
   }
 
@@ -610,8 +620,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
       if (IsOdd(kmin)) kmin++; 
       if (kmax < kmin) return -1;
       nk1 = (kmax - kmin)/2 + 1;
-      coeff1 = malloc(sizeof(double)*nk1);
-      kk1 = malloc(sizeof(int)*nk1);
+      coeff1 = RecoupleAlloc(arena, sizeof(double)*nk1);
+      kk1 = RecoupleAlloc(arena, sizeof(int)*nk1);
       if (!kk1 || !coeff1) return -1;
       for (k = kmin; k <= kmax; k += 2) {
 	kk1[m++] = k;
@@ -640,8 +650,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
       if (IsOdd(kmin)) kmin++; 
       if (kmax < kmin) return -1;
       nk1 = (kmax - kmin)/2 + 1;
-      coeff1 = malloc(sizeof(double)*nk1);
-      kk1 = malloc(sizeof(int)*nk1);
+      coeff1 = RecoupleAlloc(arena, sizeof(double)*nk1);
+      kk1 = RecoupleAlloc(arena, sizeof(int)*nk1);
       if (!kk1 || !coeff1) return -1;
       for (k = kmin; k <= kmax; k += 2) {
 	kk1[m++] = k;
@@ -674,8 +684,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
       if (IsOdd(kmin)) kmin++; 
       if (kmax < kmin) return -1;
       nk1 = (kmax - kmin)/2 + 1;
-      coeff1 = malloc(sizeof(double)*nk1);
-      kk1 = malloc(sizeof(int)*nk1);
+      coeff1 = RecoupleAlloc(arena, sizeof(double)*nk1);
+      kk1 = RecoupleAlloc(arena, sizeof(int)*nk1);
       if (!kk1 || !coeff1) return -1;
       for (k = kmin; k <= kmax; k += 2) {
 	kk1[m++] = k;
@@ -704,8 +714,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
       if (IsOdd(kmin)) kmin++; 
       if (kmax < kmin) return -1;
       nk1 = (kmax - kmin)/2 + 1;
-      coeff1 = malloc(sizeof(double)*nk1);
-      kk1 = malloc(sizeof(int)*nk1);
+      coeff1 = RecoupleAlloc(arena, sizeof(double)*nk1);
+      kk1 = RecoupleAlloc(arena, sizeof(int)*nk1);
       if (!kk1 || !coeff1) return -1;
       for (k = kmin; k <= kmax; k += 2) {
 	kk1[m++] = k;
@@ -743,8 +753,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
       if (IsOdd(kmin)) kmin++; 
       if (kmax < kmin) return -1;
       nk1 = (kmax - kmin)/2 + 1;
-      coeff1 = malloc(sizeof(double)*nk1);
-      kk1 = malloc(sizeof(int)*nk1);
+      coeff1 = RecoupleAlloc(arena, sizeof(double)*nk1);
+      kk1 = RecoupleAlloc(arena, sizeof(int)*nk1);
       if (!kk1 || !coeff1) return -1;
       for (k = kmin; k <= kmax; k += 2) {
 	kk1[m++] = k;
@@ -872,8 +882,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	SumCoeff((*coeff), (*kk), nk, 1, coeff1, kk1, nk1, 1, phase,
 		 s[0].j, s[1].j, s[3].j, s[2].j);
       }
-      free(coeff1);
-      free(kk1);
+      RecoupleFree(arena, coeff1);
+      RecoupleFree(arena, kk1);
     }
     break;
   case 6:
@@ -893,8 +903,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	SumCoeff((*coeff), (*kk), nk, 0, coeff1, kk1, nk1, 1, phase,
 		 s[0].j, s[1].j, s[2].j, s[3].j);
       }
-      free(coeff1);
-      free(kk1);
+      RecoupleFree(arena, coeff1);
+      RecoupleFree(arena, kk1);
     }
     break;      
   case 7:
@@ -941,8 +951,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	SumCoeff((*coeff), (*kk), nk, 0, coeff1, kk1, nk1, 0, phase,
 		 s[0].j, s[1].j, s[2].j, s[3].j);
       }
-      free(coeff1);
-      free(kk1);
+      RecoupleFree(arena, coeff1);
+      RecoupleFree(arena, kk1);
     }
     break; 
   case 8:
@@ -993,8 +1003,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	SumCoeff((*coeff), (*kk), nk, 0, coeff1, kk1, nk1, 0, phase,
 		 s[0].j, s[1].j, s[2].j, s[3].j);
       }
-      free(coeff1);
-      free(kk1);
+      RecoupleFree(arena, coeff1);
+      RecoupleFree(arena, kk1);
     }
     break; 
   case 9:
@@ -1059,8 +1069,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	SumCoeff((*coeff), (*kk), nk, 0, coeff1, kk1, nk1, 1, phase,
 		 s[0].j, s[1].j, s[2].j, s[3].j);
       }      
-      free(coeff1);
-      free(kk1);
+      RecoupleFree(arena, coeff1);
+      RecoupleFree(arena, kk1);
     }
     break;
   }
@@ -1082,7 +1092,8 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
    coeff. The latter does not include the phase resulting from the
    reordering of operators; it is calculated in AngularZxZ0 and
    AngularZ0 */
-static int InteractingShells(const CONFIG *cbra, const CONFIG *cket,
+static int InteractingShells(ARENA *arena,
+		      const CONFIG *cbra, const CONFIG *cket,
                       INTERACT_DATUM **idatum,
 		      const SHELL_STATE *csf_i, const SHELL_STATE *csf_j,
 		      SHELL_STATE **sbra, SHELL_STATE **sket) {
@@ -1290,8 +1301,8 @@ static int InteractingShells(const CONFIG *cbra, const CONFIG *cket,
     i = 0;
     j = 0;
       
-    (*sbra) = calloc(n_shells, sizeof(SHELL_STATE));
-    (*sket) = calloc(n_shells, sizeof(SHELL_STATE));
+    (*sbra) = ArenaCalloc(arena, n_shells, sizeof(SHELL_STATE));
+    (*sket) = ArenaCalloc(arena, n_shells, sizeof(SHELL_STATE));
     for (m = 0; m < n_shells; m++) {
       if (i < cbra->n_shells) {
 	if (bra[m].n == cbra->shells[i].n &&
@@ -1335,7 +1346,9 @@ static int InteractingShells(const CONFIG *cbra, const CONFIG *cket,
 ** INPUT:       
 ** RETURN:      
 ** SIDE EFFECT: 
-** NOTE:        
+** NOTE:        sbra and sket, if requested, are allocated in
+**              cfac->arena; the caller takes a mark before the call
+**              and releases it when done with them.
 */
 int GetInteract(cfac_t *cfac, INTERACT_DATUM **idatum,
 		SHELL_STATE **sbra, 
@@ -1361,6 +1374,8 @@ int GetInteract(cfac_t *cfac, INTERACT_DATUM **idatum,
   }
   if (ci->n_shells <= 0 || cj->n_shells <= 0) return -1;
   if (abs(ci->n_shells+ifb - cj->n_shells) > 2) return -1;
+  /* more than two electrons moved */
+  if (ConfigOccDiff(ci, cj) > 4) return -1;
 
   if (csf_i != NULL && csf_j != NULL) {
     n_shells = -1;
@@ -1384,8 +1399,8 @@ int GetInteract(cfac_t *cfac, INTERACT_DATUM **idatum,
     bra = (*idatum)->bra;
     i = 0;
     j = 0;
-    (*sbra) = calloc(n_shells, sizeof(SHELL_STATE));
-    (*sket) = calloc(n_shells, sizeof(SHELL_STATE));
+    (*sbra) = ArenaCalloc(cfac->arena, n_shells, sizeof(SHELL_STATE));
+    (*sket) = ArenaCalloc(cfac->arena, n_shells, sizeof(SHELL_STATE));
     for (m = 0; m < n_shells; m++) {
       if (i < ci->n_shells) {
 	if (bra[m].n == ci->shells[i].n &&
@@ -1434,13 +1449,15 @@ int GetInteract(cfac_t *cfac, INTERACT_DATUM **idatum,
 	cip.n_csfs = 0;
 	csf_ip = NULL;
       }
-      n_shells = InteractingShells(&cip, cj, idatum, csf_ip, csf_j, sbra, sket);
+      n_shells = InteractingShells(cfac->arena, &cip, cj, idatum,
+				   csf_ip, csf_j, sbra, sket);
       free(cip.shells);
       if (csf_i) {
 	free(cip.csfs);
       }
     } else {
-      n_shells = InteractingShells(ci, cj, idatum, csf_i, csf_j, sbra, sket);
+      n_shells = InteractingShells(cfac->arena, ci, cj, idatum,
+				   csf_i, csf_j, sbra, sket);
     }
   }
 
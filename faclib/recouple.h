@@ -81,12 +81,12 @@ typedef struct _INTERACT_DATUM_ {
 } INTERACT_DATUM;
 
 /* the coeff of type (Z^k dot Z^k) */
-int AngularZxZ0(double **coeff, int **kk, int nk,
+int AngularZxZ0(ARENA *arena, double **coeff, int **kk, int nk,
                 int n_shells, SHELL_STATE *bra, SHELL_STATE *ket,
                 INTERACT_SHELL *s, int max_rank);
 
 /* the coeff of type Z^k */
-int AngularZ(double **coeff, int **kk, int nk,
+int AngularZ(ARENA *arena, double **coeff, int **kk, int nk,
              int n_shells, SHELL_STATE *bra, SHELL_STATE *ket,
              INTERACT_SHELL *s1, INTERACT_SHELL *s2, int max_rank);
 
@@ -71,8 +71,20 @@ CREATE TABLE ctransitions (
     FOREIGN KEY(sid, fin_id) REFERENCES levels(sid, id) ON DELETE CASCADE
 );
 
-CREATE TABLE cstrengths (
-    cid      INTEGER NOT NULL REFERENCES ctransitions(cid) ON DELETE CASCADE,
-    e        REAL    NOT NULL,
-    strength REAL    NOT NULL
+/*
+ * cgrids.e: n_usr energies, little-endian doubles.
+ * cvectors.strength: nsub*n_usr little-endian floats, subset-major,
+ * i.e., subset k at offset k*n_usr (nsub is 1 unless msub is set).
+ */
+CREATE TABLE cgrids (
+    gid      INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+    sid      INTEGER NOT NULL REFERENCES sessions(sid) ON DELETE CASCADE,
+    e        BLOB    NOT NULL
+);
+
+CREATE TABLE cvectors (
+    cid      INTEGER PRIMARY KEY NOT NULL
+                     REFERENCES ctransitions(cid) ON DELETE CASCADE,
+    gid      INTEGER NOT NULL REFERENCES cgrids(gid) ON DELETE CASCADE,
+    strength BLOB    NOT NULL
 );
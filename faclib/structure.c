@@ -227,7 +227,7 @@ static void FlagClosed(cfac_t *cfac, SHAMILTON *hs) {
 static int IsClosedShell(const cfac_t *cfac, int ih, int k) {
   int i, j;
   
-  if (ih >= MAX_HAMS) {
+  if (ih >= cfac->nhams) {
     abort();
   }
 
@@ -313,6 +313,7 @@ HAMILTON *ConstructHamilton(cfac_t *cfac,
     STATE *s;
     SYMMETRY *sym;
     CONFIG *cfg;
+    GROUP_SET gs, gsp;
     double r;
 
 
@@ -333,6 +334,9 @@ HAMILTON *ConstructHamilton(cfac_t *cfac,
         return NULL;
     }
     
+    GroupSetInit(&gs, k, kg);
+    GroupSetInit(&gsp, kp, kgp);
+
     n = 0;
     np = 0;
     for (i = 0; i < sym->n_states; i++) {
@@ -343,10 +347,10 @@ HAMILTON *ConstructHamilton(cfac_t *cfac,
             continue;
         }
 
-        if (InGroups(s->kgroup, k, kg)) {
+        if (InGroupSet(&gs, s->kgroup)) {
             n++;
         }
-        if (kp && InGroups(s->kgroup, kp, kgp)) {
+        if (InGroupSet(&gsp, s->kgroup)) {
             np++;
         }
     }
@@ -378,7 +382,7 @@ HAMILTON *ConstructHamilton(cfac_t *cfac,
             continue;
         }
         
-        if (InGroups(s->kgroup, k, kg)) {
+        if (InGroupSet(&gs, s->kgroup)) {
             h->basis[n++] = i;
         }
     }
@@ -406,7 +410,7 @@ HAMILTON *ConstructHamilton(cfac_t *cfac,
                     continue;
                 }
             
-	        if (kp > 0 && InGroups(s->kgroup, kp, kgp)) {
+	        if (InGroupSet(&gsp, s->kgroup)) {
 	            h->basis[n++] = i;
 	        }
             }
@@ -443,9 +447,18 @@ HAMILTON *ConstructHamilton(cfac_t *cfac,
         }
     }
 
-    if (cfac->nhams >= MAX_HAMS) {
-        printf("Number of Hamiltonians exceeded the maximum %d\n", MAX_HAMS);
-        exit(1);
+    if (cfac->nhams >= cfac->hams_alloc) {
+        int nalloc = cfac->hams_alloc ? 2*cfac->hams_alloc:HAMS_BLOCK;
+        SHAMILTON *hams = realloc(cfac->hams, nalloc*sizeof(SHAMILTON));
+        if (!hams) {
+            printf("ConstructHamilton allocation error\n");
+            cfac_hamiltonian_free(h);
+            return NULL;
+        }
+        memset(hams + cfac->hams_alloc, 0,
+            (nalloc - cfac->hams_alloc)*sizeof(SHAMILTON));
+        cfac->hams = hams;
+        cfac->hams_alloc = nalloc;
     }
     
     hs = &cfac->hams[cfac->nhams];
@@ -1005,6 +1018,7 @@ static void HamiltonElement1E2E(cfac_t *cfac,
   int n_shells, i, j;
   INTERACT_DATUM *idatum;
   INTERACT_SHELL s[4];
+  ARENA_MARK mark;
   double r, prefactor;
 
   *x1 = 0.0;
@@ -1044,6 +1058,7 @@ static void HamiltonElement1E2E(cfac_t *cfac,
   kj = sj->kstate;
 
   idatum = NULL;
+  ArenaMark(cfac->arena, &mark);
   n_shells = GetInteract(cfac, &idatum, &sbra, &sket, 
 			 si->kgroup, sj->kgroup,
 			 si->kcfg, sj->kcfg,
@@ -1137,8 +1152,7 @@ static void HamiltonElement1E2E(cfac_t *cfac,
     *x1 += ci->delta;
   }
 
-  free(sbra);
-  free(sket);
+  ArenaRelease(cfac->arena, &mark);
 }
 
 double HamiltonElement(cfac_t *cfac, int isym, int isi, int isj) {
@@ -1162,6 +1176,7 @@ int SlaterCoeff(cfac_t *cfac, char *fn, int nlevs, int *ilevs,
   SHELL *bra;
   INTERACT_DATUM *idatum;
   INTERACT_SHELL s[4];  
+  ARENA_MARK mark;
   char name[LEVEL_NAME_LEN];
   char sname[LEVEL_NAME_LEN];
   char nc[LEVEL_NAME_LEN];
@@ -1189,6 +1204,7 @@ int SlaterCoeff(cfac_t *cfac, char *fn, int nlevs, int *ilevs,
 	s1 = GetSymmetryState(sym, lev->basis[i1]);
 	k1 = s1->kstate;
 	idatum = NULL;
+	ArenaMark(cfac->arena, &mark);
 	n_shells = GetInteract(cfac, &idatum, &sbra, &sket, s0->kgroup, s1->kgroup, 
 			       s0->kcfg, s1->kcfg, k0, k1, 0);
 	if (n_shells <= 0) continue;
@@ -1293,8 +1309,7 @@ int SlaterCoeff(cfac_t *cfac, char *fn, int nlevs, int *ilevs,
 	    }
 	  }
 	}
-	free(sbra);
-	free(sket);	
+	ArenaRelease(cfac->arena, &mark);
       }
     }
     
@@ -1343,6 +1358,7 @@ void AddSlaterCoeff(const cfac_t *cfac, double *coeff, double a, int n_shells,
   int k0, k1, k2, k3, js[4], na2, nb2, nab2;
   double e, z0, *y, *ang;
   int kmax = GetMaxRank(cfac);
+  ARENA_MARK mark;
 
   if (s[0].kl != s[1].kl) return;
   if (s[2].kl != s[3].kl) return;
@@ -1373,7 +1389,8 @@ void AddSlaterCoeff(const cfac_t *cfac, double *coeff, double a, int n_shells,
   j = i0*nb2 + i1;
 
   if (s[2].nq_bra > 0) {
-    nk = AngularZxZ0(&ang, &kk, 0, n_shells, sbra, sket, s, kmax);
+    ArenaMark(cfac->arena, &mark);
+    nk = AngularZxZ0(cfac->arena, &ang, &kk, 0, n_shells, sbra, sket, s, kmax);
     for (i = 0; i < nk; i++) {    
       if (fabs(ang[i]) < EPS30) continue;    
       for (t = 2; t <= 4; t += 2) {
@@ -1390,10 +1407,7 @@ void AddSlaterCoeff(const cfac_t *cfac, double *coeff, double a, int n_shells,
       }
     }
 
-    if (nk > 0) {
-      free(ang);
-      free(kk);
-    }
+    ArenaRelease(cfac->arena, &mark);
   }
 
   if (k1 == k3) {
@@ -1402,7 +1416,7 @@ void AddSlaterCoeff(const cfac_t *cfac, double *coeff, double a, int n_shells,
     k = 0; 
     kk0 = &k;
     y = &z0;
-    nk0 = AngularZ(&y, &kk0, nk0, n_shells, sbra, sket, s, s+1, kmax);
+    nk0 = AngularZ(NULL, &y, &kk0, nk0, n_shells, sbra, sket, s, s+1, kmax);
     if (nk0 > 0) {
       z0 /= sqrt(s[0].j + 1.0);
       if (IsOdd((s[0].j - s[2].j)/2)) z0 = -z0;
@@ -1430,7 +1444,7 @@ double Hamilton1E(cfac_t *cfac, int n_shells, SHELL_STATE *sbra, SHELL_STATE *sk
   k = 0;
   k0 = &k;
   x = &z0;
-  nk0 = AngularZ(&x, &k0, nk0, n_shells, sbra, sket, s, s+1, kmax);
+  nk0 = AngularZ(NULL, &x, &k0, nk0, n_shells, sbra, sket, s, s+1, kmax);
   if (fabs(z0) < EPS30) return 0.0;
   k1 = OrbitalIndex(cfac, s[0].n, s[0].kappa, 0.0);
   k2 = OrbitalIndex(cfac, s[1].n, s[1].kappa, 0.0);
@@ -1451,6 +1465,7 @@ double Hamilton2E(cfac_t *cfac,
   double z0, *y;
   int ks[4], js[4];
   int kmax = GetMaxRank(cfac);
+  ARENA_MARK mark;
 
   js[0] = 0;
   js[1] = 0;
@@ -1470,7 +1485,7 @@ double Hamilton2E(cfac_t *cfac,
     k = 0;
     kk0 = &k;
     y = &z0;
-    nk0 = AngularZ(&y, &kk0, nk0, n_shells, sbra, sket, s, s+3, kmax);
+    nk0 = AngularZ(NULL, &y, &kk0, nk0, n_shells, sbra, sket, s, s+3, kmax);
     if (nk0 > 0) {
       z0 /= sqrt(s[0].j + 1.0);
       if (IsOdd((s[0].j - s[2].j)/2)) z0 = -z0;
@@ -1478,7 +1493,8 @@ double Hamilton2E(cfac_t *cfac,
   }
 
   x = 0.0;    
-  nk = AngularZxZ0(&ang, &kk, 0, n_shells, sbra, sket, s, kmax);
+  ArenaMark(cfac->arena, &mark);
+  nk = AngularZxZ0(cfac->arena, &ang, &kk, 0, n_shells, sbra, sket, s, kmax);
   for (i = 0; i < nk; i++) {
     sd = 0;
     se = 0;
@@ -1491,10 +1507,7 @@ double Hamilton2E(cfac_t *cfac,
     if (nk0 > 0) x -= z0 * sd;
   }
 
-  if (nk > 0) {
-    free(ang);
-    free(kk);
-  }
+  ArenaRelease(cfac->arena, &mark);
 
   return x;
 }
@@ -1714,6 +1727,7 @@ int AddToLevels(cfac_t *cfac, HAMILTON *h, int ng, const int *kg) {
   int i, j;
   double *mix;
   SYMMETRY *sym;
+  GROUP_SET gs;
 
   if (h->pj < 0) {
     return AddToLevelsEB(cfac, h, ng, kg);
@@ -1723,6 +1737,8 @@ int AddToLevels(cfac_t *cfac, HAMILTON *h, int ng, const int *kg) {
 
   mix = h->mixing + h->dim;
 
+  GroupSetInit(&gs, ng, kg);
+
   j = cfac->n_levels;
   sym = GetSymmetry(cfac, h->pj);  
   for (i = 0; i < h->dim; i++) {
@@ -1730,7 +1746,7 @@ int AddToLevels(cfac_t *cfac, HAMILTON *h, int ng, const int *kg) {
     STATE *s, *s1;
     CONFIG *cfg;
     int k, m, t;
-    int ig = 0, p, jj;
+    int p, jj;
     double a;
     
     k = GetPrincipleBasis(mix, h->dim, NULL);
@@ -1741,19 +1757,16 @@ int AddToLevels(cfac_t *cfac, HAMILTON *h, int ng, const int *kg) {
     }
             
     if (ng > 0) {
-      if (!InGroups(s->kgroup, ng, kg)) {
+      if (!InGroupSet(&gs, s->kgroup)) {
 	m = 0;
 	if (cfac->mix_cut2 < 1.0) {
 	  a = fabs(cfac->mix_cut2*mix[k]);
 	  for (t = 0; t < h->n_basis; t++) {
 	    if (fabs(mix[t]) >= a && t != k) {
 	      s1 = GetSymmetryState(sym, h->basis[t]);
-
-	      for (ig = 0; ig < ng; ig++) {
-		if (s1->kgroup == kg[ig]) {
-		  m = 1;
-		  break;
-		}
+	      if (InGroupSet(&gs, s1->kgroup)) {
+		m = 1;
+		break;
 	      }
 	    }
 	  }
@@ -1828,7 +1841,9 @@ void CutMixing(cfac_t *cfac, int nlev, int *ilev, int n, int *kg, double c) {
   SYMMETRY *sym;
   STATE *s;
   LEVEL *lev;
+  GROUP_SET gs;
 
+  GroupSetInit(&gs, n, kg);
   for (i = 0; i < nlev; i++) {
     lev = GetLevel(cfac, ilev[i]);
     m = 0;
@@ -1836,7 +1851,7 @@ void CutMixing(cfac_t *cfac, int nlev, int *ilev, int n, int *kg, double c) {
     for (t = 0; t < lev->n_basis; t++) {
       if (fabs(lev->mixing[t]) < c) continue;
       s = GetSymmetryState(sym, lev->basis[t]);
-      if (n > 0 && !InGroups(s->kgroup, n, kg)) continue;
+      if (n > 0 && !InGroupSet(&gs, s->kgroup)) continue;
       lev->ibasis[m] = lev->ibasis[t];
       lev->basis[m] = lev->basis[t];
       lev->mixing[m] = lev->mixing[t];
@@ -2643,6 +2658,32 @@ void StructureEB(cfac_t *cfac, char *fn, int n, int *ilev) {
   SaveEBLevels(cfac, fn, k, -1);
 }
 
+/*
+** the angular coefficients are stored sparsely, hashed by the pair of
+** Hamiltonians (ih1, ih2). FindAngZDatum() returns NULL if the pair has
+** never been set up, GetAngZDatum() creates an empty datum for it.
+*/
+static ANGZ_DATUM *FindAngZDatum(MULTI *ma, int ih1, int ih2) {
+  int k[2];
+
+  k[0] = ih1;
+  k[1] = ih2;
+  return (ANGZ_DATUM *) MultiGet(ma, k);
+}
+
+static ANGZ_DATUM *GetAngZDatum(MULTI *ma, int ih1, int ih2) {
+  int k[2];
+  ANGZ_DATUM *ad;
+
+  k[0] = ih1;
+  k[1] = ih2;
+  ad = (ANGZ_DATUM *) MultiSet(ma, k, NULL);
+  if (ad == NULL) {
+    printf("cannot allocate memory for the angular datum %d %d\n", ih1, ih2);
+  }
+  return ad;
+}
+
 int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
   int kg1, kg2, kc1, kc2;
   int ns, n, p, q, nz, iz, iz1, iz2;
@@ -2659,10 +2700,13 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
   SHELL *bra;
   SHELL_STATE *sbra, *sket;
   ANGULAR_ZMIX **a, *ang;
+  ARENA_MARK mark;
   int kmax = GetMaxRank(cfac);
   
-  iz = ih1*MAX_HAMS + ih2;
-  *ad = &(cfac->angz_array[iz]);
+  *ad = GetAngZDatum(cfac->angz_array, ih1, ih2);
+  if (*ad == NULL) {
+    return -1;
+  }
   ns = (*ad)->ns;
   if (ns < 0) {
     return -1;
@@ -2672,6 +2716,10 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
     return ns;
   }
 
+  if (LoadAngZStore(cfac, ANGZ_STORE_ZMIX, *ad, ih1, ih2) > 0) {
+    return (*ad)->ns;
+  }
+
   ns1 = cfac->hams[ih1].nbasis;
   ns2 = cfac->hams[ih2].nbasis;
   (*ad)->ns = ns1*ns2;
@@ -2705,7 +2753,9 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	iz1 = i1*ns2 + i2;
 	iz2 = i2*ns1 + i1;
       }
-      if (abs(c1->n_shells - c2->n_shells) > 1) {
+      /* a one-body operator moves a single electron */
+      if (abs(c1->n_shells - c2->n_shells) > 1 ||
+	  ConfigOccDiff(c1, c2) > 2) {
 	if (ih1 != ih2) {
 	  a[iz] = NULL;
 	  pnz[iz] = 0;
@@ -2720,6 +2770,7 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
       }
 
       idatum = NULL; 
+      ArenaMark(cfac->arena, &mark);
       n_shells = GetInteract(cfac, &idatum, &sbra, &sket, 
 			     kg1, kg2, kc1, kc2, 
 			     ks1, ks2, 0);
@@ -2729,11 +2780,7 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
       memcpy(s, idatum->s, sizeof(INTERACT_SHELL)*4);
       phase = idatum->phase;
       bra = idatum->bra;
-      if (s[2].index >= 0 && s[0].index >= 0) {
-	free(sbra);
-	free(sket);
-	goto OUT;
-      }
+      if (s[2].index >= 0 && s[0].index >= 0) goto OUT;
 
       nz = ANGZ_BLOCK;
       ang = malloc(sizeof(ANGULAR_ZMIX)*nz);
@@ -2742,7 +2789,8 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	exit(1);
       }
       if (s[0].index >= 0) {
-	nkk = AngularZ(&r, &k, 0, n_shells, sbra, sket, s, s+1, kmax);
+	nkk = AngularZ(cfac->arena, &r, &k, 0, n_shells, sbra, sket, s, s+1,
+		       kmax);
 	if (nkk > 0) {
 	  orb0 = OrbitalIndex(cfac, s[0].n, s[0].kappa, 0.0);
 	  orb1 = OrbitalIndex(cfac, s[1].n, s[1].kappa, 0.0);
@@ -2750,8 +2798,6 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	    if (IsOdd(phase)) r[p] = -r[p];
 	    AddToAngularZMix(&n, &nz, &ang, k[p], orb0, orb1, r[p]);
 	  }
-	  free(r);
-	  free(k);
 	}
       } else {
 	for (q = 0; q < n_shells; q++) {	    
@@ -2774,7 +2820,8 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	  s[0].nq_ket = s[0].nq_bra;
 	  s[1].nq_bra = s[0].nq_bra;
 	  s[1].nq_ket = s[1].nq_bra;
-	  nkk = AngularZ(&r, &k, 0, n_shells, sbra, sket, s, s+1, kmax);
+	  nkk = AngularZ(cfac->arena, &r, &k, 0, n_shells, sbra, sket,
+			 s, s+1, kmax);
 	  if (nkk > 0) {
 	    orb0 = OrbitalIndex(cfac, s[0].n, s[0].kappa, 0.0);
 	    orb1 = orb0;
@@ -2783,15 +2830,12 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	      if (IsOdd(phase)) r[p] = -r[p];
 	      AddToAngularZMix(&n, &nz, &ang, k[p], orb0, orb1, r[p]);
 	    }	    
-	    free(r);
-	    free(k);
 	  }
 	}
       }
       PackAngularZMix(&n, &ang, nz);
-      free(sbra);
-      free(sket);
     OUT:
+      ArenaRelease(cfac->arena, &mark);
       if (ih1 != ih2) {
 	a[iz] = ang;
 	pnz[iz] = n;
@@ -2812,6 +2856,9 @@ int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
     }
   }
 
+  PoolAngZDatum(*ad, sizeof(ANGULAR_ZMIX));
+  SaveAngZStore(cfac, ANGZ_STORE_ZMIX, *ad, ih1, ih2);
+
   return (*ad)->ns;
 }
 
@@ -2849,9 +2896,12 @@ int AngularZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
   SHELL_STATE *sbra, *sket;
   CONFIG *c1, *c2;
   ANGULAR_ZFB *ang, **a;
+  ARENA_MARK mark;
   
-  iz = ih1*MAX_HAMS + ih2;
-  *ad = &(cfac->angz_array[iz]);
+  *ad = GetAngZDatum(cfac->angz_array, ih1, ih2);
+  if (*ad == NULL) {
+    return -1;
+  }
   ns = (*ad)->ns;
 
   if (ns < 0) {
@@ -2861,6 +2911,10 @@ int AngularZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
     return ns;
   }
 
+  if (LoadAngZStore(cfac, ANGZ_STORE_ZFB, *ad, ih1, ih2) > 0) {
+    return (*ad)->ns;
+  }
+
   ns1 = cfac->hams[ih1].nbasis;
   ns2 = cfac->hams[ih2].nbasis;
   (*ad)->ns = ns1 * ns2;
@@ -2888,7 +2942,8 @@ int AngularZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
       ks2 = s2->kstate;          
       c2 = GetConfigFromGroup(cfac, kg2, kc2);
           
-      if (abs(c1->n_shells+1 - c2->n_shells) > 1) {
+      if (abs(c1->n_shells+1 - c2->n_shells) > 1 ||
+	  ConfigOccDiff(c1, c2) > 2) {
 	a[iz] = NULL;
 	pnz[iz] = 0;
 	iz++;
@@ -2897,6 +2952,7 @@ int AngularZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
       
       j2 = (c2->csfs[ks2]).totalJ;
       idatum = NULL;
+      ArenaMark(cfac->arena, &mark);
       n_shells = GetInteract(cfac, &idatum, &sbra, &sket,
 			     kg1, kg2, kc1, kc2, 
 			     ks1, ks2, 1);
@@ -2906,8 +2962,6 @@ int AngularZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
       memcpy(s, idatum->s, sizeof(INTERACT_SHELL)*4);
       phase = idatum->phase;
       if (s[0].index < 0 || (s[0].index >= 0 && s[2].index >= 0)) {
-	free(sbra);
-	free(sket);
 	goto END;
       }
       
@@ -2931,7 +2985,7 @@ int AngularZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	sbra[0].totalJ = jp; 
 	k = &k0;
 	r = &r0;
-	AngularZ(&r, &k, 1, n_shells, sbra, sket, s, s+1, kmax);
+	AngularZ(NULL, &r, &k, 1, n_shells, sbra, sket, s, s+1, kmax);
 	if (fabs(*r) < EPS30) goto END;
 	if (IsOdd(phase+(jp+j2-k0)/2)) *r = -(*r);
 	*r /= sqrt(jp+1.0)*W6j(j1, jf, jp, k0, j2, s[1].j);
@@ -2941,15 +2995,17 @@ int AngularZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	ang->coeff = *r;
 	n = 1;
       }
-      free(sbra);
-      free(sket);
     END:
+      ArenaRelease(cfac->arena, &mark);
       a[iz] = ang;
       pnz[iz] = n;
       iz++;
     }
   }
   
+  PoolAngZDatum(*ad, sizeof(ANGULAR_ZFB));
+  SaveAngZStore(cfac, ANGZ_STORE_ZFB, *ad, ih1, ih2);
+
   return (*ad)->ns;
 }
 
@@ -2968,9 +3024,12 @@ int AngularZxZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
   CONFIG *c1, *c2;
   STATE *s1, *s2;
   ANGULAR_ZxZMIX **a, *ang;
+  ARENA_MARK mark;
 
-  iz = ih1 * MAX_HAMS + ih2;
-  *ad = &(cfac->angzxz_array[iz]);
+  *ad = GetAngZDatum(cfac->angzxz_array, ih1, ih2);
+  if (*ad == NULL) {
+    return -1;
+  }
   ns = (*ad)->ns;
 
   if (ns < 0) { 
@@ -2980,6 +3039,10 @@ int AngularZxZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
   if (ns > 0) {
     return ns;
   }
+
+  if (LoadAngZStore(cfac, ANGZ_STORE_ZXZ, *ad, ih1, ih2) > 0) {
+    return (*ad)->ns;
+  }
   
   ns1 = cfac->hams[ih1].nbasis;
   ns2 = cfac->hams[ih2].nbasis;
@@ -3016,6 +3079,7 @@ int AngularZxZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
    
       j2 = (c2->csfs[ks2]).totalJ;
       idatum = NULL;
+      ArenaMark(cfac->arena, &mark);
       n_shells = GetInteract(cfac, &idatum, &sbra, &sket,
 			     kg1, kg2, kc1, kc2, 
 			     ks1, ks2, 1);
@@ -3039,8 +3103,8 @@ int AngularZxZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	sbra[0].shellJ = s[2].j;
 	
 	if (s[0].index >= 0) {
-	  AddToAngularZxZ(cfac, &n, &nz, &ang, n_shells, phase, 
-			  sbra, sket, s, 1);
+	  if (AddToAngularZxZ(cfac, &n, &nz, &ang, n_shells, phase, 
+			      sbra, sket, s) < 0) goto ERROR;
 	} else {
 	  for (i = 0; i < n_shells; i++) {
 	    s[0].index = n_shells - i - 1;
@@ -3065,44 +3129,47 @@ int AngularZxZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2) {
 	    }
 	    s[1].nq_bra = s[0].nq_bra;
 	    s[1].nq_ket = s[0].nq_ket;
-	    AddToAngularZxZ(cfac, &n, &nz, &ang, n_shells, phase, 
-			    sbra, sket, s, 1);
+	    if (AddToAngularZxZ(cfac, &n, &nz, &ang, n_shells, phase, 
+				sbra, sket, s) < 0) goto ERROR;
 	  }
 	}
       }
       
       PackAngularZxZMix(&n, &ang, nz);
-      free(sbra);
-      free(sket);
       
     END:	  
+      ArenaRelease(cfac->arena, &mark);
       a[iz] = ang;
       pnz[iz] = n;
       iz++;
     }
   }
 
+  PoolAngZDatum(*ad, sizeof(ANGULAR_ZxZMIX));
+  SaveAngZStore(cfac, ANGZ_STORE_ZXZ, *ad, ih1, ih2);
+
   return (*ad)->ns;
+
+  /* an incomplete list must not be kept, mark the datum as failed */
+ ERROR:
+  ArenaRelease(cfac->arena, &mark);
+  free(ang);
+  for (i = 0; i < iz; i++) free(a[i]);
+  free((*ad)->angz);
+  free((*ad)->nz);
+  (*ad)->angz = NULL;
+  (*ad)->nz = NULL;
+  (*ad)->ns = -1;
+  return -1;
 }
 
 int PrepAngular(cfac_t *cfac, int n1, int *is1, int n2, int *is2) {
   int i1, i2, ih1, ih2, ns1, ns2, ne1, ne2;
-  int iz, is, i, nz, ns = 0;
+  int is, i, nz, ns = 0;
   SYMMETRY *sym1, *sym2;
   STATE *s1, *s2;
   LEVEL *lev1, *lev2;
   ANGZ_DATUM *ad;
-  
-  if (cfac->angmz_array == NULL) {
-    cfac->angmz_array = malloc(sizeof(ANGZ_DATUM)*MAX_HAMS2);
-    if (!cfac->angmz_array) {
-      printf("cannot allocate memory for cfac->angmz_array %d\n", MAX_HAMS2);
-    }
-    for (i = 0; i < MAX_HAMS2; i++) {
-      cfac->angmz_array[i].ns = 0;
-      cfac->angmz_array[i].mk = NULL;
-    }
-  }
 
   if (n2 == 0) {
     n2 = n1;
@@ -3129,22 +3196,24 @@ int PrepAngular(cfac_t *cfac, int n1, int *is1, int n2, int *is2) {
       ns = ns1*ns2;
       if (ne1 == ne2) {
 	if (ih1 > ih2) {
-	  iz = ih2 * MAX_HAMS + ih1;
+	  ad = GetAngZDatum(cfac->angmz_array, ih2, ih1);
 	  is = lev2->ilev * cfac->hams[ih1].nlevs + lev1->ilev;
 	} else {
-	  iz = ih1 * MAX_HAMS + ih2;
+	  ad = GetAngZDatum(cfac->angmz_array, ih1, ih2);
 	  is = lev1->ilev * cfac->hams[ih2].nlevs + lev2->ilev;
 	}
       } else {
 	if (ne1 > ne2) {
-	  iz = ih2 * MAX_HAMS + ih1;
+	  ad = GetAngZDatum(cfac->angmz_array, ih2, ih1);
 	  is = lev2->ilev * cfac->hams[ih1].nlevs + lev1->ilev;
 	} else {
-	  iz = ih1 * MAX_HAMS + ih2;
+	  ad = GetAngZDatum(cfac->angmz_array, ih1, ih2);
 	  is = lev1->ilev * cfac->hams[ih2].nlevs + lev2->ilev;
 	}
       }
-      ad = &(cfac->angmz_array[iz]);
+      if (ad == NULL) {
+	return -1;
+      }
       if (ad->ns == 0) {
 	if (ne1 == ne2) {
 	  ad->angz = malloc(sizeof(ANGULAR_ZMIX *)*ns);
@@ -3203,10 +3272,9 @@ int AngularZFreeBound(cfac_t *cfac, ANGULAR_ZFB **ang, int lower, int upper) {
     ih1 = lev1->iham;
     ih2 = lev2->iham;
     if (ih1 >= 0 && ih2 >= 0) {
-      isz = ih1 * MAX_HAMS + ih2;
-      ad = &(cfac->angmz_array[isz]);
+      ad = FindAngZDatum(cfac->angmz_array, ih1, ih2);
       nz = 0;
-      if (ad->ns > 0) {
+      if (ad && ad->ns > 0) {
 	isz0 = lev1->ilev * cfac->hams[ih2].nlevs + lev2->ilev;
 	nz = (ad->nz)[isz0];
 	if (nz > 0) {
@@ -3318,13 +3386,12 @@ int AngularZMix(cfac_t *cfac,
     ih2 = lev2->iham;
     if (ih1 >= 0 && ih2 >= 0) {
       if (ih1 > ih2) {
-	isz = ih2 * MAX_HAMS + ih1;
+	ad = FindAngZDatum(cfac->angmz_array, ih2, ih1);
       } else {
-	isz = ih1 * MAX_HAMS + ih2;
+	ad = FindAngZDatum(cfac->angmz_array, ih1, ih2);
       }
-      ad = &(cfac->angmz_array[isz]);
       nz = 0;
-      if (ad->ns > 0) {
+      if (ad && ad->ns > 0) {
 	if (ih1 > ih2) {
 	  isz0 = lev2->ilev * cfac->hams[ih1].nlevs + lev1->ilev;
 	} else {
@@ -3618,14 +3685,19 @@ int AngularZxZFreeBound(cfac_t *cfac,
 	  if (IsOdd((jup+jf+j2)/2)) r0 = -r0;
 	  r0 *= r;
 	  if (fabs(r0) < cfac->angz_cut) continue;
-	  AddToAngularZxZMix(&n, &nz, ang, ang_z[i].k, 
-				  jf, kb, orb0, orb1, r0);
+	  if (AddToAngularZxZMix(&n, &nz, ang, ang_z[i].k, 
+				 jf, kb, orb0, orb1, r0) < 0) {
+	    free(ang_z);
+	    goto ERROR;
+	  }
 	}
       }
       free(ang_z);
     }
   } else {
-    AngularZxZFreeBoundStates(cfac, &ad, lev1->iham, lev2->iham);
+    if (AngularZxZFreeBoundStates(cfac, &ad, lev1->iham, lev2->iham) < 0) {
+      goto ERROR;
+    }
     for (i = 0; i < lev1->n_basis; i++) {
       mix1 = lev1->mixing[i];
       if (fabs(mix1) < cfac->angz_cut) continue;      
@@ -3644,10 +3716,10 @@ int AngularZxZFreeBound(cfac_t *cfac,
 	  for (m = 0; m < nz_sub; m++) {
 	    r0 = ang_sub[m].coeff*r;
 	    if (fabs(r0) < cfac->angz_cut) continue;
-	    AddToAngularZxZMix(&n, &nz, ang, 
-				    ang_sub[m].k, ang_sub[m].k0,
-				    ang_sub[m].k1, ang_sub[m].k2,
-				    ang_sub[m].k3, r0);
+	    if (AddToAngularZxZMix(&n, &nz, ang, 
+				   ang_sub[m].k, ang_sub[m].k0,
+				   ang_sub[m].k1, ang_sub[m].k2,
+				   ang_sub[m].k3, r0) < 0) goto ERROR;
 	  }
 	}
       }
@@ -3657,6 +3729,11 @@ int AngularZxZFreeBound(cfac_t *cfac,
   PackAngularZxZMix(&n, ang, nz);
 
   return n;
+
+ ERROR:
+  free(*ang);
+  *ang = NULL;
+  return -1;
 }
   
 int CompareAngularZxZMix(const void *c1, const void *c2) {
@@ -3716,15 +3793,18 @@ int CompareAngularZFB(const void *c1, const void *c2) {
   else return 0;
 }
 
+/*
+** the AddToAngular*() routines below only append to the lists. packing
+** sorts a completed list once, merges the terms with equal indices and
+** returns the unused space.
+*/
 int PackAngularZxZMix(int *n, ANGULAR_ZxZMIX **ang, int nz) {
   int j, m;
   ANGULAR_ZxZMIX *p1, *p2;
   
   m = *n;
   if (*n <= 1) goto OUT;
-  if (*n > 2) {
-    qsort((void *)(*ang), *n, sizeof(ANGULAR_ZxZMIX), CompareAngularZxZMix);
-  }
+  qsort((void *)(*ang), *n, sizeof(ANGULAR_ZxZMIX), CompareAngularZxZMix);
   m = 1;
   p1 = (*ang);
   j = 1;
@@ -3746,11 +3826,10 @@ int PackAngularZxZMix(int *n, ANGULAR_ZxZMIX **ang, int nz) {
  OUT:
   if (*n <= 0) {
     if (nz > 0) free(*ang);
-  } else {
-    if (m < nz) {
-      (*ang) = realloc((*ang), m*sizeof(ANGULAR_ZxZMIX));
-      *n = m;
-    }
+    *ang = NULL;
+  } else if (m < nz) {
+    (*ang) = realloc((*ang), m*sizeof(ANGULAR_ZxZMIX));
+    *n = m;
   }
 
   return 0;
@@ -3759,12 +3838,10 @@ int PackAngularZxZMix(int *n, ANGULAR_ZxZMIX **ang, int nz) {
 int PackAngularZMix(int *n, ANGULAR_ZMIX **ang, int nz) {
   int j, m;
   ANGULAR_ZMIX *p1, *p2;
-
+  
   m = *n;
   if (*n <= 1) goto OUT;
-  if (*n > 2) {
-    qsort((void *)(*ang), *n, sizeof(ANGULAR_ZMIX), CompareAngularZMix);
-  }
+  qsort((void *)(*ang), *n, sizeof(ANGULAR_ZMIX), CompareAngularZMix);
   m = 1;
   p1 = (*ang);
   j = 1;
@@ -3786,11 +3863,10 @@ int PackAngularZMix(int *n, ANGULAR_ZMIX **ang, int nz) {
  OUT:
   if (*n <= 0) {
     if (nz > 0) free(*ang);
-  } else {
-    if (m < nz) {
-      (*ang) = realloc((*ang), m*sizeof(ANGULAR_ZMIX));
-      *n = m;
-    }
+    *ang = NULL;
+  } else if (m < nz) {
+    (*ang) = realloc((*ang), m*sizeof(ANGULAR_ZMIX));
+    *n = m;
   }
 
   return 0;
@@ -3802,9 +3878,7 @@ int PackAngularZFB(int *n, ANGULAR_ZFB **ang, int nz) {
   
   m = *n;
   if (*n <= 1) goto OUT;
-  if (*n > 2) {
-    qsort((void *)(*ang), *n, sizeof(ANGULAR_ZFB), CompareAngularZFB);
-  }
+  qsort((void *)(*ang), *n, sizeof(ANGULAR_ZFB), CompareAngularZFB);
   m = 1;
   p1 = (*ang);
   j = 1;
@@ -3822,50 +3896,76 @@ int PackAngularZFB(int *n, ANGULAR_ZFB **ang, int nz) {
     j++;
     p2++;
   }
-
+  
  OUT:
   if (*n <= 0) {
     if (nz > 0) free(*ang);
-  } else {
-    if (m < nz) {
-      (*ang) = realloc((*ang), m*sizeof(ANGULAR_ZFB));
-      *n = m;
-    }
+    *ang = NULL;
+  } else if (m < nz) {
+    (*ang) = realloc((*ang), m*sizeof(ANGULAR_ZFB));
+    *n = m;
   }
+
   return 0;
-}			    
+}
+
+/*
+** copy all lists of the datum ad into a single block, saving the
+** allocation overhead of the many short ones.
+*/
+void PoolAngZDatum(ANGZ_DATUM *ad, int esize) {
+  int i, m;
+  char *p;
+
+  if (ad->pool) return;
+  m = 0;
+  for (i = 0; i < ad->ns; i++) {
+    if (ad->nz[i] > 0) m += ad->nz[i];
+  }
+  if (m == 0) return;
+  p = malloc(m*esize);
+  if (!p) return;
+  ad->pool = p;
+  for (i = 0; i < ad->ns; i++) {
+    if (ad->nz[i] > 0) {
+      memcpy(p, ad->angz[i], ad->nz[i]*esize);
+      free(ad->angz[i]);
+      ad->angz[i] = p;
+      p += ad->nz[i]*esize;
+    } else {
+      ad->angz[i] = NULL;
+    }
+  }
+}
 
 int AddToAngularZxZ(cfac_t *cfac, int *n, int *nz, ANGULAR_ZxZMIX **ang, 
 		    int n_shells, int phase, SHELL_STATE *sbra, 
-		    SHELL_STATE *sket, INTERACT_SHELL *s, int m) {
+		    SHELL_STATE *sket, INTERACT_SHELL *s) {
   int nkk, *k, p;
   double *r;
   int orb0, orb1;
   int kk0, kk1;
   int kmax = GetMaxRank(cfac);
+  ARENA_MARK mark;
   
-  nkk = AngularZxZ0(&r, &k, 0, n_shells, sbra, sket, s, kmax);
+  ArenaMark(cfac->arena, &mark);
+  nkk = AngularZxZ0(cfac->arena, &r, &k, 0, n_shells, sbra, sket, s, kmax);
   if (nkk > 0) {    
-    if (m == 0) {
-      orb0 = OrbitalIndex(cfac, s[0].n, s[0].kappa, 0.0);
-      orb1 = OrbitalIndex(cfac, s[1].n, s[1].kappa, 0.0);
-      kk0 = OrbitalIndex(cfac, s[2].n, s[2].kappa, 0.0);
-      kk1 = OrbitalIndex(cfac, s[3].n, s[3].kappa, 0.0);
-    } else {
-      orb0 = s[2].j;      
-      orb1 = OrbitalIndex(cfac, s[3].n, s[3].kappa, 0.0);
-      kk0 = OrbitalIndex(cfac, s[0].n, s[0].kappa, 0.0);
-      kk1 = OrbitalIndex(cfac, s[1].n, s[1].kappa, 0.0);
-    }
+    orb0 = s[2].j;      
+    orb1 = OrbitalIndex(cfac, s[3].n, s[3].kappa, 0.0);
+    kk0 = OrbitalIndex(cfac, s[0].n, s[0].kappa, 0.0);
+    kk1 = OrbitalIndex(cfac, s[1].n, s[1].kappa, 0.0);
     for (p = 0; p < nkk; p++) {
       if (fabs(r[p]) < EPS30) continue;
       if (IsOdd(phase)) r[p] = -r[p];
-      AddToAngularZxZMix(n, nz, ang, k[p], 
-			      orb0, orb1, kk0, kk1, r[p]);
+      if (AddToAngularZxZMix(n, nz, ang, k[p], 
+			     orb0, orb1, kk0, kk1, r[p]) < 0) {
+	ArenaRelease(cfac->arena, &mark);
+	return -1;
+      }
     }
-    free(r);
-    free(k);
   }
+  ArenaRelease(cfac->arena, &mark);
   
   return 0;
 }
@@ -3874,6 +3974,10 @@ int AddToAngularZxZMix(int *n, int *nz, ANGULAR_ZxZMIX **ang,
 		       int k, int k0, int k1, int k2, int k3, double r) {
   int im;
 
+  if (k < 0 || k > 255 || k0 < 0 || k0 > 255) {
+    printf("AngularZxZMix rank %d or 2j %d out of range\n", k, k0);
+    return -1;
+  }
   im = *n;
   (*n)++;
   if (*n > *nz) {
@@ -3939,8 +4043,13 @@ int AddToAngularZFB(int *n, int *nz, ANGULAR_ZFB **ang,
 void FreeAngZDatum(ANGZ_DATUM *ap) {
   int i;
 
-  for (i = 0; i < ap->ns; i++) {
-    if (ap->nz[i] > 0) free(ap->angz[i]);
+  if (ap->pool) {
+    free(ap->pool);
+    ap->pool = NULL;
+  } else {
+    for (i = 0; i < ap->ns; i++) {
+      if (ap->nz[i] > 0) free(ap->angz[i]);
+    }
   }
   if (ap->ns > 0) {
     free(ap->angz);
@@ -3955,6 +4064,14 @@ void FreeAngZDatum(ANGZ_DATUM *ap) {
   ap->ns = 0;
 }
 
+void FreeAngZData(void *p) {
+  FreeAngZDatum((ANGZ_DATUM *) p);
+}
+
+void InitAngZData(void *p, int n) {
+  memset(p, 0, sizeof(ANGZ_DATUM)*n);
+}
+
 void FreeLevelData(void *p) {
   LEVEL *lev;
   lev = (LEVEL *) p;
@@ -77,9 +77,17 @@ typedef struct _ANGZ_DATUM_ {
   int ns;
   int *nz;
   void **angz;
+  void *pool;        /* if not NULL, a single block holding all angz[] */
   double **mk;
 } ANGZ_DATUM;
 
+/* types of the blocks kept in the persistent angular store */
+#define ANGZ_STORE_ZMIX  0
+#define ANGZ_STORE_ZFB   1
+#define ANGZ_STORE_ZXZ   2
+
+typedef struct _ANGZ_STORE_ ANGZ_STORE;
+
 typedef struct _ANGULAR_ZMIX_ {
   double coeff;
   short k;
@@ -92,13 +100,17 @@ typedef struct _ANGULAR_ZFB_ {
   short kb;
 } ANGULAR_ZFB;
 
+/*
+** k is the rank and k0 the 2j of the free electron; both are small, and
+** keeping them in a byte each makes the entry 16 bytes instead of 24.
+*/
 typedef struct _ANGULAR_ZxZMIX_ {
   double coeff;
-  short k;
-  short k0;
   short k1;
   short k2;
   short k3;
+  unsigned char k;
+  unsigned char k0;
 } ANGULAR_ZxZMIX;
 
 typedef struct _ANGULAR_FROZEN_ {
@@ -155,6 +167,7 @@ int CompareAngularZFB(const void *c1, const void *c2);
 int PackAngularZxZMix(int *n, ANGULAR_ZxZMIX **ang, int nz);
 int PackAngularZMix(int *n, ANGULAR_ZMIX **ang, int nz);
 int PackAngularZFB(int *n, ANGULAR_ZFB **ang, int nz);
+void PoolAngZDatum(ANGZ_DATUM *ad, int esize);
 int AngularZFreeBound(cfac_t *cfac, ANGULAR_ZFB **ang, int lower, int upper);
 int AngularZMixStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2);
 int AngZSwapBraKet(cfac_t *cfac, int nz, ANGULAR_ZMIX *ang, int p);
@@ -162,7 +175,7 @@ int AngularZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2);
 int AngularZxZFreeBoundStates(cfac_t *cfac, ANGZ_DATUM **ad, int ih1, int ih2);
 int AddToAngularZxZ(cfac_t *cfac, int *n, int *nz, ANGULAR_ZxZMIX **ang, 
 		    int n_shells, int phase, SHELL_STATE *sbra, 
-		    SHELL_STATE *sket, INTERACT_SHELL *s, int m);
+		    SHELL_STATE *sket, INTERACT_SHELL *s);
 int AddToAngularZxZMix(int *n, int *nz, ANGULAR_ZxZMIX **ang, 
 		       int k, int k0, int k1, int k2, int k3, double coeff);
 int AddToAngularZMix(int *n, int *nz, ANGULAR_ZMIX **ang,
@@ -178,6 +191,11 @@ int FinalizeLevels(cfac_t *cfac, int start, int n);
 int SaveEBLevels(cfac_t *cfac, char *fn, int m, int n);
 int SetAngZOptions(cfac_t *cfac, int n, double mc, double c);
 int SetAngZCut(cfac_t *cfac, double c);
+int SetAngZStore(cfac_t *cfac, const char *fn);
+void FreeAngZStore(ANGZ_STORE *st);
+int LoadAngZStore(cfac_t *cfac, int type, ANGZ_DATUM *ad, int ih1, int ih2);
+int SaveAngZStore(cfac_t *cfac, int type, const ANGZ_DATUM *ad,
+		  int ih1, int ih2);
 int SetCILevel(cfac_t *cfac, int m);
 int SetMixCut(cfac_t *cfac, double c, double c2);
 int TestHamilton(cfac_t *cfac);
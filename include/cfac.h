@@ -40,6 +40,8 @@ cfac_new(void);
 
 void 
 cfac_free(cfac_t *cfac);
+int
+cfac_get_arena_stats(const cfac_t *cfac, long *nalloc, long *nsys);
 
 /* nucleus.c */
 int
@@ -62,6 +64,8 @@ int
 cfac_get_config_gid(const cfac_t *cfac, const char *cname);
 int
 cfac_set_uta(cfac_t *cfac, int uta);
+int
+cfac_set_nthreads(cfac_t *cfac, unsigned int nthreads);
 
 /* structure.c */
 int
@@ -39,6 +39,7 @@ struct _cfac_t {
 
     CONFIG_GROUP *cfg_groups; /* a list of configuration groups              */
     int n_groups;             /* number of configuration groups present      */
+    int group_hash[GROUP_HASH_SIZE]; /* group indices + 1, hashed by name    */
 
     double ef, bf, eb_angle;  /* electric, magnetic field, and angle between */
     double e1[3];             /* spherical components of the E field         */
@@ -76,6 +77,7 @@ struct _cfac_t {
     MULTI *yk_array;
     
     int uta;                  /* UTA flag                                    */
+    unsigned int nthreads;    /* number of worker threads (1 = no threading) */
 
     struct {
       double stabilizer;
@@ -127,6 +129,9 @@ struct _cfac_t {
     
     SHAMILTON *hams;          /* symmetry Hamiltonians                       */
     int nhams;                /* number of them in use                       */
+    int hams_alloc;           /* number of them allocated                    */
+
+    ARENA *arena;             /* scratch storage of the recoupling loops     */
 
     ARRAY *levels;            /* levels                                      */
     int n_levels;             /* number of levels                            */
@@ -155,9 +160,10 @@ struct _cfac_t {
     int sym_njj;              /* length of the above array                   */
 
 
-    ANGZ_DATUM *angz_array;   /* angular coefficients                        */
-    ANGZ_DATUM *angzxz_array; /* ZxZ angular coefficients                    */
-    ANGZ_DATUM *angmz_array;  /* precalculated angular coefficients          */
+    MULTI *angz_array;        /* angular coefficients, by Hamiltonian pairs  */
+    MULTI *angzxz_array;      /* ZxZ angular coefficients                    */
+    MULTI *angmz_array;       /* precalculated angular coefficients          */
+    ANGZ_STORE *angz_store;   /* persistent store of the above, if any       */
 
     ANGULAR_FROZEN ang_frozen;/* angular coefficients for frozen states      */
 
@@ -235,6 +241,10 @@ FreeHamsArray(cfac_t *cfac);
 void
 FreeAngZDatum(ANGZ_DATUM *ap);
 void
+FreeAngZData(void *p);
+void
+InitAngZData(void *p, int n);
+void
 InitLevelData(void *p, int n);
 void
 cfac_hamiltonian_free(HAMILTON *h);
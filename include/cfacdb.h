@@ -49,6 +49,9 @@ extern "C" {
 /*! Photoionization. */
 #define CFACDB_CS_PI    3
 
+/*! Maximal number of coefficients of a rate fit. */
+#define CFACDB_RFIT_NCOEF_MAX   64
+
 /*!
  * \brief Storage type for temporary views, indices, etc .
  */
@@ -169,6 +172,7 @@ typedef struct {
  * \brief Collisional rate data. 
  */
 typedef struct {
+    unsigned int cid;   /*!< Collision transition ID.           */
     unsigned int ii;    /*!< Initial level ID.                  */
     unsigned int fi;    /*!< Final level ID (\f$E_f > E_i\f$).  */
     
@@ -179,6 +183,101 @@ typedef struct {
     double ratec;       /*!< Rate coefficient                   */
 } cfacdb_crates_data_t;
 
+/*!
+ * \brief Collisional rate data at multiple temperatures. 
+ */
+typedef struct {
+    unsigned int cid;     /*!< Collision transition ID.           */
+    unsigned int ii;      /*!< Initial level ID.                  */
+    unsigned int fi;      /*!< Final level ID (\f$E_f > E_i\f$).  */
+    
+    unsigned int type;    /*!< Process type.                      */
+    
+    double de;            /*!< Transition energy.                 */
+    
+    unsigned int nT;      /*!< Number of temperatures.            */
+    const double *T;      /*!< Temperatures, length = nT.         */
+    const double *ratec;  /*!< Rate coefficients, length = nT.    */
+} cfacdb_crates_multi_data_t;
+
+/*!
+ * \brief A batch of radiative transitions in the structure-of-arrays form.
+ *
+ * Each non-NULL member must point to a caller-allocated array large enough
+ * for the requested batch size; NULL members are not filled in.
+ */
+typedef struct {
+    unsigned int *ii;   /*!< Initial level IDs.           */
+    unsigned int *fi;   /*!< Final level IDs.             */
+    int *mpole;         /*!< Multipole types.             */
+    double *de;         /*!< Transition energies.         */
+    double *gf;         /*!< Symmetrized osc. strengths.  */
+    double *uta_de;     /*!< UTA shifts.                  */
+    double *uta_sd;     /*!< UTA Gaussian widths.         */
+} cfacdb_rtrans_batch_t;
+
+/*!
+ * \brief A batch of autoionization transitions in the structure-of-arrays
+ * form.
+ *
+ * Each non-NULL member must point to a caller-allocated array large enough
+ * for the requested batch size; NULL members are not filled in.
+ */
+typedef struct {
+    unsigned int *ii;   /*!< Initial level IDs. */
+    unsigned int *fi;   /*!< Final level IDs.   */
+    double *rate;       /*!< AI rates.          */
+} cfacdb_aitrans_batch_t;
+
+/*!
+ * \brief A cursor over transition data (used opaquely throughout the API).
+ */
+typedef struct _cfacdb_cursor_t cfacdb_cursor_t;
+
+/*!
+ * \brief Radiative transitions of one level, as returned by
+ * \ref cfacdb_rtable_from_upper or \ref cfacdb_rtable_to_lower.
+ *
+ * The arrays point into the table and remain valid until it is freed.
+ */
+typedef struct {
+    unsigned long n;            /*!< Number of transitions.              */
+    const unsigned int *lev;    /*!< The other (lower or upper) levels.  */
+    const unsigned long *tid;   /*!< Transition IDs.                     */
+    const double *a;            /*!< Einstein coefficients (a.u.).       */
+    const double *de;           /*!< Transition energies.                */
+    const double *gf;           /*!< Symmetrized osc. strengths.         */
+    const int *mpole;           /*!< Multipole types.                    */
+} cfacdb_rtable_slice_t;
+
+/*!
+ * \brief An indexed table of radiative transitions (used opaquely
+ * throughout the API).
+ */
+typedef struct _cfacdb_rtable_t cfacdb_rtable_t;
+
+/*!
+ * \brief Sparsity pattern of the rate matrix, in the compressed sparse row
+ * (CSR) form.
+ *
+ * The arrays belong to the rate-matrix object and remain valid until it is
+ * freed.
+ */
+typedef struct {
+    unsigned int n;               /*!< Dimension (number of levels).     */
+    unsigned long nnz;            /*!< Number of non-zero elements.      */
+    const unsigned long *rowptr;  /*!< Row offsets, length = n + 1.      */
+    const unsigned int *col;      /*!< Column indices, length = nnz.     */
+    const unsigned long *diag;    /*!< Positions of the diagonal
+                                       elements, length = n.             */
+} cfacdb_crm_pattern_t;
+
+/*!
+ * \brief A collisional-radiative rate matrix (used opaquely throughout the
+ * API).
+ */
+typedef struct _cfacdb_crm_t cfacdb_crm_t;
+
 /*!
  * \brief Interpolationa/extrapolation data structure. 
  */
@@ -232,12 +331,18 @@ typedef int (*cfacdb_ctrans_sink_t)(const cfacdb_t *cdb,
  */
 typedef int (*cfacdb_crates_sink_t)(const cfacdb_t *cdb,
     cfacdb_crates_data_t *cbdata, void *udata);
+/*!
+ * \brief Multi-temperature collision rate data sink prototype
+ */
+typedef int (*cfacdb_crates_multi_sink_t)(const cfacdb_t *cdb,
+    cfacdb_crates_multi_data_t *cbdata, void *udata);
 
 
 /*!
  * \brief cFACdb constructor.
  * Opens a database and allocates a new cFACdb object.
- * \param fname The SQLite database file to open.
+ * \param fname The SQLite database file (or a session image created by
+ * \ref cfacdb_save_snapshot) to open.
  * \param temp_store Storage type of temporary SQL constructs.
  * \return The object allocated or NULL if failed.
  */
@@ -261,6 +366,35 @@ void cfacdb_close(cfacdb_t *cdb);
  */
 int cfacdb_init(cfacdb_t *cdb, unsigned long sid, int nele_min, int nele_max);
 
+/*!
+ * \brief Load the selected session into memory.
+ *
+ * All charge states of the session chosen by \ref cfacdb_init are read
+ * once into contiguous in-memory arrays. Afterwards, \ref cfacdb_init
+ * calls for the same session (with any range of charge states) and all
+ * the data accessors are served from memory, without SQL queries. The
+ * snapshot is released by \ref cfacdb_close or when another session is
+ * selected.
+ * \param cdb The cFACdb object.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_load_snapshot(cfacdb_t *cdb);
+/*!
+ * \brief Save the in-memory snapshot as a session image.
+ *
+ * The image is a binary file that \ref cfacdb_open recognizes and maps
+ * read-only, without any parsing; processes on the same node mapping the
+ * same image share its memory. The image is only portable between
+ * platforms with the same binary data layout. It is written under a
+ * temporary name and then renamed, so it appears to other processes only
+ * when complete.
+ * \param cdb The cFACdb object, with a snapshot loaded by
+ * \ref cfacdb_load_snapshot.
+ * \param fname The image file to create.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_save_snapshot(const cfacdb_t *cdb, const char *fname);
+
 /*!
  * \brief Set arbitrary user-supplied data.
  * \param cdb The cFACdb object.
@@ -275,6 +409,19 @@ int cfacdb_set_udata(cfacdb_t *cdb, void *udata);
  */
 void *cfacdb_get_udata(cfacdb_t *cdb);
 
+/*!
+ * \brief Set number of threads used for computing collision rates.
+ *
+ * With more than one thread, \ref cfacdb_crates and \ref cfacdb_crates_multi
+ * integrate the rates in a pool of worker threads. The sink is still invoked from the calling
+ * thread, in the same order as in the single-threaded mode. This has no
+ * effect if cFACdb was built without POSIX threads support.
+ * \param cdb The cFACdb object.
+ * \param nthreads Number of worker threads (1 = no threading, default).
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_set_nthreads(cfacdb_t *cdb, unsigned int nthreads);
+
 /*!
  * \brief Get number of sessions.
  * \param cdb The cFACdb object.
@@ -332,6 +479,33 @@ int cfacdb_levels(cfacdb_t *cdb, cfacdb_levels_sink_t sink, void *udata);
  * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
  */
 int cfacdb_rtrans(cfacdb_t *cdb, cfacdb_rtrans_sink_t sink, void *udata);
+/*!
+ * \brief Open a cursor over radiative transitions.
+ *
+ * The transitions are the same, and come in the same order, as those passed
+ * to the sink of \ref cfacdb_rtrans. The cursor must be closed before the
+ * next \ref cfacdb_init, \ref cfacdb_load_snapshot or \ref cfacdb_close
+ * call; the former two fail while any cursor is open.
+ * \param cdb The cFACdb object.
+ * \return The cursor or NULL if failed.
+ */
+cfacdb_cursor_t *cfacdb_rtrans_open(cfacdb_t *cdb);
+/*!
+ * \brief Fetch the next batch of radiative transitions.
+ * \param cur The cursor.
+ * \param n The maximal number of transitions to fetch.
+ * \param batch Output buffers.
+ * \param nread The number of transitions fetched; 0 when exhausted.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_rtrans_next_batch(cfacdb_cursor_t *cur, unsigned int n,
+    cfacdb_rtrans_batch_t *batch, unsigned int *nread);
+/*!
+ * \brief Close a radiative-transition cursor.
+ * \param cur The cursor.
+ */
+void cfacdb_rtrans_close(cfacdb_cursor_t *cur);
+
 /*!
  * \brief Get autoionization data.
  * \param cdb The cFACdb object.
@@ -340,6 +514,138 @@ int cfacdb_rtrans(cfacdb_t *cdb, cfacdb_rtrans_sink_t sink, void *udata);
  * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
  */
 int cfacdb_aitrans(cfacdb_t *cdb, cfacdb_aitrans_sink_t sink, void *udata);
+/*!
+ * \brief Open a cursor over AI transitions.
+ *
+ * The transitions are the same, and come in the same order, as those passed
+ * to the sink of \ref cfacdb_aitrans. The cursor must be closed before the
+ * next \ref cfacdb_init, \ref cfacdb_load_snapshot or \ref cfacdb_close
+ * call; the former two fail while any cursor is open.
+ * \param cdb The cFACdb object.
+ * \return The cursor or NULL if failed.
+ */
+cfacdb_cursor_t *cfacdb_aitrans_open(cfacdb_t *cdb);
+/*!
+ * \brief Fetch the next batch of AI transitions.
+ * \param cur The cursor.
+ * \param n The maximal number of transitions to fetch.
+ * \param batch Output buffers.
+ * \param nread The number of transitions fetched; 0 when exhausted.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_aitrans_next_batch(cfacdb_cursor_t *cur, unsigned int n,
+    cfacdb_aitrans_batch_t *batch, unsigned int *nread);
+/*!
+ * \brief Close an AI-transition cursor.
+ * \param cur The cursor.
+ */
+void cfacdb_aitrans_close(cfacdb_cursor_t *cur);
+
+/*!
+ * \brief Build an indexed table of radiative transitions.
+ *
+ * The transitions of \ref cfacdb_rtrans are read once and indexed both by
+ * the upper and by the lower level, so that all transitions from or to a
+ * given level are available without scanning the data. Each transition
+ * gets an ID in the range [0, \ref cfacdb_rtable_ntrans), the same in both
+ * views. The table does not depend on the cFACdb object after it is built.
+ * \param cdb The cFACdb object.
+ * \return The table or NULL if failed.
+ */
+cfacdb_rtable_t *cfacdb_rtable_build(cfacdb_t *cdb);
+/*!
+ * \brief Free a radiative table.
+ * \param rt The table.
+ */
+void cfacdb_rtable_free(cfacdb_rtable_t *rt);
+/*!
+ * \brief Get number of levels (i.e., the range of level IDs) of a
+ * radiative table.
+ * \param rt The table.
+ * \return Number of levels.
+ */
+unsigned int cfacdb_rtable_nlevels(const cfacdb_rtable_t *rt);
+/*!
+ * \brief Get number of transitions in a radiative table.
+ * \param rt The table.
+ * \return Number of transitions.
+ */
+unsigned long cfacdb_rtable_ntrans(const cfacdb_rtable_t *rt);
+/*!
+ * \brief Get radiative transitions from an upper level.
+ *
+ * Within the slice, the transition IDs are consecutive.
+ * \param rt The table.
+ * \param iu Upper level ID.
+ * \param slice The transitions (lev are the lower levels).
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_rtable_from_upper(const cfacdb_rtable_t *rt, unsigned int iu,
+    cfacdb_rtable_slice_t *slice);
+/*!
+ * \brief Get radiative transitions to a lower level.
+ * \param rt The table.
+ * \param il Lower level ID.
+ * \param slice The transitions (lev are the upper levels).
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_rtable_to_lower(const cfacdb_rtable_t *rt, unsigned int il,
+    cfacdb_rtable_slice_t *slice);
+/*!
+ * \brief Get total radiative decay rates of all levels.
+ *
+ * \f$\sum_l A_{ul} \varepsilon_{ul}\f$ is computed for each upper level u,
+ * with optional per-transition factors \f$\varepsilon\f$ (e.g., escape
+ * probabilities), indexed by the transition ID.
+ * \param rt The table.
+ * \param esc The factors (NULL = all ones).
+ * \param asum The rates, an array of \ref cfacdb_rtable_nlevels elements.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_rtable_asums(const cfacdb_rtable_t *rt, const double *esc,
+    double *asum);
+
+/*!
+ * \brief Prepare the collisional-radiative rate matrix at a temperature.
+ *
+ * The matrix M is such that \f$dn/dt = M n\f$, with n the level
+ * populations: \f$M_{fi}\f$ is the total rate from level i to level f and
+ * \f$M_{ii}\f$ minus the total rate out of level i. It comprises radiative
+ * decays, autoionization, collisional excitation and ionization, radiative
+ * recombination, and - via detailed balance - collisional deexcitation,
+ * three-body recombination and dielectronic capture. The rates are computed here, split by the
+ * power of the electron density, so that \ref cfacdb_crm_assemble is fast.
+ * All quantities are in atomic units.
+ * \param cdb The cFACdb object.
+ * \param T The temperature.
+ * \return The rate-matrix object or NULL if failed.
+ */
+cfacdb_crm_t *cfacdb_crm_build(cfacdb_t *cdb, double T);
+/*!
+ * \brief Free a rate-matrix object.
+ * \param crm The rate-matrix object.
+ */
+void cfacdb_crm_free(cfacdb_crm_t *crm);
+/*!
+ * \brief Get the sparsity pattern of the rate matrix.
+ *
+ * The pattern does not depend on the electron density. Each row has a
+ * diagonal element.
+ * \param crm The rate-matrix object.
+ * \param pattern The pattern.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_crm_get_pattern(const cfacdb_crm_t *crm,
+    cfacdb_crm_pattern_t *pattern);
+/*!
+ * \brief Assemble the rate matrix at an electron density.
+ * \param crm The rate-matrix object.
+ * \param ne The electron density.
+ * \param val The matrix elements, an array of nnz (see
+ * \ref cfacdb_crm_pattern_t) elements.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_crm_assemble(const cfacdb_crm_t *crm, double ne, double *val);
 /*!
  * \brief Get collision processes.
  *
@@ -362,6 +668,26 @@ int cfacdb_ctrans(cfacdb_t *cdb, cfacdb_ctrans_sink_t sink, void *udata);
 int cfacdb_crates(cfacdb_t *cdb,
     double T, cfacdb_crates_sink_t sink, void *udata);
 
+/*!
+ * \brief Get Maxwellian-integrated collision rates at several temperatures.
+ *
+ * Each transition is read and its cross section evaluated only once for
+ * all the temperatures, using a fixed quadrature rule. If the cache DB is
+ * attached, the rates at the temperatures it does not cover yet are
+ * stored there; the rates passed to the sink are always computed anew.
+ * Populating the cache for a temperature grid thus takes a single pass
+ * over the collision data.
+ * \param cdb The cFACdb object.
+ * \param nT Number of temperatures.
+ * \param T The temperatures, all distinct.
+ * \param sink A user-provided function invoked for each collision process
+ * (may be NULL).
+ * \param udata An opaque pointer to arbitrary data, passed to sink.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_crates_multi(cfacdb_t *cdb, unsigned int nT, const double *T,
+    cfacdb_crates_multi_sink_t sink, void *udata);
+
 /*!
  * \brief Prepare intext structure.
  * \param cdb The cFACdb object.
@@ -378,14 +704,103 @@ int cfacdb_prepare_intext(const cfacdb_t *cdb,
  * \return Result of the evaluation.
  */
 double cfacdb_intext(const cfacdb_intext_t *intext, double x);
+/*!
+ * \brief Evaluate collision-strength data at several energies.
+ *
+ * Equivalent to calling \ref cfacdb_intext for each element of x, but
+ * faster for (partially) sorted x.
+ * \param intext The intext structure.
+ * \param x Projectile energies (in units of the threshold energy).
+ * \param nx Number of energies.
+ * \param out Results of the evaluation, length = nx.
+ */
+void cfacdb_intext_many(const cfacdb_intext_t *intext,
+    const double *x, unsigned int nx, double *out);
+
+/*!
+ * \brief Convert a database to the latest format.
+ *
+ * Collision strengths stored one row per energy point are repacked into
+ * per-transition arrays sharing a common energy grid. The file is modified
+ * in place; databases already in the latest format are left untouched.
+ * \param fname The SQLite database file to convert.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_migrate(const char *fname);
 
 /*!
  * \brief Attach a database for caching collision rates.
+ *
+ * The cache holds, per transition, the rates computed by \ref cfacdb_crates
+ * at each temperature requested so far; it is read into memory here. A rate
+ * at a temperature between cached ones is interpolated in log-log scale
+ * when accurate enough (see \ref cfacdb_set_cache_tolerance) rather than
+ * integrated anew.
  * \param cdb The cFACdb object.
  * \param fname Path to the cache DB.
  * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
  */
 int cfacdb_attach_cache(cfacdb_t *cdb, const char *fname);
+/*!
+ * \brief Set accuracy of collision rates interpolated from the cache.
+ *
+ * A rate is interpolated by the mean of the two quadratics (in log-log scale)
+ * through the two bracketing temperatures and either neighboring one, and
+ * half the difference between them is taken as the error estimate.
+ * \param cdb The cFACdb object.
+ * \param tol Maximal relative error (0 = use exact temperature matches
+ * only; default = 1e-3).
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_set_cache_tolerance(cfacdb_t *cdb, double tol);
+
+/*!
+ * \brief Fit collision rates in a temperature range.
+ *
+ * For each collision process, \f$\ln k(T) + E_0/T\f$, where \f$E_0\f$ is
+ * the threshold energy (zero for photoionization), is expanded in
+ * Chebyshev polynomials of \f$\ln T\f$ reduced to \f$[-1, 1]\f$. The rates
+ * are computed by \ref cfacdb_crates_multi at the Chebyshev nodes and the
+ * accuracy checked in between; the coefficients and the maximal relative
+ * error are stored in the cache DB, replacing previous fits, and can then
+ * be evaluated with \ref cfacdb_rate_eval. The cache DB must be attached.
+ * \param cdb The cFACdb object.
+ * \param Tmin The lower temperature.
+ * \param Tmax The upper temperature.
+ * \param ncoef Number of coefficients (2 ... \ref CFACDB_RFIT_NCOEF_MAX).
+ * \param nfail If not NULL, returns the number of processes not fitted (for
+ * having a vanishing rate anywhere in the range).
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_fit_rates(cfacdb_t *cdb, double Tmin, double Tmax,
+    unsigned int ncoef, unsigned long *nfail);
+
+/*!
+ * \brief Evaluate a collision rate from its fit.
+ *
+ * Fits are available for the processes fitted by \ref cfacdb_fit_rates,
+ * with this or any earlier session, and stored in the attached cache DB.
+ * \param cdb The cFACdb object.
+ * \param cid Collision transition ID (see \ref cfacdb_ctrans_data_t).
+ * \param T The temperature, within the range of the fit.
+ * \param ratec The rate coefficient.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise
+ * (no fit available or T out of its range).
+ */
+int cfacdb_rate_eval(const cfacdb_t *cdb, unsigned int cid, double T,
+    double *ratec);
+
+/*!
+ * \brief Get properties of a collision rate fit.
+ * \param cdb The cFACdb object.
+ * \param cid Collision transition ID.
+ * \param Tmin If not NULL, returns the lower temperature of the fit.
+ * \param Tmax If not NULL, returns the upper temperature of the fit.
+ * \param maxerr If not NULL, returns the maximal relative error of the fit.
+ * \return \ref CFACDB_SUCCESS on success or \ref CFACDB_FAILURE otherwise.
+ */
+int cfacdb_rate_fit_info(const cfacdb_t *cdb, unsigned int cid,
+    double *Tmin, double *Tmax, double *maxerr);
 
 #endif /* _CFACDB_H */
 
@@ -22,6 +22,105 @@
 #include "cfacdb.h"
 #include <sqlite3.h>
 
+/* the latest DB format supported */
+#define CFACDB_FORMAT_MAX   4
+
+/* default relative accuracy of rates interpolated in the cache */
+#define CFACDB_CACHE_TOL_DEFAULT    1.0e-3
+
+/* in-memory copy of the cache DB, see cache.c */
+typedef struct {
+    unsigned int cid;
+    double t;
+    double rate;
+} cfacdb_rcache_entry_t;
+
+typedef struct {
+    cfacdb_rcache_entry_t *entries;
+    unsigned long n, nalloc;
+    unsigned long nsorted;          /* entries[0..nsorted) are sorted */
+    double tol;
+} cfacdb_rcache_t;
+
+/* Chebyshev fits of rates in log(T), see cache.c */
+typedef struct {
+    unsigned int cid;
+    unsigned int ncoef;
+    double lmin, lmax;              /* log(Tmin), log(Tmax)      */
+    double e0;                      /* threshold energy          */
+    double maxerr;                  /* max relative error        */
+    unsigned long coffset;          /* offset in the coefs pool  */
+} cfacdb_rfit_t;
+
+typedef struct {
+    cfacdb_rfit_t *fits;            /* sorted by cid */
+    unsigned long n, nalloc;
+    double *coefs;
+    unsigned long ncoefs, ncalloc;
+} cfacdb_rfits_t;
+
+/* in-memory copy of a session, see snapshot.c */
+typedef struct {
+    unsigned int ifac;
+    int nele;
+    double energy;
+    unsigned int g, vn, vl, p;
+    size_t name, ncmplx, sname;     /* offsets in the string pool */
+} cfacdb_snap_level_t;
+
+typedef struct {
+    unsigned int ilfac, iufac;
+    int nele;
+    int mpole;
+    double de, gf, uta_de, uta_sd;
+} cfacdb_snap_rtrans_t;
+
+typedef struct {
+    unsigned int iufac, ilfac;
+    int nele;
+    double rate;
+} cfacdb_snap_aitrans_t;
+
+typedef struct {
+    unsigned int cid, ilfac, iufac;
+    int ini_nele, fin_nele;
+    unsigned int type, kl, nd;
+    double de, ap0, ap1, ap2, ap3;
+    size_t eoffset, doffset;        /* offsets in the e/d pools */
+} cfacdb_snap_ctrans_t;
+
+typedef struct {
+    unsigned long int sid;
+    char sym[8];
+    int uta;
+    
+    int db_format;
+    unsigned int anum;
+    double mass;
+    unsigned int id_min, id_max;
+    
+    unsigned long nlevels;
+    cfacdb_snap_level_t *levels;
+    
+    char *strpool;
+    size_t strpool_len, strpool_size;
+    
+    unsigned long nrtrans;
+    cfacdb_snap_rtrans_t *rtrans;
+    
+    unsigned long naitrans;
+    cfacdb_snap_aitrans_t *aitrans;
+    
+    unsigned long nctrans;
+    cfacdb_snap_ctrans_t *ctrans;
+    double *ce, *cd;                /* energy grids are shared by */
+    size_t ce_len, ce_size;         /* consecutive transitions    */
+    size_t cd_len, cd_size;
+    
+    void *image;                    /* the arrays point here if not NULL */
+    size_t image_size;
+} cfacdb_snapshot_t;
+
 struct _cfacdb_t {
     sqlite3 *db;
     int db_format;
@@ -45,14 +144,63 @@ struct _cfacdb_t {
 
     unsigned int *lmap;
     
+    unsigned int ncursors;  /* open cursors, which pin lmap and the mode */
+    
     int cached;
     sqlite3 *cache_db;
+    cfacdb_rcache_t rcache;
+    cfacdb_rfits_t rfits;
     
     void *udata;
+    
+    unsigned int nthreads;
+    
+    cfacdb_snapshot_t *snapshot;
 };
 
-int cfacdb_crates_cached(cfacdb_t *cdb,
-    double T, cfacdb_crates_sink_t sink, void *udata);
+int cfacdb_rcache_lookup(const cfacdb_rcache_t *rcache,
+    unsigned int cid, double T, double *ratec);
+int cfacdb_rcache_add(cfacdb_rcache_t *rcache,
+    unsigned int cid, double T, double rate);
+int cfacdb_rcache_sort(cfacdb_rcache_t *rcache);
+void cfacdb_rcache_free(cfacdb_rcache_t *rcache);
+
+int cfacdb_rfits_load(cfacdb_t *cdb);
+void cfacdb_rfits_free(cfacdb_rfits_t *rfits);
+
+void cfacdb_snapshot_free(cfacdb_snapshot_t *snap);
+int cfacdb_snapshot_init(cfacdb_t *cdb, int nele_min, int nele_max);
+int cfacdb_snapshot_sessions(const cfacdb_t *cdb,
+    cfacdb_sessions_sink_t sink, void *udata);
+int cfacdb_is_image(const char *fname);
+cfacdb_t *cfacdb_open_image(const char *fname);
+int cfacdb_snapshot_cstates(cfacdb_t *cdb,
+    cfacdb_cstates_sink_t sink, void *udata);
+int cfacdb_snapshot_levels(cfacdb_t *cdb,
+    cfacdb_levels_sink_t sink, void *udata);
+int cfacdb_snapshot_rtrans(cfacdb_t *cdb,
+    cfacdb_rtrans_sink_t sink, void *udata);
+int cfacdb_snapshot_aitrans(cfacdb_t *cdb,
+    cfacdb_aitrans_sink_t sink, void *udata);
+int cfacdb_snapshot_ctrans(cfacdb_t *cdb,
+    cfacdb_ctrans_sink_t sink, void *udata);
+int cfacdb_snapshot_rtrans_get(const cfacdb_t *cdb, unsigned long k,
+    cfacdb_rtrans_data_t *cbdata);
+int cfacdb_snapshot_aitrans_get(const cfacdb_t *cdb, unsigned long k,
+    cfacdb_aitrans_data_t *cbdata);
+
+/* little-endian packed arrays in BLOBs, see cfacdb.c */
+unsigned int cfacdb_unpack_doubles(const void *blob, int nbytes, double *d);
+int cfacdb_bind_packed(sqlite3_stmt *stmt, int id,
+    const double *d, int as_float, unsigned int n);
+
+/* row access shared by the sink and cursor APIs */
+sqlite3_stmt *cfacdb_rtrans_stmt(const cfacdb_t *cdb);
+void cfacdb_rtrans_row(const cfacdb_t *cdb, sqlite3_stmt *stmt,
+    cfacdb_rtrans_data_t *cbdata);
+sqlite3_stmt *cfacdb_aitrans_stmt(const cfacdb_t *cdb);
+void cfacdb_aitrans_row(const cfacdb_t *cdb, sqlite3_stmt *stmt,
+    cfacdb_aitrans_data_t *cbdata);
 
 
 #endif /* _CFACDBP_H */
@@ -514,14 +514,15 @@ static int PConfig(int argc, char *argv[], int argt[], ARRAY *variables) {
     strncpy(scfg, _closed_shells, MCHSHELL);
     strncat(scfg, argv[i], MCHSHELL - 1);
     ncfg = GetConfigFromString(&cfg, scfg);
-    for (j = 0; j < ncfg; j++) {
-      cfg[j].uta = iuta;
-      if (Couple(&cfg[j]) < 0) return -1;
+    if (ncfg > 0) {
+      for (j = 0; j < ncfg; j++) {
+        cfg[j].uta = iuta;
+      }
       t = GroupIndex(cfac, gname);
       if (t < 0) return -1;
-      if (AddConfigToList(cfac, t, &cfg[j]) < 0) return -1;
-    }   
-    if (ncfg > 0) free(cfg);
+      if (AddConfigsToList(cfac, t, ncfg, cfg) < 0) return -1;
+      free(cfg);
+    }
   }
       
   return 0;
@@ -907,6 +908,18 @@ static int PInfo(int argc, char *argv[], int argt[], ARRAY *variables) {
   return 0;
 }
 
+static int PArenaStats(int argc, char *argv[], int argt[], 
+		       ARRAY *variables) {
+  long nalloc, nsys;
+
+  if (argc != 0) return -1;
+  if (cfac_get_arena_stats(cfac, &nalloc, &nsys) != CFAC_SUCCESS) return -1;
+  printf("scratch arena: %ld allocations, %ld blocks from malloc\n",
+	 nalloc, nsys);
+
+  return 0;
+}
+
 static int PMemENTable(int argc, char *argv[], int argt[], 
 		       ARRAY *variables) {
 
@@ -1039,23 +1052,34 @@ static char *cmdline = NULL;
 
 static int PStoreInit(int argc, char *argv[], int argt[], 
 		       ARRAY *variables) {
-  int reset = 0;
-  if (argc != 1 && argc != 2) return -1;
+  int reset = 0, bulk = 0;
+  if (argc < 1 || argc > 3) return -1;
 
   if (sid) {
     printf("Store has already been initialized\n");
     return -1;
   }
 
-  if (argc == 2) {
+  if (argc >= 2) {
     if (argt[1] != NUMBER) {
       return -1;
     } else {
       reset = atoi(argv[1]);
     }
   }
+  if (argc == 3) {
+    if (argt[2] != NUMBER) {
+      return -1;
+    } else {
+      bulk = atoi(argv[2]);
+    }
+  }
   
-  return StoreInit(cfac, argv[0], reset, &db, &sid);
+  if (StoreInit(cfac, argv[0], reset, &db, &sid) != 0) {
+    return -1;
+  }
+
+  return StoreSetBulk(db, bulk);
 }
 
 static int PStoreTable(int argc, char *argv[], int argt[], 
@@ -1249,6 +1273,15 @@ static int PSetAngZCut(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PSetAngZStore(int argc, char *argv[], int argt[],
+			 ARRAY *variables) {
+  if (argc > 1) return -1;
+  if (argc == 0) return SetAngZStore(cfac, NULL);
+  if (argt[0] != STRING) return -1;
+
+  return SetAngZStore(cfac, argv[0]);
+}
+
 static int PSetMixCut(int argc, char *argv[], int argt[], 
 		      ARRAY *variables) {
   double c, c2;
@@ -2446,6 +2479,19 @@ static int PSetUTA(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PSetThreads(int argc, char *argv[], int argt[], 
+                       ARRAY *variables) {
+  int m;
+
+  if (argc != 1 || argt[0] != NUMBER) return -1;
+  m = atoi(argv[0]);
+  if (m <= 0) return -1;
+
+  cfac_set_nthreads(cfac, m);
+  
+  return 0;
+}
+
 static int PPrepAngular(int argc, char *argv[], int argt[], 
 			ARRAY *variables) {
   int nlow, nup, *low, *up;
@@ -2765,6 +2811,15 @@ static int PAppendTable(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PSetBlockIndex(int argc, char *argv[], int argt[], 
+			  ARRAY *variables) {
+  if (argc != 1 || argt[0] != NUMBER) return -1;
+
+  SetBlockIndex(atoi(argv[0]));
+
+  return 0;
+}
+
 static int PJoinTable(int argc, char *argv[], int argt[], 
 		      ARRAY *variables) {
   if (argc != 3) return -1;
@@ -2933,6 +2988,7 @@ static METHOD methods[] = {
   {"AITableMSub", PAITableMSub},
   {"AddConfig", PAddConfig},
   {"AppendTable", PAppendTable}, 
+  {"ArenaStats", PArenaStats},
   {"AvgConfig", PAvgConfig},
   {"BasisTable", PBasisTable},
   {"CETable", PCETable},
@@ -2966,9 +3022,11 @@ static METHOD methods[] = {
   {"SetAICut", PSetAICut},
   {"SetAngZCut", PSetAngZCut},
   {"SetAngZOptions", PSetAngZOptions},
+  {"SetAngZStore", PSetAngZStore},
   {"SetAngleGrid", PSetAngleGrid},
   {"SetAtom", PSetAtom},
   {"SetAvgConfig", PSetAvgConfig},
+  {"SetBlockIndex", PSetBlockIndex},
   {"SetBreit", PSetBreit},
   {"SetCEBorn", PSetCEBorn},
   {"SetCEGrid", PSetCEGrid},
@@ -3014,6 +3072,7 @@ static METHOD methods[] = {
   {"SetSlaterCut", PSetSlaterCut}, 
   {"SetSymmetry", PSetSymmetry},
   {"SetTEGrid", PSetTEGrid},
+  {"SetThreads", PSetThreads},
   {"SetTransitionCut", PSetTransitionCut},
   {"SetTransitionGauge", PSetTransitionGauge},
   {"SetTransitionMaxE", PSetTransitionMaxE},